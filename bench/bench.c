@@ -0,0 +1,1507 @@
+//
+//  bench/bench.c
+//  tbd
+//
+//  Created by inoahdev on 3/24/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dir_cache.h"
+#include "dsc_image.h"
+#include "dsc_image_order.h"
+#include "dsc_page_release.h"
+#include "dyld_shared_cache.h"
+#include "macho_file.h"
+
+#include "generate.h"
+#include "tbd.h"
+#include "tbd_write_buffer.h"
+#include "unused.h"
+#include "yaml.h"
+
+/*
+ * The vectors yaml_check_c_str() was built to use. Strings shorter than a
+ * vector are only checked with the lookup-table.
+ */
+
+#if defined(__AVX2__)
+#define BENCH_YAML_VECTOR_NAME "AVX2"
+#define BENCH_YAML_VECTOR_SIZE 32
+#elif defined(__SSE2__)
+#define BENCH_YAML_VECTOR_NAME "SSE2"
+#define BENCH_YAML_VECTOR_SIZE 16
+#else
+#define BENCH_YAML_VECTOR_NAME "table"
+#define BENCH_YAML_VECTOR_SIZE 0
+#endif
+
+struct bench_options {
+    struct bench_generate_options generate;
+    uint32_t iterations;
+
+    bool large;
+};
+
+/*
+ * The times of each iteration of a driver, to report the median and minimum
+ * of.
+ */
+
+struct bench_samples {
+    uint64_t *times;
+    uint32_t count;
+};
+
+static uint64_t get_time_ns(void) {
+    struct timespec spec = {};
+    clock_gettime(CLOCK_MONOTONIC, &spec);
+
+    return (uint64_t)spec.tv_sec * 1000000000ull + (uint64_t)spec.tv_nsec;
+}
+
+static int compare_times(const void *const left, const void *const right) {
+    const uint64_t left_time = *(const uint64_t *)left;
+    const uint64_t right_time = *(const uint64_t *)right;
+
+    if (left_time > right_time) {
+        return 1;
+    } else if (left_time < right_time) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void
+print_samples(const char *const name,
+              struct bench_samples *const samples,
+              const uint64_t items_count,
+              const uint64_t bytes_count)
+{
+    qsort(samples->times, samples->count, sizeof(uint64_t), compare_times);
+
+    const double median = (double)samples->times[samples->count / 2];
+    const double min = (double)samples->times[0];
+
+    /*
+     * Times are printed per item (per file, image or tbd), and throughput
+     * is of the median iteration.
+     */
+
+    const double items = (double)items_count;
+    const double megabytes = (double)bytes_count / (1024 * 1024);
+
+    printf("%-52s %8llu %12.2f %12.2f %10.1f\n",
+           name,
+           (unsigned long long)items_count,
+           median / items / 1000,
+           min / items / 1000,
+           megabytes / (median / 1000000000));
+}
+
+/*
+ * Write size bytes of data to fd, at the given offset.
+ */
+
+static void
+write_to_file(const int fd,
+              const uint8_t *const data,
+              const uint64_t size,
+              const uint64_t offset)
+{
+    const uint8_t *iter = data;
+    const uint8_t *const end = iter + size;
+
+    uint64_t iter_offset = offset;
+    while (iter != end) {
+        const ssize_t write_size =
+            pwrite(fd, iter, (size_t)(end - iter), (off_t)iter_offset);
+
+        if (write_size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            fprintf(stderr,
+                    "Failed to write to file, error: %s\n",
+                    strerror(errno));
+
+            exit(1);
+        }
+
+        iter += write_size;
+        iter_offset += (uint64_t)write_size;
+    }
+}
+
+/*
+ * Write out the pieces of file to fd, leaving holes in-between them.
+ */
+
+static void
+write_sparse_file(const int fd, const struct bench_sparse_file *const file) {
+    for (uint32_t i = 0; i != file->pieces_count; i++) {
+        const struct bench_sparse_piece *const piece = file->pieces + i;
+        write_to_file(fd,
+                      piece->buffer.data,
+                      piece->buffer.size,
+                      piece->offset);
+    }
+
+    if (ftruncate(fd, (off_t)file->size) != 0) {
+        fprintf(stderr,
+                "Failed to resize file to %llu bytes, error: %s\n",
+                (unsigned long long)file->size,
+                strerror(errno));
+
+        exit(1);
+    }
+}
+
+/*
+ * Create an unlinked temporary file, and return its file-descriptor.
+ */
+
+static int create_temporary_file(void) {
+    const char *dir = getenv("TMPDIR");
+    if (dir == NULL) {
+        dir = "/tmp";
+    }
+
+    char path[4096] = {};
+    snprintf(path, sizeof(path), "%s/tbd-bench.XXXXXX", dir);
+
+    const int fd = mkstemp(path);
+    if (fd < 0) {
+        fprintf(stderr,
+                "Failed to create temporary file (at path %s), error: %s\n",
+                path,
+                strerror(errno));
+
+        exit(1);
+    }
+
+    unlink(path);
+    return fd;
+}
+
+/*
+ * Parse the mach-o file at fd into info, as done when parsing from main.
+ */
+
+static void
+parse_macho(struct tbd_create_info *const info,
+            const int fd,
+            const char *const name,
+            const uint64_t macho_options)
+{
+    uint32_t magic = 0;
+    if (pread(fd, &magic, sizeof(magic), 0) != sizeof(magic)) {
+        fprintf(stderr, "Failed to read magic of %s\n", name);
+        exit(1);
+    }
+
+    if (lseek(fd, sizeof(magic), SEEK_SET) < 0) {
+        fprintf(stderr, "Failed to seek %s\n", name);
+        exit(1);
+    }
+
+    const enum macho_file_parse_result parse_result =
+        macho_file_parse_from_file(info,
+                                   fd,
+                                   magic,
+                                   0,
+                                   macho_options);
+
+    if (parse_result != E_MACHO_FILE_PARSE_OK) {
+        fprintf(stderr,
+                "Failed to parse %s, error: %d\n",
+                name,
+                parse_result);
+
+        exit(1);
+    }
+}
+
+static void
+time_macho_parse(const char *const name,
+                 const int fd,
+                 const uint64_t bytes_count,
+                 const uint64_t macho_options,
+                 struct bench_samples *const samples)
+{
+    struct tbd_create_info info = { .version = TBD_VERSION_V2 };
+    const struct tbd_create_info original_info = info;
+
+    for (uint32_t i = 0; i != samples->count; i++) {
+        const uint64_t start = get_time_ns();
+
+        parse_macho(&info, fd, name, macho_options);
+        tbd_create_info_clear(&info, &original_info);
+
+        samples->times[i] = get_time_ns() - start;
+    }
+
+    tbd_create_info_destroy(&info);
+    print_samples(name, samples, 1, bytes_count);
+}
+
+static void
+bench_macho_parse(const char *const name,
+                  const struct bench_buffer *const buffer,
+                  const uint64_t macho_options,
+                  struct bench_samples *const samples)
+{
+    const int fd = create_temporary_file();
+    write_to_file(fd, buffer->data, buffer->size, 0);
+
+    time_macho_parse(name, fd, buffer->size, macho_options, samples);
+    close(fd);
+}
+
+/*
+ * Open a file in the directory at dir_path with cache, and close it.
+ */
+
+static void
+open_file_in_dir(struct dir_cache *const cache, const char *const dir_path) {
+    char path[64] = {};
+    const int length = snprintf(path, sizeof(path), "%s/file", dir_path);
+
+    const int fd =
+        dir_cache_open_file(cache,
+                            path,
+                            (uint64_t)length,
+                            O_WRONLY | O_TRUNC,
+                            0644,
+                            0755,
+                            NULL);
+
+    if (fd < 0) {
+        fprintf(stderr,
+                "dir_cache failed to open file (at path %s), error: %s\n",
+                path,
+                strerror(errno));
+
+        exit(1);
+    }
+
+    close(fd);
+}
+
+/*
+ * A directory removed behind the dir_cache's back is forgotten, and has to
+ * still be usable when reopened while the dir_cache closes directories to stay
+ * within DIR_CACHE_MAX_OPEN_DIRS.
+ */
+
+static void check_dir_cache_forget(void) {
+    const char *dir = getenv("TMPDIR");
+    if (dir == NULL) {
+        dir = "/tmp";
+    }
+
+    char root[4096] = {};
+    snprintf(root, sizeof(root), "%s/tbd-bench.XXXXXX", dir);
+
+    if (mkdtemp(root) == NULL) {
+        fprintf(stderr,
+                "Failed to create temporary directory (at path %s), error: "
+                "%s\n",
+                root,
+                strerror(errno));
+
+        exit(1);
+    }
+
+    const int cwd_fd = open(".", O_RDONLY | O_DIRECTORY);
+    if (cwd_fd < 0 || chdir(root) != 0) {
+        fprintf(stderr,
+                "Failed to enter temporary directory (at path %s), error: "
+                "%s\n",
+                root,
+                strerror(errno));
+
+        exit(1);
+    }
+
+    struct dir_cache cache = {};
+    dir_cache_init(&cache);
+
+    /*
+     * Open the directory to be forgotten first, so it's the next directory to
+     * be closed once the dir_cache is full.
+     */
+
+    open_file_in_dir(&cache, "forgotten");
+
+    unlink("forgotten/file");
+    rmdir("forgotten");
+
+    open_file_in_dir(&cache, "forgotten");
+
+    char dir_path[32] = {};
+    for (uint32_t i = 1; i != DIR_CACHE_MAX_OPEN_DIRS; i++) {
+        snprintf(dir_path, sizeof(dir_path), "dir%u", i);
+        open_file_in_dir(&cache, dir_path);
+    }
+
+    open_file_in_dir(&cache, "forgotten");
+    open_file_in_dir(&cache, "forgotten");
+
+    dir_cache_destroy(&cache);
+
+    unlink("forgotten/file");
+    rmdir("forgotten");
+
+    for (uint32_t i = 1; i != DIR_CACHE_MAX_OPEN_DIRS; i++) {
+        snprintf(dir_path, sizeof(dir_path), "dir%u/file", i);
+        unlink(dir_path);
+
+        snprintf(dir_path, sizeof(dir_path), "dir%u", i);
+        rmdir(dir_path);
+    }
+
+    if (fchdir(cwd_fd) != 0) {
+        fprintf(stderr,
+                "Failed to leave temporary directory, error: %s\n",
+                strerror(errno));
+
+        exit(1);
+    }
+
+    close(cwd_fd);
+    rmdir(root);
+}
+
+/*
+ * Symbols of a generated fat mach-o file are weak in either every arch they're
+ * in, or none of them, so no symbol should be exported as both a normal and a
+ * weak-def symbol. Such a symbol means n_desc was misread for some of the
+ * archs.
+ */
+
+static int
+compare_export_strings(const void *const left, const void *const right) {
+    const struct tbd_export_info *const left_export =
+        *(const struct tbd_export_info *const *)left;
+
+    const struct tbd_export_info *const right_export =
+        *(const struct tbd_export_info *const *)right;
+
+    return strcmp(left_export->string, right_export->string);
+}
+
+static void check_fat_weak_defs(const struct bench_buffer *const buffer) {
+    const int fd = create_temporary_file();
+    write_to_file(fd, buffer->data, buffer->size, 0);
+
+    struct tbd_create_info info = { .version = TBD_VERSION_V2 };
+    parse_macho(&info,
+                fd,
+                "fat mach-o file",
+                O_MACHO_FILE_PARSE_IGNORE_INVALID_FIELDS);
+
+    close(fd);
+
+    const struct tbd_export_info *const exports = info.exports.data;
+    const uint64_t exports_count =
+        array_get_item_count(&info.exports, sizeof(struct tbd_export_info));
+
+    const struct tbd_export_info **const symbols =
+        calloc(exports_count, sizeof(const struct tbd_export_info *));
+
+    if (symbols == NULL && exports_count != 0) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    uint64_t symbols_count = 0;
+    uint64_t weak_defs_count = 0;
+
+    for (uint64_t i = 0; i != exports_count; i++) {
+        const struct tbd_export_info *const export = exports + i;
+        if (export->type == TBD_EXPORT_TYPE_WEAK_DEF_SYMBOL) {
+            weak_defs_count++;
+        } else if (export->type != TBD_EXPORT_TYPE_NORMAL_SYMBOL) {
+            continue;
+        }
+
+        symbols[symbols_count] = export;
+        symbols_count++;
+    }
+
+    if (weak_defs_count == 0) {
+        fputs("Fat mach-o file has no weak-def symbols\n", stderr);
+        exit(1);
+    }
+
+    qsort(symbols,
+          symbols_count,
+          sizeof(const struct tbd_export_info *),
+          compare_export_strings);
+
+    for (uint64_t i = 1; i < symbols_count; i++) {
+        if (strcmp(symbols[i - 1]->string, symbols[i]->string) == 0) {
+            fprintf(stderr,
+                    "Symbol %s is exported as both a normal and a weak-def "
+                    "symbol\n",
+                    symbols[i]->string);
+
+            exit(1);
+        }
+    }
+
+    free(symbols);
+    tbd_create_info_destroy(&info);
+}
+
+/*
+ * Time parsing a fat mach-o file whose architectures are all located past
+ * 4 GiB. Only the pieces of the file with data are counted towards the
+ * throughput, as the rest of the file is never read.
+ */
+
+static void
+bench_large_macho_parse(const char *const name,
+                        const struct bench_sparse_file *const file,
+                        const uint64_t macho_options,
+                        struct bench_samples *const samples)
+{
+    const int fd = create_temporary_file();
+    write_sparse_file(fd, file);
+
+    uint64_t bytes_count = 0;
+    for (uint32_t i = 0; i != file->pieces_count; i++) {
+        bytes_count += file->pieces[i].buffer.size;
+    }
+
+    time_macho_parse(name, fd, bytes_count, macho_options, samples);
+    close(fd);
+}
+
+static void
+parse_dsc(struct dyld_shared_cache_info *const dsc_info,
+          const int fd,
+          const char *const name)
+{
+    char magic[16] = {};
+    if (pread(fd, magic, sizeof(magic), 0) != sizeof(magic)) {
+        fprintf(stderr, "Failed to read magic of %s\n", name);
+        exit(1);
+    }
+
+    if (lseek(fd, sizeof(magic), SEEK_SET) < 0) {
+        fprintf(stderr, "Failed to seek %s\n", name);
+        exit(1);
+    }
+
+    const enum dyld_shared_cache_parse_result parse_dsc_result =
+        dyld_shared_cache_parse_from_file(dsc_info, fd, magic, 0);
+
+    if (parse_dsc_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        fprintf(stderr,
+                "Failed to parse %s, error: %d\n",
+                name,
+                parse_dsc_result);
+
+        exit(1);
+    }
+}
+
+/*
+ * Sub-caches are released after each image, as done when parsing from main,
+ * so every sub-cache is mapped again on each iteration.
+ */
+
+static void
+time_dsc_image_parse(const char *const name,
+                     struct dyld_shared_cache_info *const dsc_info,
+                     const uint64_t bytes_count,
+                     struct bench_samples *const samples)
+{
+    struct tbd_create_info info = { .version = TBD_VERSION_V2 };
+    const struct tbd_create_info original_info = info;
+
+    const uint32_t images_count = dsc_info->images_count;
+    for (uint32_t i = 0; i != samples->count; i++) {
+        const uint64_t start = get_time_ns();
+
+        for (uint32_t j = 0; j != images_count; j++) {
+            const enum dsc_image_parse_result parse_image_result =
+                dsc_image_parse(&info,
+                                dsc_info,
+                                dsc_info->images + j,
+                                O_MACHO_FILE_PARSE_IGNORE_INVALID_FIELDS,
+                                0,
+                                0);
+
+            if (parse_image_result != E_DSC_IMAGE_PARSE_OK) {
+                fprintf(stderr,
+                        "Failed to parse image %u of %s, error: %d\n",
+                        j,
+                        name,
+                        parse_image_result);
+
+                exit(1);
+            }
+
+            tbd_create_info_clear(&info, &original_info);
+            dyld_shared_cache_release_subcaches_before(dsc_info, j + 1);
+        }
+
+        samples->times[i] = get_time_ns() - start;
+    }
+
+    tbd_create_info_destroy(&info);
+    print_samples(name, samples, images_count, bytes_count);
+}
+
+static void
+bench_dsc_image_parse(const char *const name,
+                      const struct bench_buffer *const buffer,
+                      struct bench_samples *const samples)
+{
+    const int fd = create_temporary_file();
+    write_to_file(fd, buffer->data, buffer->size, 0);
+
+    struct dyld_shared_cache_info dsc_info = {};
+    parse_dsc(&dsc_info, fd, name);
+
+    time_dsc_image_parse(name, &dsc_info, buffer->size, samples);
+    dyld_shared_cache_info_destroy(&dsc_info);
+
+    close(fd);
+}
+
+static bool
+select_every_image(
+    __unused const struct dyld_cache_image_info *const image,
+    __unused const char *const path,
+    __unused void *const item)
+{
+    return true;
+}
+
+/*
+ * Time creating an order of every image, and parsing the images in that order,
+ * as done by --dsc-file-order (reading ahead if the order is by file-offset)
+ * and --release-pages (releasing pages if release_pages is set).
+ */
+
+static void
+bench_dsc_image_parse_in_order(const char *const name,
+                               const struct bench_buffer *const buffer,
+                               const uint64_t order_options,
+                               const bool release_pages,
+                               struct bench_samples *const samples)
+{
+    const int fd = create_temporary_file();
+    write_to_file(fd, buffer->data, buffer->size, 0);
+
+    struct dyld_shared_cache_info dsc_info = {};
+    parse_dsc(&dsc_info, fd, name);
+
+    struct tbd_create_info info = { .version = TBD_VERSION_V2 };
+    const struct tbd_create_info original_info = info;
+
+    for (uint32_t i = 0; i != samples->count; i++) {
+        const uint64_t start = get_time_ns();
+
+        struct dsc_image_order order = {};
+        const enum dsc_image_order_result create_order_result =
+            dsc_image_order_create(&order,
+                                   &dsc_info,
+                                   select_every_image,
+                                   NULL,
+                                   order_options);
+
+        if (create_order_result != E_DSC_IMAGE_ORDER_OK) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+
+        struct dsc_page_release release = {};
+        if (release_pages) {
+            const enum dsc_page_release_result create_release_result =
+                dsc_page_release_create(&release, &dsc_info, &order, fd, 0);
+
+            if (create_release_result != E_DSC_PAGE_RELEASE_OK) {
+                fputs("Failed to allocate memory\n", stderr);
+                exit(1);
+            }
+        }
+
+        for (uint32_t j = 0; j != order.count; j++) {
+            if (order_options & O_DSC_IMAGE_ORDER_BY_FILE_OFFSET) {
+                dsc_image_order_advise(&order, &dsc_info, j);
+            }
+
+            const uint32_t index = order.entries[j].index;
+            const enum dsc_image_parse_result parse_image_result =
+                dsc_image_parse(&info,
+                                &dsc_info,
+                                dsc_info.images + index,
+                                O_MACHO_FILE_PARSE_IGNORE_INVALID_FIELDS,
+                                0,
+                                0);
+
+            if (parse_image_result != E_DSC_IMAGE_PARSE_OK) {
+                fprintf(stderr,
+                        "Failed to parse image %u of %s, error: %d\n",
+                        index,
+                        name,
+                        parse_image_result);
+
+                exit(1);
+            }
+
+            tbd_create_info_clear(&info, &original_info);
+            if (release_pages) {
+                dsc_page_release_set_done(&release, j + 1);
+            }
+        }
+
+        if (release_pages) {
+            dsc_page_release_destroy(&release);
+        }
+
+        dsc_image_order_destroy(&order);
+        samples->times[i] = get_time_ns() - start;
+    }
+
+    tbd_create_info_destroy(&info);
+    print_samples(name, samples, dsc_info.images_count, buffer->size);
+
+    dyld_shared_cache_info_destroy(&dsc_info);
+    close(fd);
+}
+
+static void
+write_to_path(const char *const path, const struct bench_buffer *const buffer) {
+    const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fprintf(stderr,
+                "Failed to open file (at path %s), error: %s\n",
+                path,
+                strerror(errno));
+
+        exit(1);
+    }
+
+    write_to_file(fd, buffer->data, buffer->size, 0);
+    close(fd);
+}
+
+/*
+ * Write out the main cache-file of a split dyld_shared_cache to path, and each
+ * sub-cache next to it.
+ */
+
+static void
+write_split_dsc(const char *const path, const struct bench_split_dsc *const dsc)
+{
+    write_to_path(path, &dsc->main);
+    for (uint32_t i = 0; i != dsc->subcaches_count; i++) {
+        char subcache_path[4096] = {};
+        snprintf(subcache_path, sizeof(subcache_path), "%s.%u", path, i + 1);
+
+        write_to_path(subcache_path, dsc->subcaches + i);
+    }
+}
+
+static void
+remove_split_dsc(const char *const path,
+                 const struct bench_split_dsc *const dsc)
+{
+    unlink(path);
+    for (uint32_t i = 0; i != dsc->subcaches_count; i++) {
+        char subcache_path[4096] = {};
+        snprintf(subcache_path, sizeof(subcache_path), "%s.%u", path, i + 1);
+
+        unlink(subcache_path);
+    }
+}
+
+/*
+ * Sub-caches are found by their path, so a split dyld_shared_cache is written
+ * out to a temporary directory, instead of to unlinked temporary files.
+ */
+
+static void
+bench_split_dsc_image_parse(const char *const name,
+                            const struct bench_split_dsc *const dsc,
+                            struct bench_samples *const samples)
+{
+    const char *tmp_dir = getenv("TMPDIR");
+    if (tmp_dir == NULL) {
+        tmp_dir = "/tmp";
+    }
+
+    char dir[4096] = {};
+    snprintf(dir, sizeof(dir), "%s/tbd-bench.XXXXXX", tmp_dir);
+
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr,
+                "Failed to create temporary directory (at path %s), error: "
+                "%s\n",
+                dir,
+                strerror(errno));
+
+        exit(1);
+    }
+
+    char path[4096] = {};
+    snprintf(path, sizeof(path), "%s/dyld_shared_cache_x86_64", dir);
+
+    write_split_dsc(path, dsc);
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr,
+                "Failed to open file (at path %s), error: %s\n",
+                path,
+                strerror(errno));
+
+        exit(1);
+    }
+
+    struct dyld_shared_cache_info dsc_info = {};
+    parse_dsc(&dsc_info, fd, name);
+
+    const enum dyld_shared_cache_parse_result find_subcaches_result =
+        dyld_shared_cache_find_subcaches(&dsc_info, path);
+
+    if (find_subcaches_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        fprintf(stderr,
+                "Failed to find sub-caches of %s, error: %d\n",
+                name,
+                find_subcaches_result);
+
+        exit(1);
+    }
+
+    dsc_image_find_subcache_uses(&dsc_info);
+
+    uint64_t bytes_count = dsc->main.size;
+    for (uint32_t i = 0; i != dsc->subcaches_count; i++) {
+        bytes_count += dsc->subcaches[i].size;
+    }
+
+    time_dsc_image_parse(name, &dsc_info, bytes_count, samples);
+    dyld_shared_cache_info_destroy(&dsc_info);
+
+    close(fd);
+
+    remove_split_dsc(path, dsc);
+    rmdir(dir);
+}
+
+/*
+ * Collect the exports of info as the single-arch exports they were parsed
+ * from, ordered by arch, to be merged again by each merge path.
+ */
+
+static struct tbd_export_info *
+get_single_arch_exports(const struct tbd_create_info *const info,
+                        uint64_t *const count_out)
+{
+    const struct tbd_export_info *const exports = info->exports.data;
+    const uint64_t exports_count =
+        array_get_item_count(&info->exports, sizeof(struct tbd_export_info));
+
+    uint64_t count = 0;
+    for (uint64_t i = 0; i != exports_count; i++) {
+        count += exports[i].archs_count;
+    }
+
+    struct tbd_export_info *const list =
+        calloc(count, sizeof(struct tbd_export_info));
+
+    if (list == NULL && count != 0) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    uint64_t index = 0;
+    for (uint64_t bit = 1; bit != 0; bit <<= 1) {
+        if (!(info->archs & bit)) {
+            continue;
+        }
+
+        for (uint64_t i = 0; i != exports_count; i++) {
+            const struct tbd_export_info *const export = exports + i;
+            if (!(export->archs & bit)) {
+                continue;
+            }
+
+            list[index] = (struct tbd_export_info){
+                .archs = bit,
+                .archs_count = 1,
+                .length = export->length,
+                .string = export->string,
+                .type = export->type
+            };
+
+            index++;
+        }
+    }
+
+    *count_out = count;
+    return list;
+}
+
+/*
+ * Add export_info to the exports of info as done before the export-index,
+ * keeping the exports-array sorted and finding each export with a binary
+ * search.
+ */
+
+static void
+add_export_to_sorted(struct tbd_create_info *const info,
+                     const struct tbd_export_info *const export_info)
+{
+    struct array_cached_index_info cached_info = {};
+    struct tbd_export_info *const existing_info =
+        array_find_item_in_sorted(&info->exports,
+                                  sizeof(struct tbd_export_info),
+                                  export_info,
+                                  tbd_export_info_no_archs_comparator,
+                                  &cached_info);
+
+    if (existing_info != NULL) {
+        const uint64_t archs = existing_info->archs;
+        if (!(archs & export_info->archs)) {
+            existing_info->archs = archs | export_info->archs;
+            existing_info->archs_count += 1;
+        }
+
+        return;
+    }
+
+    const enum array_result add_export_info_result =
+        array_add_item_with_cached_index_info(&info->exports,
+                                              sizeof(struct tbd_export_info),
+                                              export_info,
+                                              &cached_info,
+                                              NULL);
+
+    if (add_export_info_result != E_ARRAY_OK) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+}
+
+static uint64_t
+time_export_merge(const struct tbd_export_info *const list,
+                  const uint64_t count,
+                  const bool use_export_index)
+{
+    struct tbd_create_info info = { .version = TBD_VERSION_V2 };
+    const uint64_t start = get_time_ns();
+
+    for (uint64_t i = 0; i != count; i++) {
+        if (!use_export_index) {
+            add_export_to_sorted(&info, list + i);
+            continue;
+        }
+
+        const enum tbd_add_export_result add_export_result =
+            tbd_create_info_add_export(&info, list + i, false);
+
+        if (add_export_result != E_TBD_ADD_EXPORT_OK) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+    }
+
+    if (tbd_create_info_sort_exports(&info) != E_ARRAY_OK) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    const uint64_t time = get_time_ns() - start;
+
+    tbd_create_info_destroy(&info);
+    return time;
+}
+
+/*
+ * Time merging the exports of each arch of fat mach-o files of 2, 4 and 8
+ * archs, through the export-index and through the sorted insert it replaced.
+ * Both include the final sort of the exports.
+ */
+
+static void
+bench_export_merge(const struct bench_generate_options *const options,
+                   struct bench_samples *const samples)
+{
+    const uint32_t archs_counts[] = { 2, 4, 8 };
+    for (uint32_t i = 0; i != 3; i++) {
+        struct bench_generate_options fat_options = *options;
+        fat_options.archs_count = archs_counts[i];
+
+        struct bench_buffer fat = {};
+        bench_generate_fat_macho(&fat, &fat_options);
+
+        const int fd = create_temporary_file();
+        write_to_file(fd, fat.data, fat.size, 0);
+
+        struct tbd_create_info info = { .version = TBD_VERSION_V2 };
+        parse_macho(&info,
+                    fd,
+                    "fat mach-o file",
+                    O_MACHO_FILE_PARSE_IGNORE_INVALID_FIELDS);
+
+        close(fd);
+        bench_buffer_destroy(&fat);
+
+        uint64_t count = 0;
+        struct tbd_export_info *const list =
+            get_single_arch_exports(&info, &count);
+
+        uint64_t bytes_count = 0;
+        for (uint64_t j = 0; j != count; j++) {
+            bytes_count += list[j].length;
+        }
+
+        char name[64] = {};
+        snprintf(name,
+                 sizeof(name),
+                 "tbd_create_info_add_export (%u archs)",
+                 archs_counts[i]);
+
+        for (uint32_t j = 0; j != samples->count; j++) {
+            samples->times[j] = time_export_merge(list, count, true);
+        }
+
+        print_samples(name, samples, count, bytes_count);
+        snprintf(name,
+                 sizeof(name),
+                 "array_find_item_in_sorted (%u archs)",
+                 archs_counts[i]);
+
+        for (uint32_t j = 0; j != samples->count; j++) {
+            samples->times[j] = time_export_merge(list, count, false);
+        }
+
+        print_samples(name, samples, count, bytes_count);
+
+        free(list);
+        tbd_create_info_destroy(&info);
+    }
+}
+
+struct bench_string {
+    const char *string;
+    uint64_t length;
+};
+
+static void
+time_yaml_check(const char *const name,
+                const struct bench_string *const strings,
+                const uint64_t count,
+                struct bench_samples *const samples)
+{
+    if (count == 0) {
+        return;
+    }
+
+    uint64_t bytes_count = 0;
+    for (uint64_t i = 0; i != count; i++) {
+        bytes_count += strings[i].length;
+    }
+
+    for (uint32_t i = 0; i != samples->count; i++) {
+        const uint64_t start = get_time_ns();
+
+        for (uint64_t j = 0; j != count; j++) {
+            yaml_check_c_str(strings[j].string, strings[j].length);
+        }
+
+        samples->times[i] = get_time_ns() - start;
+    }
+
+    print_samples(name, samples, count, bytes_count);
+}
+
+/*
+ * Time yaml_check_c_str() on a corpus of objc and C++ symbol-names, separately
+ * for the strings short enough to only be checked with the lookup-table, and
+ * those checked with vectors.
+ */
+
+static void
+bench_yaml_check(const struct bench_generate_options *const options,
+                 struct bench_samples *const samples)
+{
+    struct bench_buffer buffer = {};
+    bench_generate_symbol_names(&buffer, options);
+
+    const uint32_t symbols_count = options->symbols_count;
+
+    struct bench_string *const short_strings =
+        calloc(symbols_count, sizeof(struct bench_string));
+    struct bench_string *const long_strings =
+        calloc(symbols_count, sizeof(struct bench_string));
+
+    if (short_strings == NULL || long_strings == NULL) {
+        if (symbols_count != 0) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+    }
+
+    uint64_t short_count = 0;
+    uint64_t long_count = 0;
+
+    const char *iter = (const char *)buffer.data;
+    for (uint32_t i = 0; i != symbols_count; i++) {
+        const uint64_t length = strlen(iter);
+
+        /*
+         * Check the result against a plain search of the characters that
+         * need quotes.
+         */
+
+        const bool needs_quotes = strpbrk(iter, ":{}[],&*#?|-<>=!%@` ") != NULL;
+        if (yaml_check_c_str(iter, length) != needs_quotes) {
+            fprintf(stderr, "yaml_check_c_str() is wrong for %s\n", iter);
+            exit(1);
+        }
+
+        const struct bench_string string = {
+            .string = iter,
+            .length = length
+        };
+
+        if (length < BENCH_YAML_VECTOR_SIZE) {
+            short_strings[short_count] = string;
+            short_count++;
+        } else {
+            long_strings[long_count] = string;
+            long_count++;
+        }
+
+        iter += length + 1;
+    }
+
+    char name[64] = {};
+    snprintf(name,
+             sizeof(name),
+             "yaml_check_c_str (table, <%u chars)",
+             BENCH_YAML_VECTOR_SIZE);
+
+    time_yaml_check(name, short_strings, short_count, samples);
+    time_yaml_check("yaml_check_c_str (" BENCH_YAML_VECTOR_NAME ")",
+                    long_strings,
+                    long_count,
+                    samples);
+
+    free(short_strings);
+    free(long_strings);
+
+    bench_buffer_destroy(&buffer);
+}
+
+static void
+bench_tbd_create(const struct bench_buffer *const buffer,
+                 struct bench_samples *const samples)
+{
+    const int fd = create_temporary_file();
+    write_to_file(fd, buffer->data, buffer->size, 0);
+
+    struct tbd_create_info info = { .version = TBD_VERSION_V2 };
+    parse_macho(&info,
+                fd,
+                "tbd_create_with_info",
+                O_MACHO_FILE_PARSE_IGNORE_INVALID_FIELDS);
+
+    close(fd);
+
+    FILE *const file = fopen("/dev/null", "w");
+    if (file == NULL) {
+        fprintf(stderr,
+                "Failed to open /dev/null, error: %s\n",
+                strerror(errno));
+
+        exit(1);
+    }
+
+    /*
+     * The size of the tbd written out is found with the buffer, as output
+     * written to /dev/null can't be measured.
+     */
+
+    struct tbd_write_buffer write_buffer = {};
+    for (uint32_t i = 0; i != samples->count; i++) {
+        const uint64_t start = get_time_ns();
+
+        tbd_write_buffer_clear(&write_buffer);
+        tbd_create_with_info_to_buffer(&info, &write_buffer, 0);
+
+        samples->times[i] = get_time_ns() - start;
+    }
+
+    const uint64_t tbd_size =
+        (uint64_t)(write_buffer.data_end - write_buffer.data);
+
+    print_samples("tbd_create_with_info_to_buffer", samples, 1, tbd_size);
+
+    for (uint32_t i = 0; i != samples->count; i++) {
+        const uint64_t start = get_time_ns();
+
+        tbd_create_with_info(&info, file, 0);
+        fflush(file);
+
+        samples->times[i] = get_time_ns() - start;
+    }
+
+    print_samples("tbd_create_with_info", samples, 1, tbd_size);
+
+    tbd_write_buffer_destroy(&write_buffer);
+    tbd_create_info_destroy(&info);
+
+    fclose(file);
+}
+
+static void print_usage(void) {
+    fputs("Usage: tbd-bench [options]\n", stdout);
+    fputs("       tbd-bench [options] --generate "
+          "<thin|fat|large-fat|dsc|split-dsc> path\n",
+          stdout);
+
+    fputc('\n', stdout);
+    fputs("Times macho_file_parse_from_file(), dsc_image_parse(), merging "
+          "exports across\n",
+          stdout);
+
+    fputs("archs and tbd_create_with_info() on synthetic files, or writes out "
+          "a synthetic\n",
+          stdout);
+
+    fputs("file with --generate\n", stdout);
+
+    fputc('\n', stdout);
+    fputs("Options:\n", stdout);
+    fputs("    --archs,         Number of architectures of fat mach-o files "
+          "(1-8, default: 4)\n",
+          stdout);
+
+    fputs("    --images,        Number of images of dyld_shared_cache files "
+          "(default: 500)\n",
+          stdout);
+
+    fputs("    --iterations,    Number of times to run each driver "
+          "(default: 20)\n",
+          stdout);
+
+    fputs("    --large,         Also time fat mach-o files with "
+          "architectures past 4 GiB\n",
+          stdout);
+
+    fputs("    --objc-classes,  Percentage of symbols of objc-classes "
+          "(default: 10)\n",
+          stdout);
+
+    fputs("    --objc-ivars,    Number of ivars of each objc-class "
+          "(default: 2)\n",
+          stdout);
+
+    fputs("    --string-length, Minimum length of each symbol's name "
+          "(default: 24)\n",
+          stdout);
+
+    fputs("    --subcaches,     Number of sub-caches of split "
+          "dyld_shared_cache files (default: 4)\n",
+          stdout);
+
+    fputs("    --symbols,       Number of symbols of each mach-o file or "
+          "image (default: 2000)\n",
+          stdout);
+}
+
+static uint32_t
+parse_number(const int argc,
+             const char *const argv[],
+             const int index,
+             const uint32_t max)
+{
+    if (index == argc) {
+        fprintf(stderr, "Please provide a number for %s\n", argv[index - 1]);
+        exit(1);
+    }
+
+    char *end = NULL;
+    const unsigned long number = strtoul(argv[index], &end, 10);
+
+    if (*end != '\0' || number > max) {
+        fprintf(stderr,
+                "Invalid number for %s: %s\n",
+                argv[index - 1],
+                argv[index]);
+
+        exit(1);
+    }
+
+    return (uint32_t)number;
+}
+
+static void
+generate_to_path(const struct bench_generate_options *const options,
+                 const char *const kind,
+                 const char *const path)
+{
+    if (strcmp(kind, "split-dsc") == 0) {
+        struct bench_split_dsc split_dsc = {};
+        bench_generate_split_dsc(&split_dsc, options);
+
+        write_split_dsc(path, &split_dsc);
+        bench_split_dsc_destroy(&split_dsc);
+
+        return;
+    }
+
+    struct bench_buffer buffer = {};
+    struct bench_sparse_file sparse_file = {};
+
+    if (strcmp(kind, "thin") == 0) {
+        bench_generate_thin_macho(&buffer, options);
+    } else if (strcmp(kind, "fat") == 0) {
+        bench_generate_fat_macho(&buffer, options);
+    } else if (strcmp(kind, "large-fat") == 0) {
+        bench_generate_large_fat_macho(&sparse_file, options);
+    } else if (strcmp(kind, "dsc") == 0) {
+        bench_generate_dsc(&buffer, options);
+    } else {
+        fprintf(stderr, "Unrecognized kind of file to generate: %s\n", kind);
+        exit(1);
+    }
+
+    if (sparse_file.pieces != NULL) {
+        const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            fprintf(stderr,
+                    "Failed to open file (at path %s), error: %s\n",
+                    path,
+                    strerror(errno));
+
+            exit(1);
+        }
+
+        write_sparse_file(fd, &sparse_file);
+        close(fd);
+    } else {
+        write_to_path(path, &buffer);
+    }
+
+    bench_buffer_destroy(&buffer);
+    bench_sparse_file_destroy(&sparse_file);
+}
+
+int main(const int argc, const char *const argv[]) {
+    struct bench_options options = {
+        .generate = {
+            .symbols_count = 2000,
+            .string_length = 24,
+            .objc_class_percent = 10,
+            .objc_ivars_per_class = 2,
+            .archs_count = 4,
+            .images_count = 500,
+            .subcaches_count = 4
+        },
+
+        .iterations = 20
+    };
+
+    const char *generate_kind = NULL;
+    const char *generate_path = NULL;
+
+    for (int index = 1; index < argc; index++) {
+        const char *option = argv[index];
+        if (option[0] != '-') {
+            fprintf(stderr, "Unrecognized argument: %s\n", option);
+            return 1;
+        }
+
+        option++;
+        if (option[0] == '-') {
+            option++;
+        }
+
+        struct bench_generate_options *const generate = &options.generate;
+        if (strcmp(option, "archs") == 0) {
+            index++;
+            generate->archs_count = parse_number(argc, argv, index, 8);
+
+            if (generate->archs_count == 0) {
+                fputs("Please provide at least one architecture\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(option, "images") == 0) {
+            index++;
+            generate->images_count =
+                parse_number(argc, argv, index, UINT16_MAX);
+        } else if (strcmp(option, "iterations") == 0) {
+            index++;
+            options.iterations = parse_number(argc, argv, index, UINT16_MAX);
+
+            if (options.iterations == 0) {
+                fputs("Please provide at least one iteration\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(option, "large") == 0) {
+            options.large = true;
+        } else if (strcmp(option, "objc-classes") == 0) {
+            index++;
+            generate->objc_class_percent = parse_number(argc, argv, index, 100);
+        } else if (strcmp(option, "objc-ivars") == 0) {
+            index++;
+            generate->objc_ivars_per_class =
+                parse_number(argc, argv, index, 1024);
+        } else if (strcmp(option, "subcaches") == 0) {
+            index++;
+            generate->subcaches_count = parse_number(argc, argv, index, 64);
+
+            if (generate->subcaches_count == 0) {
+                fputs("Please provide at least one sub-cache\n", stderr);
+                return 1;
+            }
+        } else if (strcmp(option, "string-length") == 0) {
+            index++;
+            generate->string_length = parse_number(argc, argv, index, 4096);
+        } else if (strcmp(option, "symbols") == 0) {
+            index++;
+            generate->symbols_count =
+                parse_number(argc, argv, index, 10000000);
+        } else if (strcmp(option, "generate") == 0) {
+            if (index + 2 >= argc) {
+                fputs("Please provide a kind of file (thin, fat, large-fat, "
+                      "dsc or split-dsc) and a path to generate to\n",
+                      stderr);
+
+                return 1;
+            }
+
+            generate_kind = argv[index + 1];
+            generate_path = argv[index + 2];
+
+            index += 2;
+        } else if (strcmp(option, "h") == 0 || strcmp(option, "help") == 0) {
+            print_usage();
+            return 0;
+        } else {
+            fprintf(stderr, "Unrecognized option: %s\n", argv[index]);
+            return 1;
+        }
+    }
+
+    if (generate_kind != NULL) {
+        generate_to_path(&options.generate, generate_kind, generate_path);
+        return 0;
+    }
+
+    struct bench_samples samples = {
+        .times = calloc(options.iterations, sizeof(uint64_t)),
+        .count = options.iterations
+    };
+
+    if (samples.times == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        return 1;
+    }
+
+    struct bench_buffer thin = {};
+    struct bench_buffer fat = {};
+    struct bench_buffer dsc = {};
+    struct bench_split_dsc split_dsc = {};
+
+    bench_generate_thin_macho(&thin, &options.generate);
+    bench_generate_fat_macho(&fat, &options.generate);
+    bench_generate_dsc(&dsc, &options.generate);
+    bench_generate_split_dsc(&split_dsc, &options.generate);
+
+    printf("%u symbols (%u%% objc-classes, %u ivars each), names of %u+ "
+           "chars, %u archs, %u images, %u iterations\n\n",
+           options.generate.symbols_count,
+           options.generate.objc_class_percent,
+           options.generate.objc_ivars_per_class,
+           options.generate.string_length,
+           options.generate.archs_count,
+           options.generate.images_count,
+           options.iterations);
+
+    printf("%-52s %8s %12s %12s %10s\n",
+           "driver",
+           "items",
+           "median us",
+           "min us",
+           "MiB/s");
+
+    const uint64_t macho_options = O_MACHO_FILE_PARSE_IGNORE_INVALID_FIELDS;
+
+    check_fat_weak_defs(&fat);
+    check_dir_cache_forget();
+
+    bench_macho_parse("macho_file_parse_from_file (thin)",
+                      &thin,
+                      macho_options,
+                      &samples);
+
+    bench_macho_parse("macho_file_parse_from_file (fat)",
+                      &fat,
+                      macho_options,
+                      &samples);
+
+    if (options.large) {
+        struct bench_sparse_file large_fat = {};
+        bench_generate_large_fat_macho(&large_fat, &options.generate);
+
+        bench_large_macho_parse("macho_file_parse_from_file (fat, >4 GiB)",
+                                &large_fat,
+                                macho_options,
+                                &samples);
+
+        bench_sparse_file_destroy(&large_fat);
+    }
+
+    bench_dsc_image_parse("dsc_image_parse", &dsc, &samples);
+    bench_dsc_image_parse_in_order("dsc_image_parse (file order)",
+                                   &dsc,
+                                   O_DSC_IMAGE_ORDER_BY_FILE_OFFSET,
+                                   false,
+                                   &samples);
+
+    bench_dsc_image_parse_in_order("dsc_image_parse (release pages)",
+                                   &dsc,
+                                   O_DSC_IMAGE_ORDER_RELEASE_PAGES,
+                                   true,
+                                   &samples);
+
+    bench_split_dsc_image_parse("dsc_image_parse (split)",
+                                &split_dsc,
+                                &samples);
+
+    bench_export_merge(&options.generate, &samples);
+    bench_yaml_check(&options.generate, &samples);
+    bench_tbd_create(&thin, &samples);
+
+    bench_buffer_destroy(&thin);
+    bench_buffer_destroy(&fat);
+    bench_buffer_destroy(&dsc);
+    bench_split_dsc_destroy(&split_dsc);
+
+    free(samples.times);
+    return 0;
+}
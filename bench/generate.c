@@ -0,0 +1,1041 @@
+//
+//  bench/generate.c
+//  tbd
+//
+//  Created by inoahdev on 3/24/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mach-o/fat.h"
+#include "mach-o/loader.h"
+#include "mach-o/nlist.h"
+
+#include "dyld_shared_cache_format.h"
+#include "generate.h"
+
+#define BENCH_DSC_BASE_ADDRESS 0x180000000
+#define BENCH_PAGE_SIZE 4096
+
+#define BENCH_LARGE_ARCH_SPACING (1ull << 32)
+
+struct bench_arch {
+    cpu_type_t cputype;
+    cpu_subtype_t cpusubtype;
+
+    bool is_64;
+};
+
+static const struct bench_arch archs[] = {
+    { CPU_TYPE_X86_64, CPU_SUBTYPE_X86_64_ALL, true  },
+    { CPU_TYPE_ARM64,  CPU_SUBTYPE_ARM64_ALL,  true  },
+    { CPU_TYPE_I386,   CPU_SUBTYPE_I386_ALL,   false },
+    { CPU_TYPE_ARM,    CPU_SUBTYPE_ARM_V7,     false },
+    { CPU_TYPE_X86_64, CPU_SUBTYPE_X86_64_H,   true  },
+    { CPU_TYPE_ARM,    CPU_SUBTYPE_ARM_V7S,    false },
+    { CPU_TYPE_ARM,    CPU_SUBTYPE_ARM_V7K,    false },
+    { CPU_TYPE_ARM,    CPU_SUBTYPE_ARM_V6,     false }
+};
+
+/*
+ * Where the __LINKEDIT of an image is placed when it's located apart from the
+ * image's header, as in a split dyld_shared_cache.
+ */
+
+struct bench_linkedit {
+    struct bench_buffer *buffer;
+    uint64_t address;
+};
+
+void
+bench_buffer_append(struct bench_buffer *const buffer,
+                    const void *const data,
+                    const uint64_t size)
+{
+    const uint64_t new_size = buffer->size + size;
+    if (new_size > buffer->capacity) {
+        uint64_t capacity = (buffer->capacity != 0) ? buffer->capacity : 4096;
+        while (capacity < new_size) {
+            capacity <<= 1;
+        }
+
+        uint8_t *const new_data = realloc(buffer->data, capacity);
+        if (new_data == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+
+        buffer->data = new_data;
+        buffer->capacity = capacity;
+    }
+
+    if (data != NULL) {
+        memcpy(buffer->data + buffer->size, data, size);
+    } else {
+        memset(buffer->data + buffer->size, 0, size);
+    }
+
+    buffer->size = new_size;
+}
+
+static void
+pad_buffer(struct bench_buffer *const buffer, const uint64_t alignment) {
+    const uint64_t remainder = buffer->size % alignment;
+    if (remainder != 0) {
+        bench_buffer_append(buffer, NULL, alignment - remainder);
+    }
+}
+
+void bench_buffer_destroy(struct bench_buffer *const buffer) {
+    free(buffer->data);
+
+    buffer->data = NULL;
+    buffer->size = 0;
+    buffer->capacity = 0;
+}
+
+void bench_sparse_file_destroy(struct bench_sparse_file *const file) {
+    for (uint32_t i = 0; i != file->pieces_count; i++) {
+        bench_buffer_destroy(&file->pieces[i].buffer);
+    }
+
+    free(file->pieces);
+
+    file->pieces = NULL;
+    file->pieces_count = 0;
+    file->size = 0;
+}
+
+void bench_split_dsc_destroy(struct bench_split_dsc *const dsc) {
+    bench_buffer_destroy(&dsc->main);
+    for (uint32_t i = 0; i != dsc->subcaches_count; i++) {
+        bench_buffer_destroy(dsc->subcaches + i);
+    }
+
+    free(dsc->subcaches);
+
+    dsc->subcaches = NULL;
+    dsc->subcaches_count = 0;
+}
+
+static uint64_t align_up(const uint64_t number, const uint64_t alignment) {
+    return (number + alignment - 1) & ~(alignment - 1);
+}
+
+static void write_be32(uint8_t *const ptr, const uint32_t number) {
+    ptr[0] = (uint8_t)(number >> 24);
+    ptr[1] = (uint8_t)(number >> 16);
+    ptr[2] = (uint8_t)(number >> 8);
+    ptr[3] = (uint8_t)number;
+}
+
+static void write_be64(uint8_t *const ptr, const uint64_t number) {
+    write_be32(ptr, (uint32_t)(number >> 32));
+    write_be32(ptr + 4, (uint32_t)number);
+}
+
+static uint64_t
+hash_bytes(uint64_t hash, const void *const data, uint64_t size) {
+    const uint8_t *iter = (const uint8_t *)data;
+    for (; size != 0; size--, iter++) {
+        hash ^= *iter;
+        hash *= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+/*
+ * Append the name of the symbol at index to strtab, returning whether the
+ * symbol is exported.
+ *
+ * The first symbols are of objc-classes, each having a class, a metaclass,
+ * and its ivars. The rest are plain symbols, some of which are weak, or not
+ * exported at all.
+ */
+
+static bool
+append_symbol_name(struct bench_buffer *const strtab,
+                   const struct bench_generate_options *const options,
+                   const uint32_t index,
+                   const int64_t image_index,
+                   uint16_t *const desc_out)
+{
+    const uint32_t symbols_per_class = 2 + options->objc_ivars_per_class;
+    const uint32_t objc_symbols_count =
+        (uint32_t)((uint64_t)options->symbols_count *
+                   options->objc_class_percent / 100);
+
+    const uint32_t classes_count = objc_symbols_count / symbols_per_class;
+    const uint32_t class_symbols_count = classes_count * symbols_per_class;
+
+    const char *prefix = "_";
+    const char *base = "bench_symbol";
+
+    uint32_t number = index;
+    uint32_t ivar = 0;
+
+    bool is_ivar = false;
+    bool is_exported = true;
+
+    *desc_out = 0;
+
+    if (index < class_symbols_count) {
+        base = "BenchClass";
+        number = index / symbols_per_class;
+
+        const uint32_t kind = index % symbols_per_class;
+        if (kind == 0) {
+            prefix = "_OBJC_CLASS_$_";
+        } else if (kind == 1) {
+            prefix = "_OBJC_METACLASS_$_";
+        } else {
+            prefix = "_OBJC_IVAR_$_";
+            ivar = kind - 2;
+            is_ivar = true;
+        }
+    } else {
+        if (index % 11 == 0) {
+            *desc_out = N_WEAK_DEF;
+        }
+
+        if (index % 13 == 0) {
+            is_exported = false;
+        }
+    }
+
+    char name[64] = {};
+    int length = 0;
+
+    if (image_index >= 0) {
+        length =
+            snprintf(name,
+                     sizeof(name),
+                     "%s%s%u_i%lld",
+                     prefix,
+                     base,
+                     number,
+                     (long long)image_index);
+    } else {
+        length = snprintf(name, sizeof(name), "%s%s%u", prefix, base, number);
+    }
+
+    bench_buffer_append(strtab, name, (uint64_t)length);
+
+    /*
+     * Pad out the name (after the objc-prefix) to the requested length. The
+     * class and metaclass of an objc-class are padded alike, so they still
+     * pair up.
+     */
+
+    const uint64_t name_length = (uint64_t)length - strlen(prefix);
+    for (uint64_t i = name_length; i < options->string_length; i++) {
+        bench_buffer_append(strtab, "x", 1);
+    }
+
+    if (is_ivar) {
+        length = snprintf(name, sizeof(name), ".ivar%u", ivar);
+        bench_buffer_append(strtab, name, (uint64_t)length);
+    }
+
+    bench_buffer_append(strtab, "", 1);
+    return is_exported;
+}
+
+/*
+ * Append a mach-o file for arch to buffer.
+ *
+ * Symbols whose index has (index + skip_index) % 5 == 0 are left out, unless
+ * skip_index is negative. Offsets are absolute in the buffer (as in a
+ * dyld_shared_cache) if absolute_offsets is set.
+ */
+
+static void
+append_macho(struct bench_buffer *const buffer,
+             const struct bench_generate_options *const options,
+             const struct bench_arch *const arch,
+             const char *const install_name,
+             const int64_t image_index,
+             const int64_t skip_index,
+             const bool absolute_offsets,
+             const struct bench_linkedit *const linkedit)
+{
+    const uint64_t start = buffer->size;
+    const uint64_t base = (absolute_offsets) ? start : 0;
+
+    const uint64_t install_name_size = strlen(install_name) + 1;
+    const uint32_t dylib_command_size =
+        (uint32_t)align_up(sizeof(struct dylib_command) + install_name_size, 8);
+
+    const uint32_t segment_command_size =
+        (arch->is_64) ?
+            (uint32_t)sizeof(struct segment_command_64) :
+            (uint32_t)sizeof(struct segment_command);
+
+    uint32_t ncmds = 4;
+    uint32_t sizeofcmds =
+        dylib_command_size +
+        (uint32_t)sizeof(struct uuid_command) +
+        (uint32_t)sizeof(struct version_min_command) +
+        (uint32_t)sizeof(struct symtab_command);
+
+    if (linkedit != NULL) {
+        ncmds += 1;
+        sizeofcmds += segment_command_size;
+    }
+
+    const uint64_t header_size =
+        (arch->is_64) ?
+            sizeof(struct mach_header_64) :
+            sizeof(struct mach_header);
+
+    /*
+     * Create the string-table and symbol-table first, so the load-commands
+     * can point to them.
+     */
+
+    struct bench_buffer strtab = {};
+    struct bench_buffer symtab = {};
+
+    bench_buffer_append(&strtab, " ", 2);
+
+    const uint32_t symbols_count = options->symbols_count;
+    const uint32_t objc_symbols_count =
+        (uint32_t)((uint64_t)symbols_count * options->objc_class_percent / 100);
+
+    uint32_t nsyms = 0;
+    for (uint32_t i = 0; i != symbols_count; i++) {
+        if (skip_index >= 0 && i >= objc_symbols_count) {
+            if ((i + (uint64_t)skip_index) % 5 == 0) {
+                continue;
+            }
+        }
+
+        const uint32_t strx = (uint32_t)strtab.size;
+
+        uint16_t desc = 0;
+        const bool is_exported =
+            append_symbol_name(&strtab, options, i, image_index, &desc);
+
+        const uint8_t type = (is_exported) ? (N_SECT | N_EXT) : N_SECT;
+        if (arch->is_64) {
+            const struct nlist_64 nlist = {
+                .n_un.n_strx = strx,
+                .n_type = type,
+                .n_sect = 1,
+                .n_desc = desc,
+                .n_value = 0x1000 + i
+            };
+
+            bench_buffer_append(&symtab, &nlist, sizeof(nlist));
+        } else {
+            const struct nlist nlist = {
+                .n_un.n_strx = strx,
+                .n_type = type,
+                .n_sect = 1,
+                .n_desc = (int16_t)desc,
+                .n_value = 0x1000 + i
+            };
+
+            bench_buffer_append(&symtab, &nlist, sizeof(nlist));
+        }
+
+        nsyms++;
+    }
+
+    pad_buffer(&strtab, 8);
+
+    const uint64_t symoff = align_up(header_size + sizeofcmds, 16);
+    const uint64_t stroff = symoff + symtab.size;
+
+    if (arch->is_64) {
+        const struct mach_header_64 header = {
+            .magic = MH_MAGIC_64,
+            .cputype = arch->cputype,
+            .cpusubtype = arch->cpusubtype,
+            .filetype = MH_DYLIB,
+            .ncmds = ncmds,
+            .sizeofcmds = sizeofcmds,
+            .flags = MH_TWOLEVEL | MH_APP_EXTENSION_SAFE
+        };
+
+        bench_buffer_append(buffer, &header, sizeof(header));
+    } else {
+        const struct mach_header header = {
+            .magic = MH_MAGIC,
+            .cputype = arch->cputype,
+            .cpusubtype = arch->cpusubtype,
+            .filetype = MH_DYLIB,
+            .ncmds = ncmds,
+            .sizeofcmds = sizeofcmds,
+            .flags = MH_TWOLEVEL | MH_APP_EXTENSION_SAFE
+        };
+
+        bench_buffer_append(buffer, &header, sizeof(header));
+    }
+
+    const struct dylib_command dylib_command = {
+        .cmd = LC_ID_DYLIB,
+        .cmdsize = dylib_command_size,
+        .dylib = {
+            .name.offset = sizeof(struct dylib_command),
+            .timestamp = 2,
+            .current_version = 0x10203,
+            .compatibility_version = 0x10000
+        }
+    };
+
+    bench_buffer_append(buffer, &dylib_command, sizeof(dylib_command));
+    bench_buffer_append(buffer, install_name, install_name_size);
+    bench_buffer_append(buffer,
+                        NULL,
+                        dylib_command_size -
+                            sizeof(dylib_command) -
+                            install_name_size);
+
+    uint64_t hash = hash_bytes(14695981039346656037ull,
+                               install_name,
+                               install_name_size);
+
+    hash = hash_bytes(hash, arch, sizeof(*arch));
+
+    struct uuid_command uuid_command = {
+        .cmd = LC_UUID,
+        .cmdsize = sizeof(struct uuid_command)
+    };
+
+    const uint64_t second_hash = hash_bytes(hash, &hash, sizeof(hash));
+
+    memcpy(uuid_command.uuid, &hash, sizeof(hash));
+    memcpy(uuid_command.uuid + sizeof(hash), &second_hash, sizeof(hash));
+
+    bench_buffer_append(buffer, &uuid_command, sizeof(uuid_command));
+
+    const struct version_min_command version_min_command = {
+        .cmd = LC_VERSION_MIN_MACOSX,
+        .cmdsize = sizeof(struct version_min_command),
+        .version = 0x000a0e00,
+        .sdk = 0x000a0e00
+    };
+
+    bench_buffer_append(buffer,
+                        &version_min_command,
+                        sizeof(version_min_command));
+
+    struct symtab_command symtab_command = {
+        .cmd = LC_SYMTAB,
+        .cmdsize = sizeof(struct symtab_command),
+        .symoff = (uint32_t)(base + symoff),
+        .nsyms = nsyms,
+        .stroff = (uint32_t)(base + stroff),
+        .strsize = (uint32_t)strtab.size
+    };
+
+    if (linkedit == NULL) {
+        bench_buffer_append(buffer, &symtab_command, sizeof(symtab_command));
+        bench_buffer_append(buffer, NULL, start + symoff - buffer->size);
+
+        bench_buffer_append(buffer, symtab.data, symtab.size);
+        bench_buffer_append(buffer, strtab.data, strtab.size);
+
+        bench_buffer_destroy(&symtab);
+        bench_buffer_destroy(&strtab);
+
+        return;
+    }
+
+    /*
+     * The offsets of the symbol-table and string-table are relative to the
+     * fileoff of __LINKEDIT, which is simply its offset in the linkedit
+     * buffer, so the tables have to be found through __LINKEDIT's address.
+     */
+
+    struct bench_buffer *const linkedit_buffer = linkedit->buffer;
+    pad_buffer(linkedit_buffer, 16);
+
+    const uint64_t linkedit_offset = linkedit_buffer->size;
+    const uint64_t linkedit_size = symtab.size + strtab.size;
+
+    if (arch->is_64) {
+        struct segment_command_64 segment = {
+            .cmd = LC_SEGMENT_64,
+            .cmdsize = segment_command_size,
+            .vmaddr = linkedit->address + linkedit_offset,
+            .vmsize = linkedit_size,
+            .fileoff = linkedit_offset,
+            .filesize = linkedit_size,
+            .maxprot = 1,
+            .initprot = 1
+        };
+
+        strncpy(segment.segname, "__LINKEDIT", sizeof(segment.segname));
+        bench_buffer_append(buffer, &segment, sizeof(segment));
+    } else {
+        struct segment_command segment = {
+            .cmd = LC_SEGMENT,
+            .cmdsize = segment_command_size,
+            .vmaddr = (uint32_t)(linkedit->address + linkedit_offset),
+            .vmsize = (uint32_t)linkedit_size,
+            .fileoff = (uint32_t)linkedit_offset,
+            .filesize = (uint32_t)linkedit_size,
+            .maxprot = 1,
+            .initprot = 1
+        };
+
+        strncpy(segment.segname, "__LINKEDIT", sizeof(segment.segname));
+        bench_buffer_append(buffer, &segment, sizeof(segment));
+    }
+
+    symtab_command.symoff = (uint32_t)linkedit_offset;
+    symtab_command.stroff = (uint32_t)(linkedit_offset + symtab.size);
+
+    bench_buffer_append(buffer, &symtab_command, sizeof(symtab_command));
+
+    bench_buffer_append(linkedit_buffer, symtab.data, symtab.size);
+    bench_buffer_append(linkedit_buffer, strtab.data, strtab.size);
+
+    bench_buffer_destroy(&symtab);
+    bench_buffer_destroy(&strtab);
+}
+
+void
+bench_generate_thin_macho(struct bench_buffer *const buffer,
+                          const struct bench_generate_options *const options)
+{
+    append_macho(buffer,
+                 options,
+                 archs,
+                 "/usr/lib/libbench.dylib",
+                 -1,
+                 -1,
+                 false,
+                 NULL);
+}
+
+void
+bench_generate_fat_macho(struct bench_buffer *const buffer,
+                         const struct bench_generate_options *const options)
+{
+    const uint32_t archs_count = options->archs_count;
+    const uint64_t header_start = buffer->size;
+
+    bench_buffer_append(buffer,
+                        NULL,
+                        sizeof(struct fat_header) +
+                            sizeof(struct fat_arch) * archs_count);
+
+    write_be32(buffer->data + header_start, FAT_MAGIC);
+    write_be32(buffer->data + header_start + 4, archs_count);
+
+    for (uint32_t i = 0; i != archs_count; i++) {
+        pad_buffer(buffer, BENCH_PAGE_SIZE);
+
+        const struct bench_arch *const arch = archs + i;
+        const uint64_t offset = buffer->size;
+
+        append_macho(buffer,
+                     options,
+                     arch,
+                     "/usr/lib/libbench.dylib",
+                     -1,
+                     i,
+                     false,
+                     NULL);
+
+        uint8_t *const fat_arch =
+            buffer->data +
+            header_start +
+            sizeof(struct fat_header) +
+            sizeof(struct fat_arch) * i;
+
+        write_be32(fat_arch, (uint32_t)arch->cputype);
+        write_be32(fat_arch + 4, (uint32_t)arch->cpusubtype);
+        write_be32(fat_arch + 8, (uint32_t)(offset - header_start));
+        write_be32(fat_arch + 12, (uint32_t)(buffer->size - offset));
+        write_be32(fat_arch + 16, 12);
+    }
+}
+
+void
+bench_generate_large_fat_macho(
+    struct bench_sparse_file *const file,
+    const struct bench_generate_options *const options)
+{
+    const uint32_t archs_count = options->archs_count;
+    struct bench_sparse_piece *const pieces =
+        calloc(archs_count + 1, sizeof(struct bench_sparse_piece));
+
+    if (pieces == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    struct bench_buffer *const header = &pieces[0].buffer;
+    bench_buffer_append(header,
+                        NULL,
+                        sizeof(struct fat_header) +
+                            sizeof(struct fat_arch_64) * archs_count);
+
+    write_be32(header->data, FAT_MAGIC_64);
+    write_be32(header->data + 4, archs_count);
+
+    uint64_t size = 0;
+    for (uint32_t i = 0; i != archs_count; i++) {
+        struct bench_sparse_piece *const piece = pieces + i + 1;
+        const struct bench_arch *const arch = archs + i;
+
+        piece->offset = BENCH_LARGE_ARCH_SPACING * (i + 1);
+        append_macho(&piece->buffer,
+                     options,
+                     arch,
+                     "/usr/lib/libbench.dylib",
+                     -1,
+                     i,
+                     false,
+                     NULL);
+
+        uint8_t *const fat_arch =
+            header->data +
+            sizeof(struct fat_header) +
+            sizeof(struct fat_arch_64) * i;
+
+        write_be32(fat_arch, (uint32_t)arch->cputype);
+        write_be32(fat_arch + 4, (uint32_t)arch->cpusubtype);
+        write_be64(fat_arch + 8, piece->offset);
+        write_be64(fat_arch + 16, piece->buffer.size);
+        write_be32(fat_arch + 24, 12);
+
+        size = piece->offset + piece->buffer.size;
+    }
+
+    file->pieces = pieces;
+    file->pieces_count = archs_count + 1;
+    file->size = size;
+}
+
+static void
+append_image_paths(struct bench_buffer *const buffer,
+                   const uint64_t start,
+                   const uint32_t images_count,
+                   uint32_t *const path_offsets)
+{
+    for (uint32_t i = 0; i != images_count; i++) {
+        char path[128] = {};
+        if (i % 2 == 0) {
+            snprintf(path,
+                     sizeof(path),
+                     "/System/Library/Frameworks/BenchF%u.framework/BenchF%u",
+                     i,
+                     i);
+        } else {
+            snprintf(path, sizeof(path), "/usr/lib/libbench%u.dylib", i);
+        }
+
+        path_offsets[i] = (uint32_t)(buffer->size - start);
+        bench_buffer_append(buffer, path, strlen(path) + 1);
+    }
+}
+
+void
+bench_generate_dsc(struct bench_buffer *const buffer,
+                   const struct bench_generate_options *const options)
+{
+    const uint64_t start = buffer->size;
+    const uint32_t images_count = options->images_count;
+
+    const uint64_t mappings_offset = sizeof(struct dyld_cache_header);
+    const uint64_t images_offset =
+        mappings_offset + sizeof(struct dyld_cache_mapping_info);
+
+    const uint64_t paths_offset =
+        images_offset + sizeof(struct dyld_cache_image_info) * images_count;
+
+    bench_buffer_append(buffer, NULL, paths_offset);
+
+    uint32_t *const path_offsets = calloc(images_count, sizeof(uint32_t));
+    if (path_offsets == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    append_image_paths(buffer, start, images_count, path_offsets);
+
+    for (uint32_t i = 0; i != images_count; i++) {
+        pad_buffer(buffer, BENCH_PAGE_SIZE);
+
+        const uint64_t image_offset = buffer->size - start;
+        const char *const path =
+            (const char *)(buffer->data + start + path_offsets[i]);
+
+        /*
+         * The path is copied, as the buffer may move while appending the
+         * image.
+         */
+
+        char install_name[128] = {};
+        strncpy(install_name, path, sizeof(install_name) - 1);
+
+        append_macho(buffer, options, archs, install_name, i, -1, true, NULL);
+
+        const struct dyld_cache_image_info image = {
+            .address = BENCH_DSC_BASE_ADDRESS + image_offset,
+            .pathFileOffset = path_offsets[i]
+        };
+
+        memcpy(buffer->data +
+                   start +
+                   images_offset +
+                   sizeof(struct dyld_cache_image_info) * i,
+               &image,
+               sizeof(image));
+    }
+
+    pad_buffer(buffer, BENCH_PAGE_SIZE);
+    free(path_offsets);
+
+    struct dyld_cache_header header = {
+        .mappingOffset = (uint32_t)mappings_offset,
+        .mappingCount = 1,
+        .imagesOffset = (uint32_t)images_offset,
+        .imagesCount = images_count,
+        .dyldBaseAddress = BENCH_DSC_BASE_ADDRESS
+    };
+
+    memcpy(header.magic, "dyld_v1  x86_64", 16);
+
+    const struct dyld_cache_mapping_info mapping = {
+        .address = BENCH_DSC_BASE_ADDRESS,
+        .size = buffer->size - start,
+        .fileOffset = 0,
+        .maxProt = 5,
+        .initProt = 5
+    };
+
+    memcpy(buffer->data + start, &header, sizeof(header));
+    memcpy(buffer->data + start + mappings_offset, &mapping, sizeof(mapping));
+}
+
+/*
+ * The header of a split dyld_shared_cache ends right before cacheSubType, so
+ * that the sub-cache entries are of the first version.
+ */
+
+#define BENCH_SPLIT_DSC_HEADER_SIZE DYLD_CACHE_HEADER_CACHE_SUB_TYPE_OFFSET
+#define BENCH_SPLIT_DSC_SUBCACHE_SPACING (1ull << 32)
+
+/*
+ * Write out the header of a file of a split dyld_shared_cache, with a mapping
+ * of the file's data at address, and if linkedit_offset isn't 0, a mapping of
+ * the file's data from linkedit_offset on at linkedit_address.
+ */
+
+static void
+write_split_dsc_header(struct bench_buffer *const buffer,
+                       const uint8_t uuid_byte,
+                       const uint64_t address,
+                       const uint64_t linkedit_offset,
+                       const uint64_t linkedit_address)
+{
+    struct dyld_cache_header header = {
+        .mappingOffset = BENCH_SPLIT_DSC_HEADER_SIZE,
+        .mappingCount = (linkedit_offset != 0) ? 2 : 1,
+        .dyldBaseAddress = BENCH_DSC_BASE_ADDRESS
+    };
+
+    memcpy(header.magic, "dyld_v1  x86_64", 16);
+    memcpy(buffer->data, &header, sizeof(header));
+    memset(buffer->data + DYLD_CACHE_HEADER_UUID_OFFSET, uuid_byte, 16);
+
+    const uint64_t size =
+        (linkedit_offset != 0) ? linkedit_offset : buffer->size;
+
+    const struct dyld_cache_mapping_info mapping = {
+        .address = address,
+        .size = size,
+        .fileOffset = 0,
+        .maxProt = 5,
+        .initProt = 5
+    };
+
+    memcpy(buffer->data + BENCH_SPLIT_DSC_HEADER_SIZE,
+           &mapping,
+           sizeof(mapping));
+
+    if (linkedit_offset == 0) {
+        return;
+    }
+
+    const struct dyld_cache_mapping_info linkedit_mapping = {
+        .address = linkedit_address,
+        .size = buffer->size - linkedit_offset,
+        .fileOffset = linkedit_offset,
+        .maxProt = 1,
+        .initProt = 1
+    };
+
+    memcpy(buffer->data + BENCH_SPLIT_DSC_HEADER_SIZE + sizeof(mapping),
+           &linkedit_mapping,
+           sizeof(linkedit_mapping));
+}
+
+void
+bench_generate_split_dsc(struct bench_split_dsc *const dsc,
+                         const struct bench_generate_options *const options)
+{
+    const uint32_t images_count = options->images_count;
+    const uint32_t subcaches_count = options->subcaches_count;
+
+    struct bench_buffer *const subcaches =
+        calloc(subcaches_count, sizeof(struct bench_buffer));
+
+    uint32_t *const path_offsets = calloc(images_count, sizeof(uint32_t));
+    if (subcaches == NULL || path_offsets == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    struct bench_buffer *const main = &dsc->main;
+
+    const uint64_t entries_offset =
+        BENCH_SPLIT_DSC_HEADER_SIZE + sizeof(struct dyld_cache_mapping_info);
+
+    const uint64_t images_offset =
+        entries_offset +
+        sizeof(struct dyld_subcache_entry_v1) * subcaches_count;
+
+    bench_buffer_append(main,
+                        NULL,
+                        images_offset +
+                            sizeof(struct dyld_cache_image_info) *
+                                images_count);
+
+    append_image_paths(main, 0, images_count, path_offsets);
+    pad_buffer(main, BENCH_PAGE_SIZE);
+
+    /*
+     * Each sub-cache holds an equal share of the images, and starts
+     * BENCH_SPLIT_DSC_SUBCACHE_SPACING after the previous sub-cache.
+     *
+     * The __LINKEDIT of every image is placed in the first sub-cache, in a
+     * second mapping halfway to the next sub-cache, so most images are spread
+     * across two sub-caches, as in a real split dyld_shared_cache.
+     */
+
+    const uint64_t first_address = BENCH_DSC_BASE_ADDRESS + main->size;
+
+    struct bench_buffer linkedit_buffer = {};
+    const struct bench_linkedit linkedit = {
+        .buffer = &linkedit_buffer,
+        .address = first_address + BENCH_SPLIT_DSC_SUBCACHE_SPACING / 2
+    };
+
+    uint64_t address = first_address;
+    for (uint32_t i = 0; i != subcaches_count; i++) {
+        struct bench_buffer *const subcache = subcaches + i;
+
+        const uint32_t first_image =
+            (uint32_t)((uint64_t)images_count * i / subcaches_count);
+        const uint32_t end_image =
+            (uint32_t)((uint64_t)images_count * (i + 1) / subcaches_count);
+
+        bench_buffer_append(subcache,
+                            NULL,
+                            BENCH_SPLIT_DSC_HEADER_SIZE +
+                                sizeof(struct dyld_cache_mapping_info) * 2);
+
+        for (uint32_t j = first_image; j != end_image; j++) {
+            pad_buffer(subcache, BENCH_PAGE_SIZE);
+
+            const uint64_t image_offset = subcache->size;
+            const char *const path =
+                (const char *)(main->data + path_offsets[j]);
+
+            append_macho(subcache,
+                         options,
+                         archs,
+                         path,
+                         j,
+                         -1,
+                         true,
+                         &linkedit);
+
+            const struct dyld_cache_image_info image = {
+                .address = address + image_offset,
+                .pathFileOffset = path_offsets[j]
+            };
+
+            memcpy(main->data +
+                       images_offset +
+                       sizeof(struct dyld_cache_image_info) * j,
+                   &image,
+                   sizeof(image));
+        }
+
+        pad_buffer(subcache, BENCH_PAGE_SIZE);
+        if (i != 0) {
+            write_split_dsc_header(subcache, (uint8_t)(i + 1), address, 0, 0);
+        }
+
+        struct dyld_subcache_entry_v1 entry = {
+            .cacheVMOffset = address - BENCH_DSC_BASE_ADDRESS
+        };
+
+        memset(entry.uuid, (uint8_t)(i + 1), sizeof(entry.uuid));
+        memcpy(main->data +
+                   entries_offset +
+                   sizeof(struct dyld_subcache_entry_v1) * i,
+               &entry,
+               sizeof(entry));
+
+        address += BENCH_SPLIT_DSC_SUBCACHE_SPACING;
+    }
+
+    /*
+     * The header of the first sub-cache can only be written once the
+     * __LINKEDIT of every image has been added.
+     */
+
+    struct bench_buffer *const first_subcache = subcaches;
+    const uint64_t linkedit_offset = first_subcache->size;
+
+    bench_buffer_append(first_subcache,
+                        linkedit_buffer.data,
+                        linkedit_buffer.size);
+
+    pad_buffer(first_subcache, BENCH_PAGE_SIZE);
+    write_split_dsc_header(first_subcache,
+                           1,
+                           first_address,
+                           linkedit_offset,
+                           linkedit.address);
+
+    bench_buffer_destroy(&linkedit_buffer);
+
+    free(path_offsets);
+    write_split_dsc_header(main, 0, BENCH_DSC_BASE_ADDRESS, 0, 0);
+
+    const struct dyld_cache_header_subcaches subcaches_header = {
+        .subCacheArrayOffset = (uint32_t)entries_offset,
+        .subCacheArrayCount = subcaches_count
+    };
+
+    const struct dyld_cache_header_images images_header = {
+        .imagesOffset = (uint32_t)images_offset,
+        .imagesCount = images_count
+    };
+
+    memcpy(main->data + DYLD_CACHE_HEADER_SUBCACHES_OFFSET,
+           &subcaches_header,
+           sizeof(subcaches_header));
+
+    memcpy(main->data + DYLD_CACHE_HEADER_IMAGES_OFFSET,
+           &images_header,
+           sizeof(images_header));
+
+    dsc->subcaches = subcaches;
+    dsc->subcaches_count = subcaches_count;
+}
+
+void
+bench_generate_symbol_names(struct bench_buffer *const buffer,
+                            const struct bench_generate_options *const options)
+{
+    const uint32_t symbols_count = options->symbols_count;
+    for (uint32_t i = 0; i != symbols_count; i++) {
+        char class_name[32] = {};
+        char method_name[32] = {};
+
+        const int class_length =
+            snprintf(class_name,
+                     sizeof(class_name),
+                     "BenchClass%u",
+                     i / 8);
+
+        const int method_length =
+            snprintf(method_name,
+                     sizeof(method_name),
+                     "benchMethod%u",
+                     i);
+
+        char name[256] = {};
+        int length = 0;
+
+        /*
+         * Cycle through the kinds of symbols found in apple's frameworks. The
+         * objc-methods and blocks need quotes, while the objc-classes, C++
+         * symbols and C functions don't.
+         */
+
+        switch (i % 8) {
+            case 0:
+                length = snprintf(name,
+                                  sizeof(name),
+                                  "_OBJC_CLASS_$_%s",
+                                  class_name);
+                break;
+
+            case 1:
+                length = snprintf(name,
+                                  sizeof(name),
+                                  "_OBJC_IVAR_$_%s._benchIvar%u",
+                                  class_name,
+                                  i);
+                break;
+
+            case 2:
+                length = snprintf(name,
+                                  sizeof(name),
+                                  "-[%s %s:withObject:]",
+                                  class_name,
+                                  method_name);
+                break;
+
+            case 3:
+                length = snprintf(name,
+                                  sizeof(name),
+                                  "+[%s sharedInstance]",
+                                  class_name);
+                break;
+
+            case 4:
+                length = snprintf(name,
+                                  sizeof(name),
+                                  "___%d-[%s %s:]_block_invoke",
+                                  class_length + method_length + 5,
+                                  class_name,
+                                  method_name);
+                break;
+
+            case 5:
+                length = snprintf(name,
+                                  sizeof(name),
+                                  "__ZN5bench%d%s%d%sEPKcm",
+                                  class_length,
+                                  class_name,
+                                  method_length,
+                                  method_name);
+                break;
+
+            case 6:
+                length = snprintf(name,
+                                  sizeof(name),
+                                  "__ZNK5bench%d%s%d%sERKNSt3__16vectorIiNS2_"
+                                  "9allocatorIiEEEE",
+                                  class_length,
+                                  class_name,
+                                  method_length,
+                                  method_name);
+                break;
+
+            case 7:
+                length = snprintf(name, sizeof(name), "_bench_fn%u", i);
+                break;
+        }
+
+        bench_buffer_append(buffer, name, (uint64_t)length + 1);
+    }
+}
@@ -0,0 +1,160 @@
+//
+//  bench/generate.h
+//  tbd
+//
+//  Created by inoahdev on 3/24/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef BENCH_GENERATE_H
+#define BENCH_GENERATE_H
+
+#include <stdint.h>
+
+/*
+ * Generators for synthetic mach-o files and dyld_shared_cache files, so the
+ * parsing and writing paths can be benchmarked without apple binaries.
+ *
+ * The generated files are fully deterministic for the same options.
+ */
+
+struct bench_buffer {
+    uint8_t *data;
+
+    uint64_t size;
+    uint64_t capacity;
+};
+
+/*
+ * A file too large to be kept in memory, made up of pieces of data located at
+ * the given offsets, with holes in-between them.
+ */
+
+struct bench_sparse_piece {
+    uint64_t offset;
+    struct bench_buffer buffer;
+};
+
+struct bench_sparse_file {
+    struct bench_sparse_piece *pieces;
+    uint32_t pieces_count;
+
+    uint64_t size;
+};
+
+/*
+ * A dyld_shared_cache split into a main cache-file and several sub-cache
+ * files, with the sub-cache at index i written out with the suffix ".<i + 1>".
+ */
+
+struct bench_split_dsc {
+    struct bench_buffer main;
+
+    struct bench_buffer *subcaches;
+    uint32_t subcaches_count;
+};
+
+struct bench_generate_options {
+    /*
+     * The number of symbols in each mach-o file (or image), including the
+     * objc-class and objc-ivar symbols.
+     */
+
+    uint32_t symbols_count;
+
+    /*
+     * The minimum length of each symbol's string. Shorter names are padded
+     * out to this length.
+     */
+
+    uint32_t string_length;
+
+    /*
+     * The percentage of symbols belonging to objc-classes, and how many ivars
+     * each objc-class has. Each objc-class has a class and a metaclass symbol.
+     */
+
+    uint32_t objc_class_percent;
+    uint32_t objc_ivars_per_class;
+
+    /*
+     * The number of architectures of a fat mach-o file, and the number of
+     * images of a dyld_shared_cache file.
+     */
+
+    uint32_t archs_count;
+    uint32_t images_count;
+
+    /*
+     * The number of sub-cache files of a split dyld_shared_cache.
+     */
+
+    uint32_t subcaches_count;
+};
+
+void bench_buffer_append(struct bench_buffer *buffer,
+                         const void *data,
+                         uint64_t size);
+
+void bench_buffer_destroy(struct bench_buffer *buffer);
+void bench_sparse_file_destroy(struct bench_sparse_file *file);
+void bench_split_dsc_destroy(struct bench_split_dsc *dsc);
+
+/*
+ * Generate a thin (x86_64) mach-o dylib.
+ */
+
+void
+bench_generate_thin_macho(struct bench_buffer *buffer,
+                          const struct bench_generate_options *options);
+
+/*
+ * Generate a fat mach-o dylib with options->archs_count architectures. Each
+ * architecture is missing a different fifth of the symbols, so the exports
+ * differ between architectures.
+ */
+
+void
+bench_generate_fat_macho(struct bench_buffer *buffer,
+                         const struct bench_generate_options *options);
+
+/*
+ * Generate a fat mach-o dylib, with a 64-bit fat-header, like
+ * bench_generate_fat_macho(), but with every architecture located past 4 GiB,
+ * each 4 GiB apart.
+ */
+
+void
+bench_generate_large_fat_macho(struct bench_sparse_file *file,
+                               const struct bench_generate_options *options);
+
+/*
+ * Generate an x86_64 dyld_shared_cache with options->images_count images.
+ */
+
+void
+bench_generate_dsc(struct bench_buffer *buffer,
+                   const struct bench_generate_options *options);
+
+/*
+ * Generate an x86_64 dyld_shared_cache, like bench_generate_dsc(), but split
+ * into a main cache-file holding the image-infos and paths, and
+ * options->subcaches_count sub-caches holding the images. The __LINKEDIT of
+ * every image is placed in the first sub-cache.
+ */
+
+void
+bench_generate_split_dsc(struct bench_split_dsc *dsc,
+                         const struct bench_generate_options *options);
+
+/*
+ * Generate options->symbols_count symbol-names, each null-terminated and
+ * placed one after the other, of objc-classes, objc-methods and blocks, C++
+ * mangled symbols and C functions.
+ */
+
+void
+bench_generate_symbol_names(struct bench_buffer *buffer,
+                            const struct bench_generate_options *options);
+
+#endif /* BENCH_GENERATE_H */
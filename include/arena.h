@@ -0,0 +1,53 @@
+//
+//  include/arena.h
+//  tbd
+//
+//  Created by inoahdev on 3/2/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+
+/*
+ * arena is a bump-allocator for many small allocations that all share the
+ * same lifetime, such as the strings of a tbd_create_info.
+ *
+ * Allocations are never freed individually. Instead, the whole arena is reset
+ * at once, with its blocks kept to be reused for later allocations.
+ */
+
+struct arena_block {
+    struct arena_block *next;
+    uint64_t size;
+
+    char data[];
+};
+
+struct arena {
+    struct arena_block *front;
+    struct arena_block *current;
+
+    char *iter;
+    char *end;
+};
+
+void *arena_alloc(struct arena *arena, uint64_t size);
+
+/*
+ * Copy the provided string into the arena, with a null-terminator added.
+ */
+
+char *
+arena_copy_string(struct arena *arena, const char *string, uint64_t length);
+
+/*
+ * Mark all of the arena's memory as unused, without freeing any blocks.
+ */
+
+void arena_reset(struct arena *arena);
+void arena_destroy(struct arena *arena);
+
+#endif /* ARENA_H */
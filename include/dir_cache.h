@@ -0,0 +1,95 @@
+//
+//  include/dir_cache.h
+//  tbd
+//
+//  Created by inoahdev on 3/22/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef DIR_CACHE_H
+#define DIR_CACHE_H
+
+#include <sys/types.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "hash_table.h"
+
+/*
+ * A dir_cache remembers the directories of the output-files written out in a
+ * run, so each directory is only created (or found to already exist) once,
+ * instead of probing the directory's hierarchy for every output-file.
+ *
+ * The most recently used directories are also kept open, so output-files can
+ * be created with openat() relative to their directory.
+ */
+
+#define DIR_CACHE_MAX_OPEN_DIRS 64
+
+struct dir_cache_entry {
+    char *path;
+    uint64_t length;
+
+    int fd;
+
+    bool exists;
+    bool was_created;
+};
+
+struct dir_cache {
+    struct dir_cache_entry *entries;
+    uint64_t entries_count;
+    uint64_t entries_capacity;
+
+    struct hash_table table;
+
+    /*
+     * The indexes of the entries with an open directory, in the order they
+     * were opened, with the first opened directory closed when a directory
+     * has to be opened while full.
+     */
+
+    uint32_t open_entries[DIR_CACHE_MAX_OPEN_DIRS];
+    uint32_t open_entries_front;
+    uint32_t open_entries_count;
+
+    struct arena arena;
+    pthread_mutex_t mutex;
+};
+
+void dir_cache_init(struct dir_cache *cache);
+
+/*
+ * Open (creating if necessary) the file at path, creating its directory's
+ * hierarchy if needed, like open_r().
+ *
+ * terminator_out is set to the slash after the first directory created, if
+ * any were created.
+ */
+
+int
+dir_cache_open_file(struct dir_cache *cache,
+                    char *path,
+                    uint64_t path_length,
+                    int flags,
+                    mode_t mode,
+                    mode_t dir_mode,
+                    char **terminator_out);
+
+/*
+ * Remove the file at path, and the directories created by
+ * dir_cache_open_file(), like remove_partial_r().
+ */
+
+int
+dir_cache_remove_partial(struct dir_cache *cache,
+                         char *path,
+                         uint64_t path_length,
+                         char *from);
+
+void dir_cache_destroy(struct dir_cache *cache);
+
+#endif /* DIR_CACHE_H */
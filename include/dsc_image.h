@@ -22,6 +22,8 @@ enum dsc_image_parse_result {
     E_DSC_IMAGE_PARSE_READ_FAIL,
 
     E_DSC_IMAGE_PARSE_NO_CORRESPONDING_MAPPING,
+    E_DSC_IMAGE_PARSE_SUBCACHE_MAP_FAIL,
+    E_DSC_IMAGE_PARSE_INVALID_SUBCACHE,
     E_DSC_IMAGE_PARSE_SIZE_TOO_SMALL,
 
     E_DSC_IMAGE_PARSE_INVALID_RANGE,
@@ -39,6 +41,7 @@ enum dsc_image_parse_result {
     E_DSC_IMAGE_PARSE_INVALID_SECTION,
 
     E_DSC_IMAGE_PARSE_INVALID_CLIENT,
+    E_DSC_IMAGE_PARSE_INVALID_EXPORT_TRIE,
     E_DSC_IMAGE_PARSE_INVALID_INSTALL_NAME,
     E_DSC_IMAGE_PARSE_INVALID_PARENT_UMBRELLA,
     E_DSC_IMAGE_PARSE_INVALID_PLATFORM,
@@ -58,9 +61,21 @@ enum dsc_image_parse_result {
 enum dsc_image_parse_result
 dsc_image_parse(struct tbd_create_info *info_in,
                 struct dyld_shared_cache_info *dsc_info,
-                struct dyld_cache_image_info *image,
+                const struct dyld_cache_image_info *image,
                 uint64_t macho_options,
                 uint64_t tbd_options,
                 uint64_t options);
 
+/*
+ * Record the sub-caches of every image's objc image-info and __LINKEDIT in a
+ * dyld_shared_cache split into sub-caches, which may be different from the
+ * sub-cache containing the image's header.
+ *
+ * Strings of an image's create-info may point into any of these sub-caches
+ * until the image is written out, so this has to be called before iterating
+ * over the images of a split dyld_shared_cache.
+ */
+
+void dsc_image_find_subcache_uses(struct dyld_shared_cache_info *dsc_info);
+
 #endif /* DSC_IMAGE_H */
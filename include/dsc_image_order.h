@@ -0,0 +1,126 @@
+//
+//  include/dsc_image_order.h
+//  tbd
+//
+//  Created by inoahdev on 3/27/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef DSC_IMAGE_ORDER_H
+#define DSC_IMAGE_ORDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "dyld_shared_cache.h"
+
+/*
+ * dsc_image_order lists the images of a dyld_shared_cache in the order their
+ * data is located in the file, instead of in the order of the image-table.
+ *
+ * The symbol-tables, string-tables, and export-tries of images are spread
+ * across the dyld_shared_cache's __LINKEDIT, so handling images in the order
+ * of the image-table reads the file at random. Ordering images by the offset
+ * of their __LINKEDIT data (and then by the offset of their header) makes
+ * reading them mostly sequential, which matters when the file isn't already
+ * in the page-cache.
+ *
+ * Each entry also stores the ranges of the file the image will be read from,
+ * so they can be read ahead of time with dsc_image_order_advise().
+ */
+
+enum dsc_image_order_range {
+    DSC_IMAGE_ORDER_RANGE_LOAD_COMMANDS,
+    DSC_IMAGE_ORDER_RANGE_EXPORT_TRIE,
+    DSC_IMAGE_ORDER_RANGE_SYMBOL_TABLE,
+    DSC_IMAGE_ORDER_RANGE_STRING_TABLE,
+
+    DSC_IMAGE_ORDER_RANGE_COUNT
+};
+
+struct dsc_image_order_entry {
+    uint32_t index;
+    uint64_t key;
+
+    /*
+     * The file-offsets of each range, with an empty range if the image has
+     * none.
+     */
+
+    uint64_t begin[DSC_IMAGE_ORDER_RANGE_COUNT];
+    uint64_t end[DSC_IMAGE_ORDER_RANGE_COUNT];
+};
+
+struct dsc_image_order {
+    struct dsc_image_order_entry *entries;
+    uint32_t count;
+};
+
+enum dsc_image_order_options {
+    /*
+     * Sort the images by the location of their data. Otherwise, the images are
+     * kept in the order of the image-table, and the order only stores their
+     * ranges.
+     */
+
+    O_DSC_IMAGE_ORDER_BY_FILE_OFFSET = 1 << 0,
+
+    /*
+     * Remove the pages read while creating the order from the map (but not the
+     * page-cache) every DSC_IMAGE_ORDER_RELEASE_COUNT images, and once done.
+     *
+     * The kernel maps in the pages around each fault, so reading the
+     * load-commands of every image otherwise leaves most of the map resident.
+     */
+
+    O_DSC_IMAGE_ORDER_RELEASE_PAGES = 1 << 1
+};
+
+#define DSC_IMAGE_ORDER_RELEASE_COUNT 32
+
+enum dsc_image_order_result {
+    E_DSC_IMAGE_ORDER_OK,
+    E_DSC_IMAGE_ORDER_ALLOC_FAIL
+};
+
+/*
+ * Return true if the image should be included in the order.
+ */
+
+typedef bool
+(*dsc_image_order_filter)(const struct dyld_cache_image_info *image,
+                          const char *path,
+                          void *item);
+
+/*
+ * Create an order of every image of dsc_info that passes filter.
+ *
+ * dsc_info must not be split into sub-caches, as sub-caches are only unmapped
+ * once every image before them in the image-table has been handled.
+ */
+
+enum dsc_image_order_result
+dsc_image_order_create(struct dsc_image_order *order_out,
+                       const struct dyld_shared_cache_info *dsc_info,
+                       dsc_image_order_filter filter,
+                       void *item,
+                       uint64_t options);
+
+/*
+ * Advise the kernel that the ranges of the images after position in the order
+ * will be needed soon, so they're read in ahead of time.
+ *
+ * Only does anything every DSC_IMAGE_ORDER_ADVISE_COUNT positions, advising
+ * the next DSC_IMAGE_ORDER_ADVISE_COUNT images at once.
+ */
+
+#define DSC_IMAGE_ORDER_ADVISE_COUNT 16
+
+void
+dsc_image_order_advise(const struct dsc_image_order *order,
+                       const struct dyld_shared_cache_info *dsc_info,
+                       uint32_t position);
+
+void dsc_image_order_destroy(struct dsc_image_order *order);
+
+#endif /* DSC_IMAGE_ORDER_H */
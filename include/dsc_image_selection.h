@@ -0,0 +1,93 @@
+//
+//  include/dsc_image_selection.h
+//  tbd
+//
+//  Created by inoahdev on 3/18/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef DSC_IMAGE_SELECTION_H
+#define DSC_IMAGE_SELECTION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "array.h"
+#include "hash_table.h"
+
+/*
+ * dsc_image_selection compiles the --image-path and --filter-image-name
+ * options provided for a dyld_shared_cache into hash-tables, so an image's
+ * path can be matched against them without comparing it to every path and
+ * filter.
+ *
+ * Exact paths are kept in a hash-set of the full path, while filters are kept
+ * in a hash-table of the component-name they match. Filters that aren't a
+ * single component (empty, or containing a slash) can't be indexed, and are
+ * instead matched with path_has_component().
+ *
+ * The selection also keeps track of which exact paths have been found, so the
+ * images can stop being iterated once every image was found.
+ */
+
+struct dsc_image_selection {
+    const struct array *filters;
+    const struct array *paths;
+
+    struct hash_table path_table;
+    struct hash_table filter_table;
+
+    uint32_t *unindexed_filters;
+    uint64_t unindexed_filters_count;
+
+    bool *found_paths;
+    uint64_t paths_left;
+
+    bool allows_hierarchy;
+};
+
+enum dsc_image_selection_result {
+    E_DSC_IMAGE_SELECTION_OK,
+    E_DSC_IMAGE_SELECTION_ALLOC_FAIL
+};
+
+enum dsc_image_selection_result
+dsc_image_selection_create(struct dsc_image_selection *selection,
+                           const struct array *filters,
+                           const struct array *paths,
+                           bool allows_hierarchy);
+
+/*
+ * Find the flags of the path, or else of the first filter, that selects the
+ * image at path, or return NULL if the image isn't selected.
+ *
+ * path_index_out is set to the index of the path if the image was selected by
+ * an exact path, and to -1 otherwise.
+ */
+
+uint64_t *
+dsc_image_selection_find(const struct dsc_image_selection *selection,
+                         const char *path,
+                         int64_t *path_index_out);
+
+/*
+ * Mark the flags (and path, if path_index isn't -1) returned by
+ * dsc_image_selection_find() as having found an image.
+ */
+
+void
+dsc_image_selection_mark_found(struct dsc_image_selection *selection,
+                               uint64_t *flags,
+                               int64_t path_index);
+
+/*
+ * Returns whether no more images can be selected, which is only the case when
+ * there are no filters, and every exact path has been found.
+ */
+
+bool
+dsc_image_selection_is_complete(const struct dsc_image_selection *selection);
+
+void dsc_image_selection_destroy(struct dsc_image_selection *selection);
+
+#endif /* DSC_IMAGE_SELECTION_H */
@@ -0,0 +1,103 @@
+//
+//  include/dsc_page_release.h
+//  tbd
+//
+//  Created by inoahdev on 3/27/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef DSC_PAGE_RELEASE_H
+#define DSC_PAGE_RELEASE_H
+
+#include <stdint.h>
+
+#include "dsc_image_order.h"
+#include "dyld_shared_cache.h"
+
+/*
+ * dsc_page_release gives back the pages of a dyld_shared_cache's map once
+ * every image in an order that reads from them has been extracted, so that the
+ * resident memory of extracting a whole dyld_shared_cache follows the images
+ * being extracted, instead of growing to the size of the dyld_shared_cache.
+ *
+ * Each page read by an image (through the image's load-commands, export-trie,
+ * symbol-table, or string-table) is owned by the last image in the order that
+ * reads it. Once every image up to an owner is done, its pages are removed
+ * from the map with madvise(MADV_DONTNEED), and dropped from the page-cache
+ * with posix_fadvise(POSIX_FADV_DONTNEED).
+ *
+ * As the map is read-only, a released page that's read again is just read
+ * back in from the file.
+ */
+
+struct dsc_page_release {
+    uint8_t *map;
+    uint64_t size;
+
+    int fd;
+    uint64_t page_size;
+
+    /*
+     * The tracked page-numbers, grouped by the position of the image that owns
+     * them, with the group of the image at position i being the page-numbers
+     * from owner_starts[i] to owner_starts[i + 1].
+     */
+
+    uint64_t *pages;
+    uint64_t *owner_starts;
+
+    /*
+     * Every image before done_position is done, and the pages owned by every
+     * image before released_position have been released.
+     */
+
+    uint32_t done_position;
+    uint32_t released_position;
+
+    /*
+     * The size of the pages of done images that haven't been released yet,
+     * which are only released once more than max_size.
+     */
+
+    uint64_t pending_size;
+    uint64_t max_size;
+};
+
+enum dsc_page_release_result {
+    E_DSC_PAGE_RELEASE_OK,
+    E_DSC_PAGE_RELEASE_ALLOC_FAIL
+};
+
+/*
+ * Create a page-release for the images of order, which must have been created
+ * from dsc_info. fd is the file dsc_info was mapped from.
+ *
+ * Pages of done images are kept until more than max_size of them are pending
+ * release, with a max_size of 0 releasing the pages as soon as possible.
+ */
+
+enum dsc_page_release_result
+dsc_page_release_create(struct dsc_page_release *release_out,
+                        const struct dyld_shared_cache_info *dsc_info,
+                        const struct dsc_image_order *order,
+                        int fd,
+                        uint64_t max_size);
+
+/*
+ * Mark every image before position in the order as done, releasing the pages
+ * owned by them if needed.
+ *
+ * Positions are only ever increased, and lower positions are ignored.
+ */
+
+void
+dsc_page_release_set_done(struct dsc_page_release *release, uint32_t position);
+
+/*
+ * Release the pages of every image that's done, regardless of max_size.
+ */
+
+void dsc_page_release_flush(struct dsc_page_release *release);
+void dsc_page_release_destroy(struct dsc_page_release *release);
+
+#endif /* DSC_PAGE_RELEASE_H */
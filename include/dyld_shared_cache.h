@@ -9,14 +9,15 @@
 #ifndef DYLD_SHARED_CACHE_H
 #define DYLD_SHARED_CACHE_H
 
+#include <pthread.h>
 #include <stdbool.h>
+
 #include "mach/machine.h"
 
 #include "dyld_shared_cache_format.h"
 
 enum dyld_shared_cache_parse_options {
-    O_DYLD_SHARED_CACHE_PARSE_ZERO_IMAGE_PADS           = 1 << 0,
-    O_DYLD_SHARED_CACHE_PARSE_VERIFY_IMAGE_PATH_OFFSETS = 1 << 1
+    O_DYLD_SHARED_CACHE_PARSE_VERIFY_IMAGE_PATH_OFFSETS = 1 << 0
 };
 
 enum dyld_shared_cache_flags {
@@ -39,11 +40,58 @@ enum dyld_shared_cache_parse_result {
 
     E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_RANGES,
     E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_IMAGES,
-    E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS
+    E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS,
+
+    E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES,
+    E_DYLD_SHARED_CACHE_PARSE_MISSING_SUBCACHE,
+
+    E_DYLD_SHARED_CACHE_PARSE_NO_MAPPING
+};
+
+/*
+ * A sub-cache file of a dyld_shared_cache split into multiple files.
+ *
+ * Sub-caches are only mapped once an address inside them is first looked up,
+ * and are unmapped again once every image located in them has been iterated
+ * over, and they're no longer in use.
+ */
+
+struct dyld_shared_cache_subcache {
+    char *path;
+    uint8_t uuid[16];
+
+    /*
+     * The addresses the sub-cache's mappings start at, and the start of the
+     * next sub-cache.
+     */
+
+    uint64_t address;
+    uint64_t end_address;
+
+    const struct dyld_cache_mapping_info *mappings;
+    uint32_t mappings_count;
+
+    uint8_t *map;
+    uint64_t size;
+
+    /*
+     * The number of locations currently in use, and the index of the last
+     * image with its mach-o header, objc image-info or __LINKEDIT in the
+     * sub-cache, or -1 if no image has.
+     */
+
+    uint32_t users;
+    int64_t last_use_index;
 };
 
+/*
+ * The dyld_shared_cache is mapped read-only, so that its pages stay clean and
+ * can be shared with other processes mapping the same dyld_shared_cache. Any
+ * state kept per-image has to be stored outside of the map.
+ */
+
 struct dyld_shared_cache_info {
-    struct dyld_cache_image_info *images;
+    const struct dyld_cache_image_info *images;
     uint32_t images_count;
 
     /*
@@ -60,6 +108,36 @@ struct dyld_shared_cache_info {
 
     uint64_t arch_bit;
     uint64_t flags;
+
+    /*
+     * The sub-cache entries of the main cache-file, and the sub-caches found
+     * from them with dyld_shared_cache_find_subcaches().
+     */
+
+    const uint8_t *subcache_entries;
+    uint32_t subcache_entries_count;
+    uint32_t subcache_entry_size;
+
+    struct dyld_shared_cache_subcache *subcaches;
+    uint32_t subcaches_count;
+
+    pthread_mutex_t subcaches_mutex;
+};
+
+/*
+ * Where an address of the dyld_shared_cache was found: the map of the file
+ * containing it, the file-offset of the address, and the maximum size
+ * available from there, as found from the mapping containing it.
+ */
+
+struct dyld_shared_cache_location {
+    const uint8_t *map;
+    uint64_t map_size;
+
+    uint64_t file_offset;
+    uint64_t max_size;
+
+    struct dyld_shared_cache_subcache *subcache;
 };
 
 enum dyld_shared_cache_parse_result
@@ -75,23 +153,90 @@ dyld_shared_cache_parse_from_range(struct dyld_shared_cache_info *info_in,
                                    uint64_t end,
                                    uint64_t options); 
 
+/*
+ * Find the sub-cache files of a dyld_shared_cache split into multiple files,
+ * which are located next to the main cache-file at path.
+ *
+ * The sub-caches are not opened or mapped until needed.
+ */
+
+enum dyld_shared_cache_parse_result
+dyld_shared_cache_find_subcaches(struct dyld_shared_cache_info *info_in,
+                                 const char *path);
+
+/*
+ * Find the location of address in the dyld_shared_cache, mapping in the
+ * sub-cache containing it if needed.
+ *
+ * Every location found has to be released with
+ * dyld_shared_cache_release_location() once no longer in use.
+ */
+
+enum dyld_shared_cache_parse_result
+dyld_shared_cache_find_location(
+    struct dyld_shared_cache_info *info,
+    uint64_t address,
+    struct dyld_shared_cache_location *location_out);
+
+void
+dyld_shared_cache_release_location(
+    struct dyld_shared_cache_info *info,
+    const struct dyld_shared_cache_location *location);
+
+/*
+ * Record that the image at image_index uses the sub-cache containing address,
+ * so the sub-cache isn't unmapped before the image is done.
+ *
+ * dyld_shared_cache_find_subcaches() only records the sub-cache containing the
+ * mach-o header of each image. The sub-caches of an image's other segments
+ * have to be recorded by the caller before the images are iterated over.
+ */
+
+void
+dyld_shared_cache_set_subcache_use(struct dyld_shared_cache_info *info,
+                                   uint64_t address,
+                                   uint64_t image_index);
+
+/*
+ * Unmap every sub-cache that is not in use and is only used by images before
+ * the image at image_index, as images are iterated over in order.
+ */
+
+void
+dyld_shared_cache_release_subcaches_before(struct dyld_shared_cache_info *info,
+                                           uint64_t image_index);
+
 /*
  * dyld_shared_cache_iterate_images_with_callback callback.
  * Return true to continue iterating, false to stop.
+ *
+ * Sub-caches are released after each image is iterated over.
  */
 
 typedef bool 
 (*dyld_shared_cache_iterate_images_callback)(
-    struct dyld_cache_image_info *image,
+    const struct dyld_cache_image_info *image,
     const char *path,
     void *item);
 
 enum dyld_shared_cache_parse_result
 dyld_shared_cache_iterate_images_with_callback(
-    const struct dyld_shared_cache_info *info_in,
+    struct dyld_shared_cache_info *info_in,
     void *item,
     dyld_shared_cache_iterate_images_callback callback);
 
+/*
+ * Get the file-offset of the provided address, and the maximum size available
+ * from there, from the mapping containing it, or return 0 if no mapping
+ * contains it.
+ */
+
+uint64_t
+dyld_shared_cache_get_file_offset_from_address(
+    const struct dyld_shared_cache_info *info,
+    uint64_t address,
+    uint64_t *size_out);
+
 void
 dyld_shared_cache_print_list_of_images(int fd,
                                        uint64_t start,
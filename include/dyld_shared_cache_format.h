@@ -24,6 +24,46 @@ struct dyld_cache_header {
     uint64_t dyldBaseAddress;
 };
 
+/*
+ * Newer dyld_shared_caches have a much larger header, which is split into a
+ * main cache-file and several sub-cache files. A field of the larger header is
+ * only present if the header, which ends where the mapping-infos begin, is
+ * large enough to contain it.
+ *
+ * Only the fields needed are listed here, along with their offsets.
+ */
+
+#define DYLD_CACHE_HEADER_UUID_OFFSET 0x58
+#define DYLD_CACHE_HEADER_SUBCACHES_OFFSET 0x188
+#define DYLD_CACHE_HEADER_IMAGES_OFFSET 0x1c0
+#define DYLD_CACHE_HEADER_CACHE_SUB_TYPE_OFFSET 0x1c8
+
+struct dyld_cache_header_subcaches {
+    uint32_t subCacheArrayOffset;
+    uint32_t subCacheArrayCount;
+};
+
+struct dyld_cache_header_images {
+    uint32_t imagesOffset;
+    uint32_t imagesCount;
+};
+
+/*
+ * Caches whose header ends before cacheSubType use the first version of the
+ * sub-cache entries, whose files have the suffix ".<index + 1>".
+ */
+
+struct dyld_subcache_entry_v1 {
+    uint8_t uuid[16];
+    uint64_t cacheVMOffset;
+};
+
+struct dyld_subcache_entry {
+    uint8_t uuid[16];
+    uint64_t cacheVMOffset;
+    char fileSuffix[32];
+};
+
 struct dyld_cache_mapping_info {
     uint64_t address;
     uint64_t size;
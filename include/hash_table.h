@@ -0,0 +1,89 @@
+//
+//  include/hash_table.h
+//  tbd
+//
+//  Created by inoahdev on 3/27/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define HASH_STRING_BASIS 2166136261u
+
+/*
+ * Hash a string with FNV-1a, starting from the provided basis, so that other
+ * data (such as a type) can be mixed into the hash.
+ */
+
+uint32_t
+hash_string_with_basis(uint32_t basis, const char *string, uint64_t length);
+
+uint32_t hash_string(const char *string, uint64_t length);
+
+/*
+ * hash_table is an open-addressing hash-table of indexes into an array owned
+ * by the caller, with the array's items compared by a matches callback.
+ *
+ * The capacity is always a power of 2, and is kept at least double the count,
+ * so probe sequences stay short. A slot with an index of 0 is empty, and every
+ * other slot stores its item's index plus one.
+ */
+
+struct hash_table_slot {
+    uint32_t hash;
+    uint32_t index;
+};
+
+struct hash_table {
+    struct hash_table_slot *slots;
+
+    uint64_t capacity;
+    uint64_t count;
+};
+
+/*
+ * Return whether the item at index (into the caller's array) matches the key
+ * described by info.
+ */
+
+typedef bool (*hash_table_matches_func)(const void *info, uint32_t index);
+
+/*
+ * Ensure count items can be stored, growing the table if needed. Returns false
+ * if the slots couldn't be allocated, leaving the table unchanged.
+ */
+
+bool hash_table_reserve(struct hash_table *table, uint64_t count);
+
+/*
+ * Find the slot of the item matching info, or the empty slot an item with the
+ * provided hash should be inserted at.
+ *
+ * The table must have a capacity, either from an earlier reserve, or from
+ * checking that the table isn't empty.
+ */
+
+struct hash_table_slot *
+hash_table_find_slot(const struct hash_table *table,
+                     uint32_t hash,
+                     hash_table_matches_func matches,
+                     const void *info);
+
+/*
+ * Store the item at index (into the caller's array) in an empty slot returned
+ * by hash_table_find_slot().
+ */
+
+void
+hash_table_set_slot(struct hash_table *table,
+                    struct hash_table_slot *slot,
+                    uint32_t hash,
+                    uint32_t index);
+
+void hash_table_destroy(struct hash_table *table);
+
+#endif /* HASH_TABLE_H */
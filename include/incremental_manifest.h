@@ -0,0 +1,136 @@
+//
+//  include/incremental_manifest.h
+//  tbd
+//
+//  Created by inoahdev on 3/20/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef INCREMENTAL_MANIFEST_H
+#define INCREMENTAL_MANIFEST_H
+
+#include <sys/stat.h>
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "array.h"
+#include "hash_table.h"
+
+/*
+ * An incremental_manifest records, for every mach-o file written out while
+ * recursing, the input-file's size, modification-time and uuids, along with
+ * the output-file it was written to.
+ *
+ * On the next run with the same arguments, input-files whose size and
+ * modification-time haven't changed (and whose output-file still exists) are
+ * skipped entirely.
+ *
+ * The uuids are only recorded, and never used to skip rewriting an output-file,
+ * as a mach-o file can be changed without its uuids changing.
+ *
+ * Outputs of input-files that no longer produce a tbd, whether they no longer
+ * exist, were skipped, or failed to parse, are removed when the manifest is
+ * saved.
+ */
+
+enum incremental_manifest_entry_state {
+    INCREMENTAL_MANIFEST_ENTRY_UNSEEN,
+    INCREMENTAL_MANIFEST_ENTRY_KEEP,
+    INCREMENTAL_MANIFEST_ENTRY_DROP,
+    INCREMENTAL_MANIFEST_ENTRY_REMOVED
+};
+
+struct incremental_manifest_entry {
+    const char *input_path;
+    const char *output_path;
+
+    uint64_t size;
+
+    int64_t mtime;
+    int64_t mtime_nsec;
+
+    const uint8_t *uuids;
+    uint32_t uuids_count;
+
+    enum incremental_manifest_entry_state state;
+};
+
+struct incremental_manifest {
+    const char *path;
+    uint64_t arguments_hash;
+
+    /*
+     * The entries from the last run are only read once loaded, and can be
+     * looked up without locking. Entries recorded in this run are added under
+     * the mutex, as they may be recorded by multiple jobs at once.
+     */
+
+    char *data;
+    struct array entries;
+
+    struct hash_table table;
+
+    struct array new_entries;
+    struct arena arena;
+
+    pthread_mutex_t mutex;
+};
+
+enum incremental_manifest_result {
+    E_INCREMENTAL_MANIFEST_OK,
+    E_INCREMENTAL_MANIFEST_ALLOC_FAIL,
+
+    E_INCREMENTAL_MANIFEST_OPEN_FAIL,
+    E_INCREMENTAL_MANIFEST_READ_FAIL,
+    E_INCREMENTAL_MANIFEST_WRITE_FAIL
+};
+
+/*
+ * Hash the arguments tbd was run with, skipping the ones that don't affect
+ * the tbds written out (--incremental and --jobs).
+ */
+
+uint64_t
+incremental_manifest_hash_arguments(int argc, const char *const argv[]);
+
+/*
+ * Load the manifest at path. A missing manifest, or one written with different
+ * arguments, results in an empty manifest.
+ */
+
+enum incremental_manifest_result
+incremental_manifest_load(struct incremental_manifest *manifest,
+                          const char *path,
+                          uint64_t arguments_hash);
+
+/*
+ * Returns whether the input-file at path, with the provided stat-info, is
+ * unchanged since the last run, and its output-file still exists.
+ */
+
+bool
+incremental_manifest_is_unchanged(struct incremental_manifest *manifest,
+                                  const char *path,
+                                  const struct stat *sbuf);
+
+void
+incremental_manifest_record(struct incremental_manifest *manifest,
+                            const char *path,
+                            const char *write_path,
+                            const struct stat *sbuf,
+                            const struct array *uuids);
+
+/*
+ * Write out the manifest, and remove the output-files of input-files that no
+ * longer produce a tbd.
+ */
+
+enum incremental_manifest_result
+incremental_manifest_save(struct incremental_manifest *manifest);
+
+void incremental_manifest_destroy(struct incremental_manifest *manifest);
+
+#endif /* INCREMENTAL_MANIFEST_H */
@@ -0,0 +1,115 @@
+//
+//  include/macho_dedup.h
+//  tbd
+//
+//  Created by inoahdev on 3/21/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef MACHO_DEDUP_H
+#define MACHO_DEDUP_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "array.h"
+
+/*
+ * A macho_dedup tracks the mach-o files written out while recursing, so that
+ * later copies of the same mach-o file can have the already written tbd copied
+ * over, instead of being parsed and written out again.
+ *
+ * Files are keyed by their size and the uuids found in their load-commands, as
+ * a rebuilt mach-o file gets new uuids. Only files without uuids are keyed by
+ * a hash of their contents instead.
+ */
+
+struct macho_dedup_key {
+    uint64_t size;
+    uint64_t hash;
+
+    uint8_t *uuids;
+    uint32_t uuids_count;
+};
+
+struct macho_dedup_entry {
+    const char *input_path;
+    const char *output_path;
+
+    uint64_t size;
+    uint64_t hash;
+
+    const uint8_t *uuids;
+    uint32_t uuids_count;
+
+    /*
+     * The uuid-infos of the tbd written out, so copies of the tbd can be
+     * recorded with the same uuids.
+     */
+
+    struct array tbd_uuids;
+};
+
+struct macho_dedup {
+    struct macho_dedup_entry *entries;
+
+    uint64_t count;
+    uint64_t capacity;
+
+    struct arena arena;
+    pthread_mutex_t mutex;
+};
+
+enum macho_dedup_result {
+    E_MACHO_DEDUP_OK,
+
+    E_MACHO_DEDUP_FSTAT_FAIL,
+    E_MACHO_DEDUP_MMAP_FAIL,
+
+    E_MACHO_DEDUP_NOT_A_MACHO
+};
+
+void macho_dedup_init(struct macho_dedup *dedup);
+
+/*
+ * Create the key for the file at fd, without changing the file's offset.
+ */
+
+enum macho_dedup_result
+macho_dedup_create_key(int fd, struct macho_dedup_key *key);
+
+/*
+ * Find an earlier file with the same key as the provided key, and open the
+ * output-file its tbd was written to.
+ *
+ * tbd_uuids_out is set to the uuid-infos of the earlier file's tbd, which stay
+ * valid until the macho_dedup is destroyed.
+ *
+ * Returns -1 if there's no such file, or its output-file couldn't be opened.
+ */
+
+int
+macho_dedup_open_original_output(struct macho_dedup *dedup,
+                                 const struct macho_dedup_key *key,
+                                 struct array *tbd_uuids_out);
+
+/*
+ * Add the file at input_path, whose tbd (with the provided uuid-infos) was
+ * written out to output_path.
+ *
+ * If an earlier file with the same key was already added, the earlier file is
+ * kept instead.
+ */
+
+void
+macho_dedup_add(struct macho_dedup *dedup,
+                const struct macho_dedup_key *key,
+                const char *input_path,
+                const char *output_path,
+                const struct array *tbd_uuids);
+
+void macho_dedup_key_destroy(struct macho_dedup_key *key);
+void macho_dedup_destroy(struct macho_dedup *dedup);
+
+#endif /* MACHO_DEDUP_H */
@@ -81,6 +81,7 @@ enum macho_file_parse_result {
     E_MACHO_FILE_PARSE_INVALID_SECTION,
 
     E_MACHO_FILE_PARSE_INVALID_CLIENT,
+    E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE,
     E_MACHO_FILE_PARSE_INVALID_INSTALL_NAME,
     E_MACHO_FILE_PARSE_INVALID_PARENT_UMBRELLA,
     E_MACHO_FILE_PARSE_INVALID_PLATFORM,
@@ -17,9 +17,18 @@
 #include "macho_file.h"
 #include "range.h"
 
+/*
+ * symtab_out and export_trie_out, if not NULL, are filled with the
+ * symbol-table and export-trie info found, swapped to the host's byte-order.
+ *
+ * map is the map of the whole file if it's mapped, or NULL if the
+ * load-commands should instead be read from fd.
+ */
+
 enum macho_file_parse_result 
 macho_file_parse_load_commands_from_file(struct tbd_create_info *info,
                                          int fd,
+                                         const uint8_t *map,
                                          struct range range,
                                          const struct arch_info *arch,
                                          uint64_t arch_bit,
@@ -29,7 +38,9 @@ macho_file_parse_load_commands_from_file(struct tbd_create_info *info,
                                          uint32_t sizeofcmds,
                                          uint64_t tbd_options,
                                          uint64_t options,
-                                         struct symtab_command *symtab_out);
+                                         struct symtab_command *symtab_out,
+                                         struct linkedit_data_command
+                                            *export_trie_out);
 
 enum macho_file_parse_result 
 macho_file_parse_load_commands_from_map(struct tbd_create_info *info,
@@ -45,6 +56,8 @@ macho_file_parse_load_commands_from_map(struct tbd_create_info *info,
                                         uint32_t sizeofcmds,
                                         uint64_t tbd_options,
                                         uint64_t options,
-                                        struct symtab_command *symtab_out);
+                                        struct symtab_command *symtab_out,
+                                        struct linkedit_data_command
+                                            *export_trie_out);
 
 #endif /* MACHO_FILE_PARSE_LOAD_COMMANDS_H */
@@ -9,14 +9,23 @@
 #ifndef MACHO_FILE_PARSE_SYMBOLS_H
 #define MACHO_FILE_PARSE_SYMBOLS_H
 
+#include <stdbool.h>
 #include <stdio.h>
 
+#include "mach-o/loader.h"
+
 #include "macho_file.h"
 #include "range.h"
 
+/*
+ * The *_from_file functions take the map of the whole file if it's mapped, or
+ * NULL if the symbol-table and string-table should instead be read from fd.
+ */
+
 enum macho_file_parse_result
 macho_file_parse_symbols_from_file(struct tbd_create_info *info,
                                    int fd,
+                                   const uint8_t *map,
                                    struct range range,
                                    uint64_t arch_bit,
                                    bool is_big_endian,
@@ -29,6 +38,7 @@ macho_file_parse_symbols_from_file(struct tbd_create_info *info,
 enum macho_file_parse_result
 macho_file_parse_symbols_64_from_file(struct tbd_create_info *info,
                                       int fd,
+                                      const uint8_t *map,
                                       struct range range,
                                       uint64_t arch_bit,
                                       bool is_big_endian,
@@ -48,7 +58,8 @@ macho_file_parse_symbols_from_map(struct tbd_create_info *info,
                                   uint32_t nsyms,
                                   uint32_t stroff,
                                   uint32_t strsize,
-                                  uint64_t tbd_options);
+                                  uint64_t tbd_options,
+                                  uint64_t options);
 
 enum macho_file_parse_result
 macho_file_parse_symbols_64_from_map(struct tbd_create_info *info,
@@ -60,6 +71,40 @@ macho_file_parse_symbols_64_from_map(struct tbd_create_info *info,
                                      uint32_t nsyms,
                                      uint32_t stroff,
                                      uint32_t strsize,
-                                     uint64_t tbd_options);
+                                     uint64_t tbd_options,
+                                     uint64_t options);
+
+/*
+ * The export-trie (from either LC_DYLD_INFO(_ONLY) or LC_DYLD_EXPORTS_TRIE)
+ * only lists exported symbols, so it can be parsed instead of the symbol-table
+ * only when no private symbols were requested.
+ *
+ * export_trie is expected to have already been swapped to the host's
+ * byte-order, with cmd set to 0 if no export-trie was found.
+ */
+
+bool
+macho_file_can_parse_export_trie(
+    const struct linkedit_data_command *export_trie,
+    uint64_t tbd_options);
+
+enum macho_file_parse_result
+macho_file_parse_export_trie_from_file(struct tbd_create_info *info,
+                                       int fd,
+                                       const uint8_t *map,
+                                       struct range range,
+                                       uint64_t arch_bit,
+                                       uint32_t exports_off,
+                                       uint32_t exports_size,
+                                       uint64_t tbd_options);
+
+enum macho_file_parse_result
+macho_file_parse_export_trie_from_map(struct tbd_create_info *info,
+                                      const uint8_t *map,
+                                      uint64_t size,
+                                      uint64_t arch_bit,
+                                      uint32_t exports_off,
+                                      uint32_t exports_size,
+                                      uint64_t tbd_options);
 
 #endif /* MACHO_FILE_PARSE_SYMBOLS_H */
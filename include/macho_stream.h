@@ -0,0 +1,50 @@
+//
+//  include/macho_stream.h
+//  tbd
+//
+//  Created by inoahdev on 3/26/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef MACHO_STREAM_H
+#define MACHO_STREAM_H
+
+#include <stdint.h>
+#include "macho_file.h"
+
+/*
+ * macho_stream_map is a stand-in for a file's map when the mach-o file is read
+ * from a stream that can neither be seeked nor mapped, like a pipe.
+ *
+ * The stream is read strictly forward, and only the parts of the file the
+ * parser accesses (the headers, load-commands, objc image-info, and either
+ * the export-trie or the symbol and string tables) are kept. These parts are
+ * copied into an anonymous mapping of the stream's full size, at the same
+ * offsets they have in the file, so the mapped parsing paths can be used as
+ * is. Every other page of the mapping is never touched, and so never takes
+ * up any memory.
+ */
+
+struct macho_stream_map {
+    uint8_t *map;
+    uint64_t size;
+};
+
+/*
+ * Read the mach-o file in fd, whose magic has already been read, into a
+ * stream-map.
+ *
+ * Parts of the file that are located before a part read earlier can't be
+ * read, in which case E_MACHO_FILE_PARSE_SEEK_FAIL is returned.
+ */
+
+enum macho_file_parse_result
+macho_stream_map_create(struct macho_stream_map *map_out,
+                        int fd,
+                        uint32_t magic,
+                        uint64_t tbd_options,
+                        uint64_t options);
+
+void macho_stream_map_destroy(struct macho_stream_map *map);
+
+#endif /* MACHO_STREAM_H */
@@ -0,0 +1,101 @@
+//
+//  include/ordered_jobs.h
+//  tbd
+//
+//  Created by inoahdev on 3/9/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef ORDERED_JOBS_H
+#define ORDERED_JOBS_H
+
+#include <pthread.h>
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * ordered_jobs allows items (images, files, etc.) to be handled by multiple
+ * workers in parallel, while still doing the parts of handling an item that
+ * depend on order (printing errors, requesting user-input, opening
+ * output-files) in the order of the items.
+ *
+ * Each item has an index, and the worker handling an item waits for the item's
+ * turn before doing any order-dependent work.
+ */
+
+struct ordered_jobs {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+
+    uint64_t next_index;
+    uint64_t turn_index;
+
+    bool stopped;
+
+    /*
+     * The path of the output-file each worker is currently writing to, so no
+     * two workers ever write to the same file at once.
+     */
+
+    const char **write_paths;
+    uint32_t workers_count;
+};
+
+enum ordered_jobs_result {
+    E_ORDERED_JOBS_OK,
+    E_ORDERED_JOBS_ALLOC_FAIL
+};
+
+enum ordered_jobs_result
+ordered_jobs_init(struct ordered_jobs *jobs, uint32_t workers_count);
+
+/*
+ * Claim the next index below count, returning false if none are left.
+ */
+
+bool
+ordered_jobs_claim_index(struct ordered_jobs *jobs,
+                         uint64_t count,
+                         uint64_t *index_out);
+
+void ordered_jobs_wait_for_turn(struct ordered_jobs *jobs, uint64_t index);
+void ordered_jobs_end_turn(struct ordered_jobs *jobs);
+
+/*
+ * Stop any more indexes from being claimed. Indexes that were already claimed
+ * still get their turn.
+ */
+
+void ordered_jobs_stop(struct ordered_jobs *jobs);
+
+/*
+ * Set the path of the output-file the worker is writing to, first waiting for
+ * any other worker writing to the same path to finish.
+ *
+ * Provide NULL once the worker has finished writing.
+ */
+
+void
+ordered_jobs_set_write_path(struct ordered_jobs *jobs,
+                            uint32_t worker_index,
+                            const char *write_path);
+
+/*
+ * Call routine for each worker, on a separate thread for all except the first
+ * worker, which is called on the current thread.
+ *
+ * If a thread fails to be created, the remaining workers aren't called, and
+ * their items are left for the workers that were.
+ */
+
+void
+ordered_jobs_run(void *workers,
+                 size_t worker_size,
+                 uint32_t workers_count,
+                 void *(*routine)(void *));
+
+void ordered_jobs_destroy(struct ordered_jobs *jobs);
+
+#endif /* ORDERED_JOBS_H */
@@ -9,8 +9,25 @@
 #ifndef PARSE_MACHO_FOR_MAIN_H
 #define PARSE_MACHO_FOR_MAIN_H
 
+#include "macho_file.h"
 #include "tbd_for_main.h"
 
+/*
+ * Parse the mach-o file into the tbd's create-info, without handling the
+ * parse-result or writing out the tbd.
+ *
+ * If the file isn't a mach-o file, E_MACHO_FILE_PARSE_NOT_A_MACHO is returned,
+ * with the magic read stored in magic_in.
+ *
+ * magic_in should be atleast 4 bytes large.
+ */
+
+enum macho_file_parse_result
+parse_macho_file_into_info(struct tbd_for_main *tbd,
+                           int fd,
+                           void *magic_in,
+                           uint64_t *magic_in_size_in);
+
 /*
  * magic_in should be atleast 4 bytes large.
  */
@@ -0,0 +1,35 @@
+//
+//  include/recurse_dir_for_main.h
+//  tbd
+//
+//  Created by inoahdev on 3/9/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef RECURSE_DIR_FOR_MAIN_H
+#define RECURSE_DIR_FOR_MAIN_H
+
+#include "dir_recurse.h"
+#include "tbd_for_main.h"
+
+/*
+ * Recurse the tbd's parse-path with tbd->jobs workers, with files parsed and
+ * written out in parallel, while a separate thread walks the directory.
+ *
+ * Files are handled in the order they're found in, so that the output (and any
+ * errors printed or user-input requested) is the same as when recursing with
+ * dir_recurse().
+ *
+ * If the walking-thread can't be created, the directory is instead recursed on
+ * the current thread with dir_recurse(), callback and fail_callback.
+ */
+
+enum dir_recurse_result
+recurse_directory_with_jobs(struct tbd_for_main *global,
+                            struct tbd_for_main *tbd,
+                            uint64_t *retained_info_in,
+                            void *callback_info,
+                            dir_recurse_callback callback,
+                            dir_recurse_fail_callback fail_callback);
+
+#endif /* RECURSE_DIR_FOR_MAIN_H */
@@ -0,0 +1,81 @@
+//
+//  include/stats.h
+//  tbd
+//
+//  Created by inoahdev on 3/25/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Statistics collected with --stats: the time spent in each phase of parsing
+ * and writing, and counters for the work done.
+ *
+ * Every thread collects its own statistics, which are only summed up when
+ * printed out, so collecting them needs no locking. Nothing is collected
+ * until stats_enable() is called.
+ */
+
+enum stats_phase {
+    STATS_PHASE_WALK,
+    STATS_PHASE_MAGIC,
+    STATS_PHASE_LOAD_COMMANDS,
+    STATS_PHASE_SYMBOLS,
+    STATS_PHASE_SORT_EXPORTS,
+    STATS_PHASE_RENDER,
+    STATS_PHASE_OPEN_OUTPUT,
+    STATS_PHASE_WRITE_OUTPUT,
+    STATS_PHASE_OTHER,
+
+    STATS_PHASE_COUNT
+};
+
+enum stats_counter {
+    STATS_COUNTER_FILES_SEEN,
+    STATS_COUNTER_FILES_SKIPPED,
+    STATS_COUNTER_TBDS_WRITTEN,
+
+    STATS_COUNTER_SYMBOLS_SCANNED,
+    STATS_COUNTER_SYMBOLS_KEPT,
+
+    STATS_COUNTER_BYTES_READ,
+    STATS_COUNTER_BYTES_MAPPED,
+
+    STATS_COUNTER_ALLOCATIONS,
+
+    STATS_COUNTER_COUNT
+};
+
+/*
+ * Start collecting statistics. Must be called before any other threads are
+ * created.
+ */
+
+void stats_enable(void);
+
+void stats_add(enum stats_counter counter, uint64_t amount);
+
+/*
+ * Phases nest, with the time spent in a nested phase only counted for the
+ * nested phase. Every call to stats_begin_phase() must be paired with a call
+ * to stats_end_phase() on the same thread.
+ */
+
+void stats_begin_phase(enum stats_phase phase);
+void stats_end_phase(void);
+
+/*
+ * Print out the statistics of every thread. Must only be called once every
+ * other thread has exited.
+ */
+
+void stats_print(FILE *file);
+void stats_destroy(void);
+
+#endif /* STATS_H */
@@ -12,7 +12,9 @@
 #include <stdio.h>
 
 #include "arch_info.h"
+#include "arena.h"
 #include "array.h"
+#include "hash_table.h"
 
 /*
  * Options to handle when parsing out information for tbd_create_info.
@@ -114,7 +116,21 @@ enum tbd_create_info_flags {
     F_TBD_CREATE_INFO_INSTALL_NAME_NEEDS_QUOTES    = 1 << 0,
     F_TBD_CREATE_INFO_PARENT_UMBRELLA_NEEDS_QUOTES = 1 << 1,
 
-    F_TBD_CREATE_INFO_STRINGS_WERE_COPIED = 1 << 2,
+    /*
+     * Set when the install-name or parent-umbrella was allocated separately
+     * (when provided by the user), and so has to be freed. Strings copied while
+     * parsing are stored in the arena instead.
+     */
+
+    F_TBD_CREATE_INFO_INSTALL_NAME_WAS_COPIED    = 1 << 2,
+    F_TBD_CREATE_INFO_PARENT_UMBRELLA_WAS_COPIED = 1 << 3,
+
+    /*
+     * Set once an arch of a mach-o file was parsed, so the flags of later
+     * archs can be checked against it.
+     */
+
+    F_TBD_CREATE_INFO_PARSED_AN_ARCH = 1 << 4
 };
 
 struct tbd_create_info {
@@ -139,9 +155,47 @@ struct tbd_create_info {
     struct array exports;
     struct array uuids;
 
+    /*
+     * A hash-table of indexes into the exports-array, keyed on the type and
+     * string of each export-info, so the archs of an export found in multiple
+     * archs can be merged without the exports-array being kept sorted.
+     */
+
+    struct hash_table export_index;
     uint64_t flags;
+
+    /*
+     * Holds the strings copied while parsing (the install-name,
+     * parent-umbrella, and the export-strings), which are all freed at once.
+     */
+
+    struct arena arena;
+};
+
+enum tbd_add_export_result {
+    E_TBD_ADD_EXPORT_OK,
+    E_TBD_ADD_EXPORT_ALLOC_FAIL,
+    E_TBD_ADD_EXPORT_ARRAY_FAIL
 };
 
+/*
+ * Add an export-info to the exports-array, or add its arch to the existing
+ * export-info of the same type and string.
+ *
+ * If copy_string is false, the export-info's string is borrowed, and must be
+ * null-terminated and outlive the create-info's exports.
+ *
+ * The exports-array is left unsorted, and the export-strings unchecked for
+ * whether they need quotes, until tbd_create_info_sort_exports() is called.
+ */
+
+enum tbd_add_export_result
+tbd_create_info_add_export(struct tbd_create_info *info,
+                           const struct tbd_export_info *export_info,
+                           bool copy_string);
+
+enum array_result tbd_create_info_sort_exports(struct tbd_create_info *info);
+
 enum tbd_create_result {
     E_TBD_CREATE_OK,
     E_TBD_CREATE_WRITE_FAIL
@@ -159,11 +213,32 @@ enum tbd_create_options {
     O_TBD_CREATE_IGNORE_UNNECESSARY_FIELDS    = 1 << 8
 };
 
+struct tbd_write_buffer;
+
+enum tbd_create_result
+tbd_create_with_info_to_buffer(const struct tbd_create_info *info,
+                               struct tbd_write_buffer *buffer,
+                               uint64_t options);
+
+/*
+ * Write out the tbd to file, by writing it out to a buffer first with
+ * tbd_create_with_info_to_buffer().
+ */
+
 enum tbd_create_result
 tbd_create_with_info(const struct tbd_create_info *info,
                      FILE *file,
                      uint64_t options);
 
+/*
+ * Destroy info and restore it to orig, keeping the arena's blocks around to be
+ * reused for the strings of the next file or image.
+ */
+
+void
+tbd_create_info_clear(struct tbd_create_info *info,
+                      const struct tbd_create_info *orig);
+
 void tbd_create_info_destroy(struct tbd_create_info *info);
 
 #endif /* TBD_H */
@@ -0,0 +1,89 @@
+//
+//  include/tbd_archive.h
+//  tbd
+//
+//  Created by inoahdev on 3/23/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef TBD_ARCHIVE_H
+#define TBD_ARCHIVE_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A tbd_archive is a single uncompressed (ustar) tar file every tbd of a
+ * recursion or dyld_shared_cache extraction is written out to, instead of
+ * creating an output-file (and its directories) for every tbd.
+ *
+ * Each entry is named by the output-path the tbd would have otherwise been
+ * written to, relative to the archive's path.
+ *
+ * Entries are collected in a buffer and written out in large chunks, and may
+ * be added by multiple jobs at once.
+ */
+
+struct tbd_archive {
+    int fd;
+
+    const char *path;
+    uint64_t path_length;
+
+    char *buffer;
+    uint64_t buffer_used;
+
+    /*
+     * The total size of the archive written out so far, including what's
+     * still in the buffer.
+     */
+
+    uint64_t size;
+
+    int64_t mtime;
+    pthread_mutex_t mutex;
+};
+
+enum tbd_archive_result {
+    E_TBD_ARCHIVE_OK,
+    E_TBD_ARCHIVE_ALLOC_FAIL,
+
+    E_TBD_ARCHIVE_OPEN_FAIL,
+    E_TBD_ARCHIVE_WRITE_FAIL,
+
+    E_TBD_ARCHIVE_ENTRY_TOO_LARGE
+};
+
+/*
+ * Create (or truncate) the archive at path, creating its directory-hierarchy
+ * if needed. With no_overwrite, an existing file at path is not truncated, and
+ * E_TBD_ARCHIVE_OPEN_FAIL is returned with errno set to EEXIST.
+ */
+
+enum tbd_archive_result
+tbd_archive_open(struct tbd_archive *archive,
+                 char *path,
+                 uint64_t path_length,
+                 bool no_overwrite);
+
+/*
+ * Add an entry with the provided contents, named by write_path relative to the
+ * archive's path.
+ */
+
+enum tbd_archive_result
+tbd_archive_add_file(struct tbd_archive *archive,
+                     const char *write_path,
+                     uint64_t write_path_length,
+                     const char *data,
+                     uint64_t size);
+
+/*
+ * Write out the archive's end-of-archive marker and any buffered entries, and
+ * close the archive.
+ */
+
+enum tbd_archive_result tbd_archive_close(struct tbd_archive *archive);
+
+#endif /* TBD_ARCHIVE_H */
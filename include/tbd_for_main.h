@@ -12,6 +12,11 @@
 #include <stdint.h>
 #include "tbd.h"
 
+struct dir_cache;
+struct incremental_manifest;
+struct macho_dedup;
+struct tbd_archive;
+
 enum tbd_for_main_dsc_image_flags {
     F_TBD_FOR_MAIN_DSC_IMAGE_FOUND_ONE = 1 << 0
 };
@@ -51,7 +56,28 @@ enum tbd_for_main_options {
      * directory. (Depending on the configuration)
      */
 
-    O_TBD_FOR_MAIN_DSC_WRITE_PATH_IS_FILE = 1 << 13
+    O_TBD_FOR_MAIN_DSC_WRITE_PATH_IS_FILE = 1 << 13,
+
+    /*
+     * Write every tbd out to a single tar archive at the write-path, instead
+     * of to separate files.
+     */
+
+    O_TBD_FOR_MAIN_WRITE_TO_ARCHIVE = 1 << 14,
+
+    /*
+     * Extract dyld_shared_cache images in the order their data is located in
+     * the file, instead of in the order of the image-table.
+     */
+
+    O_TBD_FOR_MAIN_DSC_FILE_ORDER = 1 << 15,
+
+    /*
+     * Release the pages of a dyld_shared_cache read by images once they've
+     * been extracted, keeping at most dsc_max_rss bytes of such pages around.
+     */
+
+    O_TBD_FOR_MAIN_DSC_RELEASE_PAGES = 1 << 16
 };
 
 enum tbd_for_main_filetype {
@@ -96,6 +122,47 @@ struct tbd_for_main {
     uint64_t archs_re;
     uint64_t flags_re;
 
+    /*
+     * Number of threads to extract dyld_shared_cache images with.
+     */
+
+    uint32_t jobs;
+
+    /*
+     * The size of the pages of extracted images allowed to stay resident when
+     * releasing pages, with zero releasing them as soon as possible.
+     */
+
+    uint64_t dsc_max_rss;
+
+    /*
+     * The manifest of files written out while recursing, if recursing
+     * incrementally (with --incremental). Shared by every recursing tbd.
+     */
+
+    struct incremental_manifest *manifest;
+
+    /*
+     * The mach-o files written out while recursing, to copy the tbds of later
+     * copies of the same mach-o files from.
+     */
+
+    struct macho_dedup *dedup;
+
+    /*
+     * The directories of output-files created in this run. Shared by every
+     * tbd.
+     */
+
+    struct dir_cache *dir_cache;
+
+    /*
+     * The archive every tbd is written out to, if writing to an archive (with
+     * --tar).
+     */
+
+    struct tbd_archive *archive;
+
     struct array dsc_image_filters;
     struct array dsc_image_numbers;
     struct array dsc_image_paths;
@@ -127,13 +194,62 @@ void
 tbd_for_main_apply_from(struct tbd_for_main *dst,
                         const struct tbd_for_main *src);
 
-void
+/*
+ * Returns whether the tbd was successfully written out.
+ *
+ * If writing to an archive, the tbd is added to the archive as an entry for
+ * write_path instead.
+ */
+
+bool
 tbd_for_main_write_to_path(const struct tbd_for_main *tbd,
                            const char *input_path,
                            char *write_path,
                            uint64_t write_path_length,
                            bool print_paths);
 
+/*
+ * Open the file at write_path for writing, creating the directory hierarchy if
+ * necessary. On failure, NULL is returned after printing an error.
+ */
+
+FILE *
+tbd_for_main_open_write_file(const struct tbd_for_main *tbd,
+                             const char *input_path,
+                             char *write_path,
+                             uint64_t write_path_length,
+                             bool print_paths,
+                             char **terminator_out);
+
+/*
+ * Write tbd->info to a file opened with tbd_for_main_open_write_file(), and
+ * close the file. Returns whether the tbd was successfully written out.
+ */
+
+bool
+tbd_for_main_write_to_file(const struct tbd_for_main *tbd,
+                           const char *input_path,
+                           char *write_path,
+                           uint64_t write_path_length,
+                           char *terminator,
+                           bool print_paths,
+                           FILE *file);
+
+/*
+ * Copy the contents of source_fd, an already written out tbd, to a file opened
+ * with tbd_for_main_open_write_file(), and close the file.
+ */
+
+bool
+tbd_for_main_copy_to_file(const struct tbd_for_main *tbd,
+                          const char *input_path,
+                          char *write_path,
+                          uint64_t write_path_length,
+                          char *terminator,
+                          bool print_paths,
+                          int source_fd,
+                          FILE *file);
+
 void
 tbd_for_main_write_to_stdout(const struct tbd_for_main *tbd,
                              const char *input_path,
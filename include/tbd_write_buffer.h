@@ -0,0 +1,93 @@
+//
+//  include/tbd_write_buffer.h
+//  tbd
+//
+//  Created by inoahdev on 3/16/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#ifndef TBD_WRITE_BUFFER_H
+#define TBD_WRITE_BUFFER_H
+
+#include "tbd.h"
+
+/*
+ * tbd_write_buffer is a growable buffer a tbd is written out to in memory, to
+ * then be written out to a file-descriptor all at once.
+ *
+ * The buffer is owned by the caller, and can be cleared and reused for the
+ * next tbd to avoid growing a new buffer each time.
+ */
+
+struct tbd_write_buffer {
+    char *data;
+    char *data_end;
+    char *alloc_end;
+};
+
+int tbd_write_buffer_reserve(struct tbd_write_buffer *buffer, uint64_t size);
+
+/*
+ * Write out the buffer's contents to fd with write(2), retrying on partial
+ * writes.
+ */
+
+int tbd_write_buffer_flush(const struct tbd_write_buffer *buffer, int fd);
+
+void tbd_write_buffer_clear(struct tbd_write_buffer *buffer);
+void tbd_write_buffer_destroy(struct tbd_write_buffer *buffer);
+
+/*
+ * The following each write out a single field of a tbd to the buffer.
+ */
+
+int
+tbd_write_header_archs_to_buffer(struct tbd_write_buffer *buffer,
+                                 uint64_t archs);
+
+int
+tbd_write_current_version_to_buffer(struct tbd_write_buffer *buffer,
+                                    uint32_t version);
+
+int
+tbd_write_compatibility_version_to_buffer(struct tbd_write_buffer *buffer,
+                                          uint32_t version);
+
+int
+tbd_write_exports_to_buffer(struct tbd_write_buffer *buffer,
+                            const struct array *exports,
+                            enum tbd_version version);
+
+int tbd_write_flags_to_buffer(struct tbd_write_buffer *buffer, uint64_t flags);
+int tbd_write_footer_to_buffer(struct tbd_write_buffer *buffer);
+
+int
+tbd_write_install_name_to_buffer(struct tbd_write_buffer *buffer,
+                                 const struct tbd_create_info *info);
+
+int
+tbd_write_magic_to_buffer(struct tbd_write_buffer *buffer,
+                          enum tbd_version version);
+
+int
+tbd_write_parent_umbrella_to_buffer(struct tbd_write_buffer *buffer,
+                                    const struct tbd_create_info *info);
+
+int
+tbd_write_platform_to_buffer(struct tbd_write_buffer *buffer,
+                             enum tbd_platform platform);
+
+int
+tbd_write_objc_constraint_to_buffer(struct tbd_write_buffer *buffer,
+                                    enum tbd_objc_constraint constraint);
+
+int
+tbd_write_uuids_to_buffer(struct tbd_write_buffer *buffer,
+                          const struct array *uuids);
+
+int
+tbd_write_swift_version_to_buffer(struct tbd_write_buffer *buffer,
+                                  enum tbd_version tbd_vers,
+                                  uint32_t swift_vers);
+
+#endif /* TBD_WRITE_BUFFER_H */
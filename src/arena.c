@@ -0,0 +1,119 @@
+//
+//  src/arena.c
+//  tbd
+//
+//  Created by inoahdev on 3/2/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "stats.h"
+
+/*
+ * Most allocations are symbol-strings, so a single block should be able to
+ * hold the strings of most images.
+ */
+
+static const uint64_t arena_block_size = 64 * 1024;
+
+static void
+arena_use_block(struct arena *const arena, struct arena_block *const block) {
+    arena->current = block;
+    arena->iter = block->data;
+    arena->end = block->data + block->size;
+}
+
+void *arena_alloc(struct arena *const arena, const uint64_t size) {
+    if ((uint64_t)(arena->end - arena->iter) >= size) {
+        void *const ptr = arena->iter;
+        arena->iter += size;
+
+        return ptr;
+    }
+
+    /*
+     * Reuse the next block if it was kept from before the arena was reset, and
+     * is large enough.
+     */
+
+    struct arena_block *const current = arena->current;
+    struct arena_block *next = (current != NULL) ? current->next : arena->front;
+
+    if (next == NULL || next->size < size) {
+        uint64_t block_size = arena_block_size;
+        if (block_size < size) {
+            block_size = size;
+        }
+
+        struct arena_block *const block =
+            malloc(sizeof(struct arena_block) + block_size);
+
+        if (block == NULL) {
+            return NULL;
+        }
+
+        stats_add(STATS_COUNTER_ALLOCATIONS, 1);
+
+        block->next = next;
+        block->size = block_size;
+
+        if (current != NULL) {
+            current->next = block;
+        } else {
+            arena->front = block;
+        }
+
+        next = block;
+    }
+
+    arena_use_block(arena, next);
+
+    void *const ptr = arena->iter;
+    arena->iter += size;
+
+    return ptr;
+}
+
+char *
+arena_copy_string(struct arena *const arena,
+                  const char *const string,
+                  const uint64_t length)
+{
+    char *const copy = arena_alloc(arena, length + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    memcpy(copy, string, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+void arena_reset(struct arena *const arena) {
+    struct arena_block *const front = arena->front;
+    if (front == NULL) {
+        return;
+    }
+
+    arena_use_block(arena, front);
+}
+
+void arena_destroy(struct arena *const arena) {
+    struct arena_block *block = arena->front;
+    while (block != NULL) {
+        struct arena_block *const next = block->next;
+
+        free(block);
+        block = next;
+    }
+
+    arena->front = NULL;
+    arena->current = NULL;
+
+    arena->iter = NULL;
+    arena->end = NULL;
+}
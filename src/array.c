@@ -10,6 +10,7 @@
 #include <string.h>
 
 #include "array.h"
+#include "stats.h"
 
 void *
 array_get_item_at_index(const struct array *const array,
@@ -71,6 +72,8 @@ array_expand_if_necessary(struct array *const array,
         return E_ARRAY_ALLOC_FAIL;
     }
 
+    stats_add(STATS_COUNTER_ALLOCATIONS, 1);
+
     memcpy(new_data, old_data, used_size);
     free(old_data);
 
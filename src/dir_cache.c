@@ -0,0 +1,465 @@
+//
+//  src/dir_cache.c
+//  tbd
+//
+//  Created by inoahdev on 3/22/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dir_cache.h"
+#include "recursive.h"
+
+void dir_cache_init(struct dir_cache *const cache) {
+    *cache = (struct dir_cache){};
+    pthread_mutex_init(&cache->mutex, NULL);
+}
+
+struct entry_key {
+    const struct dir_cache_entry *entries;
+
+    const char *path;
+    uint64_t length;
+};
+
+static bool entry_matches(const void *const info, const uint32_t index) {
+    const struct entry_key *const key = info;
+    const struct dir_cache_entry *const entry = key->entries + index;
+
+    if (entry->length != key->length) {
+        return false;
+    }
+
+    return memcmp(entry->path, key->path, key->length) == 0;
+}
+
+static struct dir_cache_entry *
+find_entry(const struct dir_cache *const cache,
+           const char *const path,
+           const uint64_t length)
+{
+    if (cache->table.capacity == 0) {
+        return NULL;
+    }
+
+    const struct entry_key key = {
+        .entries = cache->entries,
+        .path = path,
+        .length = length
+    };
+
+    const struct hash_table_slot *const slot =
+        hash_table_find_slot(&cache->table,
+                             hash_string(path, length),
+                             entry_matches,
+                             &key);
+
+    if (slot->index == 0) {
+        return NULL;
+    }
+
+    return cache->entries + (slot->index - 1);
+}
+
+static struct dir_cache_entry *
+add_entry(struct dir_cache *const cache,
+          const char *const path,
+          const uint64_t length)
+{
+    if (!hash_table_reserve(&cache->table, cache->entries_count + 1)) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    const uint64_t count = cache->entries_count;
+    if (count == cache->entries_capacity) {
+        const uint64_t entries_capacity = (count != 0) ? count << 1 : 64;
+        struct dir_cache_entry *const entries =
+            realloc(cache->entries,
+                    sizeof(struct dir_cache_entry) * entries_capacity);
+
+        if (entries == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+
+        cache->entries = entries;
+        cache->entries_capacity = entries_capacity;
+    }
+
+    char *const path_copy = arena_copy_string(&cache->arena, path, length);
+    if (path_copy == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    const struct entry_key key = {
+        .entries = cache->entries,
+        .path = path,
+        .length = length
+    };
+
+    const uint32_t hash = hash_string(path, length);
+    struct hash_table_slot *const slot =
+        hash_table_find_slot(&cache->table, hash, entry_matches, &key);
+
+    hash_table_set_slot(&cache->table, slot, hash, (uint32_t)count);
+
+    struct dir_cache_entry *const entry = cache->entries + count;
+    *entry = (struct dir_cache_entry){
+        .path = path_copy,
+        .length = length,
+        .fd = -1
+    };
+
+    cache->entries_count = count + 1;
+    return entry;
+}
+
+static void close_entry(struct dir_cache_entry *const entry) {
+    if (entry->fd >= 0) {
+        close(entry->fd);
+        entry->fd = -1;
+    }
+}
+
+/*
+ * Track the newly opened directory of the entry, closing the first opened
+ * directory if too many are open.
+ */
+
+static void
+add_open_entry(struct dir_cache *const cache,
+               const struct dir_cache_entry *const entry)
+{
+    const uint32_t index = (uint32_t)(entry - cache->entries);
+
+    uint32_t count = cache->open_entries_count;
+    uint32_t front = cache->open_entries_front;
+
+    if (count == DIR_CACHE_MAX_OPEN_DIRS) {
+        close_entry(cache->entries + cache->open_entries[front]);
+
+        front = (front + 1) % DIR_CACHE_MAX_OPEN_DIRS;
+        count -= 1;
+    }
+
+    cache->open_entries[(front + count) % DIR_CACHE_MAX_OPEN_DIRS] = index;
+
+    cache->open_entries_front = front;
+    cache->open_entries_count = count + 1;
+}
+
+/*
+ * Stop tracking the open directory of the entry, keeping the order of the
+ * other open directories.
+ */
+
+static void
+remove_open_entry(struct dir_cache *const cache,
+                  const struct dir_cache_entry *const entry)
+{
+    const uint32_t index = (uint32_t)(entry - cache->entries);
+
+    const uint32_t count = cache->open_entries_count;
+    const uint32_t front = cache->open_entries_front;
+
+    uint32_t *const open_entries = cache->open_entries;
+    for (uint32_t i = 0; i != count; i++) {
+        if (open_entries[(front + i) % DIR_CACHE_MAX_OPEN_DIRS] != index) {
+            continue;
+        }
+
+        for (uint32_t j = i; j + 1 < count; j++) {
+            open_entries[(front + j) % DIR_CACHE_MAX_OPEN_DIRS] =
+                open_entries[(front + j + 1) % DIR_CACHE_MAX_OPEN_DIRS];
+        }
+
+        cache->open_entries_count = count - 1;
+        return;
+    }
+}
+
+/*
+ * Get the length of the parent-directory of the directory at path, and the
+ * index of the directory's path-component.
+ *
+ * If there's no parent-directory in the path, the path-component is the full
+ * path, as the directory is then relative to the current-directory, or to
+ * root.
+ */
+
+static uint64_t
+get_parent_length(const char *const path,
+                  const uint64_t length,
+                  uint64_t *const component_index_out)
+{
+    uint64_t i = length;
+    while (i != 0 && path[i - 1] != '/') {
+        i--;
+    }
+
+    uint64_t component_index = i;
+    while (i != 0 && path[i - 1] == '/') {
+        i--;
+    }
+
+    if (i == 0) {
+        component_index = 0;
+    }
+
+    *component_index_out = component_index;
+    return i;
+}
+
+/*
+ * Get an open directory for the first length bytes of path, creating the
+ * directory and its hierarchy if needed.
+ *
+ * An empty path is the current-directory, and returns AT_FDCWD.
+ */
+
+static int
+get_dir_fd(struct dir_cache *const cache,
+           char *const path,
+           const uint64_t length,
+           const mode_t mode,
+           char **const terminator_out)
+{
+    if (length == 0) {
+        return AT_FDCWD;
+    }
+
+    struct dir_cache_entry *entry = find_entry(cache, path, length);
+    if (entry != NULL && entry->exists) {
+        if (entry->fd >= 0) {
+            return entry->fd;
+        }
+
+        const int fd = open(entry->path, O_RDONLY | O_DIRECTORY);
+        if (fd < 0) {
+            return -1;
+        }
+
+        entry->fd = fd;
+        add_open_entry(cache, entry);
+
+        return fd;
+    }
+
+    uint64_t component_index = 0;
+    const uint64_t parent_length =
+        get_parent_length(path, length, &component_index);
+
+    const int parent_fd =
+        get_dir_fd(cache, path, parent_length, mode, terminator_out);
+
+    if (parent_fd < 0 && parent_fd != AT_FDCWD) {
+        return -1;
+    }
+
+    /*
+     * A directory in a directory we created can't already exist, so it's
+     * created directly. Otherwise, the directory likely already exists, and
+     * is only created if opening it fails.
+     */
+
+    const struct dir_cache_entry *const parent_entry =
+        find_entry(cache, path, parent_length);
+
+    const bool parent_was_created =
+        parent_entry != NULL && parent_entry->was_created;
+
+    char *const end = path + length;
+    const char end_ch = *end;
+
+    *end = '\0';
+
+    const char *const component = path + component_index;
+    const int open_flags = O_RDONLY | O_DIRECTORY;
+
+    bool was_created = false;
+    int fd = -1;
+
+    if (!parent_was_created) {
+        fd = openat(parent_fd, component, open_flags);
+    }
+
+    if (fd < 0) {
+        if (mkdirat(parent_fd, component, mode) == 0) {
+            was_created = true;
+        } else if (errno != EEXIST) {
+            *end = end_ch;
+            return -1;
+        }
+
+        fd = openat(parent_fd, component, open_flags);
+    }
+
+    *end = end_ch;
+
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (was_created && terminator_out != NULL) {
+        if (*terminator_out == NULL) {
+            *terminator_out = end;
+        }
+    }
+
+    /*
+     * A directory removed by dir_cache_remove_partial() keeps its entry, and
+     * is simply marked as existing again.
+     *
+     * The entry has to be found again, as creating the parent-directories may
+     * have moved the entries.
+     */
+
+    entry = find_entry(cache, path, length);
+    if (entry == NULL) {
+        entry = add_entry(cache, path, length);
+    }
+
+    entry->fd = fd;
+    entry->exists = true;
+    entry->was_created = was_created;
+
+    add_open_entry(cache, entry);
+    return fd;
+}
+
+static void
+forget_dir(struct dir_cache *const cache,
+           const char *const path,
+           const uint64_t length)
+{
+    struct dir_cache_entry *const entry = find_entry(cache, path, length);
+    if (entry == NULL) {
+        return;
+    }
+
+    /*
+     * An entry is only tracked as open while it has an open directory. It has
+     * to stop being tracked here, as otherwise closing its directory once the
+     * entry is reached again would close the directory it has by then.
+     */
+
+    if (entry->fd >= 0) {
+        remove_open_entry(cache, entry);
+        close_entry(entry);
+    }
+
+    entry->exists = false;
+}
+
+int
+dir_cache_open_file(struct dir_cache *const cache,
+                    char *const path,
+                    const uint64_t path_length,
+                    const int flags,
+                    const mode_t mode,
+                    const mode_t dir_mode,
+                    char **const terminator_out)
+{
+    uint64_t name_index = 0;
+    const uint64_t dir_length =
+        get_parent_length(path, path_length, &name_index);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    char *terminator = NULL;
+    const int dir_fd =
+        get_dir_fd(cache, path, dir_length, dir_mode, &terminator);
+
+    if (terminator_out != NULL) {
+        *terminator_out = terminator;
+    }
+
+    if (dir_fd < 0 && dir_fd != AT_FDCWD) {
+        pthread_mutex_unlock(&cache->mutex);
+        return -1;
+    }
+
+    const int fd = openat(dir_fd, path + name_index, O_CREAT | flags, mode);
+    const int open_errno = errno;
+
+    /*
+     * If the directory was removed behind our back, forget about it and fall
+     * back to creating the hierarchy again.
+     */
+
+    if (fd < 0 && open_errno == ENOENT) {
+        forget_dir(cache, path, dir_length);
+        pthread_mutex_unlock(&cache->mutex);
+
+        return open_r(path, path_length, flags, mode, dir_mode, terminator_out);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    errno = open_errno;
+    return fd;
+}
+
+int
+dir_cache_remove_partial(struct dir_cache *const cache,
+                         char *const path,
+                         const uint64_t path_length,
+                         char *const from)
+{
+    pthread_mutex_lock(&cache->mutex);
+
+    /*
+     * Every directory from the one terminated at from onwards is removed, so
+     * they all have to be created again if needed later.
+     */
+
+    const uint64_t from_index = (uint64_t)(from - path);
+    for (uint64_t i = from_index; i != path_length; i++) {
+        if (path[i] != '/') {
+            continue;
+        }
+
+        if (i != 0 && path[i - 1] == '/') {
+            continue;
+        }
+
+        forget_dir(cache, path, i);
+    }
+
+    const int ret = remove_partial_r(path, path_length, from);
+    pthread_mutex_unlock(&cache->mutex);
+
+    return ret;
+}
+
+void dir_cache_destroy(struct dir_cache *const cache) {
+    struct dir_cache_entry *iter = cache->entries;
+    struct dir_cache_entry *const end = iter + cache->entries_count;
+
+    for (; iter != end; iter++) {
+        close_entry(iter);
+    }
+
+    free(cache->entries);
+    hash_table_destroy(&cache->table);
+
+    arena_destroy(&cache->arena);
+    pthread_mutex_destroy(&cache->mutex);
+
+    cache->entries = NULL;
+    cache->entries_count = 0;
+    cache->entries_capacity = 0;
+
+    cache->open_entries_front = 0;
+    cache->open_entries_count = 0;
+}
@@ -6,6 +6,7 @@
 //  Copyright © 2018 - 2019 inoahdev. All rights reserved.
 //
 
+#include <string.h>
 #include <unistd.h>
 
 #include "mach-o/fat.h"
@@ -16,8 +17,7 @@
 
 #include "macho_file_parse_load_commands.h"
 #include "macho_file_parse_symbols.h"
-
-#include "range.h"
+#include "stats.h"
 
 /*
  * To avoid duplicating code, we pass on the mach-o verification to macho_file's
@@ -99,6 +99,9 @@ translate_macho_file_parse_result(const enum macho_file_parse_result result) {
         case E_MACHO_FILE_PARSE_INVALID_CLIENT:
             return E_DSC_IMAGE_PARSE_INVALID_CLIENT;
 
+        case E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE:
+            return E_DSC_IMAGE_PARSE_INVALID_EXPORT_TRIE;
+
         case E_MACHO_FILE_PARSE_INVALID_INSTALL_NAME:
             return E_DSC_IMAGE_PARSE_INVALID_INSTALL_NAME;
 
@@ -153,72 +156,70 @@ translate_macho_file_parse_result(const enum macho_file_parse_result result) {
     return E_DSC_IMAGE_PARSE_OK;
 }
 
-static uint64_t
-get_image_file_offset_from_address(struct dyld_shared_cache_info *const info,
-                                   const uint64_t address,
-                                   uint64_t *const size_out)
-{
-    const struct dyld_cache_mapping_info *const mappings = info->mappings;
-    const uint64_t count = info->mappings_count;
+/*
+ * The maps an image's data is read from. For a dyld_shared_cache that isn't
+ * split into sub-caches, every map is the full dyld_shared_cache map.
+ *
+ * The offsets of the symbol-table, string-table and export-trie are relative to
+ * the file containing __LINKEDIT, and are moved from linkedit_fileoff to
+ * linkedit_file_offset if __LINKEDIT was found elsewhere in its file.
+ */
 
-    for (uint64_t i = 0; i < count; i++) {
-        const struct dyld_cache_mapping_info *const mapping = mappings + i;
+struct dsc_image_maps {
+    const uint8_t *header;
+    uint64_t max_image_size;
 
-        const uint64_t mapping_begin = mapping->address;
-        const uint64_t mapping_end = mapping_begin + mapping->size;
+    const uint8_t *map;
+    uint64_t map_size;
 
-        const struct range mapping_range = {
-            .begin = mapping_begin,
-            .end = mapping_end
-        };
+    const uint8_t *linkedit_map;
+    uint64_t linkedit_map_size;
 
-        if (!range_contains_location(mapping_range, address)) {
-            continue;
-        }
+    uint64_t linkedit_fileoff;
+    uint64_t linkedit_file_offset;
+};
 
-        const uint64_t delta = address - mapping_begin;
-        const uint64_t file_offset = mapping->fileOffset + delta;
+static bool
+rebase_linkedit_offset(const struct dsc_image_maps *const maps,
+                       uint32_t *const offset_in)
+{
+    const uint64_t fileoff = maps->linkedit_fileoff;
+    const uint64_t file_offset = maps->linkedit_file_offset;
 
-        *size_out = mapping->size - delta;
-        return file_offset;
+    if (fileoff == file_offset) {
+        return true;
     }
 
-    return 0;
-}
-
-enum dsc_image_parse_result
-dsc_image_parse(struct tbd_create_info *const info_in,
-                struct dyld_shared_cache_info *const dsc_info,
-                struct dyld_cache_image_info *const image,
-                const uint64_t macho_options,
-                const uint64_t tbd_options,
-                const uint64_t options)
-{
-    /*
-     * The mappings store the data-structures that make up a mach-o file for all
-     * dyld_shared_cache images.
-     *
-     * To find out image's data, we have to recurse the mappings, to find the
-     * one containing our file.
-     */
-    
-    uint64_t max_image_size = 0;
-    const uint64_t file_offset =
-        get_image_file_offset_from_address(dsc_info,
-                                           image->address,
-                                           &max_image_size);
+    const uint64_t offset = *offset_in;
+    if (offset < fileoff) {
+        return false;
+    }
 
-    if (file_offset == 0) {
-        return E_DSC_IMAGE_PARSE_NO_CORRESPONDING_MAPPING;
+    const uint64_t rebased_offset = offset - fileoff + file_offset;
+    if (rebased_offset > UINT32_MAX) {
+        return false;
     }
 
+    *offset_in = (uint32_t)rebased_offset;
+    return true;
+}
+
+static enum dsc_image_parse_result
+parse_image(struct tbd_create_info *const info_in,
+            const struct dyld_shared_cache_info *const dsc_info,
+            const struct dsc_image_maps *const maps,
+            const uint64_t macho_options,
+            const uint64_t tbd_options,
+            const uint64_t options)
+{
+    const uint64_t max_image_size = maps->max_image_size;
     if (max_image_size < sizeof(struct mach_header)) {
         return E_DSC_IMAGE_PARSE_SIZE_TOO_SMALL;
     }
 
-    const uint8_t *const map = dsc_info->map;
+    const uint8_t *const map = maps->map;
     const struct mach_header *const header =
-        (const struct mach_header *)(map + file_offset);
+        (const struct mach_header *)maps->header;
     
     const uint32_t magic = header->magic;
     
@@ -253,6 +254,7 @@ dsc_image_parse(struct tbd_create_info *const info_in,
     }
 
     struct symtab_command symtab = {};
+    struct linkedit_data_command export_trie = {};
 
     /*
      * The symbol-table and string-table offsets are absolute, not relative from
@@ -264,7 +266,7 @@ dsc_image_parse(struct tbd_create_info *const info_in,
      */ 
 
     const uint64_t arch_bit = dsc_info->arch_bit;
-    const uint64_t dsc_size = dsc_info->size;
+    const uint64_t dsc_size = maps->map_size;
 
     const uint64_t lc_options =
         O_MACHO_FILE_PARSE_DONT_PARSE_SYMBOL_TABLE |
@@ -285,7 +287,8 @@ dsc_image_parse(struct tbd_create_info *const info_in,
                                                 header->sizeofcmds,
                                                 tbd_options,
                                                 lc_options,
-                                                &symtab);
+                                                &symtab,
+                                                &export_trie);
 
     if (parse_load_commands_result != E_MACHO_FILE_PARSE_OK) {
         return translate_macho_file_parse_result(parse_load_commands_result);
@@ -298,46 +301,103 @@ dsc_image_parse(struct tbd_create_info *const info_in,
      */
 
     if (symtab.cmd != LC_SYMTAB) {
+        const enum array_result sort_exports_result =
+            tbd_create_info_sort_exports(info_in);
+
+        if (sort_exports_result != E_ARRAY_OK) {
+            return E_DSC_IMAGE_PARSE_ARRAY_FAIL;
+        }
+
         return E_DSC_IMAGE_PARSE_OK;
     }
 
     /*
-     * For parsing the symbol-tables, we provide the full dyld_shared_cache map
-     * as the symbol-table and string-table offsets are relative to the full
-     * map, not relative to the mach-o header.
+     * For parsing the symbol-tables, we provide the full map of the file
+     * containing __LINKEDIT, as the symbol-table and string-table offsets are
+     * relative to the file, not relative to the mach-o header.
+     *
+     * The same is true for the export-trie, which is preferred when possible,
+     * as it only lists the exported symbols.
+     *
+     * Unlike the symbol-table, the export-trie doesn't store its symbol-names
+     * whole, so they're copied into the arena instead of borrowed from the
+     * map. This costs a copy of each export-string, but skips every symbol
+     * that isn't exported, which is most of the symbol-table of a dsc image.
      */
 
+    const uint8_t *const linkedit_map = maps->linkedit_map;
+    const uint64_t linkedit_map_size = maps->linkedit_map_size;
+
+    stats_begin_phase(STATS_PHASE_SYMBOLS);
+
     enum macho_file_parse_result ret = E_MACHO_FILE_PARSE_OK;
-    if (is_64) {
+    if (macho_file_can_parse_export_trie(&export_trie, tbd_options)) {
+        if (!rebase_linkedit_offset(maps, &export_trie.dataoff)) {
+            stats_end_phase();
+            return E_DSC_IMAGE_PARSE_INVALID_EXPORT_TRIE;
+        }
+
         ret =
-            macho_file_parse_symbols_64_from_map(info_in,
-                                                 map,
-                                                 dsc_size,
-                                                 arch_bit,
-                                                 is_big_endian,
-                                                 symtab.symoff,
-                                                 symtab.nsyms,
-                                                 symtab.stroff,
-                                                 symtab.strsize,
-                                                 tbd_options);
+            macho_file_parse_export_trie_from_map(info_in,
+                                                  linkedit_map,
+                                                  linkedit_map_size,
+                                                  arch_bit,
+                                                  export_trie.dataoff,
+                                                  export_trie.datasize,
+                                                  tbd_options);
     } else {
-        ret =
-            macho_file_parse_symbols_from_map(info_in,
-                                              map,
-                                              dsc_size,
-                                              arch_bit,
-                                              is_big_endian,
-                                              symtab.symoff,
-                                              symtab.nsyms,
-                                              symtab.stroff,
-                                              symtab.strsize,
-                                              tbd_options);
+        if (!rebase_linkedit_offset(maps, &symtab.symoff)) {
+            stats_end_phase();
+            return E_DSC_IMAGE_PARSE_INVALID_SYMBOL_TABLE;
+        }
+
+        if (!rebase_linkedit_offset(maps, &symtab.stroff)) {
+            stats_end_phase();
+            return E_DSC_IMAGE_PARSE_INVALID_STRING_TABLE;
+        }
+
+        if (is_64) {
+            ret =
+                macho_file_parse_symbols_64_from_map(info_in,
+                                                     linkedit_map,
+                                                     linkedit_map_size,
+                                                     arch_bit,
+                                                     is_big_endian,
+                                                     symtab.symoff,
+                                                     symtab.nsyms,
+                                                     symtab.stroff,
+                                                     symtab.strsize,
+                                                     tbd_options,
+                                                     macho_options);
+        } else {
+            ret =
+                macho_file_parse_symbols_from_map(info_in,
+                                                  linkedit_map,
+                                                  linkedit_map_size,
+                                                  arch_bit,
+                                                  is_big_endian,
+                                                  symtab.symoff,
+                                                  symtab.nsyms,
+                                                  symtab.stroff,
+                                                  symtab.strsize,
+                                                  tbd_options,
+                                                  macho_options);
+        }
     }
 
+    stats_end_phase();
+
     if (ret != E_MACHO_FILE_PARSE_OK) {
         return translate_macho_file_parse_result(ret);
     }
 
+    const enum array_result sort_exports_result =
+        tbd_create_info_sort_exports(info_in);
+
+    if (sort_exports_result != E_ARRAY_OK) {
+        return E_DSC_IMAGE_PARSE_ARRAY_FAIL;
+    }
+
     if (!(options & O_TBD_PARSE_IGNORE_MISSING_EXPORTS)) {
         if (array_is_empty(&info_in->exports)) {
             return E_DSC_IMAGE_PARSE_NO_EXPORTS;
@@ -347,3 +407,387 @@ dsc_image_parse(struct tbd_create_info *const info_in,
     info_in->archs = arch_bit;
     return E_DSC_IMAGE_PARSE_OK;
 }
+
+static enum dsc_image_parse_result
+translate_dsc_location_result(const enum dyld_shared_cache_parse_result result)
+{
+    switch (result) {
+        case E_DYLD_SHARED_CACHE_PARSE_OK:
+            break;
+
+        case E_DYLD_SHARED_CACHE_PARSE_ALLOC_FAIL:
+            return E_DSC_IMAGE_PARSE_ALLOC_FAIL;
+
+        case E_DYLD_SHARED_CACHE_PARSE_FSTAT_FAIL:
+        case E_DYLD_SHARED_CACHE_PARSE_READ_FAIL:
+        case E_DYLD_SHARED_CACHE_PARSE_MMAP_FAIL:
+        case E_DYLD_SHARED_CACHE_PARSE_MISSING_SUBCACHE:
+            return E_DSC_IMAGE_PARSE_SUBCACHE_MAP_FAIL;
+
+        case E_DYLD_SHARED_CACHE_PARSE_NOT_A_CACHE:
+        case E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES:
+        case E_DYLD_SHARED_CACHE_PARSE_INVALID_MAPPINGS:
+        case E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_RANGES:
+        case E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_IMAGES:
+        case E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS:
+        case E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES:
+            return E_DSC_IMAGE_PARSE_INVALID_SUBCACHE;
+
+        case E_DYLD_SHARED_CACHE_PARSE_NO_MAPPING:
+            return E_DSC_IMAGE_PARSE_NO_CORRESPONDING_MAPPING;
+    }
+
+    return E_DSC_IMAGE_PARSE_OK;
+}
+
+/*
+ * The segments of an image of a split dyld_shared_cache may each be located in
+ * a different sub-cache, so the addresses of the objc image-info section and of
+ * __LINKEDIT are found first, to find the files containing them.
+ *
+ * The load-commands are only verified later on, when parsed with
+ * macho_file_parse_load_commands_from_map(), so any invalid load-command
+ * simply ends the search here.
+ */
+
+struct split_image_segments {
+    uint64_t image_info_address;
+    bool found_image_info;
+
+    uint64_t linkedit_address;
+    uint64_t linkedit_fileoff;
+    bool found_linkedit;
+};
+
+static inline bool is_image_info_section_name(const char name[16]) {
+    return strncmp(name, "__objc_imageinfo", 16) == 0 ||
+           strncmp(name, "__image_info", 16) == 0;
+}
+
+static inline bool is_linkedit_segment_name(const char name[16]) {
+    return strncmp(name, "__LINKEDIT", 16) == 0;
+}
+
+static void
+find_split_image_segments(const uint8_t *const macho,
+                          const uint64_t macho_size,
+                          struct split_image_segments *const segments_out)
+{
+    const struct mach_header *const header =
+        (const struct mach_header *)macho;
+
+    const bool is_64 = header->magic == MH_MAGIC_64;
+    if (!is_64 && header->magic != MH_MAGIC) {
+        return;
+    }
+
+    uint64_t header_size = sizeof(struct mach_header);
+    if (is_64) {
+        header_size = sizeof(struct mach_header_64);
+    }
+
+    if (macho_size < header_size) {
+        return;
+    }
+
+    uint64_t size_left = macho_size - header_size;
+    if (size_left > header->sizeofcmds) {
+        size_left = header->sizeofcmds;
+    }
+
+    const uint8_t *iter = macho + header_size;
+    const uint32_t ncmds = header->ncmds;
+
+    for (uint32_t i = 0; i != ncmds; i++) {
+        if (size_left < sizeof(struct load_command)) {
+            return;
+        }
+
+        const struct load_command *const load_cmd =
+            (const struct load_command *)iter;
+
+        const uint32_t cmdsize = load_cmd->cmdsize;
+        if (cmdsize < sizeof(struct load_command) || cmdsize > size_left) {
+            return;
+        }
+
+        if (is_64 && load_cmd->cmd == LC_SEGMENT_64) {
+            if (cmdsize < sizeof(struct segment_command_64)) {
+                return;
+            }
+
+            const struct segment_command_64 *const segment =
+                (const struct segment_command_64 *)iter;
+
+            if (is_linkedit_segment_name(segment->segname)) {
+                segments_out->linkedit_address = segment->vmaddr;
+                segments_out->linkedit_fileoff = segment->fileoff;
+                segments_out->found_linkedit = true;
+            }
+
+            const uint64_t max_nsects =
+                (cmdsize - sizeof(struct segment_command_64)) /
+                sizeof(struct section_64);
+
+            const uint32_t nsects = segment->nsects;
+            if (nsects > max_nsects) {
+                return;
+            }
+
+            const struct section_64 *sect =
+                (const struct section_64 *)(segment + 1);
+
+            for (uint32_t j = 0; j != nsects; j++, sect++) {
+                if (is_image_info_section_name(sect->sectname)) {
+                    segments_out->image_info_address = sect->addr;
+                    segments_out->found_image_info = true;
+                }
+            }
+        } else if (!is_64 && load_cmd->cmd == LC_SEGMENT) {
+            if (cmdsize < sizeof(struct segment_command)) {
+                return;
+            }
+
+            const struct segment_command *const segment =
+                (const struct segment_command *)iter;
+
+            if (is_linkedit_segment_name(segment->segname)) {
+                segments_out->linkedit_address = segment->vmaddr;
+                segments_out->linkedit_fileoff = segment->fileoff;
+                segments_out->found_linkedit = true;
+            }
+
+            const uint64_t max_nsects =
+                (cmdsize - sizeof(struct segment_command)) /
+                sizeof(struct section);
+
+            const uint32_t nsects = segment->nsects;
+            if (nsects > max_nsects) {
+                return;
+            }
+
+            const struct section *sect = (const struct section *)(segment + 1);
+            for (uint32_t j = 0; j != nsects; j++, sect++) {
+                if (is_image_info_section_name(sect->sectname)) {
+                    segments_out->image_info_address = sect->addr;
+                    segments_out->found_image_info = true;
+                }
+            }
+        }
+
+        iter += cmdsize;
+        size_left -= cmdsize;
+    }
+}
+
+/*
+ * Parse an image of a dyld_shared_cache split into sub-caches, where the
+ * image's header, sections and __LINKEDIT may each be located in a different
+ * file.
+ */
+
+static enum dsc_image_parse_result
+parse_split_image(struct tbd_create_info *const info_in,
+                  struct dyld_shared_cache_info *const dsc_info,
+                  const struct dyld_cache_image_info *const image,
+                  const uint64_t macho_options,
+                  const uint64_t tbd_options,
+                  const uint64_t options)
+{
+    struct dyld_shared_cache_location header_location = {};
+    const enum dyld_shared_cache_parse_result header_location_result =
+        dyld_shared_cache_find_location(dsc_info,
+                                        image->address,
+                                        &header_location);
+
+    if (header_location_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        return translate_dsc_location_result(header_location_result);
+    }
+
+    const uint8_t *const header =
+        header_location.map + header_location.file_offset;
+
+    struct split_image_segments segments = {};
+    if (header_location.max_size >= sizeof(struct mach_header)) {
+        find_split_image_segments(header, header_location.max_size, &segments);
+    }
+
+    struct dsc_image_maps maps = {
+        .header = header,
+        .max_image_size = header_location.max_size,
+
+        .map = header_location.map,
+        .map_size = header_location.map_size,
+
+        .linkedit_map = header_location.map,
+        .linkedit_map_size = header_location.map_size
+    };
+
+    struct dyld_shared_cache_location image_info_location = {};
+    struct dyld_shared_cache_location linkedit_location = {};
+
+    enum dsc_image_parse_result result = E_DSC_IMAGE_PARSE_OK;
+    if (segments.found_image_info) {
+        const enum dyld_shared_cache_parse_result location_result =
+            dyld_shared_cache_find_location(dsc_info,
+                                            segments.image_info_address,
+                                            &image_info_location);
+
+        if (location_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+            result = translate_dsc_location_result(location_result);
+            goto done;
+        }
+
+        maps.map = image_info_location.map;
+        maps.map_size = image_info_location.map_size;
+    }
+
+    if (segments.found_linkedit) {
+        const enum dyld_shared_cache_parse_result location_result =
+            dyld_shared_cache_find_location(dsc_info,
+                                            segments.linkedit_address,
+                                            &linkedit_location);
+
+        if (location_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+            result = translate_dsc_location_result(location_result);
+            goto done;
+        }
+
+        maps.linkedit_map = linkedit_location.map;
+        maps.linkedit_map_size = linkedit_location.map_size;
+
+        maps.linkedit_fileoff = segments.linkedit_fileoff;
+        maps.linkedit_file_offset = linkedit_location.file_offset;
+    }
+
+    result =
+        parse_image(info_in,
+                    dsc_info,
+                    &maps,
+                    macho_options,
+                    tbd_options,
+                    options);
+
+done:
+    if (segments.found_linkedit) {
+        dyld_shared_cache_release_location(dsc_info, &linkedit_location);
+    }
+
+    if (segments.found_image_info) {
+        dyld_shared_cache_release_location(dsc_info, &image_info_location);
+    }
+
+    dyld_shared_cache_release_location(dsc_info, &header_location);
+    return result;
+}
+
+void
+dsc_image_find_subcache_uses(struct dyld_shared_cache_info *const dsc_info) {
+    if (dsc_info->subcaches_count == 0) {
+        return;
+    }
+
+    const uint32_t images_count = dsc_info->images_count;
+    for (uint32_t i = 0; i != images_count; i++) {
+        const struct dyld_cache_image_info *const image = dsc_info->images + i;
+
+        /*
+         * Sub-caches only used by the images found so far are unmapped as we
+         * go, though any sub-cache still used by a later image is simply
+         * mapped in again. The sub-caches of the last image are kept mapped,
+         * as the images are iterated over right after.
+         */
+
+        dyld_shared_cache_release_subcaches_before(dsc_info, i);
+
+        /*
+         * An image whose header can't be found is simply skipped, as it fails
+         * to parse later on anyways.
+         */
+
+        struct dyld_shared_cache_location location = {};
+        const enum dyld_shared_cache_parse_result location_result =
+            dyld_shared_cache_find_location(dsc_info,
+                                            image->address,
+                                            &location);
+
+        if (location_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+            continue;
+        }
+
+        struct split_image_segments segments = {};
+        if (location.max_size >= sizeof(struct mach_header)) {
+            find_split_image_segments(location.map + location.file_offset,
+                                      location.max_size,
+                                      &segments);
+        }
+
+        if (segments.found_image_info) {
+            dyld_shared_cache_set_subcache_use(dsc_info,
+                                               segments.image_info_address,
+                                               i);
+        }
+
+        if (segments.found_linkedit) {
+            dyld_shared_cache_set_subcache_use(dsc_info,
+                                               segments.linkedit_address,
+                                               i);
+        }
+
+        dyld_shared_cache_release_location(dsc_info, &location);
+    }
+}
+
+enum dsc_image_parse_result
+dsc_image_parse(struct tbd_create_info *const info_in,
+                struct dyld_shared_cache_info *const dsc_info,
+                const struct dyld_cache_image_info *const image,
+                const uint64_t macho_options,
+                const uint64_t tbd_options,
+                const uint64_t options)
+{
+    if (dsc_info->subcaches_count != 0) {
+        return parse_split_image(info_in,
+                                 dsc_info,
+                                 image,
+                                 macho_options,
+                                 tbd_options,
+                                 options);
+    }
+
+    /*
+     * The mappings store the data-structures that make up a mach-o file for all
+     * dyld_shared_cache images.
+     *
+     * To find out image's data, we have to recurse the mappings, to find the
+     * one containing our file.
+     */
+    
+    uint64_t max_image_size = 0;
+    const uint64_t file_offset =
+        dyld_shared_cache_get_file_offset_from_address(dsc_info,
+                                                       image->address,
+                                                       &max_image_size);
+
+    if (file_offset == 0) {
+        return E_DSC_IMAGE_PARSE_NO_CORRESPONDING_MAPPING;
+    }
+
+    const struct dsc_image_maps maps = {
+        .header = dsc_info->map + file_offset,
+        .max_image_size = max_image_size,
+
+        .map = dsc_info->map,
+        .map_size = dsc_info->size,
+
+        .linkedit_map = dsc_info->map,
+        .linkedit_map_size = dsc_info->size
+    };
+
+    return parse_image(info_in,
+                       dsc_info,
+                       &maps,
+                       macho_options,
+                       tbd_options,
+                       options);
+}
@@ -0,0 +1,351 @@
+//
+//  src/dsc_image_order.c
+//  tbd
+//
+//  Created by inoahdev on 3/27/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <sys/mman.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mach-o/loader.h"
+#include "mach-o/nlist.h"
+
+#include "dsc_image_order.h"
+#include "guard_overflow.h"
+
+/*
+ * Record the range [offset, offset + size) of the dyld_shared_cache, if the
+ * range is non-empty and within the file.
+ */
+
+static void
+set_range(struct dsc_image_order_entry *const entry,
+          const enum dsc_image_order_range range,
+          const uint64_t offset,
+          const uint64_t size,
+          const uint64_t dsc_size)
+{
+    uint64_t end = offset;
+    if (size == 0 || guard_overflow_add(&end, size) || end > dsc_size) {
+        return;
+    }
+
+    entry->begin[range] = offset;
+    entry->end[range] = end;
+}
+
+/*
+ * Find the ranges of the image from its load-commands. Any invalid
+ * load-command simply ends the search, as the load-commands are only verified
+ * when the image is actually parsed.
+ */
+
+static void
+find_image_ranges(struct dsc_image_order_entry *const entry,
+                  const uint8_t *const map,
+                  const uint64_t dsc_size,
+                  const uint64_t file_offset,
+                  const uint64_t max_size)
+{
+    if (max_size < sizeof(struct mach_header)) {
+        return;
+    }
+
+    const struct mach_header *const header =
+        (const struct mach_header *)(map + file_offset);
+
+    const bool is_64 = header->magic == MH_MAGIC_64;
+    if (!is_64 && header->magic != MH_MAGIC) {
+        return;
+    }
+
+    uint64_t header_size = sizeof(struct mach_header);
+    uint64_t nlist_size = sizeof(struct nlist);
+
+    if (is_64) {
+        header_size = sizeof(struct mach_header_64);
+        nlist_size = sizeof(struct nlist_64);
+    }
+
+    const uint32_t sizeofcmds = header->sizeofcmds;
+    if (max_size < header_size || max_size - header_size < sizeofcmds) {
+        return;
+    }
+
+    set_range(entry,
+              DSC_IMAGE_ORDER_RANGE_LOAD_COMMANDS,
+              file_offset,
+              header_size + sizeofcmds,
+              dsc_size);
+
+    const uint8_t *iter = map + file_offset + header_size;
+    uint32_t size_left = sizeofcmds;
+
+    const uint32_t ncmds = header->ncmds;
+    for (uint32_t i = 0; i != ncmds; i++) {
+        if (size_left < sizeof(struct load_command)) {
+            return;
+        }
+
+        const struct load_command *const load_cmd =
+            (const struct load_command *)iter;
+
+        const uint32_t cmdsize = load_cmd->cmdsize;
+        if (cmdsize < sizeof(struct load_command) || cmdsize > size_left) {
+            return;
+        }
+
+        switch (load_cmd->cmd) {
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY: {
+                if (cmdsize < sizeof(struct dyld_info_command)) {
+                    return;
+                }
+
+                const struct dyld_info_command *const dyld_info =
+                    (const struct dyld_info_command *)iter;
+
+                /*
+                 * Prefer LC_DYLD_EXPORTS_TRIE, like when parsing the image.
+                 */
+
+                if (entry->end[DSC_IMAGE_ORDER_RANGE_EXPORT_TRIE] != 0) {
+                    break;
+                }
+
+                set_range(entry,
+                          DSC_IMAGE_ORDER_RANGE_EXPORT_TRIE,
+                          dyld_info->export_off,
+                          dyld_info->export_size,
+                          dsc_size);
+
+                break;
+            }
+
+            case LC_DYLD_EXPORTS_TRIE: {
+                if (cmdsize < sizeof(struct linkedit_data_command)) {
+                    return;
+                }
+
+                const struct linkedit_data_command *const export_trie =
+                    (const struct linkedit_data_command *)iter;
+
+                set_range(entry,
+                          DSC_IMAGE_ORDER_RANGE_EXPORT_TRIE,
+                          export_trie->dataoff,
+                          export_trie->datasize,
+                          dsc_size);
+
+                break;
+            }
+
+            case LC_SYMTAB: {
+                if (cmdsize < sizeof(struct symtab_command)) {
+                    return;
+                }
+
+                const struct symtab_command *const symtab =
+                    (const struct symtab_command *)iter;
+
+                set_range(entry,
+                          DSC_IMAGE_ORDER_RANGE_SYMBOL_TABLE,
+                          symtab->symoff,
+                          nlist_size * symtab->nsyms,
+                          dsc_size);
+
+                set_range(entry,
+                          DSC_IMAGE_ORDER_RANGE_STRING_TABLE,
+                          symtab->stroff,
+                          symtab->strsize,
+                          dsc_size);
+
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        iter += cmdsize;
+        size_left -= cmdsize;
+    }
+}
+
+/*
+ * Order images by the lowest offset of their export-trie or symbol-table, or
+ * by their header if they have neither, and then by their image-index.
+ */
+
+static uint64_t get_key(const struct dsc_image_order_entry *const entry) {
+    uint64_t key = UINT64_MAX;
+
+    const enum dsc_image_order_range linkedit_ranges[] = {
+        DSC_IMAGE_ORDER_RANGE_EXPORT_TRIE,
+        DSC_IMAGE_ORDER_RANGE_SYMBOL_TABLE
+    };
+
+    for (uint32_t i = 0; i != 2; i++) {
+        const enum dsc_image_order_range range = linkedit_ranges[i];
+        if (entry->end[range] != 0 && entry->begin[range] < key) {
+            key = entry->begin[range];
+        }
+    }
+
+    if (key == UINT64_MAX) {
+        key = entry->begin[DSC_IMAGE_ORDER_RANGE_LOAD_COMMANDS];
+    }
+
+    return key;
+}
+
+static int
+entry_comparator(const void *const left, const void *const right) {
+    const struct dsc_image_order_entry *const left_entry =
+        (const struct dsc_image_order_entry *)left;
+
+    const struct dsc_image_order_entry *const right_entry =
+        (const struct dsc_image_order_entry *)right;
+
+    if (left_entry->key != right_entry->key) {
+        return (left_entry->key < right_entry->key) ? -1 : 1;
+    }
+
+    if (left_entry->index != right_entry->index) {
+        return (left_entry->index < right_entry->index) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+enum dsc_image_order_result
+dsc_image_order_create(struct dsc_image_order *const order_out,
+                       const struct dyld_shared_cache_info *const dsc_info,
+                       const dsc_image_order_filter filter,
+                       void *const item,
+                       const uint64_t options)
+{
+    const uint32_t images_count = dsc_info->images_count;
+    struct dsc_image_order_entry *const entries =
+        calloc(images_count, sizeof(struct dsc_image_order_entry));
+
+    if (entries == NULL && images_count != 0) {
+        return E_DSC_IMAGE_ORDER_ALLOC_FAIL;
+    }
+
+    const uint8_t *const map = dsc_info->map;
+    const uint64_t dsc_size = dsc_info->size;
+
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i != images_count; i++) {
+        const struct dyld_cache_image_info *const image = dsc_info->images + i;
+        const char *const path = (const char *)(map + image->pathFileOffset);
+
+        if (!filter(image, path, item)) {
+            continue;
+        }
+
+        struct dsc_image_order_entry *const entry = entries + count;
+        entry->index = i;
+
+        count++;
+
+        uint64_t max_size = 0;
+        const uint64_t file_offset =
+            dyld_shared_cache_get_file_offset_from_address(dsc_info,
+                                                           image->address,
+                                                           &max_size);
+
+        if (file_offset == 0) {
+            continue;
+        }
+
+        find_image_ranges(entry, map, dsc_size, file_offset, max_size);
+        entry->key = get_key(entry);
+
+        if (options & O_DSC_IMAGE_ORDER_RELEASE_PAGES) {
+            if (count % DSC_IMAGE_ORDER_RELEASE_COUNT == 0) {
+                madvise(dsc_info->map, dsc_size, MADV_DONTNEED);
+            }
+        }
+    }
+
+    if (options & O_DSC_IMAGE_ORDER_RELEASE_PAGES) {
+        madvise(dsc_info->map, dsc_size, MADV_DONTNEED);
+    }
+
+    if (options & O_DSC_IMAGE_ORDER_BY_FILE_OFFSET) {
+        qsort(entries,
+              count,
+              sizeof(struct dsc_image_order_entry),
+              entry_comparator);
+    }
+
+    order_out->entries = entries;
+    order_out->count = count;
+
+    return E_DSC_IMAGE_ORDER_OK;
+}
+
+void
+dsc_image_order_advise(const struct dsc_image_order *const order,
+                       const struct dyld_shared_cache_info *const dsc_info,
+                       const uint32_t position)
+{
+    if (position % DSC_IMAGE_ORDER_ADVISE_COUNT != 0) {
+        return;
+    }
+
+    const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+    const uint64_t page_mask = page_size - 1;
+
+    uint32_t end = position + DSC_IMAGE_ORDER_ADVISE_COUNT;
+    if (end > order->count) {
+        end = order->count;
+    }
+
+    /*
+     * Images often share a string-table, which only has to be advised once.
+     */
+
+    uint64_t last_string_table_begin = 0;
+    uint64_t last_string_table_end = 0;
+
+    for (uint32_t i = position; i < end; i++) {
+        const struct dsc_image_order_entry *const entry = order->entries + i;
+        for (uint32_t j = 0; j != DSC_IMAGE_ORDER_RANGE_COUNT; j++) {
+            const uint64_t range_end = entry->end[j];
+            if (range_end == 0) {
+                continue;
+            }
+
+            const uint64_t range_begin = entry->begin[j];
+            if (j == DSC_IMAGE_ORDER_RANGE_STRING_TABLE) {
+                if (range_begin == last_string_table_begin &&
+                    range_end == last_string_table_end)
+                {
+                    continue;
+                }
+
+                last_string_table_begin = range_begin;
+                last_string_table_end = range_end;
+            }
+
+            const uint64_t page_begin = range_begin & ~page_mask;
+            madvise(dsc_info->map + page_begin,
+                    range_end - page_begin,
+                    MADV_WILLNEED);
+        }
+    }
+}
+
+void dsc_image_order_destroy(struct dsc_image_order *const order) {
+    free(order->entries);
+
+    order->entries = NULL;
+    order->count = 0;
+}
@@ -0,0 +1,403 @@
+//
+//  src/dsc_image_selection.c
+//  tbd
+//
+//  Created by inoahdev on 3/18/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "dsc_image_selection.h"
+#include "path.h"
+#include "tbd_for_main.h"
+
+static inline const char *
+get_path_string(const struct dsc_image_selection *const selection,
+                const uint32_t index)
+{
+    const struct tbd_for_main_dsc_image_path *const paths =
+        selection->paths->data;
+
+    return paths[index].string;
+}
+
+static inline const struct tbd_for_main_dsc_image_filter *
+get_filter(const struct dsc_image_selection *const selection,
+           const uint32_t index)
+{
+    const struct tbd_for_main_dsc_image_filter *const filters =
+        selection->filters->data;
+
+    return filters + index;
+}
+
+struct path_key {
+    const struct dsc_image_selection *selection;
+    const char *path;
+};
+
+static bool path_matches(const void *const info, const uint32_t index) {
+    const struct path_key *const key = info;
+    return strcmp(get_path_string(key->selection, index), key->path) == 0;
+}
+
+static struct hash_table_slot *
+find_path_slot(const struct dsc_image_selection *const selection,
+               const char *const path,
+               const uint32_t hash)
+{
+    const struct path_key key = {
+        .selection = selection,
+        .path = path
+    };
+
+    return hash_table_find_slot(&selection->path_table,
+                                hash,
+                                path_matches,
+                                &key);
+}
+
+struct filter_key {
+    const struct dsc_image_selection *selection;
+
+    const char *component;
+    uint64_t length;
+};
+
+static bool filter_matches(const void *const info, const uint32_t index) {
+    const struct filter_key *const key = info;
+    const struct tbd_for_main_dsc_image_filter *const filter =
+        get_filter(key->selection, index);
+
+    if (filter->length != key->length) {
+        return false;
+    }
+
+    return memcmp(filter->string, key->component, key->length) == 0;
+}
+
+static struct hash_table_slot *
+find_filter_slot(const struct dsc_image_selection *const selection,
+                 const char *const component,
+                 const uint64_t length,
+                 const uint32_t hash)
+{
+    const struct filter_key key = {
+        .selection = selection,
+        .component = component,
+        .length = length
+    };
+
+    return hash_table_find_slot(&selection->filter_table,
+                                hash,
+                                filter_matches,
+                                &key);
+}
+
+static enum dsc_image_selection_result
+create_path_table(struct dsc_image_selection *const selection) {
+    const struct array *const paths = selection->paths;
+    const uint64_t count =
+        array_get_item_count(paths, sizeof(struct tbd_for_main_dsc_image_path));
+
+    if (count == 0) {
+        return E_DSC_IMAGE_SELECTION_OK;
+    }
+
+    if (!hash_table_reserve(&selection->path_table, count)) {
+        return E_DSC_IMAGE_SELECTION_ALLOC_FAIL;
+    }
+
+    selection->found_paths = calloc(count, sizeof(bool));
+    if (selection->found_paths == NULL) {
+        return E_DSC_IMAGE_SELECTION_ALLOC_FAIL;
+    }
+
+    /*
+     * Only the first of any duplicate paths is inserted, as the first path
+     * provided is the one that was always matched.
+     */
+
+    for (uint32_t i = 0; i != count; i++) {
+        const char *const string = get_path_string(selection, i);
+        const uint32_t hash = hash_string(string, strlen(string));
+
+        struct hash_table_slot *const slot =
+            find_path_slot(selection, string, hash);
+
+        if (slot->index != 0) {
+            continue;
+        }
+
+        hash_table_set_slot(&selection->path_table, slot, hash, i);
+
+        selection->paths_left += 1;
+    }
+
+    return E_DSC_IMAGE_SELECTION_OK;
+}
+
+static inline bool
+filter_is_component(const struct tbd_for_main_dsc_image_filter *const filter) {
+    const uint64_t length = filter->length;
+    if (length == 0) {
+        return false;
+    }
+
+    return memchr(filter->string, '/', length) == NULL;
+}
+
+static enum dsc_image_selection_result
+create_filter_table(struct dsc_image_selection *const selection) {
+    const struct array *const filters = selection->filters;
+    const uint64_t count =
+        array_get_item_count(filters,
+                             sizeof(struct tbd_for_main_dsc_image_filter));
+
+    if (count == 0) {
+        return E_DSC_IMAGE_SELECTION_OK;
+    }
+
+    if (!hash_table_reserve(&selection->filter_table, count)) {
+        return E_DSC_IMAGE_SELECTION_ALLOC_FAIL;
+    }
+
+    selection->unindexed_filters = calloc(count, sizeof(uint32_t));
+    if (selection->unindexed_filters == NULL) {
+        return E_DSC_IMAGE_SELECTION_ALLOC_FAIL;
+    }
+
+    for (uint32_t i = 0; i != count; i++) {
+        const struct tbd_for_main_dsc_image_filter *const filter =
+            get_filter(selection, i);
+
+        if (!filter_is_component(filter)) {
+            const uint64_t unindexed_count = selection->unindexed_filters_count;
+
+            selection->unindexed_filters[unindexed_count] = i;
+            selection->unindexed_filters_count = unindexed_count + 1;
+
+            continue;
+        }
+
+        const char *const string = filter->string;
+        const uint64_t length = filter->length;
+        const uint32_t hash = hash_string(string, length);
+
+        struct hash_table_slot *const slot =
+            find_filter_slot(selection, string, length, hash);
+
+        /*
+         * Keep the first of any duplicate filters, as filters are matched in
+         * the order they were provided.
+         */
+
+        if (slot->index != 0) {
+            continue;
+        }
+
+        hash_table_set_slot(&selection->filter_table, slot, hash, i);
+    }
+
+    return E_DSC_IMAGE_SELECTION_OK;
+}
+
+enum dsc_image_selection_result
+dsc_image_selection_create(struct dsc_image_selection *const selection,
+                           const struct array *const filters,
+                           const struct array *const paths,
+                           const bool allows_hierarchy)
+{
+    *selection = (struct dsc_image_selection){
+        .filters = filters,
+        .paths = paths,
+        .allows_hierarchy = allows_hierarchy
+    };
+
+    if (create_path_table(selection) != E_DSC_IMAGE_SELECTION_OK) {
+        dsc_image_selection_destroy(selection);
+        return E_DSC_IMAGE_SELECTION_ALLOC_FAIL;
+    }
+
+    if (create_filter_table(selection) != E_DSC_IMAGE_SELECTION_OK) {
+        dsc_image_selection_destroy(selection);
+        return E_DSC_IMAGE_SELECTION_ALLOC_FAIL;
+    }
+
+    return E_DSC_IMAGE_SELECTION_OK;
+}
+
+/*
+ * Find the index of the first indexed filter that matches a component of the
+ * path, or UINT32_MAX if there's none.
+ *
+ * This follows path_has_component(), where components are separated by rows of
+ * slashes, and a component is only in the hierarchy if another component
+ * follows it.
+ */
+
+static uint32_t
+find_indexed_filter(const struct dsc_image_selection *const selection,
+                    const char *const path)
+{
+    uint32_t first_index = UINT32_MAX;
+    const char *iter = path;
+
+    do {
+        while (*iter == '/') {
+            iter++;
+        }
+
+        if (*iter == '\0') {
+            break;
+        }
+
+        const char *const component = iter;
+        while (*iter != '/' && *iter != '\0') {
+            iter++;
+        }
+
+        const char *next = iter;
+        while (*next == '/') {
+            next++;
+        }
+
+        if (*next != '\0' && !selection->allows_hierarchy) {
+            continue;
+        }
+
+        const uint64_t length = (uint64_t)(iter - component);
+        const uint32_t hash = hash_string(component, length);
+
+        const struct hash_table_slot *const slot =
+            find_filter_slot(selection, component, length, hash);
+
+        if (slot->index == 0) {
+            continue;
+        }
+
+        const uint32_t index = slot->index - 1;
+        if (index < first_index) {
+            first_index = index;
+        }
+    } while (*iter != '\0');
+
+    return first_index;
+}
+
+uint64_t *
+dsc_image_selection_find(const struct dsc_image_selection *const selection,
+                         const char *const path,
+                         int64_t *const path_index_out)
+{
+    *path_index_out = -1;
+
+    if (selection->path_table.capacity != 0) {
+        const uint32_t hash = hash_string(path, strlen(path));
+        const struct hash_table_slot *const slot =
+            find_path_slot(selection, path, hash);
+
+        if (slot->index != 0) {
+            struct tbd_for_main_dsc_image_path *const paths =
+                selection->paths->data;
+
+            const uint32_t index = slot->index - 1;
+
+            *path_index_out = index;
+            return &paths[index].flags;
+        }
+    }
+
+    if (selection->filter_table.capacity == 0) {
+        return NULL;
+    }
+
+    uint32_t first_index = find_indexed_filter(selection, path);
+
+    /*
+     * Only unindexed filters provided before the first matching indexed filter
+     * have to be checked.
+     */
+
+    const uint32_t *iter = selection->unindexed_filters;
+    const uint32_t *const end = iter + selection->unindexed_filters_count;
+
+    for (; iter != end; iter++) {
+        const uint32_t index = *iter;
+        if (index > first_index) {
+            break;
+        }
+
+        const struct tbd_for_main_dsc_image_filter *const filter =
+            get_filter(selection, index);
+
+        const bool has_component =
+            path_has_component(path,
+                               filter->string,
+                               filter->length,
+                               selection->allows_hierarchy);
+
+        if (has_component) {
+            first_index = index;
+            break;
+        }
+    }
+
+    if (first_index == UINT32_MAX) {
+        return NULL;
+    }
+
+    struct tbd_for_main_dsc_image_filter *const filters =
+        selection->filters->data;
+
+    return &filters[first_index].flags;
+}
+
+void
+dsc_image_selection_mark_found(struct dsc_image_selection *const selection,
+                               uint64_t *const flags,
+                               const int64_t path_index)
+{
+    if (flags != NULL) {
+        *flags |= F_TBD_FOR_MAIN_DSC_IMAGE_FOUND_ONE;
+    }
+
+    if (path_index == -1) {
+        return;
+    }
+
+    bool *const found = selection->found_paths + path_index;
+    if (*found) {
+        return;
+    }
+
+    *found = true;
+    selection->paths_left -= 1;
+}
+
+bool
+dsc_image_selection_is_complete(
+    const struct dsc_image_selection *const selection)
+{
+    if (!array_is_empty(selection->filters)) {
+        return false;
+    }
+
+    return selection->paths_left == 0;
+}
+
+void dsc_image_selection_destroy(struct dsc_image_selection *const selection) {
+    hash_table_destroy(&selection->path_table);
+    hash_table_destroy(&selection->filter_table);
+
+    free(selection->unindexed_filters);
+    free(selection->found_paths);
+
+    selection->unindexed_filters = NULL;
+    selection->found_paths = NULL;
+
+    selection->unindexed_filters_count = 0;
+    selection->paths_left = 0;
+}
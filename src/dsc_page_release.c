@@ -0,0 +1,332 @@
+//
+//  src/dsc_page_release.c
+//  tbd
+//
+//  Created by inoahdev on 3/27/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <sys/mman.h>
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "dsc_page_release.h"
+
+struct page_range {
+    uint64_t first_page;
+    uint64_t end_page;
+
+    uint32_t position;
+};
+
+static int
+page_range_comparator(const void *const left, const void *const right) {
+    const struct page_range *const left_range =
+        (const struct page_range *)left;
+
+    const struct page_range *const right_range =
+        (const struct page_range *)right;
+
+    if (left_range->first_page != right_range->first_page) {
+        return (left_range->first_page < right_range->first_page) ? -1 : 1;
+    }
+
+    if (left_range->end_page != right_range->end_page) {
+        return (left_range->end_page < right_range->end_page) ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Collect the page-ranges of every image in the order, with each range only
+ * appearing once, with the highest position of the images that read from it.
+ *
+ * Many images share a single string-table, which would otherwise have each of
+ * its pages visited once for every image.
+ */
+
+static struct page_range *
+collect_page_ranges(const struct dsc_image_order *const order,
+                    const uint64_t page_size,
+                    uint64_t *const count_out)
+{
+    const uint64_t max_count =
+        (uint64_t)order->count * DSC_IMAGE_ORDER_RANGE_COUNT;
+
+    struct page_range *const ranges =
+        calloc(max_count, sizeof(struct page_range));
+
+    if (ranges == NULL && max_count != 0) {
+        return NULL;
+    }
+
+    uint64_t count = 0;
+    for (uint32_t i = 0; i != order->count; i++) {
+        const struct dsc_image_order_entry *const entry = order->entries + i;
+        for (uint32_t j = 0; j != DSC_IMAGE_ORDER_RANGE_COUNT; j++) {
+            const uint64_t end = entry->end[j];
+            if (end == 0) {
+                continue;
+            }
+
+            struct page_range *const range = ranges + count;
+
+            range->first_page = entry->begin[j] / page_size;
+            range->end_page = (end + page_size - 1) / page_size;
+            range->position = i;
+
+            count++;
+        }
+    }
+
+    qsort(ranges, count, sizeof(struct page_range), page_range_comparator);
+
+    uint64_t unique_count = 0;
+    for (uint64_t i = 0; i != count; i++) {
+        const struct page_range *const range = ranges + i;
+        if (unique_count != 0) {
+            struct page_range *const last = ranges + (unique_count - 1);
+            if (last->first_page == range->first_page &&
+                last->end_page == range->end_page)
+            {
+                if (last->position < range->position) {
+                    last->position = range->position;
+                }
+
+                continue;
+            }
+        }
+
+        ranges[unique_count] = *range;
+        unique_count++;
+    }
+
+    *count_out = unique_count;
+    return ranges;
+}
+
+enum dsc_page_release_result
+dsc_page_release_create(struct dsc_page_release *const release_out,
+                        const struct dyld_shared_cache_info *const dsc_info,
+                        const struct dsc_image_order *const order,
+                        const int fd,
+                        const uint64_t max_size)
+{
+    const uint64_t page_size = (uint64_t)sysconf(_SC_PAGESIZE);
+    const uint64_t page_count = (dsc_info->size + page_size - 1) / page_size;
+
+    uint64_t ranges_count = 0;
+    struct page_range *const ranges =
+        collect_page_ranges(order, page_size, &ranges_count);
+
+    if (ranges == NULL && ranges_count != 0) {
+        return E_DSC_PAGE_RELEASE_ALLOC_FAIL;
+    }
+
+    /*
+     * Store the owner of each page as its position plus one, so a page no
+     * image reads from has an owner of zero.
+     */
+
+    uint32_t *const owners = calloc(page_count, sizeof(uint32_t));
+    if (owners == NULL && page_count != 0) {
+        free(ranges);
+        return E_DSC_PAGE_RELEASE_ALLOC_FAIL;
+    }
+
+    for (uint64_t i = 0; i != ranges_count; i++) {
+        const struct page_range *const range = ranges + i;
+        const uint32_t owner = range->position + 1;
+
+        uint64_t end_page = range->end_page;
+        if (end_page > page_count) {
+            end_page = page_count;
+        }
+
+        for (uint64_t page = range->first_page; page < end_page; page++) {
+            if (owners[page] < owner) {
+                owners[page] = owner;
+            }
+        }
+    }
+
+    free(ranges);
+
+    /*
+     * Group the page-numbers by their owner with a counting-sort, which keeps
+     * the page-numbers of each owner in increasing order.
+     */
+
+    const uint32_t count = order->count;
+    uint64_t *const owner_starts = calloc(count + 1ull, sizeof(uint64_t));
+
+    if (owner_starts == NULL) {
+        free(owners);
+        return E_DSC_PAGE_RELEASE_ALLOC_FAIL;
+    }
+
+    uint64_t tracked_count = 0;
+    for (uint64_t page = 0; page != page_count; page++) {
+        const uint32_t owner = owners[page];
+        if (owner != 0) {
+            owner_starts[owner] += 1;
+            tracked_count++;
+        }
+    }
+
+    for (uint32_t i = 0; i != count; i++) {
+        owner_starts[i + 1] += owner_starts[i];
+    }
+
+    uint64_t *const pages = calloc(tracked_count, sizeof(uint64_t));
+    if (pages == NULL && tracked_count != 0) {
+        free(owner_starts);
+        free(owners);
+
+        return E_DSC_PAGE_RELEASE_ALLOC_FAIL;
+    }
+
+    /*
+     * owner_starts[i] is used as the cursor of the group of position i, which
+     * leaves it at the start of the next group once every page-number is
+     * placed, so the starts are shifted back afterwards.
+     */
+
+    for (uint64_t page = 0; page != page_count; page++) {
+        const uint32_t owner = owners[page];
+        if (owner == 0) {
+            continue;
+        }
+
+        const uint64_t index = owner_starts[owner - 1];
+
+        pages[index] = page;
+        owner_starts[owner - 1] = index + 1;
+    }
+
+    for (uint32_t i = count; i != 0; i--) {
+        owner_starts[i] = owner_starts[i - 1];
+    }
+
+    owner_starts[0] = 0;
+    free(owners);
+
+    release_out->map = dsc_info->map;
+    release_out->size = dsc_info->size;
+    release_out->fd = fd;
+    release_out->page_size = page_size;
+    release_out->pages = pages;
+    release_out->owner_starts = owner_starts;
+    release_out->done_position = 0;
+    release_out->released_position = 0;
+    release_out->pending_size = 0;
+    release_out->max_size = max_size;
+
+    return E_DSC_PAGE_RELEASE_OK;
+}
+
+static void
+release_pages(const struct dsc_page_release *const release,
+              const uint64_t first_page,
+              const uint64_t end_page)
+{
+    const uint64_t page_size = release->page_size;
+    const uint64_t offset = first_page * page_size;
+
+    uint64_t length = (end_page - first_page) * page_size;
+    if (length > release->size - offset) {
+        length = release->size - offset;
+    }
+
+    madvise(release->map + offset, length, MADV_DONTNEED);
+    if (release->fd != -1) {
+        posix_fadvise(release->fd,
+                      (off_t)offset,
+                      (off_t)length,
+                      POSIX_FADV_DONTNEED);
+    }
+}
+
+/*
+ * Release the pages owned by every image before position, with each run of
+ * consecutive pages released at once.
+ */
+
+static void
+release_until(struct dsc_page_release *const release,
+              const uint32_t position)
+{
+    const uint64_t begin = release->owner_starts[release->released_position];
+    const uint64_t end = release->owner_starts[position];
+
+    const uint64_t *const pages = release->pages;
+
+    uint64_t first_page = 0;
+    uint64_t end_page = 0;
+
+    for (uint64_t i = begin; i != end; i++) {
+        const uint64_t page = pages[i];
+        if (page == end_page && end_page != first_page) {
+            end_page++;
+            continue;
+        }
+
+        if (end_page != first_page) {
+            release_pages(release, first_page, end_page);
+        }
+
+        first_page = page;
+        end_page = page + 1;
+    }
+
+    if (end_page != first_page) {
+        release_pages(release, first_page, end_page);
+    }
+
+    release->released_position = position;
+    release->pending_size = 0;
+}
+
+void
+dsc_page_release_set_done(struct dsc_page_release *const release,
+                          const uint32_t position)
+{
+    if (position <= release->done_position) {
+        return;
+    }
+
+    const uint64_t *const owner_starts = release->owner_starts;
+    const uint64_t pages_count =
+        owner_starts[position] - owner_starts[release->done_position];
+
+    release->pending_size += pages_count * release->page_size;
+    release->done_position = position;
+
+    if (release->pending_size > release->max_size) {
+        release_until(release, position);
+    }
+}
+
+void dsc_page_release_flush(struct dsc_page_release *const release) {
+    if (release->released_position != release->done_position) {
+        release_until(release, release->done_position);
+    }
+}
+
+void dsc_page_release_destroy(struct dsc_page_release *const release) {
+    free(release->pages);
+    free(release->owner_starts);
+
+    release->map = NULL;
+    release->size = 0;
+
+    release->pages = NULL;
+    release->owner_starts = NULL;
+
+    release->done_position = 0;
+    release->released_position = 0;
+    release->pending_size = 0;
+}
@@ -10,7 +10,9 @@
 #include <sys/stat.h>
 
 #include <errno.h>
+#include <fcntl.h>
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -21,6 +23,7 @@
 
 #include "guard_overflow.h"
 #include "range.h"
+#include "stats.h"
 
 static const uint64_t dsc_magic_64 = 2319765435151317348;
 
@@ -159,6 +162,182 @@ get_arch_info_from_magic(const char magic[16],
     return 0;
 }
 
+/*
+ * Verify the images if need be. Since the images array is quite large (Usually
+ * >1000 images), we only loop over it when asked to.
+ */
+
+static bool
+verify_images(const struct dyld_cache_image_info *const images,
+              const uint32_t images_count,
+              const struct range available_cache_range,
+              const uint64_t options)
+{
+    if (!(options & O_DYLD_SHARED_CACHE_PARSE_VERIFY_IMAGE_PATH_OFFSETS)) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < images_count; i++) {
+        const struct dyld_cache_image_info *const image = images + i;
+        const uint32_t location = image->pathFileOffset;
+
+        if (!range_contains_location(available_cache_range, location)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static enum dyld_shared_cache_parse_result
+read_header_field(const int fd,
+                  const uint64_t offset,
+                  void *const field,
+                  const uint64_t size)
+{
+    if (pread(fd, field, size, (off_t)offset) != (ssize_t)size) {
+        return E_DYLD_SHARED_CACHE_PARSE_READ_FAIL;
+    }
+
+    stats_add(STATS_COUNTER_BYTES_READ, size);
+    return E_DYLD_SHARED_CACHE_PARSE_OK;
+}
+
+/*
+ * Read the location of the sub-cache entries, if the header is large enough
+ * to have them, and verify the entries are within the cache-file.
+ */
+
+static enum dyld_shared_cache_parse_result
+read_subcaches_header(const int fd,
+                      const uint32_t mapping_offset,
+                      const struct range available_cache_range,
+                      struct dyld_cache_header_subcaches *const header_out,
+                      uint32_t *const entry_size_out)
+{
+    const uint64_t header_end =
+        DYLD_CACHE_HEADER_SUBCACHES_OFFSET +
+        sizeof(struct dyld_cache_header_subcaches);
+
+    if (mapping_offset < header_end) {
+        return E_DYLD_SHARED_CACHE_PARSE_OK;
+    }
+
+    struct dyld_cache_header_subcaches header = {};
+    const enum dyld_shared_cache_parse_result read_result =
+        read_header_field(fd,
+                          DYLD_CACHE_HEADER_SUBCACHES_OFFSET,
+                          &header,
+                          sizeof(header));
+
+    if (read_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        return read_result;
+    }
+
+    if (header.subCacheArrayCount == 0) {
+        return E_DYLD_SHARED_CACHE_PARSE_OK;
+    }
+
+    uint32_t entry_size = sizeof(struct dyld_subcache_entry);
+    if (mapping_offset <= DYLD_CACHE_HEADER_CACHE_SUB_TYPE_OFFSET) {
+        entry_size = sizeof(struct dyld_subcache_entry_v1);
+    }
+
+    uint64_t entries_size = entry_size;
+    if (guard_overflow_mul(&entries_size, header.subCacheArrayCount)) {
+        return E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES;
+    }
+
+    uint64_t entries_end = header.subCacheArrayOffset;
+    if (guard_overflow_add(&entries_end, entries_size)) {
+        return E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES;
+    }
+
+    const struct range entries_range = {
+        .begin = header.subCacheArrayOffset,
+        .end = entries_end
+    };
+
+    if (!range_contains_range(available_cache_range, entries_range)) {
+        return E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES;
+    }
+
+    *header_out = header;
+    *entry_size_out = entry_size;
+
+    return E_DYLD_SHARED_CACHE_PARSE_OK;
+}
+
+/*
+ * Verify that every mapping is within the file, and that no mappings overlap.
+ */
+
+static enum dyld_shared_cache_parse_result
+verify_mappings(const struct dyld_cache_mapping_info *const mappings,
+                const uint32_t mapping_count,
+                const uint64_t dsc_size)
+{
+    /*
+     * Mappings are like mach-o segments, covering entire swaths of the file.
+     */
+
+    const struct range full_cache_range = {
+        .begin = 0,
+        .end = dsc_size
+    };
+
+    for (uint32_t i = 0; i < mapping_count; i++) {
+        const struct dyld_cache_mapping_info *const mapping = mappings + i;
+
+        /*
+         * We skip validation of mapping's address-range as its irrelevant to
+         * our operations, and because we aim to be lenient.
+         */
+
+        const uint64_t mapping_file_begin = mapping->fileOffset;
+        uint64_t mapping_file_end = mapping_file_begin;
+
+        if (guard_overflow_add(&mapping_file_end, mapping->size)) {
+            return E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS;
+        }
+
+        const struct range mapping_file_range = {
+            .begin = mapping_file_begin,
+            .end = mapping_file_end
+        };
+
+        if (!range_contains_range(full_cache_range, mapping_file_range)) {
+            return E_DYLD_SHARED_CACHE_PARSE_INVALID_MAPPINGS;
+        }
+
+        /*
+         * Check the previous mappings, which conveniently have already gone
+         * through verification in this loop before, for any overlaps with the
+         * current mapping.
+         */
+
+        for (uint32_t j = 0; j < i; j++) {
+            const struct dyld_cache_mapping_info *const inner_mapping =
+                mappings + j;
+
+            const uint64_t inner_file_begin = inner_mapping->fileOffset;
+            const uint64_t inner_file_end =
+                inner_file_begin + inner_mapping->size;
+
+            const struct range inner_file_range = {
+                .begin = inner_file_begin,
+                .end = inner_file_end
+            };
+
+            if (ranges_overlap(mapping_file_range, inner_file_range)) {
+                return E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS;
+            }
+        }
+    }
+
+    return E_DYLD_SHARED_CACHE_PARSE_OK;
+}
+
 enum dyld_shared_cache_parse_result
 dyld_shared_cache_parse_from_file(struct dyld_shared_cache_info *const info_in,
                                   const int fd,
@@ -186,6 +365,8 @@ dyld_shared_cache_parse_from_file(struct dyld_shared_cache_info *const info_in,
         return E_DYLD_SHARED_CACHE_PARSE_READ_FAIL;
     }
 
+    stats_add(STATS_COUNTER_BYTES_READ, sizeof(header) - 16);
+
     struct stat sbuf = {};
     if (fstat(fd, &sbuf) < 0) {
         return E_DYLD_SHARED_CACHE_PARSE_FSTAT_FAIL;
@@ -206,22 +387,59 @@ dyld_shared_cache_parse_from_file(struct dyld_shared_cache_info *const info_in,
      */
 
     const uint32_t mapping_offset = header.mappingOffset;
-    const uint32_t images_offset = header.imagesOffset;    
-
     if (!range_contains_location(available_cache_range, mapping_offset)) {
         return E_DYLD_SHARED_CACHE_PARSE_INVALID_MAPPINGS;
     }
 
+    /*
+     * Newer dyld_shared_caches store their images in a newer field of the
+     * header, leaving the original fields empty.
+     */
+
+    uint32_t images_offset = header.imagesOffset;
+    uint32_t images_count = header.imagesCount;
+
+    if (images_count == 0 &&
+        mapping_offset >= DYLD_CACHE_HEADER_CACHE_SUB_TYPE_OFFSET)
+    {
+        struct dyld_cache_header_images images_header = {};
+        const enum dyld_shared_cache_parse_result read_images_result =
+            read_header_field(fd,
+                              DYLD_CACHE_HEADER_IMAGES_OFFSET,
+                              &images_header,
+                              sizeof(images_header));
+
+        if (read_images_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+            return read_images_result;
+        }
+
+        images_offset = images_header.imagesOffset;
+        images_count = images_header.imagesCount;
+    }
+
     if (!range_contains_location(available_cache_range, images_offset)) {
         return E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES;
     }
 
+    struct dyld_cache_header_subcaches subcaches_header = {};
+    uint32_t subcache_entry_size = 0;
+
+    const enum dyld_shared_cache_parse_result read_subcaches_result =
+        read_subcaches_header(fd,
+                              mapping_offset,
+                              available_cache_range,
+                              &subcaches_header,
+                              &subcache_entry_size);
+
+    if (read_subcaches_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        return read_subcaches_result;
+    }
+
     /*
      * Validate that the mapping-infos array and images-array have no overflows.
      */
 
     const uint32_t mapping_count = header.mappingCount;
-    const uint32_t images_count = header.imagesCount;
 
     /*
      * Get the size of the mapping-infos table by multipying the mapping-count
@@ -302,136 +520,511 @@ dyld_shared_cache_parse_from_file(struct dyld_shared_cache_info *const info_in,
     /*
      * Map file to memory only at the last moment, after all checking has been
      * done to ensure this is a valid dyld_shared_cache file.
+     *
+     * The map is never written to, so its pages are shared with the page-cache
+     * (and any other process mapping the same file) instead of being copied.
      */
 
-    uint8_t *const map =
-        mmap(0, dsc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
-
+    uint8_t *const map = mmap(0, dsc_size, PROT_READ, MAP_SHARED, fd, 0);
     if (map == MAP_FAILED) {
         return E_DYLD_SHARED_CACHE_PARSE_MMAP_FAIL;
     }
 
+    stats_add(STATS_COUNTER_BYTES_MAPPED, dsc_size);
+
     const struct dyld_cache_mapping_info *const mappings =
         (const struct dyld_cache_mapping_info *)(map + mapping_offset);
 
-    /*
-     * Mappings are like mach-o segments, covering entire swaths of the file.
-     */
+    const enum dyld_shared_cache_parse_result verify_mappings_result =
+        verify_mappings(mappings, mapping_count, dsc_size);
 
-    const struct range full_cache_range = {
-        .begin = 0, 
-        .end = dsc_size 
-    };
+    if (verify_mappings_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        munmap(map, dsc_size);
+        return verify_mappings_result;
+    }
+
+    const struct dyld_cache_image_info *const images =
+        (const struct dyld_cache_image_info *)(map + images_offset);
+
+    const bool images_ok =
+        verify_images(images, images_count, available_cache_range, options);
+
+    if (!images_ok) {
+        munmap(map, dsc_size);
+        return E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES;
+    }
+
+    info_in->images = images;
+    info_in->images_count = images_count;
+
+    info_in->mappings = mappings;
+    info_in->mappings_count = mapping_count;
+
+    if (subcaches_header.subCacheArrayCount != 0) {
+        info_in->subcache_entries = map + subcaches_header.subCacheArrayOffset;
+        info_in->subcache_entries_count = subcaches_header.subCacheArrayCount;
+        info_in->subcache_entry_size = subcache_entry_size;
+    }
+
+    info_in->arch = arch;
+    info_in->arch_bit = arch_bit;
+
+    info_in->map = map;
+    info_in->size = dsc_size;
+
+    info_in->flags |= F_DYLD_SHARED_CACHE_UNMAP_MAP;
+    return E_DYLD_SHARED_CACHE_PARSE_OK;
+}
+
+/*
+ * Create the path of a sub-cache by appending its suffix to the path of the
+ * main cache-file.
+ */
+
+static char *
+create_subcache_path(const struct dyld_shared_cache_info *const info,
+                     const char *const path,
+                     const uint64_t path_length,
+                     const uint32_t index)
+{
+    const uint8_t *const entry =
+        info->subcache_entries + (uint64_t)info->subcache_entry_size * index;
+
+    char suffix[33] = {};
+    if (info->subcache_entry_size == sizeof(struct dyld_subcache_entry_v1)) {
+        snprintf(suffix, sizeof(suffix), ".%u", index + 1);
+    } else {
+        const struct dyld_subcache_entry *const subcache_entry =
+            (const struct dyld_subcache_entry *)entry;
+
+        memcpy(suffix,
+               subcache_entry->fileSuffix,
+               sizeof(subcache_entry->fileSuffix));
+    }
+
+    const uint64_t suffix_length = strlen(suffix);
+    char *const subcache_path = malloc(path_length + suffix_length + 1);
+
+    if (subcache_path == NULL) {
+        return NULL;
+    }
+
+    memcpy(subcache_path, path, path_length);
+    memcpy(subcache_path + path_length, suffix, suffix_length + 1);
+
+    return subcache_path;
+}
+
+static void
+free_subcaches(struct dyld_shared_cache_subcache *const subcaches,
+               const uint32_t count)
+{
+    for (uint32_t i = 0; i != count; i++) {
+        struct dyld_shared_cache_subcache *const subcache = subcaches + i;
+        if (subcache->map != NULL) {
+            munmap(subcache->map, subcache->size);
+        }
+
+        free(subcache->path);
+    }
+
+    free(subcaches);
+}
+
+/*
+ * Find the sub-cache whose address-range contains address. The sub-caches are
+ * sorted by their address.
+ */
+
+static struct dyld_shared_cache_subcache *
+find_subcache_for_address(const struct dyld_shared_cache_info *const info,
+                          const uint64_t address)
+{
+    struct dyld_shared_cache_subcache *const subcaches = info->subcaches;
+
+    uint32_t low = 0;
+    uint32_t high = info->subcaches_count;
+
+    while (low != high) {
+        const uint32_t middle = low + (high - low) / 2;
+        struct dyld_shared_cache_subcache *const subcache = subcaches + middle;
+
+        if (address < subcache->address) {
+            high = middle;
+        } else if (address >= subcache->end_address) {
+            low = middle + 1;
+        } else {
+            return subcache;
+        }
+    }
+
+    return NULL;
+}
+
+enum dyld_shared_cache_parse_result
+dyld_shared_cache_find_subcaches(struct dyld_shared_cache_info *const info_in,
+                                 const char *const path)
+{
+    const uint32_t count = info_in->subcache_entries_count;
+    if (count == 0) {
+        return E_DYLD_SHARED_CACHE_PARSE_OK;
+    }
 
     /*
-     * Verify we don't have any overlapping mappings.
+     * The address of each sub-cache is stored relative to the address of the
+     * main cache-file.
      */
 
-    for (uint32_t i = 0; i < mapping_count; i++) {
-        const struct dyld_cache_mapping_info *const mapping = mappings + i;
-    
-        /*
-         * We skip validation of mapping's address-range as its irrelevant to
-         * our operations, and because we aim to be lenient.
-         */
+    if (path == NULL || info_in->mappings_count == 0) {
+        return E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES;
+    }
 
-        const uint64_t mapping_file_begin = mapping->fileOffset;
-        uint64_t mapping_file_end = mapping_file_begin;
+    struct dyld_shared_cache_subcache *const subcaches =
+        calloc(count, sizeof(struct dyld_shared_cache_subcache));
 
-        if (guard_overflow_add(&mapping_file_end, mapping->size)) {
-            munmap(map, dsc_size);
-            return E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS;
-        }
+    if (subcaches == NULL) {
+        return E_DYLD_SHARED_CACHE_PARSE_ALLOC_FAIL;
+    }
 
-        const struct range mapping_file_range = {
-            .begin = mapping_file_begin,
-            .end = mapping_file_end
-        };
+    const uint64_t base_address = info_in->mappings[0].address;
+    const uint64_t path_length = strlen(path);
 
-        if (!range_contains_range(full_cache_range, mapping_file_range)) {
-            munmap(map, dsc_size);
-            return E_DYLD_SHARED_CACHE_PARSE_INVALID_MAPPINGS;            
+    for (uint32_t i = 0; i != count; i++) {
+        struct dyld_shared_cache_subcache *const subcache = subcaches + i;
+        const struct dyld_subcache_entry_v1 *const entry =
+            (const struct dyld_subcache_entry_v1 *)
+                (info_in->subcache_entries +
+                 (uint64_t)info_in->subcache_entry_size * i);
+
+        uint64_t address = base_address;
+        if (guard_overflow_add(&address, entry->cacheVMOffset)) {
+            free_subcaches(subcaches, i);
+            return E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES;
         }
 
-        /*
-         * Check the previous mappings, which conveniently have already gone
-         * through verification in this loop before, for any overlaps with the
-         * current mapping.
-         */
+        if (i != 0 && address <= subcaches[i - 1].address) {
+            free_subcaches(subcaches, i);
+            return E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES;
+        }
 
-        for (uint32_t j = 0; j < i; j++) {
-            const struct dyld_cache_mapping_info *const inner_mapping =
-                mappings + j;
+        char *const subcache_path =
+            create_subcache_path(info_in, path, path_length, i);
 
-            const uint64_t inner_file_begin = inner_mapping->fileOffset;
-            const uint64_t inner_file_end =
-                inner_file_begin + inner_mapping->size;
+        if (subcache_path == NULL) {
+            free_subcaches(subcaches, i);
+            return E_DYLD_SHARED_CACHE_PARSE_ALLOC_FAIL;
+        }
 
-            const struct range inner_file_range = {
-                .begin = inner_file_begin,
-                .end = inner_file_end  
-            };
+        subcache->path = subcache_path;
+        subcache->address = address;
+        subcache->end_address = UINT64_MAX;
+        subcache->last_use_index = -1;
 
-            if (ranges_overlap(mapping_file_range, inner_file_range)) {
-                munmap(map, dsc_size);
-                return E_DYLD_SHARED_CACHE_PARSE_OVERLAPPING_MAPPINGS;
-            }
+        memcpy(subcache->uuid, entry->uuid, sizeof(subcache->uuid));
+
+        if (i != 0) {
+            subcaches[i - 1].end_address = address;
+        }
+
+        struct stat sbuf = {};
+        if (stat(subcache_path, &sbuf) != 0 || !S_ISREG(sbuf.st_mode)) {
+            free_subcaches(subcaches, i + 1);
+            return E_DYLD_SHARED_CACHE_PARSE_MISSING_SUBCACHE;
         }
     }
 
-    struct dyld_cache_image_info *const images =
-        (struct dyld_cache_image_info *)(map + images_offset);
+    info_in->subcaches = subcaches;
+    info_in->subcaches_count = count;
 
     /*
-     * Perform the image operations if need be. Since the images array is quite
-     * large (Usually >1000 images), we aim to do everything in only one loop.
+     * Find the last image with its header in each sub-cache, so the sub-cache
+     * can be unmapped once iterated past it.
      */
 
-    if (options & O_DYLD_SHARED_CACHE_PARSE_ZERO_IMAGE_PADS) {
-        for (uint32_t i = 0; i < images_count; i++) {
-            struct dyld_cache_image_info *const image = images + i;
+    const struct dyld_cache_image_info *const images = info_in->images;
+    const uint32_t images_count = info_in->images_count;
 
-            if (options & O_DYLD_SHARED_CACHE_PARSE_VERIFY_IMAGE_PATH_OFFSETS) {
-                const uint32_t location = image->pathFileOffset;
-                if (!range_contains_location(available_cache_range, location)) {
-                    munmap(map, dsc_size);
-                    return E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES;
-                }
-            }
- 
-            image->pad = 0;             
+    for (uint32_t i = 0; i != images_count; i++) {
+        dyld_shared_cache_set_subcache_use(info_in, images[i].address, i);
+    }
+
+    pthread_mutex_init(&info_in->subcaches_mutex, NULL);
+    return E_DYLD_SHARED_CACHE_PARSE_OK;
+}
+
+/*
+ * Map a sub-cache into memory, and verify it belongs to the main cache-file.
+ */
+
+static enum dyld_shared_cache_parse_result
+map_subcache(const struct dyld_shared_cache_info *const info,
+             struct dyld_shared_cache_subcache *const subcache)
+{
+    const int fd = open(subcache->path, O_RDONLY);
+    if (fd < 0) {
+        return E_DYLD_SHARED_CACHE_PARSE_MISSING_SUBCACHE;
+    }
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) < 0) {
+        close(fd);
+        return E_DYLD_SHARED_CACHE_PARSE_FSTAT_FAIL;
+    }
+
+    const uint64_t size = (uint64_t)sbuf.st_size;
+    if (size < DYLD_CACHE_HEADER_UUID_OFFSET + sizeof(subcache->uuid)) {
+        close(fd);
+        return E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES;
+    }
+
+    uint8_t *const map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        return E_DYLD_SHARED_CACHE_PARSE_MMAP_FAIL;
+    }
+
+    stats_add(STATS_COUNTER_BYTES_MAPPED, size);
+
+    /*
+     * Every sub-cache has the magic of the main cache-file, and the uuid listed
+     * in the main cache-file's sub-cache entries.
+     */
+
+    const struct dyld_cache_header *const header =
+        (const struct dyld_cache_header *)map;
+
+    const uint8_t *const uuid = map + DYLD_CACHE_HEADER_UUID_OFFSET;
+    const struct dyld_cache_header *const main_header =
+        (const struct dyld_cache_header *)info->map;
+
+    const bool is_valid_header =
+        memcmp(header->magic, main_header->magic, sizeof(header->magic)) == 0 &&
+        memcmp(uuid, subcache->uuid, sizeof(subcache->uuid)) == 0;
+
+    if (!is_valid_header) {
+        munmap(map, size);
+        return E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES;
+    }
+
+    const uint32_t mapping_offset = header->mappingOffset;
+    const uint32_t mapping_count = header->mappingCount;
+
+    const uint64_t mapping_end =
+        mapping_offset +
+        sizeof(struct dyld_cache_mapping_info) * (uint64_t)mapping_count;
+
+    if (mapping_offset < sizeof(struct dyld_cache_header) ||
+        mapping_end > size)
+    {
+        munmap(map, size);
+        return E_DYLD_SHARED_CACHE_PARSE_INVALID_MAPPINGS;
+    }
+
+    const struct dyld_cache_mapping_info *const mappings =
+        (const struct dyld_cache_mapping_info *)(map + mapping_offset);
+
+    const enum dyld_shared_cache_parse_result verify_mappings_result =
+        verify_mappings(mappings, mapping_count, size);
+
+    if (verify_mappings_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        munmap(map, size);
+        return verify_mappings_result;
+    }
+
+    subcache->mappings = mappings;
+    subcache->mappings_count = mapping_count;
+
+    subcache->map = map;
+    subcache->size = size;
+
+    return E_DYLD_SHARED_CACHE_PARSE_OK;
+}
+
+static void unmap_subcache(struct dyld_shared_cache_subcache *const subcache) {
+    munmap(subcache->map, subcache->size);
+
+    subcache->map = NULL;
+    subcache->size = 0;
+
+    subcache->mappings = NULL;
+    subcache->mappings_count = 0;
+}
+
+static uint64_t
+get_file_offset_from_mappings(
+    const struct dyld_cache_mapping_info *const mappings,
+    const uint64_t count,
+    const uint64_t address,
+    uint64_t *const size_out)
+{
+    for (uint64_t i = 0; i < count; i++) {
+        const struct dyld_cache_mapping_info *const mapping = mappings + i;
+
+        const uint64_t mapping_begin = mapping->address;
+        const uint64_t mapping_end = mapping_begin + mapping->size;
+
+        const struct range mapping_range = {
+            .begin = mapping_begin,
+            .end = mapping_end
+        };
+
+        if (!range_contains_location(mapping_range, address)) {
+            continue;
         }
-    } else if (options & O_DYLD_SHARED_CACHE_PARSE_VERIFY_IMAGE_PATH_OFFSETS) {
-        for (uint32_t i = 0; i < images_count; i++) {
-            struct dyld_cache_image_info *image = images + i;
-            const uint32_t location = image->pathFileOffset;
-
-            if (!range_contains_location(available_cache_range, location)) {
-                munmap(map, dsc_size);
-                return E_DYLD_SHARED_CACHE_PARSE_INVALID_IMAGES;
-            }
+
+        const uint64_t delta = address - mapping_begin;
+        const uint64_t file_offset = mapping->fileOffset + delta;
+
+        *size_out = mapping->size - delta;
+        return file_offset;
+    }
+
+    return 0;
+}
+
+uint64_t
+dyld_shared_cache_get_file_offset_from_address(
+    const struct dyld_shared_cache_info *const info,
+    const uint64_t address,
+    uint64_t *const size_out)
+{
+    return get_file_offset_from_mappings(info->mappings,
+                                         info->mappings_count,
+                                         address,
+                                         size_out);
+}
+
+enum dyld_shared_cache_parse_result
+dyld_shared_cache_find_location(
+    struct dyld_shared_cache_info *const info,
+    const uint64_t address,
+    struct dyld_shared_cache_location *const location_out)
+{
+    uint64_t max_size = 0;
+    uint64_t file_offset =
+        dyld_shared_cache_get_file_offset_from_address(info,
+                                                       address,
+                                                       &max_size);
+
+    if (file_offset != 0) {
+        location_out->map = info->map;
+        location_out->map_size = info->size;
+        location_out->file_offset = file_offset;
+        location_out->max_size = max_size;
+        location_out->subcache = NULL;
+
+        return E_DYLD_SHARED_CACHE_PARSE_OK;
+    }
+
+    struct dyld_shared_cache_subcache *const subcache =
+        find_subcache_for_address(info, address);
+
+    if (subcache == NULL) {
+        return E_DYLD_SHARED_CACHE_PARSE_NO_MAPPING;
+    }
+
+    pthread_mutex_lock(&info->subcaches_mutex);
+
+    if (subcache->map == NULL) {
+        const enum dyld_shared_cache_parse_result map_result =
+            map_subcache(info, subcache);
+
+        if (map_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+            pthread_mutex_unlock(&info->subcaches_mutex);
+            return map_result;
         }
     }
 
-    info_in->images = images;
-    info_in->images_count = images_count;
+    file_offset =
+        get_file_offset_from_mappings(subcache->mappings,
+                                      subcache->mappings_count,
+                                      address,
+                                      &max_size);
 
-    info_in->mappings = mappings;
-    info_in->mappings_count = mapping_count;
+    if (file_offset == 0) {
+        pthread_mutex_unlock(&info->subcaches_mutex);
+        return E_DYLD_SHARED_CACHE_PARSE_NO_MAPPING;
+    }
 
-    info_in->arch = arch;
-    info_in->arch_bit = arch_bit;
+    subcache->users += 1;
 
-    info_in->map = map;
-    info_in->size = dsc_size;
+    location_out->map = subcache->map;
+    location_out->map_size = subcache->size;
+    location_out->file_offset = file_offset;
+    location_out->max_size = max_size;
+    location_out->subcache = subcache;
 
-    info_in->flags |= F_DYLD_SHARED_CACHE_UNMAP_MAP;
+    pthread_mutex_unlock(&info->subcaches_mutex);
     return E_DYLD_SHARED_CACHE_PARSE_OK;
 }
 
+void
+dyld_shared_cache_release_location(
+    struct dyld_shared_cache_info *const info,
+    const struct dyld_shared_cache_location *const location)
+{
+    struct dyld_shared_cache_subcache *const subcache = location->subcache;
+    if (subcache == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&info->subcaches_mutex);
+    subcache->users -= 1;
+    pthread_mutex_unlock(&info->subcaches_mutex);
+}
+
+void
+dyld_shared_cache_set_subcache_use(struct dyld_shared_cache_info *const info,
+                                   const uint64_t address,
+                                   const uint64_t image_index)
+{
+    struct dyld_shared_cache_subcache *const subcache =
+        find_subcache_for_address(info, address);
+
+    if (subcache == NULL) {
+        return;
+    }
+
+    if (subcache->last_use_index < (int64_t)image_index) {
+        subcache->last_use_index = (int64_t)image_index;
+    }
+}
+
+void
+dyld_shared_cache_release_subcaches_before(
+    struct dyld_shared_cache_info *const info,
+    const uint64_t image_index)
+{
+    const uint32_t count = info->subcaches_count;
+    if (count == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&info->subcaches_mutex);
+
+    for (uint32_t i = 0; i != count; i++) {
+        struct dyld_shared_cache_subcache *const subcache =
+            info->subcaches + i;
+
+        if (subcache->map == NULL || subcache->users != 0) {
+            continue;
+        }
+
+        const int64_t last_use_index = subcache->last_use_index;
+        if (last_use_index < 0 || (uint64_t)last_use_index >= image_index) {
+            continue;
+        }
+
+        unmap_subcache(subcache);
+    }
+
+    pthread_mutex_unlock(&info->subcaches_mutex);
+}
+
 enum dyld_shared_cache_parse_result
 dyld_shared_cache_iterate_images_with_callback(
-    const struct dyld_shared_cache_info *const info_in,
+    struct dyld_shared_cache_info *const info_in,
     void *const item,
     const dyld_shared_cache_iterate_images_callback callback)
 {
@@ -439,16 +1032,17 @@ dyld_shared_cache_iterate_images_with_callback(
     const uint32_t images_count = info_in->images_count; 
 
     for (uint32_t i = 0; i < images_count; i++) {
-        struct dyld_cache_image_info *const image = info_in->images + i;
+        const struct dyld_cache_image_info *const image = info_in->images + i;
 
         const uint32_t path_file_offset = image->pathFileOffset;
         const char *const path = (const char *)(map + path_file_offset);
 
-        if (callback(image, path, item)) {
-            continue; 
-        }
+        const bool should_continue = callback(image, path, item);
+        dyld_shared_cache_release_subcaches_before(info_in, i + 1);
 
-        break;
+        if (!should_continue) {
+            break;
+        }
     }
 
     return E_DYLD_SHARED_CACHE_PARSE_OK;
@@ -459,9 +1053,21 @@ void dyld_shared_cache_info_destroy(struct dyld_shared_cache_info *const info) {
         munmap(info->map, info->size);
     }
 
+    if (info->subcaches != NULL) {
+        free_subcaches(info->subcaches, info->subcaches_count);
+        pthread_mutex_destroy(&info->subcaches_mutex);
+    }
+
     info->map = NULL;
     info->size = 0;
 
+    info->subcache_entries = NULL;
+    info->subcache_entries_count = 0;
+    info->subcache_entry_size = 0;
+
+    info->subcaches = NULL;
+    info->subcaches_count = 0;
+
     info->mappings = NULL;
     info->images = NULL;
 
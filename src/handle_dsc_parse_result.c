@@ -161,6 +161,51 @@ handle_dsc_file_parse_result(
 
             break;
         }
+
+        case E_DYLD_SHARED_CACHE_PARSE_INVALID_SUBCACHES: {
+            if (print_paths) {
+                fprintf(stderr,
+                        "dyld_shared_cache file (at path %s) has invalid "
+                        "sub-caches\n",
+                        path);
+            } else {
+                fputs("dyld_shared_cache file at the provided path has invalid "
+                      "sub-caches\n",
+                      stderr);
+            }
+
+            break;
+        }
+
+        case E_DYLD_SHARED_CACHE_PARSE_MISSING_SUBCACHE: {
+            if (print_paths) {
+                fprintf(stderr,
+                        "dyld_shared_cache file (at path %s) is missing one of "
+                        "its sub-cache files\n",
+                        path);
+            } else {
+                fputs("dyld_shared_cache file at the provided path is missing "
+                      "one of its sub-cache files\n",
+                      stderr);
+            }
+
+            break;
+        }
+
+        case E_DYLD_SHARED_CACHE_PARSE_NO_MAPPING: {
+            if (print_paths) {
+                fprintf(stderr,
+                        "dyld_shared_cache file (at path %s) has an address "
+                        "with no corresponding mapping\n",
+                        path);
+            } else {
+                fputs("dyld_shared_cache file at the provided path has an "
+                      "address with no corresponding mapping\n",
+                      stderr);
+            }
+
+            break;
+        }
     }
 }
 
@@ -224,6 +269,38 @@ handle_dsc_image_parse_result(struct tbd_for_main *const global,
 
             return false;
 
+        case E_DSC_IMAGE_PARSE_SUBCACHE_MAP_FAIL:
+            if (print_paths) {
+                fprintf(stderr,
+                        "Failed to map a sub-cache file of dyld_shared_cache "
+                        "(at path %s) for an image (with path %s)\n",
+                        dsc_path,
+                        image_path);
+            } else {
+                fprintf(stderr,
+                        "Failed to map a sub-cache file of the provided "
+                        "dyld_shared_cache file for an image (with path %s)\n",
+                        image_path);
+            }
+
+            return false;
+
+        case E_DSC_IMAGE_PARSE_INVALID_SUBCACHE:
+            if (print_paths) {
+                fprintf(stderr,
+                        "dyld_shared_cache (at path %s) has an image (with "
+                        "path %s) located in an invalid sub-cache file\n",
+                        dsc_path,
+                        image_path);
+            } else {
+                fprintf(stderr,
+                        "The provided dyld_shared_cache file has an image "
+                        "(with path %s) located in an invalid sub-cache file\n",
+                        image_path);
+            }
+
+            return false;
+
         case E_DSC_IMAGE_PARSE_FAT_NOT_SUPPORTED:
             if (print_paths) {
                 fprintf(stderr,
@@ -431,6 +508,22 @@ handle_dsc_image_parse_result(struct tbd_for_main *const global,
 
             return false;
 
+        case E_DSC_IMAGE_PARSE_INVALID_EXPORT_TRIE:
+            if (print_paths) {
+                fprintf(stderr,
+                        "dyld_shared_cache file (at path %s) has an image "
+                        "(with path %s) that has an invalid export-trie\n",
+                        dsc_path,
+                        image_path);
+            } else {
+                fprintf(stderr,
+                        "The provided dyld_shared_cache file has an image "
+                        "(with path %s) that has an invalid export-trie\n",
+                        image_path);
+            }
+
+            return false;
+
         case E_DSC_IMAGE_PARSE_INVALID_INSTALL_NAME: {
             bool request_result = false;
             if (print_paths) {
@@ -330,6 +330,20 @@ handle_macho_file_parse_result(struct tbd_for_main *const global,
 
             return false;
 
+        case E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE:
+            if (print_paths) {
+                fprintf(stderr,
+                        "Mach-o file (at path %s), or one of its "
+                        "architectures, has an invalid export-trie\n",
+                        path);
+            } else {
+                fputs("The provided mach-o file, or one of its architectures, "
+                      "has an invalid export-trie\n",
+                      stderr);
+            }
+
+            return false;
+
         case E_MACHO_FILE_PARSE_INVALID_INSTALL_NAME: {
             bool request_result = false;
             if (print_paths) {
@@ -0,0 +1,129 @@
+//
+//  src/hash_table.c
+//  tbd
+//
+//  Created by inoahdev on 3/27/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <stdlib.h>
+
+#include "hash_table.h"
+
+uint32_t
+hash_string_with_basis(const uint32_t basis,
+                       const char *const string,
+                       const uint64_t length)
+{
+    uint32_t hash = basis;
+
+    const uint8_t *iter = (const uint8_t *)string;
+    const uint8_t *const end = iter + length;
+
+    for (; iter != end; iter++) {
+        hash ^= *iter;
+        hash *= 16777619;
+    }
+
+    return hash;
+}
+
+uint32_t hash_string(const char *const string, const uint64_t length) {
+    return hash_string_with_basis(HASH_STRING_BASIS, string, length);
+}
+
+static void
+insert_slot(struct hash_table_slot *const slots,
+            const uint64_t capacity,
+            const struct hash_table_slot slot)
+{
+    const uint64_t mask = capacity - 1;
+    uint64_t i = slot.hash & mask;
+
+    while (slots[i].index != 0) {
+        i = (i + 1) & mask;
+    }
+
+    slots[i] = slot;
+}
+
+bool hash_table_reserve(struct hash_table *const table, const uint64_t count) {
+    const uint64_t capacity = table->capacity;
+    if (count * 2 <= capacity) {
+        return true;
+    }
+
+    uint64_t new_capacity = (capacity != 0) ? capacity << 1 : 8;
+    while (new_capacity < count * 2) {
+        new_capacity <<= 1;
+    }
+
+    struct hash_table_slot *const new_slots =
+        calloc(new_capacity, sizeof(struct hash_table_slot));
+
+    if (new_slots == NULL) {
+        return false;
+    }
+
+    struct hash_table_slot *const slots = table->slots;
+    for (uint64_t i = 0; i != capacity; i++) {
+        const struct hash_table_slot slot = slots[i];
+        if (slot.index == 0) {
+            continue;
+        }
+
+        insert_slot(new_slots, new_capacity, slot);
+    }
+
+    free(slots);
+
+    table->slots = new_slots;
+    table->capacity = new_capacity;
+
+    return true;
+}
+
+struct hash_table_slot *
+hash_table_find_slot(const struct hash_table *const table,
+                     const uint32_t hash,
+                     const hash_table_matches_func matches,
+                     const void *const info)
+{
+    struct hash_table_slot *const slots = table->slots;
+
+    const uint64_t mask = table->capacity - 1;
+    uint64_t i = hash & mask;
+
+    for (; slots[i].index != 0; i = (i + 1) & mask) {
+        const struct hash_table_slot slot = slots[i];
+        if (slot.hash != hash) {
+            continue;
+        }
+
+        if (matches(info, slot.index - 1)) {
+            break;
+        }
+    }
+
+    return slots + i;
+}
+
+void
+hash_table_set_slot(struct hash_table *const table,
+                    struct hash_table_slot *const slot,
+                    const uint32_t hash,
+                    const uint32_t index)
+{
+    slot->hash = hash;
+    slot->index = index + 1;
+
+    table->count += 1;
+}
+
+void hash_table_destroy(struct hash_table *const table) {
+    free(table->slots);
+
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+}
@@ -0,0 +1,749 @@
+//
+//  src/incremental_manifest.c
+//  tbd
+//
+//  Created by inoahdev on 3/20/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "incremental_manifest.h"
+#include "tbd.h"
+
+/*
+ * The manifest is a text-file, starting with a header-line of the format's
+ * version and the hash of the arguments it was written with, followed by a
+ * line for each entry:
+ *
+ *     <size> <mtime> <mtime-nsec> <uuids-count>[ <uuid>...]\t<input>\t<output>
+ *
+ * Paths with a tab or newline can't be stored, and are simply never recorded.
+ */
+
+static const char *const manifest_header_format =
+    "tbd-incremental-manifest 1 %016llX\n";
+
+uint64_t
+incremental_manifest_hash_arguments(const int argc, const char *const argv[]) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (int i = 1; i < argc; i++) {
+        const char *const argument = argv[i];
+        const char *option = argument;
+
+        if (option[0] == '-') {
+            option += 1;
+            if (option[0] == '-') {
+                option += 1;
+            }
+
+            const bool is_ignored =
+                strcmp(option, "incremental") == 0 ||
+                strcmp(option, "jobs") == 0;
+
+            if (is_ignored) {
+                i += 1;
+                continue;
+            }
+
+            if (strcmp(option, "stats") == 0) {
+                continue;
+            }
+        }
+
+        /*
+         * Include the null-terminator so arguments can't run into each other.
+         */
+
+        const uint8_t *iter = (const uint8_t *)argument;
+        do {
+            hash ^= *iter;
+            hash *= 1099511628211ull;
+        } while (*iter++ != '\0');
+    }
+
+    return hash;
+}
+
+static inline int64_t get_mtime_nsec(const struct stat *const sbuf) {
+#if defined(__APPLE__)
+    return (int64_t)sbuf->st_mtimespec.tv_nsec;
+#else
+    return (int64_t)sbuf->st_mtim.tv_nsec;
+#endif
+}
+
+static int get_hex_value(const char ch) {
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+
+    return -1;
+}
+
+static char *parse_uuid(char *iter, uint8_t *const uuid) {
+    for (uint32_t i = 0; i != 16; i++) {
+        const int high = get_hex_value(iter[0]);
+        if (high < 0) {
+            return NULL;
+        }
+
+        const int low = get_hex_value(iter[1]);
+        if (low < 0) {
+            return NULL;
+        }
+
+        uuid[i] = (uint8_t)((high << 4) | low);
+        iter += 2;
+    }
+
+    return iter;
+}
+
+/*
+ * Parse the line at iter into entry, returning the start of the next line, or
+ * NULL if the line is invalid.
+ */
+
+static char *
+parse_entry(struct incremental_manifest *const manifest,
+            char *iter,
+            struct incremental_manifest_entry *const entry)
+{
+    char *end = NULL;
+
+    entry->size = strtoull(iter, &end, 10);
+    if (end == iter || *end != ' ') {
+        return NULL;
+    }
+
+    iter = end + 1;
+    entry->mtime = strtoll(iter, &end, 10);
+
+    if (end == iter || *end != ' ') {
+        return NULL;
+    }
+
+    iter = end + 1;
+    entry->mtime_nsec = strtoll(iter, &end, 10);
+
+    if (end == iter || *end != ' ') {
+        return NULL;
+    }
+
+    iter = end + 1;
+
+    const uint64_t uuids_count = strtoull(iter, &end, 10);
+    if (end == iter || uuids_count > UINT32_MAX) {
+        return NULL;
+    }
+
+    iter = end;
+
+    uint8_t *uuids = NULL;
+    if (uuids_count != 0) {
+        uuids = arena_alloc(&manifest->arena, uuids_count * 16);
+        if (uuids == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+    }
+
+    for (uint64_t i = 0; i != uuids_count; i++) {
+        if (*iter != ' ') {
+            return NULL;
+        }
+
+        iter = parse_uuid(iter + 1, uuids + (i * 16));
+        if (iter == NULL) {
+            return NULL;
+        }
+    }
+
+    if (*iter != '\t') {
+        return NULL;
+    }
+
+    char *const input_path = iter + 1;
+    char *const input_path_end = strchr(input_path, '\t');
+
+    if (input_path_end == NULL) {
+        return NULL;
+    }
+
+    char *const output_path = input_path_end + 1;
+    char *const output_path_end = strchr(output_path, '\n');
+
+    if (output_path_end == NULL) {
+        return NULL;
+    }
+
+    *input_path_end = '\0';
+    *output_path_end = '\0';
+
+    entry->input_path = input_path;
+    entry->output_path = output_path;
+
+    entry->uuids = uuids;
+    entry->uuids_count = (uint32_t)uuids_count;
+
+    return output_path_end + 1;
+}
+
+static bool parse_entries(struct incremental_manifest *const manifest) {
+    char header[64] = {};
+    const int header_length =
+        snprintf(header,
+                 sizeof(header),
+                 manifest_header_format,
+                 (unsigned long long)manifest->arguments_hash);
+
+    char *iter = manifest->data;
+    if (strncmp(iter, header, (uint64_t)header_length) != 0) {
+        return false;
+    }
+
+    iter += header_length;
+    while (*iter != '\0') {
+        struct incremental_manifest_entry entry = {};
+
+        iter = parse_entry(manifest, iter, &entry);
+        if (iter == NULL) {
+            return false;
+        }
+
+        const enum array_result add_entry_result =
+            array_add_item(&manifest->entries, sizeof(entry), &entry, NULL);
+
+        if (add_entry_result != E_ARRAY_OK) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+    }
+
+    return true;
+}
+
+struct entry_key {
+    const struct incremental_manifest_entry *entries;
+    const char *path;
+};
+
+static bool entry_matches(const void *const info, const uint32_t index) {
+    const struct entry_key *const key = info;
+    return strcmp(key->entries[index].input_path, key->path) == 0;
+}
+
+static enum incremental_manifest_result
+create_table(struct incremental_manifest *const manifest) {
+    const uint64_t count =
+        array_get_item_count(&manifest->entries,
+                             sizeof(struct incremental_manifest_entry));
+
+    if (count == 0) {
+        return E_INCREMENTAL_MANIFEST_OK;
+    }
+
+    if (!hash_table_reserve(&manifest->table, count)) {
+        return E_INCREMENTAL_MANIFEST_ALLOC_FAIL;
+    }
+
+    const struct incremental_manifest_entry *const entries =
+        manifest->entries.data;
+
+    /*
+     * A manifest never has duplicate input-paths, but keep the last one if it
+     * somehow does.
+     */
+
+    for (uint32_t i = 0; i != count; i++) {
+        const char *const path = entries[i].input_path;
+        const struct entry_key key = {
+            .entries = entries,
+            .path = path
+        };
+
+        const uint32_t hash = hash_string(path, strlen(path));
+        struct hash_table_slot *const slot =
+            hash_table_find_slot(&manifest->table, hash, entry_matches, &key);
+
+        if (slot->index != 0) {
+            slot->index = i + 1;
+            continue;
+        }
+
+        hash_table_set_slot(&manifest->table, slot, hash, i);
+    }
+
+    return E_INCREMENTAL_MANIFEST_OK;
+}
+
+static enum incremental_manifest_result
+read_manifest_data(struct incremental_manifest *const manifest, const int fd) {
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) < 0) {
+        return E_INCREMENTAL_MANIFEST_READ_FAIL;
+    }
+
+    const uint64_t size = (uint64_t)sbuf.st_size;
+
+    char *const data = malloc(size + 1);
+    if (data == NULL) {
+        return E_INCREMENTAL_MANIFEST_ALLOC_FAIL;
+    }
+
+    uint64_t read_size = 0;
+    while (read_size != size) {
+        const ssize_t result = read(fd, data + read_size, size - read_size);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            free(data);
+            return E_INCREMENTAL_MANIFEST_READ_FAIL;
+        }
+
+        if (result == 0) {
+            break;
+        }
+
+        read_size += (uint64_t)result;
+    }
+
+    data[read_size] = '\0';
+    manifest->data = data;
+
+    return E_INCREMENTAL_MANIFEST_OK;
+}
+
+enum incremental_manifest_result
+incremental_manifest_load(struct incremental_manifest *const manifest,
+                          const char *const path,
+                          const uint64_t arguments_hash)
+{
+    *manifest = (struct incremental_manifest){
+        .path = path,
+        .arguments_hash = arguments_hash
+    };
+
+    pthread_mutex_init(&manifest->mutex, NULL);
+
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return E_INCREMENTAL_MANIFEST_OK;
+        }
+
+        return E_INCREMENTAL_MANIFEST_OPEN_FAIL;
+    }
+
+    const enum incremental_manifest_result read_data_result =
+        read_manifest_data(manifest, fd);
+
+    close(fd);
+
+    if (read_data_result != E_INCREMENTAL_MANIFEST_OK) {
+        return read_data_result;
+    }
+
+    /*
+     * A manifest that's invalid, or was written with different arguments, is
+     * treated as empty, so every file is parsed again.
+     */
+
+    if (!parse_entries(manifest)) {
+        array_destroy(&manifest->entries);
+        return E_INCREMENTAL_MANIFEST_OK;
+    }
+
+    return create_table(manifest);
+}
+
+static struct incremental_manifest_entry *
+find_entry(const struct incremental_manifest *const manifest,
+           const char *const path)
+{
+    if (manifest->table.capacity == 0) {
+        return NULL;
+    }
+
+    const struct entry_key key = {
+        .entries = manifest->entries.data,
+        .path = path
+    };
+
+    const struct hash_table_slot *const slot =
+        hash_table_find_slot(&manifest->table,
+                             hash_string(path, strlen(path)),
+                             entry_matches,
+                             &key);
+
+    if (slot->index == 0) {
+        return NULL;
+    }
+
+    struct incremental_manifest_entry *const entries = manifest->entries.data;
+    return entries + (slot->index - 1);
+}
+
+bool
+incremental_manifest_is_unchanged(struct incremental_manifest *const manifest,
+                                  const char *const path,
+                                  const struct stat *const sbuf)
+{
+    struct incremental_manifest_entry *const entry = find_entry(manifest, path);
+    if (entry == NULL) {
+        return false;
+    }
+
+    /*
+     * Every entry is only ever looked up by the one job handling its file, so
+     * its state can be set without locking.
+     */
+
+    const bool is_unchanged =
+        entry->size == (uint64_t)sbuf->st_size &&
+        entry->mtime == (int64_t)sbuf->st_mtime &&
+        entry->mtime_nsec == get_mtime_nsec(sbuf) &&
+        access(entry->output_path, F_OK) == 0;
+
+    if (is_unchanged) {
+        entry->state = INCREMENTAL_MANIFEST_ENTRY_KEEP;
+    } else {
+        entry->state = INCREMENTAL_MANIFEST_ENTRY_DROP;
+    }
+
+    return is_unchanged;
+}
+
+void
+incremental_manifest_record(struct incremental_manifest *const manifest,
+                            const char *const path,
+                            const char *const write_path,
+                            const struct stat *const sbuf,
+                            const struct array *const uuids)
+{
+    if (strpbrk(path, "\t\n") != NULL || strpbrk(write_path, "\t\n") != NULL) {
+        return;
+    }
+
+    const uint64_t uuids_count =
+        array_get_item_count(uuids, sizeof(struct tbd_uuid_info));
+
+    pthread_mutex_lock(&manifest->mutex);
+
+    struct arena *const arena = &manifest->arena;
+
+    char *const input_path = arena_copy_string(arena, path, strlen(path));
+    char *const output_path =
+        arena_copy_string(arena, write_path, strlen(write_path));
+
+    if (input_path == NULL || output_path == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    uint8_t *uuids_copy = NULL;
+    if (uuids_count != 0) {
+        uuids_copy = arena_alloc(arena, uuids_count * 16);
+        if (uuids_copy == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+    }
+
+    const struct tbd_uuid_info *const uuid_infos = uuids->data;
+    for (uint64_t i = 0; i != uuids_count; i++) {
+        memcpy(uuids_copy + (i * 16), uuid_infos[i].uuid, 16);
+    }
+
+    const struct incremental_manifest_entry entry = {
+        .input_path = input_path,
+        .output_path = output_path,
+        .size = (uint64_t)sbuf->st_size,
+        .mtime = (int64_t)sbuf->st_mtime,
+        .mtime_nsec = get_mtime_nsec(sbuf),
+        .uuids = uuids_copy,
+        .uuids_count = (uint32_t)uuids_count
+    };
+
+    const enum array_result add_entry_result =
+        array_add_item(&manifest->new_entries, sizeof(entry), &entry, NULL);
+
+    if (add_entry_result != E_ARRAY_OK) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    pthread_mutex_unlock(&manifest->mutex);
+}
+
+static int
+write_entry(FILE *const file,
+            const struct incremental_manifest_entry *const entry)
+{
+    const int header_result =
+        fprintf(file,
+                "%llu %lld %lld %u",
+                (unsigned long long)entry->size,
+                (long long)entry->mtime,
+                (long long)entry->mtime_nsec,
+                entry->uuids_count);
+
+    if (header_result < 0) {
+        return 1;
+    }
+
+    const uint8_t *const uuids = entry->uuids;
+    const uint64_t uuids_size = (uint64_t)entry->uuids_count * 16;
+
+    for (uint64_t i = 0; i != uuids_size; i += 16) {
+        const uint8_t *const uuid = uuids + i;
+        const int uuid_result =
+            fprintf(file,
+                    " %02X%02X%02X%02X%02X%02X%02X%02X"
+                    "%02X%02X%02X%02X%02X%02X%02X%02X",
+                    uuid[0], uuid[1], uuid[2], uuid[3],
+                    uuid[4], uuid[5], uuid[6], uuid[7],
+                    uuid[8], uuid[9], uuid[10], uuid[11],
+                    uuid[12], uuid[13], uuid[14], uuid[15]);
+
+        if (uuid_result < 0) {
+            return 1;
+        }
+    }
+
+    const int paths_result =
+        fprintf(file, "\t%s\t%s\n", entry->input_path, entry->output_path);
+
+    if (paths_result < 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * A set of the output-paths still in use, so that removing the output of a
+ * stale entry never removes an output-file that has since been written out
+ * for a different input-file.
+ */
+
+struct output_path_set {
+    struct hash_table table;
+
+    const struct incremental_manifest_entry *new_entries;
+    const struct incremental_manifest_entry *entries;
+
+    uint64_t new_count;
+};
+
+/*
+ * Items of the set are indexes into the new-entries, followed by the entries
+ * from the last run.
+ */
+
+static const char *
+get_output_path(const struct output_path_set *const set, const uint32_t index) {
+    if (index < set->new_count) {
+        return set->new_entries[index].output_path;
+    }
+
+    return set->entries[index - set->new_count].output_path;
+}
+
+struct output_path_key {
+    const struct output_path_set *set;
+    const char *path;
+};
+
+static bool output_path_matches(const void *const info, const uint32_t index) {
+    const struct output_path_key *const key = info;
+    return strcmp(get_output_path(key->set, index), key->path) == 0;
+}
+
+static struct hash_table_slot *
+find_output_path(const struct output_path_set *const set,
+                 const char *const path,
+                 const uint32_t hash)
+{
+    const struct output_path_key key = {
+        .set = set,
+        .path = path
+    };
+
+    return hash_table_find_slot(&set->table, hash, output_path_matches, &key);
+}
+
+static void
+add_output_path(struct output_path_set *const set, const uint32_t index) {
+    const char *const path = get_output_path(set, index);
+    const uint32_t hash = hash_string(path, strlen(path));
+
+    struct hash_table_slot *const slot = find_output_path(set, path, hash);
+    if (slot->index != 0) {
+        return;
+    }
+
+    hash_table_set_slot(&set->table, slot, hash, index);
+}
+
+static bool
+has_output_path(const struct output_path_set *const set,
+                const char *const path)
+{
+    const uint32_t hash = hash_string(path, strlen(path));
+    return find_output_path(set, path, hash)->index != 0;
+}
+
+/*
+ * Remove the output-files of the entries from the last run that didn't produce
+ * a tbd in this run, as a full run wouldn't have written them out either.
+ *
+ * An entry's input-file may no longer exist, may have been skipped (and so
+ * never looked up), or may have been changed and no longer be parsable.
+ * Entries that were written out again were recorded as new entries instead.
+ */
+
+static void
+remove_stale_entries(struct incremental_manifest *const manifest) {
+    struct incremental_manifest_entry *const entries = manifest->entries.data;
+    const struct incremental_manifest_entry *const new_entries =
+        manifest->new_entries.data;
+
+    const uint64_t count =
+        array_get_item_count(&manifest->entries,
+                             sizeof(struct incremental_manifest_entry));
+
+    const uint64_t new_count =
+        array_get_item_count(&manifest->new_entries,
+                             sizeof(struct incremental_manifest_entry));
+
+    struct output_path_set set = {
+        .new_entries = new_entries,
+        .entries = entries,
+        .new_count = new_count
+    };
+
+    if (!hash_table_reserve(&set.table, count + new_count)) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    for (uint32_t i = 0; i != new_count; i++) {
+        add_output_path(&set, i);
+    }
+
+    for (uint64_t i = 0; i != count; i++) {
+        struct incremental_manifest_entry *const entry = entries + i;
+        if (entry->state == INCREMENTAL_MANIFEST_ENTRY_KEEP) {
+            add_output_path(&set, (uint32_t)(new_count + i));
+            continue;
+        }
+
+        entry->state = INCREMENTAL_MANIFEST_ENTRY_REMOVED;
+    }
+
+    for (uint64_t i = 0; i != count; i++) {
+        const struct incremental_manifest_entry *const entry = entries + i;
+        if (entry->state != INCREMENTAL_MANIFEST_ENTRY_REMOVED) {
+            continue;
+        }
+
+        if (!has_output_path(&set, entry->output_path)) {
+            unlink(entry->output_path);
+        }
+    }
+
+    hash_table_destroy(&set.table);
+}
+
+enum incremental_manifest_result
+incremental_manifest_save(struct incremental_manifest *const manifest) {
+    remove_stale_entries(manifest);
+
+    const char *const path = manifest->path;
+    const uint64_t path_length = strlen(path);
+
+    char *const temp_path = malloc(path_length + 8);
+    if (temp_path == NULL) {
+        return E_INCREMENTAL_MANIFEST_ALLOC_FAIL;
+    }
+
+    memcpy(temp_path, path, path_length);
+    memcpy(temp_path + path_length, ".XXXXXX", 8);
+
+    const int fd = mkstemp(temp_path);
+    if (fd < 0) {
+        free(temp_path);
+        return E_INCREMENTAL_MANIFEST_OPEN_FAIL;
+    }
+
+    FILE *const file = fdopen(fd, "w");
+    if (file == NULL) {
+        close(fd);
+        unlink(temp_path);
+        free(temp_path);
+
+        return E_INCREMENTAL_MANIFEST_OPEN_FAIL;
+    }
+
+    bool failed =
+        fprintf(file,
+                manifest_header_format,
+                (unsigned long long)manifest->arguments_hash) < 0;
+
+    const struct incremental_manifest_entry *iter = manifest->entries.data;
+    const struct incremental_manifest_entry *end = manifest->entries.data_end;
+
+    for (; iter != end && !failed; iter++) {
+        if (iter->state == INCREMENTAL_MANIFEST_ENTRY_KEEP) {
+            failed = write_entry(file, iter) != 0;
+        }
+    }
+
+    iter = manifest->new_entries.data;
+    end = manifest->new_entries.data_end;
+
+    for (; iter != end && !failed; iter++) {
+        failed = write_entry(file, iter) != 0;
+    }
+
+    if (fclose(file) != 0) {
+        failed = true;
+    }
+
+    if (failed || rename(temp_path, path) != 0) {
+        unlink(temp_path);
+        free(temp_path);
+
+        return E_INCREMENTAL_MANIFEST_WRITE_FAIL;
+    }
+
+    free(temp_path);
+    return E_INCREMENTAL_MANIFEST_OK;
+}
+
+void incremental_manifest_destroy(struct incremental_manifest *const manifest) {
+    free(manifest->data);
+    hash_table_destroy(&manifest->table);
+
+    array_destroy(&manifest->entries);
+    array_destroy(&manifest->new_entries);
+
+    arena_destroy(&manifest->arena);
+    pthread_mutex_destroy(&manifest->mutex);
+
+    manifest->data = NULL;
+}
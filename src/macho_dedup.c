@@ -0,0 +1,537 @@
+//
+//  src/macho_dedup.c
+//  tbd
+//
+//  Created by inoahdev on 3/21/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mach-o/fat.h"
+#include "mach-o/loader.h"
+
+#include "guard_overflow.h"
+#include "macho_dedup.h"
+#include "range.h"
+#include "swap.h"
+#include "tbd.h"
+
+static const uint64_t hash_offset_basis = 14695981039346656037ull;
+static const uint64_t hash_prime = 1099511628211ull;
+
+static uint64_t
+hash_bytes(uint64_t hash, const uint8_t *const data, const uint64_t size) {
+    const uint8_t *iter = data;
+    const uint8_t *const end = data + size;
+
+    for (; iter != end; iter++) {
+        hash ^= *iter;
+        hash *= hash_prime;
+    }
+
+    return hash;
+}
+
+/*
+ * Hash the contents of a file a word at a time, as files without uuids are
+ * hashed in their entirety.
+ */
+
+static uint64_t hash_contents(const uint8_t *const map, const uint64_t size) {
+    uint64_t hash = hash_offset_basis;
+
+    const uint8_t *iter = map;
+    const uint8_t *const end = map + (size & ~7ull);
+
+    for (; iter != end; iter += sizeof(uint64_t)) {
+        uint64_t word = 0;
+        memcpy(&word, iter, sizeof(word));
+
+        hash ^= word;
+        hash *= hash_prime;
+    }
+
+    return hash_bytes(hash, end, size & 7);
+}
+
+/*
+ * Add the uuid to the uuids of the key, and to the key's hash.
+ */
+
+static void
+add_uuid(struct macho_dedup_key *const key, const uint8_t *const uuid) {
+    const uint32_t count = key->uuids_count;
+    uint8_t *const uuids = realloc(key->uuids, ((uint64_t)count + 1) * 16);
+
+    if (uuids == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    memcpy(uuids + ((uint64_t)count * 16), uuid, 16);
+
+    key->uuids = uuids;
+    key->uuids_count = count + 1;
+    key->hash = hash_bytes(key->hash, uuid, 16);
+}
+
+/*
+ * Add the uuids in the load-commands of a thin mach-o file to the key, without
+ * otherwise validating the mach-o file, which is left to the parse.
+ *
+ * Returns false if the data doesn't start with a mach-header.
+ */
+
+static bool
+add_uuids_in_thin(const uint8_t *const data,
+                  const uint64_t size,
+                  struct macho_dedup_key *const key)
+{
+    struct mach_header header = {};
+    if (size < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, data, sizeof(header));
+
+    bool is_64 = false;
+    bool is_big_endian = false;
+
+    switch (header.magic) {
+        case MH_MAGIC:
+            break;
+
+        case MH_CIGAM:
+            is_big_endian = true;
+            break;
+
+        case MH_MAGIC_64:
+            is_64 = true;
+            break;
+
+        case MH_CIGAM_64:
+            is_64 = true;
+            is_big_endian = true;
+
+            break;
+
+        default:
+            return false;
+    }
+
+    uint32_t ncmds = header.ncmds;
+    uint32_t sizeofcmds = header.sizeofcmds;
+
+    if (is_big_endian) {
+        ncmds = swap_uint32(ncmds);
+        sizeofcmds = swap_uint32(sizeofcmds);
+    }
+
+    const uint64_t header_size =
+        is_64 ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+
+    if (size < header_size || sizeofcmds > size - header_size) {
+        return true;
+    }
+
+    const uint8_t *iter = data + header_size;
+    const uint8_t *const end = iter + sizeofcmds;
+
+    for (uint32_t i = 0; i != ncmds; i++) {
+        const uint64_t size_left = (uint64_t)(end - iter);
+
+        struct load_command load_cmd = {};
+        if (size_left < sizeof(load_cmd)) {
+            break;
+        }
+
+        memcpy(&load_cmd, iter, sizeof(load_cmd));
+        if (is_big_endian) {
+            load_cmd.cmd = swap_uint32(load_cmd.cmd);
+            load_cmd.cmdsize = swap_uint32(load_cmd.cmdsize);
+        }
+
+        if (load_cmd.cmdsize < sizeof(load_cmd)) {
+            break;
+        }
+
+        if (load_cmd.cmdsize > size_left) {
+            break;
+        }
+
+        if (load_cmd.cmd == LC_UUID) {
+            if (load_cmd.cmdsize >= sizeof(struct uuid_command)) {
+                const struct uuid_command *const uuid_cmd =
+                    (const struct uuid_command *)iter;
+
+                add_uuid(key, uuid_cmd->uuid);
+            }
+        }
+
+        iter += load_cmd.cmdsize;
+    }
+
+    return true;
+}
+
+static bool
+add_uuids_in_fat(const uint8_t *const map,
+                 const uint64_t size,
+                 struct macho_dedup_key *const key)
+{
+    struct fat_header header = {};
+    memcpy(&header, map, sizeof(header));
+
+    bool is_64 = false;
+    bool is_big_endian = false;
+
+    switch (header.magic) {
+        case FAT_MAGIC:
+            break;
+
+        case FAT_CIGAM:
+            is_big_endian = true;
+            break;
+
+        case FAT_MAGIC_64:
+            is_64 = true;
+            break;
+
+        case FAT_CIGAM_64:
+            is_64 = true;
+            is_big_endian = true;
+
+            break;
+
+        default:
+            return false;
+    }
+
+    uint32_t nfat_arch = header.nfat_arch;
+    if (is_big_endian) {
+        nfat_arch = swap_uint32(nfat_arch);
+    }
+
+    const uint64_t arch_size =
+        is_64 ? sizeof(struct fat_arch_64) : sizeof(struct fat_arch);
+
+    const uint64_t archs_size = arch_size * nfat_arch;
+    if (archs_size > size - sizeof(header)) {
+        return true;
+    }
+
+    const struct range file_range = {
+        .begin = 0,
+        .end = size
+    };
+
+    const uint8_t *const archs = map + sizeof(header);
+    for (uint32_t i = 0; i != nfat_arch; i++) {
+        const uint8_t *const arch = archs + (arch_size * i);
+
+        uint64_t offset = 0;
+        uint64_t arch_file_size = 0;
+
+        if (is_64) {
+            struct fat_arch_64 fat_arch = {};
+            memcpy(&fat_arch, arch, sizeof(fat_arch));
+
+            offset = fat_arch.offset;
+            arch_file_size = fat_arch.size;
+
+            if (is_big_endian) {
+                offset = swap_uint64(offset);
+                arch_file_size = swap_uint64(arch_file_size);
+            }
+        } else {
+            struct fat_arch fat_arch = {};
+            memcpy(&fat_arch, arch, sizeof(fat_arch));
+
+            offset = fat_arch.offset;
+            arch_file_size = fat_arch.size;
+
+            if (is_big_endian) {
+                offset = swap_uint32((uint32_t)offset);
+                arch_file_size = swap_uint32((uint32_t)arch_file_size);
+            }
+        }
+
+        uint64_t arch_end = offset;
+        if (guard_overflow_add(&arch_end, arch_file_size)) {
+            continue;
+        }
+
+        if (!range_contains_end(file_range, arch_end)) {
+            continue;
+        }
+
+        add_uuids_in_thin(map + offset, arch_file_size, key);
+    }
+
+    return true;
+}
+
+void macho_dedup_init(struct macho_dedup *const dedup) {
+    *dedup = (struct macho_dedup){};
+    pthread_mutex_init(&dedup->mutex, NULL);
+}
+
+enum macho_dedup_result
+macho_dedup_create_key(const int fd, struct macho_dedup_key *const key) {
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) < 0) {
+        return E_MACHO_DEDUP_FSTAT_FAIL;
+    }
+
+    const uint64_t size = (uint64_t)sbuf.st_size;
+    if (size < sizeof(struct fat_header)) {
+        return E_MACHO_DEDUP_NOT_A_MACHO;
+    }
+
+    uint8_t *const map = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return E_MACHO_DEDUP_MMAP_FAIL;
+    }
+
+    struct macho_dedup_key new_key = {
+        .size = size,
+        .hash = hash_offset_basis
+    };
+
+    const bool is_macho =
+        add_uuids_in_fat(map, size, &new_key) ||
+        add_uuids_in_thin(map, size, &new_key);
+
+    if (!is_macho) {
+        munmap(map, size);
+        macho_dedup_key_destroy(&new_key);
+
+        return E_MACHO_DEDUP_NOT_A_MACHO;
+    }
+
+    /*
+     * Only files without uuids have to be read in full.
+     */
+
+    if (new_key.uuids_count == 0) {
+        new_key.hash = hash_contents(map, size);
+    }
+
+    munmap(map, size);
+    *key = new_key;
+
+    return E_MACHO_DEDUP_OK;
+}
+
+/*
+ * Find the entry with the provided key, or the empty entry the key should be
+ * inserted at.
+ */
+
+static struct macho_dedup_entry *
+find_entry(const struct macho_dedup *const dedup,
+           const uint64_t size,
+           const uint64_t hash,
+           const uint8_t *const uuids,
+           const uint32_t uuids_count)
+{
+    struct macho_dedup_entry *const entries = dedup->entries;
+
+    const uint64_t mask = dedup->capacity - 1;
+    uint64_t i = hash & mask;
+
+    for (; entries[i].input_path != NULL; i = (i + 1) & mask) {
+        const struct macho_dedup_entry *const entry = entries + i;
+        if (entry->hash != hash || entry->size != size) {
+            continue;
+        }
+
+        if (entry->uuids_count != uuids_count) {
+            continue;
+        }
+
+        if (memcmp(entry->uuids, uuids, (uint64_t)uuids_count * 16) == 0) {
+            break;
+        }
+    }
+
+    return entries + i;
+}
+
+int
+macho_dedup_open_original_output(struct macho_dedup *const dedup,
+                                 const struct macho_dedup_key *const key,
+                                 struct array *const tbd_uuids_out)
+{
+    struct macho_dedup_entry entry = {};
+    pthread_mutex_lock(&dedup->mutex);
+
+    if (dedup->capacity != 0) {
+        entry = *find_entry(dedup,
+                            key->size,
+                            key->hash,
+                            key->uuids,
+                            key->uuids_count);
+    }
+
+    pthread_mutex_unlock(&dedup->mutex);
+
+    /*
+     * The paths and uuids of an entry are never moved or freed until the
+     * macho_dedup is destroyed, and stay valid after unlocking.
+     */
+
+    if (entry.input_path == NULL) {
+        return -1;
+    }
+
+    *tbd_uuids_out = entry.tbd_uuids;
+    return open(entry.output_path, O_RDONLY);
+}
+
+static void grow_entries(struct macho_dedup *const dedup) {
+    const uint64_t old_capacity = dedup->capacity;
+    const uint64_t capacity = (old_capacity != 0) ? old_capacity << 1 : 64;
+
+    struct macho_dedup_entry *const old_entries = dedup->entries;
+    struct macho_dedup_entry *const entries =
+        calloc(capacity, sizeof(struct macho_dedup_entry));
+
+    if (entries == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    dedup->entries = entries;
+    dedup->capacity = capacity;
+
+    for (uint64_t i = 0; i != old_capacity; i++) {
+        const struct macho_dedup_entry *const entry = old_entries + i;
+        if (entry->input_path == NULL) {
+            continue;
+        }
+
+        *find_entry(dedup,
+                    entry->size,
+                    entry->hash,
+                    entry->uuids,
+                    entry->uuids_count) = *entry;
+    }
+
+    free(old_entries);
+}
+
+void
+macho_dedup_add(struct macho_dedup *const dedup,
+                const struct macho_dedup_key *const key,
+                const char *const input_path,
+                const char *const output_path,
+                const struct array *const tbd_uuids)
+{
+    pthread_mutex_lock(&dedup->mutex);
+
+    if ((dedup->count + 1) * 2 > dedup->capacity) {
+        grow_entries(dedup);
+    }
+
+    struct macho_dedup_entry *const entry =
+        find_entry(dedup, key->size, key->hash, key->uuids, key->uuids_count);
+
+    if (entry->input_path != NULL) {
+        pthread_mutex_unlock(&dedup->mutex);
+        return;
+    }
+
+    struct arena *const arena = &dedup->arena;
+
+    char *const input_path_copy =
+        arena_copy_string(arena, input_path, strlen(input_path));
+
+    char *const output_path_copy =
+        arena_copy_string(arena, output_path, strlen(output_path));
+
+    if (input_path_copy == NULL || output_path_copy == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    const uint64_t uuids_size = (uint64_t)key->uuids_count * 16;
+    uint8_t *uuids_copy = NULL;
+
+    if (uuids_size != 0) {
+        uuids_copy = arena_alloc(arena, uuids_size);
+        if (uuids_copy == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+
+        memcpy(uuids_copy, key->uuids, uuids_size);
+    }
+
+    struct array tbd_uuids_copy = {};
+    if (!array_is_empty(tbd_uuids)) {
+        const uint64_t tbd_uuids_size = array_get_used_size(tbd_uuids);
+        struct tbd_uuid_info *const data = malloc(tbd_uuids_size);
+
+        if (data == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+
+        memcpy(data, tbd_uuids->data, tbd_uuids_size);
+
+        tbd_uuids_copy.data = data;
+        tbd_uuids_copy.data_end = (uint8_t *)data + tbd_uuids_size;
+        tbd_uuids_copy.alloc_end = tbd_uuids_copy.data_end;
+    }
+
+    *entry = (struct macho_dedup_entry){
+        .input_path = input_path_copy,
+        .output_path = output_path_copy,
+        .size = key->size,
+        .hash = key->hash,
+        .uuids = uuids_copy,
+        .uuids_count = key->uuids_count,
+        .tbd_uuids = tbd_uuids_copy
+    };
+
+    dedup->count += 1;
+    pthread_mutex_unlock(&dedup->mutex);
+}
+
+void macho_dedup_key_destroy(struct macho_dedup_key *const key) {
+    free(key->uuids);
+
+    key->size = 0;
+    key->hash = 0;
+
+    key->uuids = NULL;
+    key->uuids_count = 0;
+}
+
+void macho_dedup_destroy(struct macho_dedup *const dedup) {
+    struct macho_dedup_entry *iter = dedup->entries;
+    const struct macho_dedup_entry *const end = iter + dedup->capacity;
+
+    for (; iter != end; iter++) {
+        array_destroy(&iter->tbd_uuids);
+    }
+
+    free(dedup->entries);
+    arena_destroy(&dedup->arena);
+
+    pthread_mutex_destroy(&dedup->mutex);
+
+    dedup->entries = NULL;
+    dedup->count = 0;
+    dedup->capacity = 0;
+}
@@ -6,6 +6,7 @@
 //  Copyright © 2018 - 2019 inoahdev. All rights reserved.
 //
 
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 
@@ -22,12 +23,15 @@
 
 #include "macho_file.h"
 #include "macho_file_parse_load_commands.h"
+#include "macho_stream.h"
+#include "stats.h"
 
 #include "swap.h"
 
 static enum macho_file_parse_result
 parse_thin_file(struct tbd_create_info *const info_in,
                 const int fd,
+                const uint8_t *const map,
                 const struct mach_header header,
                 const bool is_big_endian,
                 const uint64_t start,
@@ -42,22 +46,18 @@ parse_thin_file(struct tbd_create_info *const info_in,
         if (size < sizeof(struct mach_header_64)) {
             return E_MACHO_FILE_PARSE_SIZE_TOO_SMALL;
         }
-
-        /*
-         * 64-bit mach-o files have a different header (struct mach_header_64),
-         * which only differs by having an extra uint32_t field at the end.
-         */
-
-        if (lseek(fd, sizeof(uint32_t), SEEK_CUR) < 0) {
-            return E_MACHO_FILE_PARSE_SEEK_FAIL;
-        }
     } else {
         if (!is_big_endian && header.magic != MH_MAGIC) {
             return E_MACHO_FILE_PARSE_NOT_A_MACHO;
         }
     }
 
-    if (info_in->flags != 0) {
+    /*
+     * If an arch was already parsed, ensure this arch's flags match up with
+     * the flags found in the earlier archs.
+     */
+
+    if (info_in->flags & F_TBD_CREATE_INFO_PARSED_AN_ARCH) {
         if (info_in->flags_field & TBD_FLAG_FLAT_NAMESPACE) {
             if (!(header.flags & MH_TWOLEVEL)) {
                 return E_MACHO_FILE_PARSE_CONFLICTING_FLAGS;
@@ -109,6 +109,7 @@ parse_thin_file(struct tbd_create_info *const info_in,
     const enum macho_file_parse_result parse_load_commands_result =    
         macho_file_parse_load_commands_from_file(info_in,
                                                  fd,
+                                                 map,
                                                  range,
                                                  arch,
                                                  arch_bit,
@@ -118,12 +119,15 @@ parse_thin_file(struct tbd_create_info *const info_in,
                                                  header.sizeofcmds,
                                                  tbd_options,
                                                  options,
+                                                 NULL,
                                                  NULL);
 
     if (parse_load_commands_result != E_MACHO_FILE_PARSE_OK) {
         return parse_load_commands_result;
     }
 
+    info_in->flags |= F_TBD_CREATE_INFO_PARSED_AN_ARCH;
+
     return E_MACHO_FILE_PARSE_OK;
 }
 
@@ -134,6 +138,7 @@ static inline bool thin_magic_is_valid(const uint32_t magic) {
 static enum macho_file_parse_result
 handle_fat_32_file(struct tbd_create_info *const info_in,
                    const int fd,
+                   const uint8_t *const map,
                    const bool is_big_endian,
                    const uint32_t nfat_arch,
                    const uint64_t start,
@@ -164,31 +169,28 @@ handle_fat_32_file(struct tbd_create_info *const info_in,
         return E_MACHO_FILE_PARSE_ALLOC_FAIL;
     }
 
-    if (read(fd, archs, archs_size) < 0) {
-        free(archs);
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
-
     /*
-     * First loop over only to swap the arch-header's fields. We also do some
-     * basic verification to ensure no architectures overflow.
+     * The arch-headers are swapped in place, so they're copied out even when
+     * the file is mapped.
      */
 
-    if (is_big_endian) {
-        struct fat_arch *const arch = archs;
-
-        arch->cputype = swap_int32(arch->cputype);
-        arch->cpusubtype = swap_int32(arch->cpusubtype);
-
-        arch->offset = swap_uint32(arch->offset);
-        arch->size = swap_uint32(arch->size);
+    const uint64_t archs_offset = start + sizeof(struct fat_header);
+    if (map != NULL) {
+        memcpy(archs, map + archs_offset, archs_size);
+    } else if (pread(fd, archs, archs_size, (off_t)archs_offset) < 0) {
+        free(archs);
+        return E_MACHO_FILE_PARSE_READ_FAIL;
+    } else {
+        stats_add(STATS_COUNTER_BYTES_READ, archs_size);
     }
 
     /*
-     * Before parsing, verify each architecture.
+     * Before parsing, swap and verify each architecture. Every architecture,
+     * including the first, has to be verified, as the file's map is accessed
+     * directly.
      */
 
-    for (uint32_t i = 1; i < nfat_arch; i++) {
+    for (uint32_t i = 0; i < nfat_arch; i++) {
         struct fat_arch *const arch = archs + i;
 
         uint32_t arch_offset = arch->offset;
@@ -238,7 +240,7 @@ handle_fat_32_file(struct tbd_create_info *const info_in,
          * Verify that the architecture is fully within the given size.
          */
 
-        const uint64_t arch_end = arch_offset + arch_size;
+        const uint64_t arch_end = (uint64_t)arch_offset + arch_size;
         if (arch_end > size) {
             free(archs);
             return E_MACHO_FILE_PARSE_INVALID_ARCHITECTURE;
@@ -283,17 +285,16 @@ handle_fat_32_file(struct tbd_create_info *const info_in,
     bool parsed_one_arch = false;
     for (uint32_t i = 0; i < nfat_arch; i++) {
         const struct fat_arch arch = archs[i];
-        const off_t arch_offset = (off_t)(start + arch.offset);
-
-        if (lseek(fd, arch_offset, SEEK_SET) < 0) {
-            free(archs);
-            return E_MACHO_FILE_PARSE_SEEK_FAIL;
-        }
+        const uint64_t arch_offset = start + arch.offset;
 
         struct mach_header header = {};
-        if (read(fd, &header, sizeof(header)) < 0) {
+        if (map != NULL) {
+            memcpy(&header, map + arch_offset, sizeof(header));
+        } else if (pread(fd, &header, sizeof(header), (off_t)arch_offset) < 0) {
             free(archs);
             return E_MACHO_FILE_PARSE_READ_FAIL;
+        } else {
+            stats_add(STATS_COUNTER_BYTES_READ, sizeof(header));
         }
 
         /*
@@ -337,6 +338,7 @@ handle_fat_32_file(struct tbd_create_info *const info_in,
         const enum macho_file_parse_result handle_arch_result =
             parse_thin_file(info_in,
                             fd,
+                            map,
                             header,
                             arch_is_big_endian,
                             start + arch.offset,
@@ -364,6 +366,7 @@ handle_fat_32_file(struct tbd_create_info *const info_in,
 static enum macho_file_parse_result
 handle_fat_64_file(struct tbd_create_info *const info_in,
                    const int fd,
+                   const uint8_t *const map,
                    const bool is_big_endian,
                    const uint32_t nfat_arch,
                    const uint64_t start,
@@ -397,31 +400,28 @@ handle_fat_64_file(struct tbd_create_info *const info_in,
         return E_MACHO_FILE_PARSE_ALLOC_FAIL;
     }
 
-    if (read(fd, archs, archs_size) < 0) {
-        free(archs);
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
-
     /*
-     * First loop over only to swap the arch-header's fields. We also do some
-     * basic verification to ensure no architectures overflow.
+     * The arch-headers are swapped in place, so they're copied out even when
+     * the file is mapped.
      */
 
-    if (is_big_endian) {
-        struct fat_arch_64 *const arch = archs;
-
-        arch->cputype = swap_int32(arch->cputype);
-        arch->cpusubtype = swap_int32(arch->cpusubtype);
-
-        arch->offset = swap_uint64(arch->offset);
-        arch->size = swap_uint64(arch->size);
+    const uint64_t archs_offset = start + sizeof(struct fat_header);
+    if (map != NULL) {
+        memcpy(archs, map + archs_offset, archs_size);
+    } else if (pread(fd, archs, archs_size, (off_t)archs_offset) < 0) {
+        free(archs);
+        return E_MACHO_FILE_PARSE_READ_FAIL;
+    } else {
+        stats_add(STATS_COUNTER_BYTES_READ, archs_size);
     }
 
     /*
-     * Before parsing, verify each architecture.
+     * Before parsing, swap and verify each architecture. Every architecture,
+     * including the first, has to be verified, as the file's map is accessed
+     * directly.
      */
 
-    for (uint32_t i = 1; i < nfat_arch; i++) {
+    for (uint32_t i = 0; i < nfat_arch; i++) {
         struct fat_arch_64 *const arch = archs + i;
 
         uint64_t arch_offset = arch->offset;
@@ -525,17 +525,16 @@ handle_fat_64_file(struct tbd_create_info *const info_in,
     bool parsed_one_arch = false;
     for (uint32_t i = 0; i < nfat_arch; i++) {
         const struct fat_arch_64 arch = archs[i];
-        const off_t arch_offset = (off_t)(start + arch.offset);
-
-        if (lseek(fd, arch_offset, SEEK_SET) < 0) {
-            free(archs);
-            return E_MACHO_FILE_PARSE_SEEK_FAIL;
-        }
+        const uint64_t arch_offset = start + arch.offset;
 
         struct mach_header header = {};
-        if (read(fd, &header, sizeof(header)) < 0) {
+        if (map != NULL) {
+            memcpy(&header, map + arch_offset, sizeof(header));
+        } else if (pread(fd, &header, sizeof(header), (off_t)arch_offset) < 0) {
             free(archs);
             return E_MACHO_FILE_PARSE_READ_FAIL;
+        } else {
+            stats_add(STATS_COUNTER_BYTES_READ, sizeof(header));
         }
 
         /*
@@ -580,6 +579,7 @@ handle_fat_64_file(struct tbd_create_info *const info_in,
         const enum macho_file_parse_result handle_arch_result =
             parse_thin_file(info_in,
                             fd,
+                            map,
                             header,
                             arch_is_big_endian,
                             start + arch.offset,
@@ -604,6 +604,159 @@ handle_fat_64_file(struct tbd_create_info *const info_in,
     return E_MACHO_FILE_PARSE_OK;
 }
 
+/*
+ * Files larger than this are read with pread() instead, as only the headers,
+ * load-commands, and symbol-tables of a file are ever accessed.
+ */
+
+static const uint64_t max_map_size = 1ull << 30;
+
+static const uint8_t *map_file(const int fd, const uint64_t size) {
+    if (size > max_map_size) {
+        return NULL;
+    }
+
+    void *const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    stats_add(STATS_COUNTER_BYTES_MAPPED, size);
+    return map;
+}
+
+static void unmap_file(const uint8_t *const map, const uint64_t size) {
+    if (map != NULL) {
+        munmap((void *)map, size);
+    }
+}
+
+static enum macho_file_parse_result
+parse_fat_from_stream_map(struct tbd_create_info *const info_in,
+                          const struct macho_stream_map *const stream,
+                          const uint32_t magic,
+                          const uint64_t tbd_options,
+                          const uint64_t options)
+{
+    if (stream->size < sizeof(struct fat_header)) {
+        return E_MACHO_FILE_PARSE_SIZE_TOO_SMALL;
+    }
+
+    const struct fat_header *const header =
+        (const struct fat_header *)stream->map;
+
+    uint32_t nfat_arch = header->nfat_arch;
+    if (nfat_arch == 0) {
+        return E_MACHO_FILE_PARSE_NO_ARCHITECTURES;
+    }
+
+    const bool is_big_endian = magic == FAT_CIGAM || magic == FAT_CIGAM_64;
+    if (is_big_endian) {
+        nfat_arch = swap_uint32(nfat_arch);
+    }
+
+    if (magic == FAT_MAGIC_64 || magic == FAT_CIGAM_64) {
+        return handle_fat_64_file(info_in,
+                                  -1,
+                                  stream->map,
+                                  is_big_endian,
+                                  nfat_arch,
+                                  0,
+                                  stream->size,
+                                  tbd_options,
+                                  options);
+    }
+
+    return handle_fat_32_file(info_in,
+                              -1,
+                              stream->map,
+                              is_big_endian,
+                              nfat_arch,
+                              0,
+                              stream->size,
+                              tbd_options,
+                              options);
+}
+
+static enum macho_file_parse_result
+parse_thin_from_stream_map(struct tbd_create_info *const info_in,
+                           const struct macho_stream_map *const stream,
+                           const uint32_t magic,
+                           const uint64_t tbd_options,
+                           const uint64_t options)
+{
+    if (stream->size < sizeof(struct mach_header)) {
+        return E_MACHO_FILE_PARSE_SIZE_TOO_SMALL;
+    }
+
+    struct mach_header header = {};
+    memcpy(&header, stream->map, sizeof(header));
+
+    const bool is_big_endian = magic == MH_CIGAM || magic == MH_CIGAM_64;
+    if (is_big_endian) {
+        header.cputype = swap_int32(header.cputype);
+        header.cpusubtype = swap_int32(header.cpusubtype);
+
+        header.ncmds = swap_uint32(header.ncmds);
+        header.sizeofcmds = swap_uint32(header.sizeofcmds);
+
+        header.flags = swap_uint32(header.flags);
+    }
+
+    return parse_thin_file(info_in,
+                           -1,
+                           stream->map,
+                           header,
+                           is_big_endian,
+                           0,
+                           stream->size,
+                           tbd_options,
+                           options);
+}
+
+/*
+ * Streams, like pipes, can neither be seeked nor mapped, so the parts of the
+ * mach-o that are needed are first read into a stream-map in a single forward
+ * pass, which is then parsed like any other map.
+ */
+
+static enum macho_file_parse_result
+parse_from_stream(struct tbd_create_info *const info_in,
+                  const int fd,
+                  const uint32_t magic,
+                  const bool is_fat,
+                  const uint64_t tbd_options,
+                  const uint64_t options)
+{
+    struct macho_stream_map stream = {};
+    const enum macho_file_parse_result create_map_result =
+        macho_stream_map_create(&stream, fd, magic, tbd_options, options);
+
+    if (create_map_result != E_MACHO_FILE_PARSE_OK) {
+        return create_map_result;
+    }
+
+    enum macho_file_parse_result ret = E_MACHO_FILE_PARSE_OK;
+    if (is_fat) {
+        ret =
+            parse_fat_from_stream_map(info_in,
+                                      &stream,
+                                      magic,
+                                      tbd_options,
+                                      options);
+    } else {
+        ret =
+            parse_thin_from_stream_map(info_in,
+                                       &stream,
+                                       magic,
+                                       tbd_options,
+                                       options);
+    }
+
+    macho_stream_map_destroy(&stream);
+    return ret;
+}
+
 enum macho_file_parse_result
 macho_file_parse_from_file(struct tbd_create_info *const info_in,
                            const int fd,
@@ -615,8 +768,31 @@ macho_file_parse_from_file(struct tbd_create_info *const info_in,
         magic == FAT_MAGIC    || magic == FAT_CIGAM ||
         magic == FAT_MAGIC_64 || magic == FAT_CIGAM_64;
 
+    const bool is_thin =
+        magic == MH_MAGIC    || magic == MH_CIGAM ||
+        magic == MH_MAGIC_64 || magic == MH_CIGAM_64;
+
+    if (!is_fat && !is_thin) {
+        return E_MACHO_FILE_PARSE_NOT_A_MACHO;
+    }
+
+    struct stat sbuf = {};
+    if (fstat(fd, &sbuf) < 0) {
+        return E_MACHO_FILE_PARSE_FSTAT_FAIL;
+    }
+
+    const uint64_t file_size = (uint64_t)sbuf.st_size;
+
     enum macho_file_parse_result ret = E_MACHO_FILE_PARSE_OK;
-    if (is_fat) {
+    if (!S_ISREG(sbuf.st_mode)) {
+        ret =
+            parse_from_stream(info_in,
+                              fd,
+                              magic,
+                              is_fat,
+                              tbd_options,
+                              options);
+    } else if (is_fat) {
         uint32_t nfat_arch = 0;
         if (read(fd, &nfat_arch, sizeof(nfat_arch)) < 0) {
             if (errno == EOVERFLOW) {
@@ -626,6 +802,8 @@ macho_file_parse_from_file(struct tbd_create_info *const info_in,
             return E_MACHO_FILE_PARSE_READ_FAIL;
         }
 
+        stats_add(STATS_COUNTER_BYTES_READ, sizeof(nfat_arch));
+
         if (nfat_arch == 0) {
             return E_MACHO_FILE_PARSE_NO_ARCHITECTURES;
         }
@@ -635,18 +813,14 @@ macho_file_parse_from_file(struct tbd_create_info *const info_in,
             nfat_arch = swap_uint32(nfat_arch);
         }
 
-        struct stat sbuf = {};
-        if (fstat(fd, &sbuf) < 0) {
-            return E_MACHO_FILE_PARSE_FSTAT_FAIL;
-        }
-
         const bool is_64 = magic == FAT_MAGIC_64 || magic == FAT_CIGAM_64;
-        const uint64_t file_size = (uint64_t)sbuf.st_size;
+        const uint8_t *const map = map_file(fd, file_size);
 
         if (is_64) {
             ret =
                 handle_fat_64_file(info_in,
                                    fd,
+                                   map,
                                    is_big_endian,
                                    nfat_arch,
                                    0,
@@ -657,6 +831,7 @@ macho_file_parse_from_file(struct tbd_create_info *const info_in,
             ret =
                 handle_fat_32_file(info_in,
                                    fd,
+                                   map,
                                    is_big_endian,
                                    nfat_arch,
                                    0,
@@ -664,15 +839,9 @@ macho_file_parse_from_file(struct tbd_create_info *const info_in,
                                    tbd_options,
                                    options);
         }
-    } else {
-        const bool is_thin =
-            magic == MH_MAGIC    || magic == MH_CIGAM ||
-            magic == MH_MAGIC_64 || magic == MH_CIGAM_64;
-
-        if (!is_thin) {
-            return E_MACHO_FILE_PARSE_NOT_A_MACHO;
-        }
 
+        unmap_file(map, file_size);
+    } else {
         struct mach_header header = { .magic = magic };
         if (read(fd, &header.cputype, sizeof(header) - sizeof(magic)) < 0) {
             if (errno == EOVERFLOW) {
@@ -682,12 +851,8 @@ macho_file_parse_from_file(struct tbd_create_info *const info_in,
             return E_MACHO_FILE_PARSE_READ_FAIL;
         }
 
-        struct stat sbuf = {};
-        if (fstat(fd, &sbuf) < 0) {
-            return E_MACHO_FILE_PARSE_FSTAT_FAIL;
-        }
+        stats_add(STATS_COUNTER_BYTES_READ, sizeof(header) - sizeof(magic));
 
-        const uint64_t file_size = (uint64_t)sbuf.st_size;
         const bool is_big_endian = magic == MH_CIGAM || magic == MH_CIGAM_64;
         /*
          * Swap the mach_header's fields if big-endian.
@@ -703,15 +868,19 @@ macho_file_parse_from_file(struct tbd_create_info *const info_in,
             header.flags = swap_uint32(header.flags);
         }
 
+        const uint8_t *const map = map_file(fd, file_size);
         ret =
             parse_thin_file(info_in,
                             fd,
+                            map,
                             header,
                             is_big_endian,
                             0,
                             file_size,
                             tbd_options,
                             options);
+
+        unmap_file(map, file_size);
     }
 
     if (ret != E_MACHO_FILE_PARSE_OK) {
@@ -729,9 +898,7 @@ macho_file_parse_from_file(struct tbd_create_info *const info_in,
      */
 
     const enum array_result sort_exports_result =
-        array_sort_items_with_comparator(&info_in->exports,
-                                         sizeof(struct tbd_export_info),
-                                         tbd_export_info_comparator);
+        tbd_create_info_sort_exports(info_in);
 
     if (sort_exports_result != E_ARRAY_OK) {
         return E_MACHO_FILE_PARSE_ARRAY_FAIL;
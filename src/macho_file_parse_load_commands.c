@@ -21,6 +21,7 @@
 #include "macho_file_parse_symbols.h"
 
 #include "path.h"
+#include "stats.h"
 #include "swap.h"
 
 #include "yaml.h"
@@ -138,6 +139,7 @@ static enum macho_file_parse_result
 parse_section_from_file(struct tbd_create_info *const info_in,
                         uint32_t *const existing_swift_version_in,
                         const int fd,
+                        const uint8_t *const map,
                         const struct range full_range,
                         const struct range macho_range,
                         uint32_t sect_offset,
@@ -157,37 +159,18 @@ parse_section_from_file(struct tbd_create_info *const info_in,
         return E_MACHO_FILE_PARSE_INVALID_SECTION;
     }
 
-    /*
-     * Keep an offset of our original position, which we'll seek back to alter,
-     * so we can return safetly back to the for loop.
-     */
-
-    const off_t original_pos = lseek(fd, 0, SEEK_CUR);
+    off_t absolute = (off_t)(full_range.begin + sect_offset);
     if (options & O_MACHO_FILE_PARSE_SECT_OFF_ABSOLUTE) {
-        if (lseek(fd, sect_offset, SEEK_SET) < 0) {
-            return E_MACHO_FILE_PARSE_SEEK_FAIL;
-        }
-    } else {
-        const off_t absolute = (off_t)(full_range.begin + sect_offset);
-        if (lseek(fd, absolute, SEEK_SET) < 0) {
-            return E_MACHO_FILE_PARSE_SEEK_FAIL;
-        }
+        absolute = sect_offset;
     }
 
     struct objc_image_info image_info = {};
-    if (read(fd, &image_info, sizeof(image_info)) < 0) {
+    if (map != NULL) {
+        memcpy(&image_info, map + absolute, sizeof(image_info));
+    } else if (pread(fd, &image_info, sizeof(image_info), absolute) < 0) {
         return E_MACHO_FILE_PARSE_READ_FAIL;
     }
 
-    /*
-     * Seek back to our original-position to continue recursing the
-     * load-commands.
-     */
-
-    if (lseek(fd, original_pos, SEEK_SET) < 0) {
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
-
     /*
      * Parse the objc-constraint and ensure it's the same as the one discovered
      * for another containers.
@@ -246,60 +229,18 @@ add_export_to_info(struct tbd_create_info *const info_in,
         .type = type
     };
 
-    struct array *const exports = &info_in->exports;
-    struct array_cached_index_info cached_info = {};
-
-    struct tbd_export_info *const existing_info =
-        array_find_item_in_sorted(exports,
-                                  sizeof(export_info),
-                                  &export_info,
-                                  tbd_export_info_no_archs_comparator,
-                                  &cached_info);
-
-    if (existing_info != NULL) {
-        const uint64_t archs = existing_info->archs;
-        if (!(archs & arch_bit)) {
-            existing_info->archs = archs | arch_bit;
-            existing_info->archs_count += 1;
-        }
-
-        return E_MACHO_FILE_PARSE_OK;
-    }
+    const enum tbd_add_export_result add_export_result =
+        tbd_create_info_add_export(info_in, &export_info, true);
 
-    /*
-     * Do a quick check here to ensure that the string is a valid yaml-string
-     * (with some additional boundaries).
-     *
-     * We do this after searching for an existing export-info, as its usually
-     * not the case that a mach-o library has an invalid exported string of any
-     * kind.
-     */
-
-    const bool needs_quotes = yaml_check_c_str(string, string_length);
-    if (needs_quotes) {
-        export_info.flags |= F_TBD_EXPORT_INFO_STRING_NEEDS_QUOTES;
-    }
-
-    /*
-     * Copy the provided string as the original string comes from the large
-     * load-command buffer which will soon be freed.
-     */
-
-    export_info.string = strndup(export_info.string, export_info.length);
-    if (export_info.string == NULL) {
-        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
-    }
+    switch (add_export_result) {
+        case E_TBD_ADD_EXPORT_OK:
+            break;
 
-    const enum array_result add_export_info_result =
-        array_add_item_with_cached_index_info(exports,
-                                              sizeof(export_info),
-                                              &export_info,
-                                              &cached_info,
-                                              NULL);
+        case E_TBD_ADD_EXPORT_ALLOC_FAIL:
+            return E_MACHO_FILE_PARSE_ALLOC_FAIL;
 
-    if (add_export_info_result != E_ARRAY_OK) {
-        free(export_info.string);
-        return E_MACHO_FILE_PARSE_ARRAY_FAIL;
+        case E_TBD_ADD_EXPORT_ARRAY_FAIL:
+            return E_MACHO_FILE_PARSE_ARRAY_FAIL;
     }
 
     return E_MACHO_FILE_PARSE_OK;
@@ -317,7 +258,8 @@ parse_load_command(struct tbd_create_info *const info_in,
                    const uint64_t tbd_options,
                    const uint64_t options,
                    bool *const found_identification_out,
-                   struct symtab_command *const symtab_out)
+                   struct symtab_command *const symtab_out,
+                   struct linkedit_data_command *const export_trie_out)
 {
     switch (load_cmd.cmd) {
         case LC_BUILD_VERSION: {
@@ -403,6 +345,86 @@ parse_load_command(struct tbd_create_info *const info_in,
             break;
         }
 
+        case LC_DYLD_INFO:
+        case LC_DYLD_INFO_ONLY: {
+            /*
+             * If symbols aren't needed, skip the unnecessary parsing.
+             */
+
+            if (tbd_options & O_TBD_PARSE_IGNORE_SYMBOLS) {
+                break;
+            }
+
+            /*
+             * The export-trie is only an alternative to the symbol-table, so
+             * for leniency, ignore a dyld-info command that's too small
+             * instead of erroring out.
+             */
+
+            if (load_cmd.cmdsize < sizeof(struct dyld_info_command)) {
+                break;
+            }
+
+            /*
+             * Prefer LC_DYLD_EXPORTS_TRIE, which newer mach-o files carry
+             * alongside an LC_DYLD_INFO_ONLY with no export info.
+             */
+
+            if (export_trie_out->cmd == LC_DYLD_EXPORTS_TRIE) {
+                break;
+            }
+
+            const struct dyld_info_command *const dyld_info =
+                (const struct dyld_info_command *)load_cmd_iter;
+
+            uint32_t export_off = dyld_info->export_off;
+            uint32_t export_size = dyld_info->export_size;
+
+            if (is_big_endian) {
+                export_off = swap_uint32(export_off);
+                export_size = swap_uint32(export_size);
+            }
+
+            export_trie_out->cmd = load_cmd.cmd;
+            export_trie_out->cmdsize = load_cmd.cmdsize;
+            export_trie_out->dataoff = export_off;
+            export_trie_out->datasize = export_size;
+
+            break;
+        }
+
+        case LC_DYLD_EXPORTS_TRIE: {
+            /*
+             * If symbols aren't needed, skip the unnecessary parsing.
+             */
+
+            if (tbd_options & O_TBD_PARSE_IGNORE_SYMBOLS) {
+                break;
+            }
+
+            if (load_cmd.cmdsize < sizeof(struct linkedit_data_command)) {
+                break;
+            }
+
+            const struct linkedit_data_command *const exports_trie =
+                (const struct linkedit_data_command *)load_cmd_iter;
+
+            uint32_t dataoff = exports_trie->dataoff;
+            uint32_t datasize = exports_trie->datasize;
+
+            if (is_big_endian) {
+                dataoff = swap_uint32(dataoff);
+                datasize = swap_uint32(datasize);
+            }
+
+            export_trie_out->cmd = load_cmd.cmd;
+            export_trie_out->cmdsize = load_cmd.cmdsize;
+            export_trie_out->dataoff = dataoff;
+            export_trie_out->datasize = datasize;
+
+            break;
+        }
+
         case LC_ID_DYLIB: {
             /*
              * We could check here if an LC_ID_DYLIB was already found for the
@@ -545,7 +567,11 @@ parse_load_command(struct tbd_create_info *const info_in,
 
                 if (!(tbd_options & O_TBD_PARSE_IGNORE_INSTALL_NAME)) {
                     if (options & O_MACHO_FILE_PARSE_COPY_STRINGS_IN_MAP) {
-                        char *const install_name = strndup(name_ptr, length);
+                        char *const install_name =
+                            arena_copy_string(&info_in->arena,
+                                              name_ptr,
+                                              length);
+
                         if (install_name == NULL) {
                             return E_MACHO_FILE_PARSE_ALLOC_FAIL;
                         }
@@ -805,7 +831,11 @@ parse_load_command(struct tbd_create_info *const info_in,
             } else {
                 if (tbd_options & O_TBD_PARSE_IGNORE_PARENT_UMBRELLA) {
                     if (options & O_MACHO_FILE_PARSE_COPY_STRINGS_IN_MAP) {
-                        char *const umbrella_string = strndup(umbrella, length);
+                        char *const umbrella_string =
+                            arena_copy_string(&info_in->arena,
+                                              umbrella,
+                                              length);
+
                         if (umbrella_string == NULL) {
                             return E_MACHO_FILE_PARSE_ALLOC_FAIL;
                         }
@@ -1028,6 +1058,7 @@ enum macho_file_parse_result
 macho_file_parse_load_commands_from_file(
     struct tbd_create_info *const info_in,
     const int fd,
+    const uint8_t *const map,
     const struct range range,
     const struct arch_info *const arch,
     const uint64_t arch_bit,
@@ -1037,7 +1068,8 @@ macho_file_parse_load_commands_from_file(
     const uint32_t sizeofcmds,
     const uint64_t tbd_options,
     const uint64_t options,
-    struct symtab_command *const symtab_out)
+    struct symtab_command *const symtab_out,
+    struct linkedit_data_command *const export_trie_out)
 {
     if (ncmds == 0) {
         return E_MACHO_FILE_PARSE_NO_LOAD_COMMANDS; 
@@ -1078,8 +1110,11 @@ macho_file_parse_load_commands_from_file(
     }
 
     const uint64_t macho_size = range.end - range.begin;
-    const uint32_t available_load_cmd_size =
-        (uint32_t)(macho_size - header_size);
+    if (macho_size < header_size) {
+        return E_MACHO_FILE_PARSE_TOO_MANY_LOAD_COMMANDS;
+    }
+
+    const uint64_t available_load_cmd_size = macho_size - header_size;
 
     if (sizeofcmds > available_load_cmd_size) {
         return E_MACHO_FILE_PARSE_TOO_MANY_LOAD_COMMANDS;
@@ -1094,20 +1129,37 @@ macho_file_parse_load_commands_from_file(
     bool found_uuid = false;
 
     struct symtab_command symtab = {};
+    struct linkedit_data_command export_trie = {};
     struct tbd_uuid_info uuid_info = { .arch = arch };
 
     /*
-     * Allocate the entire load-commands buffer to allow fast parsing.
+     * Parse the load-commands straight from the map if the file is mapped.
+     * Otherwise, read the entire load-commands buffer to allow fast parsing.
      */
 
-    uint8_t *const load_cmd_buffer = calloc(1, sizeofcmds);
-    if (load_cmd_buffer == NULL) {
-        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
-    }
-    
-    if (read(fd, load_cmd_buffer, sizeofcmds) < 0) {
-        free(load_cmd_buffer);
-        return E_MACHO_FILE_PARSE_READ_FAIL;
+    const uint64_t load_cmds_offset = range.begin + header_size;
+
+    const uint8_t *load_cmd_buffer = NULL;
+    uint8_t *load_cmd_alloc = NULL;
+
+    if (map != NULL) {
+        load_cmd_buffer = map + load_cmds_offset;
+    } else {
+        load_cmd_alloc = calloc(1, sizeofcmds);
+        if (load_cmd_alloc == NULL) {
+            return E_MACHO_FILE_PARSE_ALLOC_FAIL;
+        }
+
+        const off_t offset = (off_t)load_cmds_offset;
+        if (pread(fd, load_cmd_alloc, sizeofcmds, offset) < 0) {
+            free(load_cmd_alloc);
+            return E_MACHO_FILE_PARSE_READ_FAIL;
+        }
+
+        stats_add(STATS_COUNTER_BYTES_READ, sizeofcmds);
+        stats_add(STATS_COUNTER_ALLOCATIONS, 1);
+
+        load_cmd_buffer = load_cmd_alloc;
     }
 
     const uint64_t complete_options =
@@ -1118,7 +1170,7 @@ macho_file_parse_load_commands_from_file(
      * mach-o header.
      */
 
-    uint8_t *load_cmd_iter = load_cmd_buffer;
+    const uint8_t *load_cmd_iter = load_cmd_buffer;
     uint32_t size_left = sizeofcmds;
 
     for (uint32_t i = 0; i != ncmds; i++) {
@@ -1127,7 +1179,7 @@ macho_file_parse_load_commands_from_file(
          */
 
         if (size_left < sizeof(struct load_command)) {
-            free(load_cmd_buffer);
+            free(load_cmd_alloc);
             return E_MACHO_FILE_PARSE_INVALID_LOAD_COMMAND;
         }
 
@@ -1148,12 +1200,12 @@ macho_file_parse_load_commands_from_file(
          */
 
         if (load_cmd.cmdsize < sizeof(struct load_command)) {
-            free(load_cmd_buffer);
+            free(load_cmd_alloc);
             return E_MACHO_FILE_PARSE_INVALID_LOAD_COMMAND;
         }
 
         if (size_left < load_cmd.cmdsize) {
-            free(load_cmd_buffer);
+            free(load_cmd_alloc);
             return E_MACHO_FILE_PARSE_INVALID_LOAD_COMMAND;
         }
 
@@ -1190,7 +1242,7 @@ macho_file_parse_load_commands_from_file(
                 }
 
                 if (load_cmd.cmdsize < sizeof(struct segment_command)) {
-                    free(load_cmd_buffer);
+                    free(load_cmd_alloc);
                     return E_MACHO_FILE_PARSE_INVALID_LOAD_COMMAND;
                 }
 
@@ -1216,7 +1268,7 @@ macho_file_parse_load_commands_from_file(
 
                 uint64_t sections_size = sizeof(struct section);
                 if (guard_overflow_mul(&sections_size, nsects)) {
-                    free(load_cmd_buffer);
+                    free(load_cmd_alloc);
                     return E_MACHO_FILE_PARSE_TOO_MANY_SECTIONS;
                 }
 
@@ -1224,7 +1276,7 @@ macho_file_parse_load_commands_from_file(
                     load_cmd.cmdsize - sizeof(struct segment_command);
 
                 if (sections_size > max_sections_size) {
-                    free(load_cmd_buffer);
+                    free(load_cmd_alloc);
                     return E_MACHO_FILE_PARSE_TOO_MANY_SECTIONS;
                 }
 
@@ -1250,6 +1302,7 @@ macho_file_parse_load_commands_from_file(
                         parse_section_from_file(info_in,
                                                 &swift_version,
                                                 fd,
+                                                map,
                                                 range,
                                                 relative_range,
                                                 sect_offset,
@@ -1257,7 +1310,7 @@ macho_file_parse_load_commands_from_file(
                                                 options);
 
                     if (parse_section_result != E_MACHO_FILE_PARSE_OK) {
-                        free(load_cmd_buffer);
+                        free(load_cmd_alloc);
                         return parse_section_result;
                     }
                 }
@@ -1268,7 +1321,7 @@ macho_file_parse_load_commands_from_file(
 
                     if (!ignore_conflicting_fields) {
                         if (info_in->swift_version != swift_version) {
-                            free(load_cmd_buffer);
+                            free(load_cmd_alloc);
                             return E_MACHO_FILE_PARSE_CONFLICTING_SWIFT_VERSION;
                         }
                     }
@@ -1304,7 +1357,7 @@ macho_file_parse_load_commands_from_file(
                 }
 
                 if (load_cmd.cmdsize < sizeof(struct segment_command_64)) {
-                    free(load_cmd_buffer);
+                    free(load_cmd_alloc);
                     return E_MACHO_FILE_PARSE_INVALID_LOAD_COMMAND;
                 }
 
@@ -1330,7 +1383,7 @@ macho_file_parse_load_commands_from_file(
 
                 uint64_t sections_size = sizeof(struct section_64);
                 if (guard_overflow_mul(&sections_size, nsects)) {
-                    free(load_cmd_buffer);
+                    free(load_cmd_alloc);
                     return E_MACHO_FILE_PARSE_TOO_MANY_SECTIONS;
                 }
 
@@ -1338,7 +1391,7 @@ macho_file_parse_load_commands_from_file(
                     load_cmd.cmdsize - sizeof(struct segment_command_64);
 
                 if (sections_size > max_sections_size) {
-                    free(load_cmd_buffer);
+                    free(load_cmd_alloc);
                     return E_MACHO_FILE_PARSE_TOO_MANY_SECTIONS;
                 }
 
@@ -1366,6 +1419,7 @@ macho_file_parse_load_commands_from_file(
                         parse_section_from_file(info_in,
                                                 &swift_version,
                                                 fd,
+                                                map,
                                                 range,
                                                 relative_range,
                                                 sect_offset,
@@ -1373,7 +1427,7 @@ macho_file_parse_load_commands_from_file(
                                                 options);
 
                     if (parse_section_result != E_MACHO_FILE_PARSE_OK) {
-                        free(load_cmd_buffer);
+                        free(load_cmd_alloc);
                         return parse_section_result;
                     }
                 }
@@ -1384,7 +1438,7 @@ macho_file_parse_load_commands_from_file(
 
                     if (!ignore_conflicting_fields) {
                         if (info_in->swift_version != swift_version) {
-                            free(load_cmd_buffer);
+                            free(load_cmd_alloc);
                             return E_MACHO_FILE_PARSE_CONFLICTING_SWIFT_VERSION;
                         }
                     }
@@ -1407,10 +1461,11 @@ macho_file_parse_load_commands_from_file(
                                        tbd_options,
                                        complete_options,
                                        &found_identification,
-                                       &symtab);
+                                       &symtab,
+                                       &export_trie);
 
                 if (parse_load_command_result != E_MACHO_FILE_PARSE_OK) {
-                    free(load_cmd_buffer);
+                    free(load_cmd_alloc);
                     return parse_load_command_result;
                 }
 
@@ -1421,8 +1476,7 @@ macho_file_parse_load_commands_from_file(
         load_cmd_iter += load_cmd.cmdsize;
     }
 
-    free(load_cmd_buffer);
-    info_in->flags |= F_TBD_CREATE_INFO_STRINGS_WERE_COPIED;
+    free(load_cmd_alloc);
 
     if (!found_identification) {
         return E_MACHO_FILE_PARSE_NO_IDENTIFICATION;
@@ -1485,10 +1539,36 @@ macho_file_parse_load_commands_from_file(
         *symtab_out = symtab;
     }
 
+    if (export_trie_out != NULL) {
+        *export_trie_out = export_trie;
+    }
+
     if (options & O_MACHO_FILE_PARSE_DONT_PARSE_SYMBOL_TABLE) {
         return E_MACHO_FILE_PARSE_OK;
     }
 
+    /*
+     * Prefer the export-trie when possible, as it only lists the exported
+     * symbols, instead of every local and debug symbol in the symbol-table.
+     */
+
+    stats_begin_phase(STATS_PHASE_SYMBOLS);
+
+    if (macho_file_can_parse_export_trie(&export_trie, tbd_options)) {
+        const enum macho_file_parse_result parse_export_trie_result =
+            macho_file_parse_export_trie_from_file(info_in,
+                                                   fd,
+                                                   map,
+                                                   range,
+                                                   arch_bit,
+                                                   export_trie.dataoff,
+                                                   export_trie.datasize,
+                                                   tbd_options);
+
+        stats_end_phase();
+        return parse_export_trie_result;
+    }
+
     /*
      * Verify the symbol-table's information.
      */
@@ -1498,6 +1578,7 @@ macho_file_parse_load_commands_from_file(
         ret =
             macho_file_parse_symbols_64_from_file(info_in,
                                                   fd,
+                                                  map,
                                                   range,
                                                   arch_bit,
                                                   is_big_endian,
@@ -1510,6 +1591,7 @@ macho_file_parse_load_commands_from_file(
         ret =
             macho_file_parse_symbols_from_file(info_in,
                                                fd,
+                                               map,
                                                range,
                                                arch_bit,
                                                is_big_endian,
@@ -1520,6 +1602,8 @@ macho_file_parse_load_commands_from_file(
                                                tbd_options);
     }
 
+    stats_end_phase();
+
     if (ret != E_MACHO_FILE_PARSE_OK) {
         return ret;
     }
@@ -1622,7 +1706,9 @@ macho_file_parse_load_commands_from_map(struct tbd_create_info *const info_in,
                                         const uint32_t sizeofcmds,
                                         const uint64_t tbd_options,
                                         const uint64_t options,
-                                        struct symtab_command *const symtab_out)
+                                        struct symtab_command *const symtab_out,
+                                        struct linkedit_data_command *const
+                                            export_trie_out)
 {
     if (ncmds == 0) {
         return E_MACHO_FILE_PARSE_NO_LOAD_COMMANDS; 
@@ -1662,8 +1748,7 @@ macho_file_parse_load_commands_from_map(struct tbd_create_info *const info_in,
         header_size += sizeof(uint32_t);
     }
 
-    const uint32_t available_load_cmd_size =
-        (uint32_t)(macho_size - header_size);
+    const uint64_t available_load_cmd_size = macho_size - header_size;
 
     if (sizeofcmds > available_load_cmd_size) {
         return E_MACHO_FILE_PARSE_TOO_MANY_LOAD_COMMANDS;
@@ -1683,6 +1768,7 @@ macho_file_parse_load_commands_from_map(struct tbd_create_info *const info_in,
     bool found_uuid = false;
 
     struct symtab_command symtab = {};
+    struct linkedit_data_command export_trie = {};
     struct tbd_uuid_info uuid_info = { .arch = arch };
 
     /*
@@ -1979,7 +2065,8 @@ macho_file_parse_load_commands_from_map(struct tbd_create_info *const info_in,
                                        tbd_options,
                                        options,
                                        &found_identification,
-                                       &symtab);
+                                       &symtab,
+                                       &export_trie);
 
                 if (parse_load_command_result != E_MACHO_FILE_PARSE_OK) {
                     return parse_load_command_result;
@@ -1992,10 +2079,6 @@ macho_file_parse_load_commands_from_map(struct tbd_create_info *const info_in,
         load_cmd_iter += load_cmd.cmdsize;
     }
 
-    if (options & O_MACHO_FILE_PARSE_COPY_STRINGS_IN_MAP) {
-        info_in->flags |= F_TBD_CREATE_INFO_STRINGS_WERE_COPIED;
-    }
-
     if (!found_identification) {
         return E_MACHO_FILE_PARSE_NO_IDENTIFICATION;
     }
@@ -2057,10 +2140,35 @@ macho_file_parse_load_commands_from_map(struct tbd_create_info *const info_in,
         *symtab_out = symtab;
     }
 
+    if (export_trie_out != NULL) {
+        *export_trie_out = export_trie;
+    }
+
     if (options & O_MACHO_FILE_PARSE_DONT_PARSE_SYMBOL_TABLE) {
         return E_MACHO_FILE_PARSE_OK;
     }
 
+    /*
+     * Prefer the export-trie when possible, as it only lists the exported
+     * symbols, instead of every local and debug symbol in the symbol-table.
+     */
+
+    stats_begin_phase(STATS_PHASE_SYMBOLS);
+
+    if (macho_file_can_parse_export_trie(&export_trie, tbd_options)) {
+        const enum macho_file_parse_result parse_export_trie_result =
+            macho_file_parse_export_trie_from_map(info_in,
+                                                  map,
+                                                  size,
+                                                  arch_bit,
+                                                  export_trie.dataoff,
+                                                  export_trie.datasize,
+                                                  tbd_options);
+
+        stats_end_phase();
+        return parse_export_trie_result;
+    }
+
     /*
      * Verify the symbol-table's information.
      */
@@ -2077,7 +2185,8 @@ macho_file_parse_load_commands_from_map(struct tbd_create_info *const info_in,
                                                  symtab.nsyms,
                                                  symtab.stroff,
                                                  symtab.strsize,
-                                                 tbd_options);
+                                                 tbd_options,
+                                                 options);
     } else {
         ret =
             macho_file_parse_symbols_from_map(info_in,
@@ -2089,9 +2198,12 @@ macho_file_parse_load_commands_from_map(struct tbd_create_info *const info_in,
                                               symtab.nsyms,
                                               symtab.stroff,
                                               symtab.strsize,
-                                              tbd_options);
+                                              tbd_options,
+                                              options);
     }
 
+    stats_end_phase();
+
     if (ret != E_MACHO_FILE_PARSE_OK) {
         return ret;
     }
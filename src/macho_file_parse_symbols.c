@@ -20,10 +20,10 @@
 #include "macho_file_parse_symbols.h"
 
 #include "range.h"
+#include "stats.h"
 #include "swap.h"
 
 #include "tbd.h"
-#include "yaml.h"
 
 /*
  * For performance, compare strings using the largest byte-size integers
@@ -166,7 +166,8 @@ handle_symbol(struct tbd_create_info *const info,
               const char *const symbol_string,
               const uint16_t n_desc,
               const uint8_t n_type,
-              const uint64_t options)
+              const uint64_t options,
+              const bool borrow_string)
 {
     /*
      * Short-circuit symbols if they're not external and no options have been
@@ -196,7 +197,18 @@ handle_symbol(struct tbd_create_info *const info,
      */
 
     enum tbd_export_type symbol_type = TBD_EXPORT_TYPE_NORMAL_SYMBOL;
-    uint32_t length = 0;
+    uint32_t length = (uint32_t)strnlen(symbol_string, max_length);
+
+    if (length == 0) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    /*
+     * A symbol-string can only be borrowed if it's null-terminated within the
+     * string-table, as export-strings are expected to be null-terminated.
+     */
+
+    const bool is_terminated = length != max_length;
 
     if (n_desc & N_WEAK_DEF) {
         if (!(options & O_TBD_PARSE_ALLOW_PRIVATE_NORMAL_SYMBOLS)) {
@@ -206,17 +218,7 @@ handle_symbol(struct tbd_create_info *const info,
         }
 
         symbol_type = TBD_EXPORT_TYPE_WEAK_DEF_SYMBOL;
-        length = (uint32_t)strnlen(symbol_string, max_length);
-
-        if (length == 0) {
-            return E_MACHO_FILE_PARSE_OK;
-        }
     } else {
-        length = (uint32_t)strnlen(symbol_string, max_length);
-        if (length == 0) {
-            return E_MACHO_FILE_PARSE_OK;
-        }
-
         if (is_objc_class_symbol(string, length, &string, &length)) {
             if (!(options & O_TBD_PARSE_ALLOW_PRIVATE_OBJC_CLASS_SYMBOLS)) {
                 if (!(n_type & N_EXT)) {
@@ -253,68 +255,67 @@ handle_symbol(struct tbd_create_info *const info,
         .type = symbol_type,
     };
 
-    struct array *const exports = &info->exports;
-    struct array_cached_index_info cached_info = {};
+    const bool copy_string = !borrow_string || !is_terminated;
+    const enum tbd_add_export_result add_export_result =
+        tbd_create_info_add_export(info, &export_info, copy_string);
 
-    struct tbd_export_info *const existing_info =
-        array_find_item_in_sorted(exports,
-                                  sizeof(export_info),
-                                  &export_info,
-                                  tbd_export_info_no_archs_comparator,
-                                  &cached_info);
+    switch (add_export_result) {
+        case E_TBD_ADD_EXPORT_OK:
+            break;
 
-    if (existing_info != NULL) {
-        const uint64_t archs = existing_info->archs;
+        case E_TBD_ADD_EXPORT_ALLOC_FAIL:
+            return E_MACHO_FILE_PARSE_ALLOC_FAIL;
 
-        /*
-         * Ensure multiple symbols for the same arch (which we, for sake of
-         * leniency, ignore) are ignored.
-         */
+        case E_TBD_ADD_EXPORT_ARRAY_FAIL:
+            return E_MACHO_FILE_PARSE_ARRAY_FAIL;
+    }
 
-        if (!(archs & arch_bit)) {
-            existing_info->archs = archs | arch_bit;
-            existing_info->archs_count += 1;
-        }
+    stats_add(STATS_COUNTER_SYMBOLS_KEPT, 1);
+    return E_MACHO_FILE_PARSE_OK;
+}
+        
+/*
+ * Get the data at offset in the mach-o file, straight from the map if the file
+ * is mapped, or otherwise read into a buffer that has to be freed by the
+ * caller.
+ */
 
+static enum macho_file_parse_result
+get_file_data(const int fd,
+              const uint8_t *const map,
+              const uint64_t offset,
+              const uint64_t size,
+              const void **const data_out,
+              void **const buffer_out)
+{
+    if (map != NULL) {
+        *data_out = map + offset;
         return E_MACHO_FILE_PARSE_OK;
     }
 
-    const bool needs_quotes = yaml_check_c_str(string, length);
-    if (needs_quotes) {
-        export_info.flags |= F_TBD_EXPORT_INFO_STRING_NEEDS_QUOTES;
-    }
-
-    /*
-     * Add our symbol-info to the list, as a matching symbol-info was not found.
-     *
-     * Note: As the symbol is from a large allocation in the call hierarchy that
-     * will eventually be freed, we need to allocate a copy of the symbol before
-     * placing it in the list.
-     */
-
-    export_info.string = strndup(export_info.string, export_info.length);
-    if (export_info.string == NULL) {
+    void *const buffer = calloc(1, size);
+    if (buffer == NULL) {
         return E_MACHO_FILE_PARSE_ALLOC_FAIL;
     }
-    
-    const enum array_result add_export_info_result =
-        array_add_item_with_cached_index_info(exports,
-                                              sizeof(export_info),
-                                              &export_info,
-                                              &cached_info,
-                                              NULL);
-
-    if (add_export_info_result != E_ARRAY_OK) {
-        free(export_info.string);
-        return E_MACHO_FILE_PARSE_ARRAY_FAIL;
+
+    if (pread(fd, buffer, size, (off_t)offset) < 0) {
+        free(buffer);
+        return E_MACHO_FILE_PARSE_READ_FAIL;
     }
 
+    stats_add(STATS_COUNTER_BYTES_READ, size);
+    stats_add(STATS_COUNTER_ALLOCATIONS, 1);
+
+    *data_out = buffer;
+    *buffer_out = buffer;
+
     return E_MACHO_FILE_PARSE_OK;
 }
-        
+
 enum macho_file_parse_result
 macho_file_parse_symbols_from_file(struct tbd_create_info *const info,
                                    const int fd,
+                                   const uint8_t *const map,
                                    const struct range range,
                                    const uint64_t arch_bit,
                                    const bool is_big_endian,
@@ -328,17 +329,24 @@ macho_file_parse_symbols_from_file(struct tbd_create_info *const info,
         return E_MACHO_FILE_PARSE_OK;
     }
 
+    stats_add(STATS_COUNTER_SYMBOLS_SCANNED, nsyms);
+
     /*
      * Ensure the string-table and symbol-table are fully contained within
      * the mach-o file.
      */
 
-    uint32_t symbol_table_size = sizeof(struct nlist);
+    uint64_t symbol_table_size = sizeof(struct nlist);
     if (guard_overflow_mul(&symbol_table_size, nsyms)) {
         return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
     }
 
-    uint32_t absolute_symoff = (uint32_t)range.begin;
+    /*
+     * The mach-o may be located past 4 GiB in the file (in a fat file, or a
+     * dyld_shared_cache), so the absolute offsets have to be 64-bit.
+     */
+
+    uint64_t absolute_symoff = range.begin;
     if (guard_overflow_add(&absolute_symoff, symoff)) {
         return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
     }
@@ -357,12 +365,16 @@ macho_file_parse_symbols_from_file(struct tbd_create_info *const info,
         return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
     }
 
-    uint32_t absolute_stroff = (uint32_t)range.begin;
+    uint64_t absolute_stroff = range.begin;
     if (guard_overflow_add(&absolute_stroff, stroff)) {
         return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
     }
 
-    const uint64_t string_table_end = absolute_stroff + strsize;
+    uint64_t string_table_end = absolute_stroff;
+    if (guard_overflow_add(&string_table_end, strsize)) {
+        return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
+    }
+
     const struct range string_table_range = {
         .begin = absolute_stroff,
         .end = string_table_end
@@ -380,39 +392,38 @@ macho_file_parse_symbols_from_file(struct tbd_create_info *const info,
         return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
     }
 
-    if (lseek(fd, absolute_symoff, SEEK_SET) < 0) {
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
+    const struct nlist *symbol_table = NULL;
+    void *symbol_table_buffer = NULL;
 
-    struct nlist *const symbol_table = calloc(1, symbol_table_size);
-    if (symbol_table == NULL) {
-        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
-    }
+    const enum macho_file_parse_result get_symbol_table_result =
+        get_file_data(fd,
+                      map,
+                      absolute_symoff,
+                      symbol_table_size,
+                      (const void **)&symbol_table,
+                      &symbol_table_buffer);
 
-    if (read(fd, symbol_table, symbol_table_size) < 0) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
-
-    if (lseek(fd, absolute_stroff, SEEK_SET) < 0) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
+    if (get_symbol_table_result != E_MACHO_FILE_PARSE_OK) {
+        return get_symbol_table_result;
     }
 
-    char *const string_table = calloc(1, strsize);
-    if (string_table == NULL) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
+    const char *string_table = NULL;
+    void *string_table_buffer = NULL;
 
-    if (read(fd, string_table, strsize) < 0) {
-        free(symbol_table);
-        free(string_table);
+    const enum macho_file_parse_result get_string_table_result =
+        get_file_data(fd,
+                      map,
+                      absolute_stroff,
+                      strsize,
+                      (const void **)&string_table,
+                      &string_table_buffer);
 
-        return E_MACHO_FILE_PARSE_READ_FAIL;
+    if (get_string_table_result != E_MACHO_FILE_PARSE_OK) {
+        free(symbol_table_buffer);
+        return get_string_table_result;
     }
 
-    struct nlist *nlist = symbol_table;
+    const struct nlist *nlist = symbol_table;
     const struct nlist *const end = symbol_table + nsyms;
 
     if (is_big_endian) {
@@ -450,11 +461,12 @@ macho_file_parse_symbols_from_file(struct tbd_create_info *const info,
                               symbol_string,
                               (uint16_t)n_desc,
                               n_type,
-                              tbd_options);
+                              tbd_options,
+                              false);
 
             if (handle_symbol_result != E_MACHO_FILE_PARSE_OK) {
-                free(symbol_table);
-                free(string_table);
+                free(symbol_table_buffer);
+                free(string_table_buffer);
 
                 return handle_symbol_result;
             }
@@ -483,7 +495,7 @@ macho_file_parse_symbols_from_file(struct tbd_create_info *const info,
                 continue;
             }
 
-            const int16_t n_desc = swap_int16(nlist->n_desc);
+            const int16_t n_desc = nlist->n_desc;
 
             const char *const symbol_string = string_table + index;
             const enum macho_file_parse_result handle_symbol_result =
@@ -494,19 +506,20 @@ macho_file_parse_symbols_from_file(struct tbd_create_info *const info,
                               symbol_string,
                               (uint16_t)n_desc,
                               n_type,
-                              tbd_options);
+                              tbd_options,
+                              false);
 
             if (handle_symbol_result != E_MACHO_FILE_PARSE_OK) {
-                free(symbol_table);
-                free(string_table);
+                free(symbol_table_buffer);
+                free(string_table_buffer);
 
                 return handle_symbol_result;
             }
         }
     }
 
-    free(symbol_table);
-    free(string_table);
+    free(symbol_table_buffer);
+    free(string_table_buffer);
 
     return E_MACHO_FILE_PARSE_OK;
 }
@@ -514,6 +527,7 @@ macho_file_parse_symbols_from_file(struct tbd_create_info *const info,
 enum macho_file_parse_result
 macho_file_parse_symbols_64_from_file(struct tbd_create_info *const info,
                                       const int fd,
+                                      const uint8_t *const map,
                                       const struct range range,
                                       const uint64_t arch_bit,
                                       const bool is_big_endian,
@@ -527,6 +541,8 @@ macho_file_parse_symbols_64_from_file(struct tbd_create_info *const info,
         return E_MACHO_FILE_PARSE_OK;
     }
 
+    stats_add(STATS_COUNTER_SYMBOLS_SCANNED, nsyms);
+
     /*
      * Get the size of the symbol table by multipying the symbol-count and the
      * size of symbol-table-entry
@@ -540,7 +556,7 @@ macho_file_parse_symbols_64_from_file(struct tbd_create_info *const info,
         return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
     }
 
-    uint32_t absolute_symoff = (uint32_t)range.begin;
+    uint64_t absolute_symoff = range.begin;
     if (guard_overflow_add(&absolute_symoff, symoff)) {
         return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
     }
@@ -559,12 +575,16 @@ macho_file_parse_symbols_64_from_file(struct tbd_create_info *const info,
         return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
     }
 
-    uint32_t absolute_stroff = (uint32_t)range.begin;
+    uint64_t absolute_stroff = range.begin;
     if (guard_overflow_add(&absolute_stroff, stroff)) {
         return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
     }
 
-    const uint64_t string_table_end = absolute_stroff + strsize;
+    uint64_t string_table_end = absolute_stroff;
+    if (guard_overflow_add(&string_table_end, strsize)) {
+        return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
+    }
+
     const struct range string_table_range = {
         .begin = absolute_stroff,
         .end = string_table_end
@@ -582,39 +602,38 @@ macho_file_parse_symbols_64_from_file(struct tbd_create_info *const info,
         return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
     }
 
-    if (lseek(fd, absolute_symoff, SEEK_SET) < 0) {
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
-
-    struct nlist_64 *const symbol_table = calloc(1, symbol_table_size);
-    if (symbol_table == NULL) {
-        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
-    }
+    const struct nlist_64 *symbol_table = NULL;
+    void *symbol_table_buffer = NULL;
 
-    if (read(fd, symbol_table, symbol_table_size) < 0) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_READ_FAIL;
-    }
+    const enum macho_file_parse_result get_symbol_table_result =
+        get_file_data(fd,
+                      map,
+                      absolute_symoff,
+                      symbol_table_size,
+                      (const void **)&symbol_table,
+                      &symbol_table_buffer);
 
-    if (lseek(fd, absolute_stroff, SEEK_SET) < 0) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
+    if (get_symbol_table_result != E_MACHO_FILE_PARSE_OK) {
+        return get_symbol_table_result;
     }
 
-    char *const string_table = calloc(1, strsize);
-    if (string_table == NULL) {
-        free(symbol_table);
-        return E_MACHO_FILE_PARSE_SEEK_FAIL;
-    }
+    const char *string_table = NULL;
+    void *string_table_buffer = NULL;
 
-    if (read(fd, string_table, strsize) < 0) {
-        free(symbol_table);
-        free(string_table);
+    const enum macho_file_parse_result get_string_table_result =
+        get_file_data(fd,
+                      map,
+                      absolute_stroff,
+                      strsize,
+                      (const void **)&string_table,
+                      &string_table_buffer);
 
-        return E_MACHO_FILE_PARSE_READ_FAIL;
+    if (get_string_table_result != E_MACHO_FILE_PARSE_OK) {
+        free(symbol_table_buffer);
+        return get_string_table_result;
     }
 
-    struct nlist_64 *nlist = symbol_table;
+    const struct nlist_64 *nlist = symbol_table;
     const struct nlist_64 *const end = symbol_table + nsyms;
 
     if (is_big_endian) {
@@ -652,11 +671,12 @@ macho_file_parse_symbols_64_from_file(struct tbd_create_info *const info,
                               symbol_string,
                               n_desc,
                               n_type,
-                              tbd_options);
+                              tbd_options,
+                              false);
 
             if (handle_symbol_result != E_MACHO_FILE_PARSE_OK) {
-                free(symbol_table);
-                free(string_table);
+                free(symbol_table_buffer);
+                free(string_table_buffer);
 
                 return handle_symbol_result;
             }
@@ -696,19 +716,20 @@ macho_file_parse_symbols_64_from_file(struct tbd_create_info *const info,
                               symbol_string,
                               n_desc,
                               n_type,
-                              tbd_options);
+                              tbd_options,
+                              false);
 
             if (handle_symbol_result != E_MACHO_FILE_PARSE_OK) {
-                free(symbol_table);
-                free(string_table);
+                free(symbol_table_buffer);
+                free(string_table_buffer);
 
                 return handle_symbol_result;
             }
         }
     }
 
-    free(symbol_table);
-    free(string_table);
+    free(symbol_table_buffer);
+    free(string_table_buffer);
     
     return E_MACHO_FILE_PARSE_OK;
 }
@@ -723,13 +744,16 @@ macho_file_parse_symbols_from_map(struct tbd_create_info *const info,
                                   const uint32_t nsyms,
                                   const uint32_t stroff,
                                   const uint32_t strsize,
-                                  const uint64_t tbd_options)
+                                  const uint64_t tbd_options,
+                                  const uint64_t options)
 {
     if (nsyms == 0) {
         return E_MACHO_FILE_PARSE_OK;
     }
 
-    const uint64_t string_table_end = stroff + strsize;
+    stats_add(STATS_COUNTER_SYMBOLS_SCANNED, nsyms);
+
+    const uint64_t string_table_end = (uint64_t)stroff + strsize;
     if (string_table_end > size) {
         return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
     }
@@ -775,6 +799,15 @@ macho_file_parse_symbols_from_map(struct tbd_create_info *const info,
         return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
     }
 
+    /*
+     * Unless the strings in the map were requested to be copied, the map
+     * outlives the create-info's exports, so symbol-strings can be borrowed
+     * straight from the map.
+     */
+
+    const bool borrow_strings =
+        !(options & O_MACHO_FILE_PARSE_COPY_STRINGS_IN_MAP);
+
     const char *const string_table = (const char *)(map + stroff);
 
     const struct nlist *nlist = (const struct nlist *)(map + symoff);
@@ -815,7 +848,8 @@ macho_file_parse_symbols_from_map(struct tbd_create_info *const info,
                               symbol_string,
                               (uint16_t)n_desc,
                               n_type,
-                              tbd_options);
+                              tbd_options,
+                              borrow_strings);
 
             if (handle_symbol_result != E_MACHO_FILE_PARSE_OK) {
                 return handle_symbol_result;
@@ -856,7 +890,8 @@ macho_file_parse_symbols_from_map(struct tbd_create_info *const info,
                               symbol_string,
                               (uint16_t)n_desc,
                               n_type,
-                              tbd_options);
+                              tbd_options,
+                              borrow_strings);
 
             if (handle_symbol_result != E_MACHO_FILE_PARSE_OK) {
                 return handle_symbol_result;
@@ -877,13 +912,16 @@ macho_file_parse_symbols_64_from_map(struct tbd_create_info *const info,
                                      const uint32_t nsyms,
                                      const uint32_t stroff,
                                      const uint32_t strsize,
-                                     const uint64_t tbd_options)
+                                     const uint64_t tbd_options,
+                                     const uint64_t options)
 {
     if (nsyms == 0) {
         return E_MACHO_FILE_PARSE_OK;
     }
 
-    const uint64_t string_table_end = stroff + strsize;
+    stats_add(STATS_COUNTER_SYMBOLS_SCANNED, nsyms);
+
+    const uint64_t string_table_end = (uint64_t)stroff + strsize;
     if (string_table_end > size) {
         return E_MACHO_FILE_PARSE_INVALID_STRING_TABLE;
     }
@@ -937,6 +975,15 @@ macho_file_parse_symbols_64_from_map(struct tbd_create_info *const info,
         return E_MACHO_FILE_PARSE_INVALID_SYMBOL_TABLE;
     }
 
+    /*
+     * Unless the strings in the map were requested to be copied, the map
+     * outlives the create-info's exports, so symbol-strings can be borrowed
+     * straight from the map.
+     */
+
+    const bool borrow_strings =
+        !(options & O_MACHO_FILE_PARSE_COPY_STRINGS_IN_MAP);
+
     const char *const string_table = (const char *)(map + stroff);
 
     const struct nlist_64 *nlist = (const struct nlist_64 *)(map + symoff);
@@ -977,7 +1024,8 @@ macho_file_parse_symbols_64_from_map(struct tbd_create_info *const info,
                               symbol_string,
                               n_desc,
                               n_type,
-                              tbd_options);
+                              tbd_options,
+                              borrow_strings);
 
             if (handle_symbol_result != E_MACHO_FILE_PARSE_OK) {
                 return handle_symbol_result;
@@ -1018,7 +1066,8 @@ macho_file_parse_symbols_64_from_map(struct tbd_create_info *const info,
                               symbol_string,
                               n_desc,
                               n_type,
-                              tbd_options);
+                              tbd_options,
+                              borrow_strings);
 
             if (handle_symbol_result != E_MACHO_FILE_PARSE_OK) {
                 return handle_symbol_result;
@@ -1027,4 +1076,356 @@ macho_file_parse_symbols_64_from_map(struct tbd_create_info *const info,
     }
 
     return E_MACHO_FILE_PARSE_OK;
-}
\ No newline at end of file
+}
+
+bool
+macho_file_can_parse_export_trie(
+    const struct linkedit_data_command *const export_trie,
+    const uint64_t tbd_options)
+{
+    if (export_trie->cmd == 0 || export_trie->datasize == 0) {
+        return false;
+    }
+
+    const uint64_t all_allow_symbols_flags =
+        O_TBD_PARSE_ALLOW_PRIVATE_NORMAL_SYMBOLS |
+        O_TBD_PARSE_ALLOW_PRIVATE_OBJC_CLASS_SYMBOLS |
+        O_TBD_PARSE_ALLOW_PRIVATE_OBJC_IVAR_SYMBOLS |
+        O_TBD_PARSE_ALLOW_PRIVATE_WEAK_DEF_SYMBOLS;
+
+    return !(tbd_options & all_allow_symbols_flags);
+}
+
+static bool
+read_uleb128(const uint8_t **const iter_in,
+             const uint8_t *const end,
+             uint64_t *const result_out)
+{
+    const uint8_t *iter = *iter_in;
+
+    uint64_t result = 0;
+    uint32_t shift = 0;
+
+    for (; iter != end; iter++) {
+        const uint8_t byte = *iter;
+        if (shift > 63) {
+            return false;
+        }
+
+        result |= (uint64_t)(byte & 0x7f) << shift;
+        shift += 7;
+
+        if (!(byte & 0x80)) {
+            *iter_in = iter + 1;
+            *result_out = result;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * A node of the export-trie that still has to be visited, along with the edge
+ * that led to it.
+ *
+ * parent_length is the length of the symbol-name up to the edge, which is
+ * shared with the node's siblings.
+ */
+
+struct export_trie_node {
+    uint64_t offset;
+
+    const char *edge;
+    uint32_t edge_length;
+    uint32_t parent_length;
+};
+
+static enum macho_file_parse_result
+parse_export_trie(struct tbd_create_info *const info,
+                  const uint64_t arch_bit,
+                  const uint8_t *const trie,
+                  const uint32_t size,
+                  const uint64_t tbd_options)
+{
+    /*
+     * Every node may only be visited once, which both rejects tries with
+     * cycles, and bounds the amount of nodes (and edges) to the trie's size.
+     */
+
+    uint8_t *const visited = calloc(1, (size / 8) + 1);
+    if (visited == NULL) {
+        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
+    }
+
+    uint64_t stack_capacity = 64;
+    uint64_t stack_count = 1;
+
+    struct export_trie_node *stack =
+        calloc(stack_capacity, sizeof(struct export_trie_node));
+
+    if (stack == NULL) {
+        free(visited);
+        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
+    }
+
+    /*
+     * The symbol-name is built up in a single buffer as the trie is walked
+     * depth-first, as a node's name is always its parent's name followed by
+     * the edge to the node.
+     *
+     * As the edges on a path are each from a different node, a name can never
+     * be longer than the trie itself.
+     */
+
+    uint64_t name_capacity = 256;
+    char *name = malloc(name_capacity);
+
+    if (name == NULL) {
+        free(visited);
+        free(stack);
+
+        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
+    }
+
+    const uint8_t *const end = trie + size;
+    enum macho_file_parse_result ret = E_MACHO_FILE_PARSE_OK;
+
+    while (stack_count != 0) {
+        const struct export_trie_node node = stack[--stack_count];
+        if (node.offset >= size) {
+            ret = E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE;
+            break;
+        }
+
+        const uint8_t visited_bit = (uint8_t)(1 << (node.offset % 8));
+        uint8_t *const visited_byte = visited + (node.offset / 8);
+
+        if (*visited_byte & visited_bit) {
+            ret = E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE;
+            break;
+        }
+
+        *visited_byte |= visited_bit;
+
+        const uint32_t name_length = node.parent_length + node.edge_length;
+        if (name_length >= name_capacity) {
+            const uint64_t new_capacity = (uint64_t)name_length * 2;
+            char *const new_name = realloc(name, new_capacity);
+
+            if (new_name == NULL) {
+                ret = E_MACHO_FILE_PARSE_ALLOC_FAIL;
+                break;
+            }
+
+            name = new_name;
+            name_capacity = new_capacity;
+        }
+
+        memcpy(name + node.parent_length, node.edge, node.edge_length);
+        name[name_length] = '\0';
+
+        const uint8_t *iter = trie + node.offset;
+
+        uint64_t terminal_size = 0;
+        if (!read_uleb128(&iter, end, &terminal_size)) {
+            ret = E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE;
+            break;
+        }
+
+        /*
+         * Every node, even one without children, ends with its children-count,
+         * which has to follow the terminal-info.
+         */
+
+        if (terminal_size >= (uint64_t)(end - iter)) {
+            ret = E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE;
+            break;
+        }
+
+        if (terminal_size != 0) {
+            const uint8_t *flags_iter = iter;
+            uint64_t flags = 0;
+
+            if (!read_uleb128(&flags_iter, iter + terminal_size, &flags)) {
+                ret = E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE;
+                break;
+            }
+
+            /*
+             * Absolute symbols are skipped to match the symbol-table, where
+             * only symbols in a section, or indirect symbols, are exported.
+             */
+
+            stats_add(STATS_COUNTER_SYMBOLS_SCANNED, 1);
+
+            const uint64_t kind = flags & EXPORT_SYMBOL_FLAGS_KIND_MASK;
+            if (kind != EXPORT_SYMBOL_FLAGS_KIND_ABSOLUTE) {
+                uint16_t n_desc = 0;
+                if (flags & EXPORT_SYMBOL_FLAGS_WEAK_DEFINITION) {
+                    n_desc = N_WEAK_DEF;
+                }
+
+                /*
+                 * The name-buffer is reused for the next symbol, so the
+                 * symbol-string can never be borrowed. Only the first
+                 * occurrence of each symbol is copied, into the arena.
+                 */
+
+                ret =
+                    handle_symbol(info,
+                                  arch_bit,
+                                  0,
+                                  (uint64_t)name_length + 1,
+                                  name,
+                                  n_desc,
+                                  N_EXT | N_SECT,
+                                  tbd_options,
+                                  false);
+
+                if (ret != E_MACHO_FILE_PARSE_OK) {
+                    break;
+                }
+            }
+
+            iter += terminal_size;
+        }
+
+        const uint8_t children_count = *iter;
+        iter++;
+
+        if (stack_count + children_count > stack_capacity) {
+            const uint64_t new_capacity = stack_capacity * 2 + children_count;
+            struct export_trie_node *const new_stack =
+                realloc(stack, sizeof(struct export_trie_node) * new_capacity);
+
+            if (new_stack == NULL) {
+                ret = E_MACHO_FILE_PARSE_ALLOC_FAIL;
+                break;
+            }
+
+            stack = new_stack;
+            stack_capacity = new_capacity;
+        }
+
+        for (uint8_t i = 0; i != children_count; i++) {
+            const char *const edge = (const char *)iter;
+            const uint64_t max_length = (uint64_t)(end - iter);
+            const uint64_t edge_length = strnlen(edge, max_length);
+
+            /*
+             * Every edge has to be a non-empty, null-terminated string.
+             */
+
+            if (edge_length == 0 || edge_length == max_length) {
+                ret = E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE;
+                break;
+            }
+
+            iter += edge_length + 1;
+
+            uint64_t child_offset = 0;
+            if (!read_uleb128(&iter, end, &child_offset)) {
+                ret = E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE;
+                break;
+            }
+
+            stack[stack_count++] = (struct export_trie_node){
+                .offset = child_offset,
+                .edge = edge,
+                .edge_length = (uint32_t)edge_length,
+                .parent_length = name_length
+            };
+        }
+
+        if (ret != E_MACHO_FILE_PARSE_OK) {
+            break;
+        }
+    }
+
+    free(visited);
+    free(stack);
+    free(name);
+
+    return ret;
+}
+
+enum macho_file_parse_result
+macho_file_parse_export_trie_from_file(struct tbd_create_info *const info,
+                                       const int fd,
+                                       const uint8_t *const map,
+                                       const struct range range,
+                                       const uint64_t arch_bit,
+                                       const uint32_t exports_off,
+                                       const uint32_t exports_size,
+                                       const uint64_t tbd_options)
+{
+    if (exports_size == 0) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    const uint64_t absolute_exports_off = range.begin + exports_off;
+    const struct range export_trie_range = {
+        .begin = absolute_exports_off,
+        .end = absolute_exports_off + exports_size
+    };
+
+    if (!range_contains_range(range, export_trie_range)) {
+        return E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE;
+    }
+
+    const uint8_t *export_trie = NULL;
+    void *export_trie_buffer = NULL;
+
+    const enum macho_file_parse_result get_export_trie_result =
+        get_file_data(fd,
+                      map,
+                      absolute_exports_off,
+                      exports_size,
+                      (const void **)&export_trie,
+                      &export_trie_buffer);
+
+    if (get_export_trie_result != E_MACHO_FILE_PARSE_OK) {
+        return get_export_trie_result;
+    }
+
+    const enum macho_file_parse_result ret =
+        parse_export_trie(info,
+                          arch_bit,
+                          export_trie,
+                          exports_size,
+                          tbd_options);
+
+    free(export_trie_buffer);
+    return ret;
+}
+
+enum macho_file_parse_result
+macho_file_parse_export_trie_from_map(struct tbd_create_info *const info,
+                                      const uint8_t *const map,
+                                      const uint64_t size,
+                                      const uint64_t arch_bit,
+                                      const uint32_t exports_off,
+                                      const uint32_t exports_size,
+                                      const uint64_t tbd_options)
+{
+    if (exports_size == 0) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    const uint64_t export_trie_end = (uint64_t)exports_off + exports_size;
+    if (export_trie_end > size) {
+        return E_MACHO_FILE_PARSE_INVALID_EXPORT_TRIE;
+    }
+
+    const uint8_t *const export_trie = map + exports_off;
+    const enum macho_file_parse_result ret =
+        parse_export_trie(info,
+                          arch_bit,
+                          export_trie,
+                          exports_size,
+                          tbd_options);
+
+    return ret;
+}
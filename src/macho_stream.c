@@ -0,0 +1,984 @@
+//
+//  src/macho_stream.c
+//  tbd
+//
+//  Created by inoahdev on 3/26/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <sys/mman.h>
+#include <sys/types.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mach-o/fat.h"
+#include "mach-o/nlist.h"
+
+#include "array.h"
+#include "guard_overflow.h"
+#include "macho_file_parse_symbols.h"
+#include "macho_stream.h"
+#include "objc.h"
+#include "range.h"
+#include "stats.h"
+#include "swap.h"
+
+/*
+ * A part of the stream that was read and kept.
+ */
+
+struct stream_chunk {
+    uint64_t begin;
+    uint64_t end;
+
+    uint8_t *data;
+};
+
+struct stream_reader {
+    int fd;
+
+    uint64_t position;
+    bool reached_eof;
+
+    /*
+     * The chunks are only ever added in order of their location, and never
+     * overlap.
+     */
+
+    struct array chunks;
+};
+
+/*
+ * The size of the buffer used to skip over the parts of the stream that aren't
+ * needed, and the size a chunk's buffer starts out with, so a bogus size
+ * doesn't cause a huge allocation before the stream runs out.
+ */
+
+#define STREAM_SKIP_BUFFER_SIZE 65536
+#define STREAM_CHUNK_INITIAL_SIZE (1ull << 20)
+
+/*
+ * Unlike with files, read() on a pipe can return less than what was asked for
+ * well before the end of the stream, so read until size bytes have been read
+ * or the stream has ended.
+ */
+
+static int64_t
+read_from_stream(struct stream_reader *const reader,
+                 uint8_t *const buffer,
+                 const uint64_t size)
+{
+    uint64_t read_size = 0;
+    while (read_size != size) {
+        const ssize_t amount =
+            read(reader->fd, buffer + read_size, size - read_size);
+
+        if (amount < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return -1;
+        }
+
+        if (amount == 0) {
+            reader->reached_eof = true;
+            break;
+        }
+
+        read_size += (uint64_t)amount;
+    }
+
+    reader->position += read_size;
+    stats_add(STATS_COUNTER_BYTES_READ, read_size);
+
+    return (int64_t)read_size;
+}
+
+static enum macho_file_parse_result
+skip_to_location(struct stream_reader *const reader, const uint64_t location) {
+    uint8_t buffer[STREAM_SKIP_BUFFER_SIZE];
+
+    while (reader->position < location && !reader->reached_eof) {
+        uint64_t size = location - reader->position;
+        if (size > sizeof(buffer)) {
+            size = sizeof(buffer);
+        }
+
+        if (read_from_stream(reader, buffer, size) < 0) {
+            return E_MACHO_FILE_PARSE_READ_FAIL;
+        }
+    }
+
+    return E_MACHO_FILE_PARSE_OK;
+}
+
+static bool
+range_was_read(const struct stream_reader *const reader,
+               const struct range range)
+{
+    uint64_t location = range.begin;
+
+    const struct stream_chunk *chunk = reader->chunks.data;
+    const struct stream_chunk *const end = reader->chunks.data_end;
+
+    for (; chunk != end && location < range.end; chunk++) {
+        if (chunk->end <= location) {
+            continue;
+        }
+
+        if (chunk->begin > location) {
+            return false;
+        }
+
+        location = chunk->end;
+    }
+
+    return location >= range.end;
+}
+
+/*
+ * Read and keep the provided range of the stream. The part of the range that
+ * was already passed must have been kept before, as the stream can't go back.
+ *
+ * A range that goes past the end of the stream is only kept up to the end of
+ * the stream, and left to the parser to reject.
+ */
+
+static enum macho_file_parse_result
+read_range(struct stream_reader *const reader, struct range range) {
+    if (range.begin < reader->position) {
+        struct range passed_range = range;
+        if (passed_range.end > reader->position) {
+            passed_range.end = reader->position;
+        }
+
+        if (!range_was_read(reader, passed_range)) {
+            return E_MACHO_FILE_PARSE_SEEK_FAIL;
+        }
+
+        range.begin = reader->position;
+    }
+
+    if (range.begin >= range.end) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    const enum macho_file_parse_result skip_result =
+        skip_to_location(reader, range.begin);
+
+    if (skip_result != E_MACHO_FILE_PARSE_OK) {
+        return skip_result;
+    }
+
+    if (reader->reached_eof) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    const uint64_t size = range.end - range.begin;
+
+    uint64_t capacity = size;
+    if (capacity > STREAM_CHUNK_INITIAL_SIZE) {
+        capacity = STREAM_CHUNK_INITIAL_SIZE;
+    }
+
+    uint8_t *data = malloc(capacity);
+    if (data == NULL) {
+        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
+    }
+
+    stats_add(STATS_COUNTER_ALLOCATIONS, 1);
+
+    uint64_t read_size = 0;
+    while (read_size != size && !reader->reached_eof) {
+        if (read_size == capacity) {
+            capacity *= 2;
+            if (capacity > size) {
+                capacity = size;
+            }
+
+            uint8_t *const new_data = realloc(data, capacity);
+            if (new_data == NULL) {
+                free(data);
+                return E_MACHO_FILE_PARSE_ALLOC_FAIL;
+            }
+
+            data = new_data;
+        }
+
+        const int64_t amount =
+            read_from_stream(reader, data + read_size, capacity - read_size);
+
+        if (amount < 0) {
+            free(data);
+            return E_MACHO_FILE_PARSE_READ_FAIL;
+        }
+
+        read_size += (uint64_t)amount;
+    }
+
+    if (read_size == 0) {
+        free(data);
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    const struct stream_chunk chunk = {
+        .begin = range.begin,
+        .end = range.begin + read_size,
+        .data = data
+    };
+
+    const enum array_result add_chunk_result =
+        array_add_item(&reader->chunks, sizeof(chunk), &chunk, NULL);
+
+    if (add_chunk_result != E_ARRAY_OK) {
+        free(data);
+        return E_MACHO_FILE_PARSE_ARRAY_FAIL;
+    }
+
+    return E_MACHO_FILE_PARSE_OK;
+}
+
+/*
+ * Copy out a range that was kept. Returns false if any part of the range
+ * wasn't read, which only happens when the stream ended early.
+ */
+
+static bool
+copy_range(const struct stream_reader *const reader,
+           const struct range range,
+           void *const buffer)
+{
+    if (!range_was_read(reader, range)) {
+        return false;
+    }
+
+    const struct stream_chunk *chunk = reader->chunks.data;
+    const struct stream_chunk *const end = reader->chunks.data_end;
+
+    for (; chunk != end; chunk++) {
+        if (chunk->end <= range.begin || chunk->begin >= range.end) {
+            continue;
+        }
+
+        uint64_t begin = range.begin;
+        if (begin < chunk->begin) {
+            begin = chunk->begin;
+        }
+
+        uint64_t copy_end = range.end;
+        if (copy_end > chunk->end) {
+            copy_end = chunk->end;
+        }
+
+        memcpy((uint8_t *)buffer + (begin - range.begin),
+               chunk->data + (begin - chunk->begin),
+               copy_end - begin);
+    }
+
+    return true;
+}
+
+static void destroy_chunks(struct stream_reader *const reader) {
+    struct stream_chunk *chunk = reader->chunks.data;
+    const struct stream_chunk *const end = reader->chunks.data_end;
+
+    for (; chunk != end; chunk++) {
+        free(chunk->data);
+    }
+
+    array_destroy(&reader->chunks);
+}
+
+static int compare_ranges(const void *const left, const void *const right) {
+    const struct range *const left_range = (const struct range *)left;
+    const struct range *const right_range = (const struct range *)right;
+
+    if (left_range->begin < right_range->begin) {
+        return -1;
+    }
+
+    if (left_range->begin > right_range->begin) {
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Add a range, relative to the mach-o's start, that the parser will need, while
+ * ensuring it doesn't go past the end of the mach-o.
+ */
+
+static enum macho_file_parse_result
+add_needed_range(struct array *const ranges,
+                 const struct range macho_range,
+                 const uint64_t offset,
+                 const uint64_t size)
+{
+    struct range range = {
+        .begin = macho_range.begin,
+        .end = macho_range.begin
+    };
+
+    if (guard_overflow_add(&range.begin, offset)) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    range.end = range.begin;
+    if (guard_overflow_add(&range.end, size)) {
+        range.end = UINT64_MAX;
+    }
+
+    if (range.begin >= macho_range.end) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    if (range.end > macho_range.end) {
+        range.end = macho_range.end;
+    }
+
+    const enum array_result add_range_result =
+        array_add_item(ranges, sizeof(range), &range, NULL);
+
+    if (add_range_result != E_ARRAY_OK) {
+        return E_MACHO_FILE_PARSE_ARRAY_FAIL;
+    }
+
+    return E_MACHO_FILE_PARSE_OK;
+}
+
+static inline bool is_image_info_section(const char name[16]) {
+    return strncmp(name, "__objc_imageinfo", 16) == 0 ||
+           strncmp(name, "__image_info", 16) == 0;
+}
+
+static enum macho_file_parse_result
+add_image_info_ranges(struct array *const ranges,
+                      const struct range macho_range,
+                      const uint8_t *const load_cmd,
+                      const uint32_t cmdsize,
+                      const bool is_64,
+                      const bool is_big_endian)
+{
+    uint32_t nsects = 0;
+    uint64_t sects_offset = 0;
+
+    if (is_64) {
+        if (cmdsize < sizeof(struct segment_command_64)) {
+            return E_MACHO_FILE_PARSE_OK;
+        }
+
+        nsects = ((const struct segment_command_64 *)load_cmd)->nsects;
+        sects_offset = sizeof(struct segment_command_64);
+    } else {
+        if (cmdsize < sizeof(struct segment_command)) {
+            return E_MACHO_FILE_PARSE_OK;
+        }
+
+        nsects = ((const struct segment_command *)load_cmd)->nsects;
+        sects_offset = sizeof(struct segment_command);
+    }
+
+    if (is_big_endian) {
+        nsects = swap_uint32(nsects);
+    }
+
+    const uint64_t sect_size =
+        is_64 ? sizeof(struct section_64) : sizeof(struct section);
+
+    for (uint32_t i = 0; i < nsects; i++) {
+        if (sects_offset + sect_size > cmdsize) {
+            break;
+        }
+
+        const uint8_t *const sect_ptr = load_cmd + sects_offset;
+        sects_offset += sect_size;
+
+        if (!is_image_info_section((const char *)sect_ptr)) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        if (is_64) {
+            offset = ((const struct section_64 *)sect_ptr)->offset;
+        } else {
+            offset = ((const struct section *)sect_ptr)->offset;
+        }
+
+        if (is_big_endian) {
+            offset = swap_uint32(offset);
+        }
+
+        const enum macho_file_parse_result add_range_result =
+            add_needed_range(ranges,
+                             macho_range,
+                             offset,
+                             sizeof(struct objc_image_info));
+
+        if (add_range_result != E_MACHO_FILE_PARSE_OK) {
+            return add_range_result;
+        }
+    }
+
+    return E_MACHO_FILE_PARSE_OK;
+}
+
+/*
+ * Go through the load-commands the same way the parser does, and collect the
+ * ranges of the mach-o the parser will need to read.
+ */
+
+static enum macho_file_parse_result
+collect_needed_ranges(struct array *const ranges,
+                      const struct range macho_range,
+                      const uint8_t *const load_cmds,
+                      const uint32_t ncmds,
+                      const uint32_t sizeofcmds,
+                      const bool is_64,
+                      const bool is_big_endian,
+                      const uint64_t tbd_options,
+                      const uint64_t options)
+{
+    struct symtab_command symtab = {};
+    struct linkedit_data_command export_trie = {};
+
+    const uint8_t *load_cmd_iter = load_cmds;
+    uint32_t size_left = sizeofcmds;
+
+    for (uint32_t i = 0; i < ncmds; i++) {
+        if (size_left < sizeof(struct load_command)) {
+            break;
+        }
+
+        struct load_command load_cmd = {};
+        memcpy(&load_cmd, load_cmd_iter, sizeof(load_cmd));
+
+        if (is_big_endian) {
+            load_cmd.cmd = swap_uint32(load_cmd.cmd);
+            load_cmd.cmdsize = swap_uint32(load_cmd.cmdsize);
+        }
+
+        if (load_cmd.cmdsize < sizeof(struct load_command)) {
+            break;
+        }
+
+        if (load_cmd.cmdsize > size_left) {
+            break;
+        }
+
+        switch (load_cmd.cmd) {
+            case LC_DYLD_INFO:
+            case LC_DYLD_INFO_ONLY: {
+                if (tbd_options & O_TBD_PARSE_IGNORE_SYMBOLS) {
+                    break;
+                }
+
+                if (load_cmd.cmdsize < sizeof(struct dyld_info_command)) {
+                    break;
+                }
+
+                if (export_trie.cmd == LC_DYLD_EXPORTS_TRIE) {
+                    break;
+                }
+
+                const struct dyld_info_command *const dyld_info =
+                    (const struct dyld_info_command *)load_cmd_iter;
+
+                export_trie.cmd = load_cmd.cmd;
+                export_trie.dataoff = dyld_info->export_off;
+                export_trie.datasize = dyld_info->export_size;
+
+                break;
+            }
+
+            case LC_DYLD_EXPORTS_TRIE: {
+                if (tbd_options & O_TBD_PARSE_IGNORE_SYMBOLS) {
+                    break;
+                }
+
+                if (load_cmd.cmdsize < sizeof(struct linkedit_data_command)) {
+                    break;
+                }
+
+                const struct linkedit_data_command *const exports_trie =
+                    (const struct linkedit_data_command *)load_cmd_iter;
+
+                export_trie.cmd = load_cmd.cmd;
+                export_trie.dataoff = exports_trie->dataoff;
+                export_trie.datasize = exports_trie->datasize;
+
+                break;
+            }
+
+            case LC_SEGMENT:
+            case LC_SEGMENT_64: {
+                const enum macho_file_parse_result add_ranges_result =
+                    add_image_info_ranges(ranges,
+                                          macho_range,
+                                          load_cmd_iter,
+                                          load_cmd.cmdsize,
+                                          load_cmd.cmd == LC_SEGMENT_64,
+                                          is_big_endian);
+
+                if (add_ranges_result != E_MACHO_FILE_PARSE_OK) {
+                    return add_ranges_result;
+                }
+
+                break;
+            }
+
+            case LC_SYMTAB:
+                if (load_cmd.cmdsize < sizeof(struct symtab_command)) {
+                    break;
+                }
+
+                memcpy(&symtab, load_cmd_iter, sizeof(symtab));
+                break;
+
+            default:
+                break;
+        }
+
+        load_cmd_iter += load_cmd.cmdsize;
+        size_left -= load_cmd.cmdsize;
+    }
+
+    if (options & O_MACHO_FILE_PARSE_DONT_PARSE_SYMBOL_TABLE) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    if (is_big_endian) {
+        export_trie.dataoff = swap_uint32(export_trie.dataoff);
+        export_trie.datasize = swap_uint32(export_trie.datasize);
+
+        symtab.symoff = swap_uint32(symtab.symoff);
+        symtab.nsyms = swap_uint32(symtab.nsyms);
+        symtab.stroff = swap_uint32(symtab.stroff);
+        symtab.strsize = swap_uint32(symtab.strsize);
+    }
+
+    if (macho_file_can_parse_export_trie(&export_trie, tbd_options)) {
+        return add_needed_range(ranges,
+                                macho_range,
+                                export_trie.dataoff,
+                                export_trie.datasize);
+    }
+
+    uint64_t symbols_size = symtab.nsyms;
+    if (is_64) {
+        symbols_size *= sizeof(struct nlist_64);
+    } else {
+        symbols_size *= sizeof(struct nlist);
+    }
+
+    const enum macho_file_parse_result add_symbols_result =
+        add_needed_range(ranges, macho_range, symtab.symoff, symbols_size);
+
+    if (add_symbols_result != E_MACHO_FILE_PARSE_OK) {
+        return add_symbols_result;
+    }
+
+    return add_needed_range(ranges,
+                            macho_range,
+                            symtab.stroff,
+                            symtab.strsize);
+}
+
+/*
+ * Read the thin mach-o in the provided range of the stream. Problems with the
+ * mach-o itself are left for the parser to find.
+ */
+
+static enum macho_file_parse_result
+read_thin_macho(struct stream_reader *const reader,
+                const struct range macho_range,
+                const uint64_t tbd_options,
+                const uint64_t options)
+{
+    struct range header_range = {
+        .begin = macho_range.begin,
+        .end = macho_range.begin
+    };
+
+    if (guard_overflow_add(&header_range.end, sizeof(struct mach_header_64))) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    if (header_range.end > macho_range.end) {
+        header_range.end = macho_range.end;
+    }
+
+    const enum macho_file_parse_result read_header_result =
+        read_range(reader, header_range);
+
+    if (read_header_result != E_MACHO_FILE_PARSE_OK) {
+        return read_header_result;
+    }
+
+    header_range.end = macho_range.begin + sizeof(struct mach_header);
+
+    struct mach_header header = {};
+    if (!copy_range(reader, header_range, &header)) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    const bool is_64 =
+        header.magic == MH_MAGIC_64 || header.magic == MH_CIGAM_64;
+
+    const bool is_big_endian =
+        header.magic == MH_CIGAM || header.magic == MH_CIGAM_64;
+
+    if (!is_64 && !is_big_endian && header.magic != MH_MAGIC) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    if (is_big_endian) {
+        header.ncmds = swap_uint32(header.ncmds);
+        header.sizeofcmds = swap_uint32(header.sizeofcmds);
+    }
+
+    const uint64_t header_size =
+        is_64 ? sizeof(struct mach_header_64) : sizeof(struct mach_header);
+
+    struct range load_cmds_range = {
+        .begin = macho_range.begin + header_size,
+        .end = macho_range.begin + header_size
+    };
+
+    if (guard_overflow_add(&load_cmds_range.end, header.sizeofcmds)) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    if (load_cmds_range.end > macho_range.end) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    const enum macho_file_parse_result read_load_cmds_result =
+        read_range(reader, load_cmds_range);
+
+    if (read_load_cmds_result != E_MACHO_FILE_PARSE_OK) {
+        return read_load_cmds_result;
+    }
+
+    uint8_t *const load_cmds = malloc(header.sizeofcmds);
+    if (load_cmds == NULL) {
+        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
+    }
+
+    if (!copy_range(reader, load_cmds_range, load_cmds)) {
+        free(load_cmds);
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    struct array ranges = {};
+    enum macho_file_parse_result ret =
+        collect_needed_ranges(&ranges,
+                              macho_range,
+                              load_cmds,
+                              header.ncmds,
+                              header.sizeofcmds,
+                              is_64,
+                              is_big_endian,
+                              tbd_options,
+                              options);
+
+    free(load_cmds);
+
+    if (ret != E_MACHO_FILE_PARSE_OK) {
+        array_destroy(&ranges);
+        return ret;
+    }
+
+    /*
+     * Read the needed ranges in the order they're located in the stream.
+     */
+
+    const enum array_result sort_ranges_result =
+        array_sort_items_with_comparator(&ranges,
+                                         sizeof(struct range),
+                                         compare_ranges);
+
+    if (sort_ranges_result != E_ARRAY_OK) {
+        array_destroy(&ranges);
+        return E_MACHO_FILE_PARSE_ARRAY_FAIL;
+    }
+
+    const struct range *range = ranges.data;
+    const struct range *const end = ranges.data_end;
+
+    for (; range != end; range++) {
+        ret = read_range(reader, *range);
+        if (ret != E_MACHO_FILE_PARSE_OK) {
+            break;
+        }
+    }
+
+    array_destroy(&ranges);
+    return ret;
+}
+
+static enum macho_file_parse_result
+read_fat_macho(struct stream_reader *const reader,
+               const uint32_t magic,
+               const uint64_t tbd_options,
+               const uint64_t options)
+{
+    const struct range nfat_arch_range = {
+        .begin = sizeof(magic),
+        .end = sizeof(struct fat_header)
+    };
+
+    const enum macho_file_parse_result read_nfat_arch_result =
+        read_range(reader, nfat_arch_range);
+
+    if (read_nfat_arch_result != E_MACHO_FILE_PARSE_OK) {
+        return read_nfat_arch_result;
+    }
+
+    uint32_t nfat_arch = 0;
+    if (!copy_range(reader, nfat_arch_range, &nfat_arch)) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    const bool is_big_endian = magic == FAT_CIGAM || magic == FAT_CIGAM_64;
+    if (is_big_endian) {
+        nfat_arch = swap_uint32(nfat_arch);
+    }
+
+    const bool is_64 = magic == FAT_MAGIC_64 || magic == FAT_CIGAM_64;
+    const uint64_t arch_size =
+        is_64 ? sizeof(struct fat_arch_64) : sizeof(struct fat_arch);
+
+    const struct range archs_range = {
+        .begin = sizeof(struct fat_header),
+        .end = sizeof(struct fat_header) + arch_size * nfat_arch
+    };
+
+    const enum macho_file_parse_result read_archs_result =
+        read_range(reader, archs_range);
+
+    if (read_archs_result != E_MACHO_FILE_PARSE_OK) {
+        return read_archs_result;
+    }
+
+    /*
+     * The stream may have ended before all the arch-headers could be read,
+     * which the parser will catch.
+     */
+
+    if (!range_was_read(reader, archs_range)) {
+        return E_MACHO_FILE_PARSE_OK;
+    }
+
+    struct array arch_ranges = {};
+    for (uint32_t i = 0; i < nfat_arch; i++) {
+        const struct range arch_header_range = {
+            .begin = archs_range.begin + arch_size * i,
+            .end = archs_range.begin + arch_size * (i + 1)
+        };
+
+        struct range arch_range = {};
+        if (is_64) {
+            struct fat_arch_64 arch = {};
+            copy_range(reader, arch_header_range, &arch);
+
+            if (is_big_endian) {
+                arch.offset = swap_uint64(arch.offset);
+                arch.size = swap_uint64(arch.size);
+            }
+
+            arch_range.begin = arch.offset;
+            arch_range.end = arch.offset + arch.size;
+
+            if (arch_range.end < arch_range.begin) {
+                arch_range.end = UINT64_MAX;
+            }
+        } else {
+            struct fat_arch arch = {};
+            copy_range(reader, arch_header_range, &arch);
+
+            if (is_big_endian) {
+                arch.offset = swap_uint32(arch.offset);
+                arch.size = swap_uint32(arch.size);
+            }
+
+            arch_range.begin = arch.offset;
+            arch_range.end = (uint64_t)arch.offset + arch.size;
+        }
+
+        const enum array_result add_range_result =
+            array_add_item(&arch_ranges,
+                           sizeof(arch_range),
+                           &arch_range,
+                           NULL);
+
+        if (add_range_result != E_ARRAY_OK) {
+            array_destroy(&arch_ranges);
+            return E_MACHO_FILE_PARSE_ARRAY_FAIL;
+        }
+    }
+
+    /*
+     * The archs can be listed in any order, but have to be read in the order
+     * they're located in the stream.
+     */
+
+    const enum array_result sort_ranges_result =
+        array_sort_items_with_comparator(&arch_ranges,
+                                         sizeof(struct range),
+                                         compare_ranges);
+
+    if (sort_ranges_result != E_ARRAY_OK) {
+        array_destroy(&arch_ranges);
+        return E_MACHO_FILE_PARSE_ARRAY_FAIL;
+    }
+
+    enum macho_file_parse_result ret = E_MACHO_FILE_PARSE_OK;
+
+    const struct range *arch_range = arch_ranges.data;
+    const struct range *const end = arch_ranges.data_end;
+
+    for (; arch_range != end; arch_range++) {
+        /*
+         * An arch located within the headers, or overlapping an earlier arch,
+         * is rejected by the parser anyways.
+         */
+
+        if (arch_range->begin < reader->position) {
+            continue;
+        }
+
+        ret = read_thin_macho(reader, *arch_range, tbd_options, options);
+        if (ret != E_MACHO_FILE_PARSE_OK) {
+            break;
+        }
+    }
+
+    array_destroy(&arch_ranges);
+    return ret;
+}
+
+/*
+ * Copy every chunk kept into an anonymous mapping of the stream's full size.
+ */
+
+static enum macho_file_parse_result
+create_map(struct stream_reader *const reader,
+           struct macho_stream_map *const map_out)
+{
+    const uint64_t size = reader->position;
+    if (size == 0) {
+        return E_MACHO_FILE_PARSE_SIZE_TOO_SMALL;
+    }
+
+    void *const map =
+        mmap(NULL,
+             size,
+             PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS,
+             -1,
+             0);
+
+    if (map == MAP_FAILED) {
+        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
+    }
+
+    const struct stream_chunk *chunk = reader->chunks.data;
+    const struct stream_chunk *const end = reader->chunks.data_end;
+
+    for (; chunk != end; chunk++) {
+        memcpy((uint8_t *)map + chunk->begin,
+               chunk->data,
+               chunk->end - chunk->begin);
+    }
+
+    map_out->map = map;
+    map_out->size = size;
+
+    return E_MACHO_FILE_PARSE_OK;
+}
+
+enum macho_file_parse_result
+macho_stream_map_create(struct macho_stream_map *const map_out,
+                        const int fd,
+                        const uint32_t magic,
+                        const uint64_t tbd_options,
+                        const uint64_t options)
+{
+    struct stream_reader reader = {
+        .fd = fd,
+        .position = sizeof(magic)
+    };
+
+    /*
+     * The magic was already read, so keep it as the first chunk.
+     */
+
+    uint8_t *const magic_data = malloc(sizeof(magic));
+    if (magic_data == NULL) {
+        return E_MACHO_FILE_PARSE_ALLOC_FAIL;
+    }
+
+    memcpy(magic_data, &magic, sizeof(magic));
+
+    const struct stream_chunk magic_chunk = {
+        .begin = 0,
+        .end = sizeof(magic),
+        .data = magic_data
+    };
+
+    const enum array_result add_chunk_result =
+        array_add_item(&reader.chunks,
+                       sizeof(magic_chunk),
+                       &magic_chunk,
+                       NULL);
+
+    if (add_chunk_result != E_ARRAY_OK) {
+        free(magic_data);
+        return E_MACHO_FILE_PARSE_ARRAY_FAIL;
+    }
+
+    const bool is_fat =
+        magic == FAT_MAGIC    || magic == FAT_CIGAM ||
+        magic == FAT_MAGIC_64 || magic == FAT_CIGAM_64;
+
+    enum macho_file_parse_result ret = E_MACHO_FILE_PARSE_OK;
+    if (is_fat) {
+        ret = read_fat_macho(&reader, magic, tbd_options, options);
+    } else {
+        const struct range macho_range = {
+            .begin = 0,
+            .end = UINT64_MAX
+        };
+
+        ret = read_thin_macho(&reader, macho_range, tbd_options, options);
+    }
+
+    /*
+     * Read through the rest of the stream to find its full size.
+     */
+
+    if (ret == E_MACHO_FILE_PARSE_OK) {
+        ret = skip_to_location(&reader, UINT64_MAX);
+    }
+
+    if (ret == E_MACHO_FILE_PARSE_OK) {
+        ret = create_map(&reader, map_out);
+    }
+
+    destroy_chunks(&reader);
+    return ret;
+}
+
+void macho_stream_map_destroy(struct macho_stream_map *const map) {
+    if (map->map != NULL) {
+        munmap(map->map, map->size);
+    }
+
+    map->map = NULL;
+    map->size = 0;
+}
@@ -18,7 +18,10 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "dir_cache.h"
 #include "dir_recurse.h"
+#include "incremental_manifest.h"
+#include "macho_dedup.h"
 #include "parse_or_list_fields.h"
 
 #include "parse_dsc_for_main.h"
@@ -27,7 +30,10 @@
 #include "macho_file.h"
 #include "path.h"
 
+#include "recurse_dir_for_main.h"
 #include "recursive.h"
+#include "stats.h"
+#include "tbd_archive.h"
 
 #include "unused.h"
 #include "usage.h"
@@ -40,17 +46,32 @@ struct recurse_callback_info {
     bool print_paths;
 };
 
-static bool
-recurse_directory_callback(const char *const parse_path,
-                           const uint64_t parse_path_length,
-                           struct dirent *__unused const dirent,
-                           void *const callback_info)
+static void
+parse_recursed_file(struct recurse_callback_info *const recurse_info,
+                    const char *const parse_path,
+                    const uint64_t parse_path_length)
 {
-    struct recurse_callback_info *const recurse_info =
-        (struct recurse_callback_info *)callback_info;
-
     struct tbd_for_main *const tbd = recurse_info->tbd;
 
+    /*
+     * Skip files that haven't changed since they were last written out when
+     * recursing incrementally.
+     */
+
+    struct incremental_manifest *const manifest = tbd->manifest;
+    if (manifest != NULL) {
+        struct stat sbuf = {};
+        if (stat(parse_path, &sbuf) == 0) {
+            const bool is_unchanged =
+                incremental_manifest_is_unchanged(manifest, parse_path, &sbuf);
+
+            if (is_unchanged) {
+                stats_add(STATS_COUNTER_FILES_SKIPPED, 1);
+                return;
+            }
+        }
+    }
+
     const uint64_t options = tbd->options;
     const int fd = open(parse_path, O_RDONLY);
 
@@ -62,7 +83,8 @@ recurse_directory_callback(const char *const parse_path,
                     strerror(errno));
         }
 
-        return true;
+        stats_add(STATS_COUNTER_FILES_SKIPPED, 1);
+        return;
     }
 
     struct tbd_for_main *const global = recurse_info->global;
@@ -94,16 +116,20 @@ recurse_directory_callback(const char *const parse_path,
 
         if (parse_as_macho_result) {
             close(fd);
-            return true;
+            return;
         }
 
         if (!(options & O_TBD_FOR_MAIN_RECURSE_INCLUDE_DSC)) {
+            stats_add(STATS_COUNTER_FILES_SKIPPED, 1);
             close(fd);
-            return true;
+
+            return;
         }
     } else if (!(options & O_TBD_FOR_MAIN_RECURSE_INCLUDE_DSC)) {
+        stats_add(STATS_COUNTER_FILES_SKIPPED, 1);
         close(fd);
-        return true;
+
+        return;
     }
 
     const bool parse_as_dsc_result =
@@ -118,12 +144,33 @@ recurse_directory_callback(const char *const parse_path,
                            &magic,
                            &magic_size);
 
-    if (parse_as_dsc_result) {
-        close(fd);
-        return true;
+    if (!parse_as_dsc_result) {
+        stats_add(STATS_COUNTER_FILES_SKIPPED, 1);
     }
 
     close(fd);
+}
+
+static bool
+recurse_directory_callback(const char *const parse_path,
+                           const uint64_t parse_path_length,
+                           struct dirent *__unused const dirent,
+                           void *const callback_info)
+{
+    struct recurse_callback_info *const recurse_info =
+        (struct recurse_callback_info *)callback_info;
+
+    /*
+     * Time spent handling the file outside of any more specific phase is kept
+     * apart from the time spent walking the directory.
+     */
+
+    stats_add(STATS_COUNTER_FILES_SEEN, 1);
+    stats_begin_phase(STATS_PHASE_OTHER);
+
+    parse_recursed_file(recurse_info, parse_path, parse_path_length);
+
+    stats_end_phase();
     return true;
 }
 
@@ -221,6 +268,60 @@ static void verify_dsc_write_path(struct tbd_for_main *const tbd) {
     }
 }
 
+static bool
+open_archive(struct tbd_for_main *const tbd,
+             struct tbd_archive *const archive,
+             const bool print_paths)
+{
+    const bool no_overwrite = tbd->options & O_TBD_FOR_MAIN_NO_OVERWRITE;
+    const enum tbd_archive_result open_archive_result =
+        tbd_archive_open(archive,
+                         tbd->write_path,
+                         tbd->write_path_length,
+                         no_overwrite);
+
+    if (open_archive_result != E_TBD_ARCHIVE_OK) {
+        if (print_paths) {
+            fprintf(stderr,
+                    "Failed to open archive (at path %s), error: %s\n",
+                    tbd->write_path,
+                    strerror(errno));
+        } else {
+            fprintf(stderr,
+                    "Failed to open the provided archive, error: %s\n",
+                    strerror(errno));
+        }
+
+        return false;
+    }
+
+    tbd->archive = archive;
+    return true;
+}
+
+static void
+close_archive(struct tbd_for_main *const tbd, const bool print_paths) {
+    const enum tbd_archive_result close_archive_result =
+        tbd_archive_close(tbd->archive);
+
+    if (close_archive_result != E_TBD_ARCHIVE_OK) {
+        if (print_paths) {
+            fprintf(stderr,
+                    "Failed to finish writing archive (at path %s), error: "
+                    "%s\n",
+                    tbd->write_path,
+                    strerror(errno));
+        } else {
+            fprintf(stderr,
+                    "Failed to finish writing the provided archive, error: "
+                    "%s\n",
+                    strerror(errno));
+        }
+    }
+
+    tbd->archive = NULL;
+}
+
 static void destroy_tbds_array(struct array *const tbds) {
     struct tbd_for_main *tbd = tbds->data;
     const struct tbd_for_main *const end = tbds->data_end;
@@ -271,6 +372,8 @@ int main(const int argc, const char *const argv[]) {
     uint64_t current_tbd_index = 0;
     bool has_stdout = false;
 
+    const char *incremental_path = NULL;
+
     for (int index = 1; index < argc; index++) {
         /*
          * Every argument parsed here should be an option. Any extra arguments,
@@ -365,6 +468,8 @@ int main(const int argc, const char *const argv[]) {
                             O_TBD_FOR_MAIN_PRESERVE_DIRECTORY_SUBDIRS;
                     } else if (strcmp(inner_opt, "no-overwrite") == 0) {
                         tbd->options |= O_TBD_FOR_MAIN_NO_OVERWRITE;
+                    } else if (strcmp(inner_opt, "tar") == 0) {
+                        tbd->options |= O_TBD_FOR_MAIN_WRITE_TO_ARCHIVE;
                     } else {
                         if (strcmp(inner_opt, "replace-path-extension") == 0) {
                             tbd->options |=
@@ -391,6 +496,18 @@ int main(const int argc, const char *const argv[]) {
 
                 const char *const path = inner_arg; 
                 if (strcmp(path, "stdout") == 0) {
+                    if (tbd->options & O_TBD_FOR_MAIN_WRITE_TO_ARCHIVE) {
+                        fputs("Writing an archive to stdout is not "
+                              "supported. Please provide a path to write the "
+                              "archive to\n",
+                              stderr);
+
+                        tbd_for_main_destroy(&global);
+                        destroy_tbds_array(&tbds);
+
+                        return 1;
+                    }
+
                     const bool preserve_subdirs =
                         tbd->options &
                         O_TBD_FOR_MAIN_PRESERVE_DIRECTORY_SUBDIRS;
@@ -458,6 +575,18 @@ int main(const int argc, const char *const argv[]) {
                         
                         return 1;
                     }
+
+                    if (options & O_TBD_FOR_MAIN_WRITE_TO_ARCHIVE) {
+                        fputs("Option --tar can only be provided for "
+                              "recursing directories or parsing "
+                              "dyld_shared_cache files\n",
+                              stderr);
+
+                        tbd_for_main_destroy(&global);
+                        destroy_tbds_array(&tbds);
+
+                        return 1;
+                    }
                 }
 
                 /*
@@ -488,7 +617,26 @@ int main(const int argc, const char *const argv[]) {
 
                 struct stat info = {};
                 if (stat(path, &info) == 0) {
-                    if (S_ISREG(info.st_mode)) {
+                    const bool is_archive =
+                        options & O_TBD_FOR_MAIN_WRITE_TO_ARCHIVE;
+
+                    if (is_archive && S_ISDIR(info.st_mode)) {
+                        fputs("Writing an archive to a directory is not "
+                              "supported, Please provide a path to write the "
+                              "archive to\n",
+                              stderr);
+
+                        if (full_path != path) {
+                            free(full_path);
+                        }
+
+                        tbd_for_main_destroy(&global);
+                        destroy_tbds_array(&tbds);
+
+                        return 1;
+                    }
+
+                    if (S_ISREG(info.st_mode) && !is_archive) {
                         if (options & O_TBD_FOR_MAIN_RECURSE_DIRECTORIES) {
                             fputs("Writing to a regular file while recursing a "
                                   "directory is not supported, Please provide "
@@ -918,6 +1066,22 @@ int main(const int argc, const char *const argv[]) {
 
                 return 1;
             }
+        } else if (strcmp(option, "incremental") == 0) {
+            index += 1;
+            if (index == argc) {
+                fputs("Please provide a path to a manifest to use when "
+                      "recursing incrementally\n",
+                      stderr);
+
+                tbd_for_main_destroy(&global);
+                destroy_tbds_array(&tbds);
+
+                return 1;
+            }
+
+            incremental_path = argv[index];
+        } else if (strcmp(option, "stats") == 0) {
+            stats_enable();
         } else if (strcmp(option, "list-architectures") == 0) {
             if (index != 1 || argc > 3) {
                 fputs("--list-architectures needs to be run by itself, or with "
@@ -1106,12 +1270,51 @@ int main(const int argc, const char *const argv[]) {
 
     uint64_t retained_info = 0;
 
+    /*
+     * The manifest is shared by all recursed directories, and only saved once
+     * every directory has been recursed.
+     */
+
+    struct incremental_manifest manifest = {};
+    if (incremental_path != NULL) {
+        const uint64_t arguments_hash =
+            incremental_manifest_hash_arguments(argc, argv);
+
+        const enum incremental_manifest_result load_manifest_result =
+            incremental_manifest_load(&manifest,
+                                      incremental_path,
+                                      arguments_hash);
+
+        if (load_manifest_result != E_INCREMENTAL_MANIFEST_OK) {
+            fprintf(stderr,
+                    "Failed to read manifest (at path %s), error: %s\n",
+                    incremental_path,
+                    strerror(errno));
+
+            incremental_manifest_destroy(&manifest);
+
+            tbd_for_main_destroy(&global);
+            destroy_tbds_array(&tbds);
+
+            return 1;
+        }
+    }
+
+    /*
+     * The directories of output-files are shared by every tbd, as tbds may
+     * write out to the same directories.
+     */
+
+    struct dir_cache dir_cache = {};
+    dir_cache_init(&dir_cache);
+
     const bool should_print_paths = item_count != 1;
     const struct tbd_for_main *const end = tbds.data_end;
 
     struct tbd_for_main *tbd = tbds.data;
     for (; tbd != end; tbd++) {
         tbd_for_main_apply_from(tbd, &global);
+        tbd->dir_cache = &dir_cache;
 
         const uint64_t options = tbd->options;
         if (options & O_TBD_FOR_MAIN_RECURSE_DIRECTORIES) {
@@ -1126,12 +1329,58 @@ int main(const int argc, const char *const argv[]) {
                       "a directory to write all found files to\n",
                       stderr);
 
+                dir_cache_destroy(&dir_cache);
                 tbd_for_main_destroy(&global);
                 destroy_tbds_array(&tbds);
                 
                 return 1;
             }
 
+            const bool write_to_archive =
+                options & O_TBD_FOR_MAIN_WRITE_TO_ARCHIVE;
+
+            if (incremental_path != NULL) {
+                if (write_to_archive) {
+                    fputs("Recursing incrementally while writing to an "
+                          "archive is not supported, as the archive is "
+                          "written anew every run\n",
+                          stderr);
+
+                    incremental_manifest_destroy(&manifest);
+                    dir_cache_destroy(&dir_cache);
+
+                    tbd_for_main_destroy(&global);
+                    destroy_tbds_array(&tbds);
+
+                    return 1;
+                }
+
+                tbd->manifest = &manifest;
+            }
+
+            struct tbd_archive archive = {};
+            if (write_to_archive) {
+                if (!open_archive(tbd, &archive, should_print_paths)) {
+                    continue;
+                }
+            }
+
+            /*
+             * Copies of a mach-o file are only looked for within the same
+             * directory's recursion, as the tbds written out for the same
+             * mach-o file may differ with different options.
+             *
+             * Tbds written to an archive can't be copied from, so copies are
+             * then simply parsed again.
+             */
+
+            struct macho_dedup dedup = {};
+            macho_dedup_init(&dedup);
+
+            if (!write_to_archive) {
+                tbd->dedup = &dedup;
+            }
+
             struct recurse_callback_info recurse_info = {
                 .global = &global,
                 .tbd = tbd,
@@ -1139,13 +1388,28 @@ int main(const int argc, const char *const argv[]) {
                 .print_paths = true
             };
 
-            const enum dir_recurse_result recurse_dir_result =
-                dir_recurse(tbd->parse_path,
-                            tbd->parse_path_length,
-                            options & O_TBD_FOR_MAIN_RECURSE_SUBDIRECTORIES,
-                            &recurse_info,
-                            recurse_directory_callback,
-                            recurse_directory_fail_callback);
+            enum dir_recurse_result recurse_dir_result = E_DIR_RECURSE_OK;
+            if (tbd->jobs > 1) {
+                recurse_dir_result =
+                    recurse_directory_with_jobs(
+                        &global,
+                        tbd,
+                        &recurse_info.retained_info,
+                        &recurse_info,
+                        recurse_directory_callback,
+                        recurse_directory_fail_callback);
+            } else {
+                stats_begin_phase(STATS_PHASE_WALK);
+                recurse_dir_result =
+                    dir_recurse(tbd->parse_path,
+                                tbd->parse_path_length,
+                                options & O_TBD_FOR_MAIN_RECURSE_SUBDIRECTORIES,
+                                &recurse_info,
+                                recurse_directory_callback,
+                                recurse_directory_fail_callback);
+
+                stats_end_phase();
+            }
 
             if (recurse_dir_result != E_DIR_RECURSE_OK) {
                 if (should_print_paths) {
@@ -1156,9 +1420,30 @@ int main(const int argc, const char *const argv[]) {
                     fputs("Failed to recurse the provided directory\n", stderr);
                 }
             }
+
+            tbd->dedup = NULL;
+            macho_dedup_destroy(&dedup);
+
+            if (write_to_archive) {
+                close_archive(tbd, should_print_paths);
+            }
         } else {
-            char *const parse_path = tbd->parse_path;
-            const int fd = open(parse_path, O_RDONLY);
+            stats_add(STATS_COUNTER_FILES_SEEN, 1);
+
+            /*
+             * A parse-path isn't stored when parsing from stdin.
+             */
+
+            const char *parse_path = tbd->parse_path;
+            uint64_t parse_path_length = tbd->parse_path_length;
+
+            int fd = STDIN_FILENO;
+            if (parse_path != NULL) {
+                fd = open(parse_path, O_RDONLY);
+            } else {
+                parse_path = "stdin";
+                parse_path_length = strlen(parse_path);
+            }
 
             if (fd < 0) {
                 if (should_print_paths) {
@@ -1173,6 +1458,7 @@ int main(const int argc, const char *const argv[]) {
                             strerror(errno));
                 }
 
+                stats_add(STATS_COUNTER_FILES_SKIPPED, 1);
                 continue;
             }
 
@@ -1188,7 +1474,7 @@ int main(const int argc, const char *const argv[]) {
                     parse_macho_file(&global,
                                      tbd,
                                      parse_path,
-                                     tbd->parse_path_length,
+                                     parse_path_length,
                                      fd,
                                      true,
                                      &retained_info,
@@ -1203,11 +1489,31 @@ int main(const int argc, const char *const argv[]) {
                      * configuration is now accounted for.
                      */
 
-                    verify_dsc_write_path(tbd);
+                    if (!(options & O_TBD_FOR_MAIN_WRITE_TO_ARCHIVE)) {
+                        verify_dsc_write_path(tbd);
+                        parse_shared_cache(&global,
+                                           tbd,
+                                           parse_path,
+                                           parse_path_length,
+                                           fd,
+                                           false,
+                                           should_print_paths,
+                                           &retained_info,
+                                           &magic,
+                                           &magic_size);
+
+                        break;
+                    }
+
+                    struct tbd_archive archive = {};
+                    if (!open_archive(tbd, &archive, should_print_paths)) {
+                        break;
+                    }
+
                     parse_shared_cache(&global,
                                        tbd,
                                        parse_path,
-                                       tbd->parse_path_length,
+                                       parse_path_length,
                                        fd,
                                        false,
                                        should_print_paths,
@@ -1215,16 +1521,40 @@ int main(const int argc, const char *const argv[]) {
                                        &magic,
                                        &magic_size);
 
+                    close_archive(tbd, should_print_paths);
                     break;
                 }
             }
 
-            close(fd);
+            if (fd != STDIN_FILENO) {
+                close(fd);
+            }
+        }
+    }
+
+    int result = 0;
+    if (incremental_path != NULL) {
+        const enum incremental_manifest_result save_manifest_result =
+            incremental_manifest_save(&manifest);
+
+        if (save_manifest_result != E_INCREMENTAL_MANIFEST_OK) {
+            fprintf(stderr,
+                    "Failed to write manifest (at path %s), error: %s\n",
+                    incremental_path,
+                    strerror(errno));
+
+            result = 1;
         }
+
+        incremental_manifest_destroy(&manifest);
     }
 
+    stats_print(stderr);
+    stats_destroy();
+
+    dir_cache_destroy(&dir_cache);
     tbd_for_main_destroy(&global);
     destroy_tbds_array(&tbds);
 
-    return 0;
+    return result;
 }
@@ -0,0 +1,173 @@
+//
+//  src/ordered_jobs.c
+//  tbd
+//
+//  Created by inoahdev on 3/9/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ordered_jobs.h"
+
+enum ordered_jobs_result
+ordered_jobs_init(struct ordered_jobs *const jobs,
+                  const uint32_t workers_count)
+{
+    const char **const write_paths = calloc(workers_count, sizeof(char *));
+    if (write_paths == NULL) {
+        return E_ORDERED_JOBS_ALLOC_FAIL;
+    }
+
+    pthread_mutex_init(&jobs->mutex, NULL);
+    pthread_cond_init(&jobs->cond, NULL);
+
+    jobs->next_index = 0;
+    jobs->turn_index = 0;
+    jobs->stopped = false;
+
+    jobs->write_paths = write_paths;
+    jobs->workers_count = workers_count;
+
+    return E_ORDERED_JOBS_OK;
+}
+
+bool
+ordered_jobs_claim_index(struct ordered_jobs *const jobs,
+                         const uint64_t count,
+                         uint64_t *const index_out)
+{
+    pthread_mutex_lock(&jobs->mutex);
+
+    const uint64_t index = jobs->next_index;
+    const bool has_index = index != count && !jobs->stopped;
+
+    if (has_index) {
+        jobs->next_index = index + 1;
+    }
+
+    pthread_mutex_unlock(&jobs->mutex);
+
+    if (!has_index) {
+        return false;
+    }
+
+    *index_out = index;
+    return true;
+}
+
+void
+ordered_jobs_wait_for_turn(struct ordered_jobs *const jobs,
+                           const uint64_t index)
+{
+    pthread_mutex_lock(&jobs->mutex);
+    while (jobs->turn_index != index) {
+        pthread_cond_wait(&jobs->cond, &jobs->mutex);
+    }
+
+    pthread_mutex_unlock(&jobs->mutex);
+}
+
+void ordered_jobs_end_turn(struct ordered_jobs *const jobs) {
+    pthread_mutex_lock(&jobs->mutex);
+
+    jobs->turn_index += 1;
+    pthread_cond_broadcast(&jobs->cond);
+
+    pthread_mutex_unlock(&jobs->mutex);
+}
+
+void ordered_jobs_stop(struct ordered_jobs *const jobs) {
+    pthread_mutex_lock(&jobs->mutex);
+    jobs->stopped = true;
+    pthread_mutex_unlock(&jobs->mutex);
+}
+
+static bool
+write_path_is_in_use(const struct ordered_jobs *const jobs,
+                     const char *const write_path)
+{
+    const char *const *iter = jobs->write_paths;
+    const char *const *const end = iter + jobs->workers_count;
+
+    for (; iter != end; iter++) {
+        const char *const other_write_path = *iter;
+        if (other_write_path == NULL) {
+            continue;
+        }
+
+        if (strcmp(other_write_path, write_path) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+ordered_jobs_set_write_path(struct ordered_jobs *const jobs,
+                            const uint32_t worker_index,
+                            const char *const write_path)
+{
+    pthread_mutex_lock(&jobs->mutex);
+
+    /*
+     * Wait for any other worker writing to the same output-file, so files are
+     * overwritten (or skipped) in the order of the items.
+     */
+
+    if (write_path != NULL) {
+        while (write_path_is_in_use(jobs, write_path)) {
+            pthread_cond_wait(&jobs->cond, &jobs->mutex);
+        }
+    }
+
+    jobs->write_paths[worker_index] = write_path;
+
+    pthread_cond_broadcast(&jobs->cond);
+    pthread_mutex_unlock(&jobs->mutex);
+}
+
+void
+ordered_jobs_run(void *const workers,
+                 const size_t worker_size,
+                 const uint32_t workers_count,
+                 void *(*const routine)(void *))
+{
+    if (workers_count == 0) {
+        return;
+    }
+
+    pthread_t *const threads = calloc(workers_count, sizeof(pthread_t));
+    uint32_t started_count = 1;
+
+    if (threads != NULL) {
+        for (; started_count != workers_count; started_count++) {
+            pthread_t *const thread = threads + started_count;
+            void *const worker = workers + (worker_size * started_count);
+
+            if (pthread_create(thread, NULL, routine, worker) != 0) {
+                break;
+            }
+        }
+    }
+
+    routine(workers);
+
+    for (uint32_t i = 1; i != started_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+}
+
+void ordered_jobs_destroy(struct ordered_jobs *const jobs) {
+    pthread_cond_destroy(&jobs->cond);
+    pthread_mutex_destroy(&jobs->mutex);
+
+    free(jobs->write_paths);
+
+    jobs->write_paths = NULL;
+    jobs->workers_count = 0;
+}
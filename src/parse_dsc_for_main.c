@@ -12,13 +12,18 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "dsc_image_order.h"
+#include "dsc_image_selection.h"
+#include "dsc_page_release.h"
 #include "handle_dsc_parse_result.h"
 #include "parse_dsc_for_main.h"
 
 #include "macho_file.h"
+#include "ordered_jobs.h"
 #include "path.h"
 
 #include "recursive.h"
+#include "stats.h"
 #include "unused.h"
 
 struct dsc_iterate_images_callback_info {
@@ -31,6 +36,27 @@ struct dsc_iterate_images_callback_info {
     struct tbd_for_main *tbd;
 
     struct array images;
+    struct dsc_image_selection *selection;
+
+    /*
+     * The order to extract images in, or NULL if images are extracted in the
+     * order of the image-table.
+     */
+
+    const struct dsc_image_order *order;
+
+    /*
+     * The release of the pages of order's images, or NULL if pages aren't
+     * released.
+     */
+
+    struct dsc_page_release *release;
+
+    /*
+     * A bitmap, indexed by image-number, of the images already extracted.
+     */
+
+    uint64_t *extracted_images;
 
     uint64_t write_path_length;
     uint64_t *retained_info;
@@ -39,22 +65,44 @@ struct dsc_iterate_images_callback_info {
     bool parse_all_images;
 };
 
-enum dyld_cache_image_info_pad {
-    E_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED = 1 << 0
-};
+/*
+ * With multiple jobs, an image's bit is read before the worker's turn, while
+ * other workers may be setting the bits of other images in the same word, so
+ * the bitmap is always accessed atomically.
+ */
+
+static bool
+image_was_extracted(
+    const struct dsc_iterate_images_callback_info *const callback_info,
+    const struct dyld_cache_image_info *const image)
+{
+    const uint64_t index = (uint64_t)(image - callback_info->dsc_info->images);
+    const uint64_t bit = 1ull << (index % 64);
+
+    const uint64_t word =
+        __atomic_load_n(callback_info->extracted_images + index / 64,
+                        __ATOMIC_RELAXED);
+
+    return (word & bit);
+}
 
 static void
-clear_create_info(struct tbd_create_info *const info_in,
-                  const struct tbd_create_info *const orig)
+mark_image_extracted(
+    const struct dsc_iterate_images_callback_info *const callback_info,
+    const struct dyld_cache_image_info *const image)
 {
-    tbd_create_info_destroy(info_in);
-    *info_in = *orig;
+    const uint64_t index = (uint64_t)(image - callback_info->dsc_info->images);
+    const uint64_t bit = 1ull << (index % 64);
+
+    __atomic_fetch_or(callback_info->extracted_images + index / 64,
+                      bit,
+                      __ATOMIC_RELAXED);
 }
 
 static int 
 actually_parse_image(
     struct tbd_for_main *const tbd,
-    struct dyld_cache_image_info *const image,
+    const struct dyld_cache_image_info *const image,
     const char *const image_path,
     const struct dsc_iterate_images_callback_info *const callback_info)
 {
@@ -64,6 +112,7 @@ actually_parse_image(
     const uint64_t macho_options =
         O_MACHO_FILE_PARSE_IGNORE_INVALID_FIELDS | tbd->macho_options;
 
+    stats_begin_phase(STATS_PHASE_LOAD_COMMANDS);
     const enum dsc_image_parse_result parse_image_result =
         dsc_image_parse(create_info,
                         callback_info->dsc_info,
@@ -72,6 +121,8 @@ actually_parse_image(
                         tbd->dsc_options,
                         0);
 
+    stats_end_phase();
+
     const bool should_continue =
         handle_dsc_image_parse_result(callback_info->global,
                                       callback_info->tbd,
@@ -82,7 +133,7 @@ actually_parse_image(
                                       callback_info->retained_info); 
 
     if (!should_continue) {
-        clear_create_info(create_info, &original_info);
+        tbd_create_info_clear(create_info, &original_info);
         return 1;
     }
 
@@ -109,104 +160,565 @@ actually_parse_image(
 
     tbd_for_main_write_to_path(tbd, image_path, write_path, length, true);
 
-    clear_create_info(create_info, &original_info);
+    tbd_create_info_clear(create_info, &original_info);
     free(write_path);
 
     return 0;
 }
 
+/*
+ * Find out if the image should be parsed, and if so, the flags of the filter
+ * or path that allowed the image to be parsed, if any, and the index of the
+ * path, or -1 if the image wasn't selected by a path.
+ */
+
 static bool
-path_has_image_entry(const char *const path,
-                     const char *const filter,
-                     const uint64_t filter_length,
-                     const uint64_t options)
+should_parse_image(
+    const struct dsc_iterate_images_callback_info *const callback_info,
+    const struct dyld_cache_image_info *const image,
+    const char *const image_path,
+    uint64_t **const flags_out,
+    int64_t *const path_index_out)
 {
-    const bool allows_hierarchy =
-        !(options & O_TBD_FOR_MAIN_RECURSE_SKIP_IMAGE_DIRS);
-
-    if (path_has_component(path, filter, filter_length, allows_hierarchy)) {
-        return true;
+    if (image_was_extracted(callback_info, image)) {
+        return false;
     }
 
-    return false;
-}
+    /*
+     * Skip any dyld_shared_cache images if we haven't been prompted to accept
+     * them. We extract all the images in the dyld_shared_cache if none specific
+     * have been provided.
+     */
 
-static uint64_t *
-find_image_flags_for_path(const struct array *const filters,
-                          const struct array *const paths,
-                          const char *const path,
-                          const uint64_t options)
-{
-    struct tbd_for_main_dsc_image_path *image_path = paths->data;
-    const struct tbd_for_main_dsc_image_path *const image_paths_end =
-        paths->data_end; 
+    uint64_t *flags = NULL;
+    int64_t path_index = -1;
 
-    for (; image_path != image_paths_end; image_path++) {
-        if (strcmp(image_path->string, path) != 0) {
-            continue; 
-        }
+    if (!callback_info->parse_all_images) {
+        flags =
+            dsc_image_selection_find(callback_info->selection,
+                                     image_path,
+                                     &path_index);
 
-        return &image_path->flags;
+        if (flags == NULL) {
+            return false;
+        }
     }
 
-    struct tbd_for_main_dsc_image_filter *filter = filters->data;
-    const struct tbd_for_main_dsc_image_filter *const end =
-        filters->data_end;
+    *flags_out = flags;
+    *path_index_out = path_index;
 
-    for (; filter != end; filter++) {
-        const char *const string = filter->string;
-        const uint64_t length = filter->length;
+    return true;
+}
 
-        if (path_has_image_entry(path, string, length, options)) {
-            return &filter->flags;
-        }
+/*
+ * Returns whether every image that can be selected has been parsed, so no
+ * more images have to be iterated over.
+ */
+
+static bool
+found_all_images(
+    const struct dsc_iterate_images_callback_info *const callback_info)
+{
+    if (callback_info->parse_all_images) {
+        return false;
     }
 
-    return NULL;
+    return dsc_image_selection_is_complete(callback_info->selection);
 }
 
 static bool
-dsc_iterate_images_callback(struct dyld_cache_image_info *const image,
+dsc_iterate_images_callback(const struct dyld_cache_image_info *const image,
                             const char *const image_path,
                             void *const item)
 {
-    if (image->pad & E_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED) {
-        return true;
-    }
-
     struct dsc_iterate_images_callback_info *const callback_info =
        (struct dsc_iterate_images_callback_info *)item;
 
+    uint64_t *flags = NULL;
+    int64_t path_index = -1;
+
+    const bool should_parse =
+        should_parse_image(callback_info,
+                           image,
+                           image_path,
+                           &flags,
+                           &path_index);
+
+    if (!should_parse) {
+        return true;
+    }
+
     struct tbd_for_main *const tbd = callback_info->tbd;
-    const uint64_t options = tbd->options;
+    if (actually_parse_image(tbd, image, image_path, callback_info)) {
+        return true;
+    }
+
+    if (!callback_info->parse_all_images) {
+        dsc_image_selection_mark_found(callback_info->selection,
+                                       flags,
+                                       path_index);
+    }
+
+    mark_image_extracted(callback_info, image);
 
     /*
-     * Skip any dyld_shared_cache images if we haven't been prompted to accept
-     * them. We extract all the images in the dyld_shared_cache if none specific
-     * have been provided.
+     * Stop iterating once every image selected by path was found, unless
+     * filters still have to be checked against every image.
      */
 
-    const struct array *const filters = &tbd->dsc_image_filters;
-    const struct array *const paths = &tbd->dsc_image_paths;
+    return !found_all_images(callback_info);
+}
+
+static bool
+dsc_image_order_filter_callback(
+    const struct dyld_cache_image_info *const image,
+    const char *const image_path,
+    void *const item)
+{
+    const struct dsc_iterate_images_callback_info *const callback_info =
+        (const struct dsc_iterate_images_callback_info *)item;
 
     uint64_t *flags = NULL;
+    int64_t path_index = -1;
+
+    return should_parse_image(callback_info,
+                              image,
+                              image_path,
+                              &flags,
+                              &path_index);
+}
+
+/*
+ * Read ahead of the images at and after position in the order, if the images
+ * are ordered by the location of their data.
+ */
+
+static void
+advise_images_at(
+    const struct dsc_iterate_images_callback_info *const callback_info,
+    const uint32_t position)
+{
+    if (callback_info->tbd->options & O_TBD_FOR_MAIN_DSC_FILE_ORDER) {
+        dsc_image_order_advise(callback_info->order,
+                               callback_info->dsc_info,
+                               position);
+    }
+}
+
+/*
+ * Extract images in the order of callback_info's order, reading ahead of the
+ * images that come next, and releasing the pages of images that are done.
+ */
+
+static void
+parse_images_in_order(
+    struct dsc_iterate_images_callback_info *const callback_info)
+{
+    const struct dyld_shared_cache_info *const dsc_info =
+        callback_info->dsc_info;
+
+    const struct dsc_image_order *const order = callback_info->order;
+    const uint32_t count = order->count;
+
+    for (uint32_t i = 0; i != count; i++) {
+        advise_images_at(callback_info, i);
+
+        const uint32_t index = order->entries[i].index;
+        const struct dyld_cache_image_info *const image =
+            dsc_info->images + index;
+
+        const uint32_t path_file_offset = image->pathFileOffset;
+        const char *const image_path =
+            (const char *)(dsc_info->map + path_file_offset);
+
+        const bool should_continue =
+            dsc_iterate_images_callback(image, image_path, callback_info);
+
+        if (callback_info->release != NULL) {
+            dsc_page_release_set_done(callback_info->release, i + 1);
+        }
+
+        if (!should_continue) {
+            break;
+        }
+    }
+}
+
+/*
+ * When extracting with multiple jobs, each worker claims the next image, and
+ * parses it into its own copy of the tbd (and therefore its own create-info).
+ *
+ * To keep the output the same as when extracting with a single job, everything
+ * that depends on the order the images are handled in (handling the
+ * parse-result, which may print errors or request user-input, updating the
+ * filter and path flags, and opening the output-file) is done in a turn taken
+ * in the order of the images. Only parsing the image and writing out its tbd
+ * are done in parallel.
+ */
+
+struct dsc_parse_worker;
+struct dsc_parse_jobs_info {
+    struct dsc_iterate_images_callback_info *callback_info;
+    struct ordered_jobs jobs;
+
+    struct dsc_parse_worker *workers;
+
+    /*
+     * Protects the image_index of every worker, which is only tracked for a
+     * dyld_shared_cache split into sub-caches, or when releasing pages.
+     */
+
+    pthread_mutex_t images_mutex;
+};
+
+struct dsc_parse_worker {
+    struct dsc_parse_jobs_info *jobs_info;
+    struct tbd_for_main tbd;
+
+    /*
+     * The lowest index of an image the worker may still be handling, or
+     * UINT64_MAX once the worker is done.
+     */
+
+    uint64_t image_index;
+    uint32_t index;
+};
+
+/*
+ * Handle the parse-result of an image, and open its output-file.
+ *
+ * This must only be called in the worker's turn for the image.
+ */
+
+static FILE *
+handle_image_in_turn(struct dsc_parse_worker *const worker,
+                     const struct dyld_cache_image_info *const image,
+                     const char *const image_path,
+                     const enum dsc_image_parse_result parse_image_result,
+                     uint64_t *const flags,
+                     const int64_t path_index,
+                     char **const write_path_out,
+                     uint64_t *const write_path_length_out,
+                     char **const terminator_out)
+{
+    const struct dsc_iterate_images_callback_info *const callback_info =
+        worker->jobs_info->callback_info;
+
+    struct tbd_for_main *const tbd = &worker->tbd;
+    struct tbd_for_main *const shared_tbd = callback_info->tbd;
+
+    /*
+     * Requests made for the image may change the tbd's parse-options, which
+     * have to be shared by all workers.
+     */
+
+    tbd->parse_options = shared_tbd->parse_options;
+
+    const bool should_continue =
+        handle_dsc_image_parse_result(callback_info->global,
+                                      tbd,
+                                      callback_info->dsc_path,
+                                      image_path,
+                                      parse_image_result,
+                                      callback_info->print_paths,
+                                      callback_info->retained_info);
+
+    shared_tbd->parse_options = tbd->parse_options;
+    if (!should_continue) {
+        return NULL;
+    }
+
+    struct ordered_jobs *const jobs = &worker->jobs_info->jobs;
     if (!callback_info->parse_all_images) {
-        flags = find_image_flags_for_path(filters, paths, image_path, options);
-        if (flags == NULL) {
-            return true;
+        dsc_image_selection_mark_found(callback_info->selection,
+                                       flags,
+                                       path_index);
+
+        if (found_all_images(callback_info)) {
+            ordered_jobs_stop(jobs);
         }
     }
 
-    if (actually_parse_image(tbd, image, image_path, callback_info)) {
-        return true;
+    mark_image_extracted(callback_info, image);
+
+    char *write_path = callback_info->write_path;
+    uint64_t length = callback_info->write_path_length;
+
+    if (!(tbd->options & O_TBD_FOR_MAIN_DSC_WRITE_PATH_IS_FILE)) {
+        write_path =
+            tbd_for_main_create_write_path(tbd,
+                                           write_path,
+                                           length,
+                                           image_path,
+                                           strlen(image_path),
+                                           "tbd",
+                                           3,
+                                           false,
+                                           &length);
+
+        if (write_path == NULL) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
     }
 
-    if (flags != NULL) {
-        *flags |= F_TBD_FOR_MAIN_DSC_IMAGE_FOUND_ONE;
+    *write_path_out = write_path;
+    *write_path_length_out = length;
+
+    /*
+     * Entries are added to an archive in the image's turn, so the archive's
+     * entries are in the same order as when extracting without jobs.
+     */
+
+    if (tbd->archive != NULL) {
+        tbd_for_main_write_to_path(tbd, image_path, write_path, length, true);
+        return NULL;
     }
 
-    image->pad |= E_DYLD_CACHE_IMAGE_INFO_PAD_ALREADY_EXTRACTED;
-    return true;
+    ordered_jobs_set_write_path(jobs, worker->index, write_path);
+
+    FILE *const file =
+        tbd_for_main_open_write_file(tbd,
+                                     image_path,
+                                     write_path,
+                                     length,
+                                     true,
+                                     terminator_out);
+
+    if (file == NULL) {
+        ordered_jobs_set_write_path(jobs, worker->index, NULL);
+    }
+
+    return file;
+}
+
+/*
+ * The create-info of an image points into the file the image was parsed from
+ * until it's written out and cleared, so a sub-cache can only be unmapped once
+ * every image located in it has been written out by its worker.
+ *
+ * Each worker stores the lowest image-index it may still be handling. As
+ * images are claimed in order, every image before the lowest such index of all
+ * workers is done. Unmapping is done while holding images_mutex, so no worker
+ * can start on an image of a sub-cache as it's being unmapped.
+ *
+ * The same goes for releasing the pages of images, where the index is instead
+ * a position in the order.
+ */
+
+static void
+set_worker_image_index(struct dsc_parse_worker *const worker,
+                       const uint64_t image_index)
+{
+    struct dsc_parse_jobs_info *const jobs_info = worker->jobs_info;
+    const struct dsc_iterate_images_callback_info *const callback_info =
+        jobs_info->callback_info;
+
+    struct dyld_shared_cache_info *const dsc_info = callback_info->dsc_info;
+    struct dsc_page_release *const release = callback_info->release;
+
+    if (dsc_info->subcaches_count == 0 && release == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&jobs_info->images_mutex);
+    worker->image_index = image_index;
+
+    const struct dsc_parse_worker *const workers = jobs_info->workers;
+    const uint32_t workers_count = jobs_info->jobs.workers_count;
+
+    uint64_t lowest_index = UINT64_MAX;
+    for (uint32_t i = 0; i != workers_count; i++) {
+        if (workers[i].image_index < lowest_index) {
+            lowest_index = workers[i].image_index;
+        }
+    }
+
+    if (release != NULL) {
+        const uint32_t count = callback_info->order->count;
+        if (lowest_index > count) {
+            lowest_index = count;
+        }
+
+        dsc_page_release_set_done(release, (uint32_t)lowest_index);
+    } else {
+        dyld_shared_cache_release_subcaches_before(dsc_info, lowest_index);
+    }
+
+    pthread_mutex_unlock(&jobs_info->images_mutex);
+}
+
+static void *dsc_parse_worker_routine(void *const item) {
+    struct dsc_parse_worker *const worker = (struct dsc_parse_worker *)item;
+    struct dsc_parse_jobs_info *const jobs_info = worker->jobs_info;
+    struct ordered_jobs *const jobs = &jobs_info->jobs;
+
+    const struct dsc_iterate_images_callback_info *const callback_info =
+        jobs_info->callback_info;
+
+    struct dyld_shared_cache_info *const dsc_info = callback_info->dsc_info;
+    struct tbd_for_main *const tbd = &worker->tbd;
+
+    const struct tbd_create_info original_info = tbd->info;
+    const uint64_t macho_options =
+        O_MACHO_FILE_PARSE_IGNORE_INVALID_FIELDS | tbd->macho_options;
+
+    /*
+     * With an order, the claimed index is a position in the order, which is
+     * also the order in which workers take their turns.
+     */
+
+    const struct dsc_image_order *const order = callback_info->order;
+    uint32_t images_count = dsc_info->images_count;
+
+    if (order != NULL) {
+        images_count = order->count;
+    }
+
+    uint64_t index = 0;
+    while (ordered_jobs_claim_index(jobs, images_count, &index)) {
+        const struct dyld_cache_image_info *image = dsc_info->images + index;
+        if (order != NULL) {
+            advise_images_at(callback_info, (uint32_t)index);
+            image = dsc_info->images + order->entries[index].index;
+        }
+
+        const uint32_t path_file_offset = image->pathFileOffset;
+        const char *const image_path =
+            (const char *)(dsc_info->map + path_file_offset);
+
+        uint64_t *flags = NULL;
+        int64_t path_index = -1;
+
+        const bool should_parse =
+            should_parse_image(callback_info,
+                               image,
+                               image_path,
+                               &flags,
+                               &path_index);
+
+        enum dsc_image_parse_result parse_image_result = E_DSC_IMAGE_PARSE_OK;
+        if (should_parse) {
+            stats_begin_phase(STATS_PHASE_LOAD_COMMANDS);
+            parse_image_result =
+                dsc_image_parse(&tbd->info,
+                                dsc_info,
+                                image,
+                                macho_options,
+                                tbd->dsc_options,
+                                0);
+
+            stats_end_phase();
+        }
+
+        FILE *file = NULL;
+
+        char *write_path = NULL;
+        char *terminator = NULL;
+        uint64_t write_path_length = 0;
+
+        ordered_jobs_wait_for_turn(jobs, index);
+
+        if (should_parse) {
+            file =
+                handle_image_in_turn(worker,
+                                     image,
+                                     image_path,
+                                     parse_image_result,
+                                     flags,
+                                     path_index,
+                                     &write_path,
+                                     &write_path_length,
+                                     &terminator);
+        }
+
+        ordered_jobs_end_turn(jobs);
+
+        if (file != NULL) {
+            tbd_for_main_write_to_file(tbd,
+                                       image_path,
+                                       write_path,
+                                       write_path_length,
+                                       terminator,
+                                       true,
+                                       file);
+
+            ordered_jobs_set_write_path(jobs, worker->index, NULL);
+        }
+
+        if (write_path != callback_info->write_path) {
+            free(write_path);
+        }
+
+        tbd_create_info_clear(&tbd->info, &original_info);
+        set_worker_image_index(worker, index + 1);
+    }
+
+    set_worker_image_index(worker, UINT64_MAX);
+    return NULL;
+}
+
+static void
+parse_images_with_jobs(
+    struct dsc_iterate_images_callback_info *const callback_info,
+    const uint32_t jobs)
+{
+    uint32_t workers_count = jobs;
+    if (workers_count > callback_info->dsc_info->images_count) {
+        workers_count = callback_info->dsc_info->images_count;
+    }
+
+    if (workers_count == 0) {
+        return;
+    }
+
+    struct dsc_parse_worker *const workers =
+        calloc(workers_count, sizeof(struct dsc_parse_worker));
+
+    if (workers == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    struct dsc_parse_jobs_info jobs_info = {
+        .callback_info = callback_info,
+        .workers = workers,
+        .images_mutex = PTHREAD_MUTEX_INITIALIZER
+    };
+
+    if (ordered_jobs_init(&jobs_info.jobs, workers_count)) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    /*
+     * Each worker gets a shallow copy of the tbd, with the create-info acting
+     * as a template for the create-info of each image, but with its own arena.
+     */
+
+    for (uint32_t i = 0; i != workers_count; i++) {
+        struct dsc_parse_worker *const worker = workers + i;
+
+        worker->jobs_info = &jobs_info;
+        worker->tbd = *callback_info->tbd;
+        worker->tbd.info.arena = (struct arena){};
+        worker->image_index = 0;
+        worker->index = i;
+    }
+
+    ordered_jobs_run(workers,
+                     sizeof(struct dsc_parse_worker),
+                     workers_count,
+                     dsc_parse_worker_routine);
+
+    for (uint32_t i = 0; i != workers_count; i++) {
+        arena_destroy(&workers[i].tbd.info.arena);
+    }
+
+    ordered_jobs_destroy(&jobs_info.jobs);
+    pthread_mutex_destroy(&jobs_info.images_mutex);
+
+    free(workers);
 }
 
 /*
@@ -307,7 +819,14 @@ read_magic(const int fd,
         memcpy(magic_out, magic, magic_size);
 
         const uint64_t read_size = 16 - magic_size;
-        if (read(fd, magic_out + magic_size, read_size) < 0) {
+
+        stats_begin_phase(STATS_PHASE_MAGIC);
+        const ssize_t read_result =
+            read(fd, magic_out + magic_size, read_size);
+
+        stats_end_phase();
+
+        if (read_result < 0) {
             if (errno == EOVERFLOW) {
                 return E_READ_MAGIC_NOT_LARGE_ENOUGH;
             }
@@ -324,6 +843,8 @@ read_magic(const int fd,
                                         
             return E_READ_MAGIC_READ_FAILED;
         }
+
+        stats_add(STATS_COUNTER_BYTES_READ, (uint64_t)read_result);
     } else {
         memcpy(magic_out, magic, 16);
     }
@@ -360,15 +881,12 @@ parse_shared_cache(struct tbd_for_main *const global,
             return false;
     }
 
-    const uint64_t dsc_options =
-        O_DYLD_SHARED_CACHE_PARSE_ZERO_IMAGE_PADS | tbd->dsc_options;
-
     struct dyld_shared_cache_info dsc_info = {};
     const enum dyld_shared_cache_parse_result parse_dsc_file_result =
         dyld_shared_cache_parse_from_file(&dsc_info,
                                           fd,
                                           magic,
-                                          dsc_options);
+                                          tbd->dsc_options);
 
     if (parse_dsc_file_result == E_DYLD_SHARED_CACHE_PARSE_NOT_A_CACHE) {
         if (magic_in_size < sizeof(magic)) {
@@ -384,6 +902,19 @@ parse_shared_cache(struct tbd_for_main *const global,
         return true;
     }
 
+    const enum dyld_shared_cache_parse_result find_subcaches_result =
+        dyld_shared_cache_find_subcaches(&dsc_info, path);
+
+    if (find_subcaches_result != E_DYLD_SHARED_CACHE_PARSE_OK) {
+        handle_dsc_file_parse_result(path, find_subcaches_result, print_paths);
+
+        dyld_shared_cache_info_destroy(&dsc_info);
+
+        return true;
+    }
+
+    dsc_image_find_subcache_uses(&dsc_info);
+
     char *write_path = tbd->write_path;
     uint64_t write_path_length = tbd->write_path_length;
 
@@ -408,6 +939,22 @@ parse_shared_cache(struct tbd_for_main *const global,
                                            &write_path_length); 
     }
 
+    /*
+     * The dyld_shared_cache is mapped read-only, so which images were extracted
+     * is stored in a bitmap, instead of in each image's padding.
+     */
+
+    const uint64_t extracted_words =
+        ((uint64_t)dsc_info.images_count + 63) / 64;
+
+    uint64_t *const extracted_images =
+        calloc(extracted_words, sizeof(uint64_t));
+
+    if (extracted_images == NULL && extracted_words != 0) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
     struct dsc_iterate_images_callback_info callback_info = {
         .dsc_info = &dsc_info,
         .dsc_path = path,
@@ -417,7 +964,8 @@ parse_shared_cache(struct tbd_for_main *const global,
         .write_path_length = write_path_length,
         .retained_info = retained_info_in,
         .print_paths = print_paths,
-        .parse_all_images = true
+        .parse_all_images = true,
+        .extracted_images = extracted_images
     };
 
     /*
@@ -453,11 +1001,16 @@ parse_shared_cache(struct tbd_for_main *const global,
                             dsc_info.images_count);
                 }
 
+                free(extracted_images);
+
+                dyld_shared_cache_info_destroy(&dsc_info);
+
                 return false; 
             }
 
             const uint32_t index = number - 1;
-            struct dyld_cache_image_info *const image = &dsc_info.images[index];
+            const struct dyld_cache_image_info *const image =
+                dsc_info.images + index;
 
             const uint32_t image_path_offset = image->pathFileOffset;
             const char *const image_path =
@@ -479,6 +1032,10 @@ parse_shared_cache(struct tbd_for_main *const global,
                 free(write_path);
             }
 
+            free(extracted_images);
+
+            dyld_shared_cache_info_destroy(&dsc_info);
+
             return true;
         }
 
@@ -495,16 +1052,113 @@ parse_shared_cache(struct tbd_for_main *const global,
         }
     }
 
+    /*
+     * Compile the filters and paths once, instead of comparing every image's
+     * path against each of them.
+     */
+
+    struct dsc_image_selection selection = {};
+    if (!callback_info.parse_all_images) {
+        const bool allows_hierarchy =
+            !(tbd->options & O_TBD_FOR_MAIN_RECURSE_SKIP_IMAGE_DIRS);
+
+        const enum dsc_image_selection_result create_selection_result =
+            dsc_image_selection_create(&selection,
+                                       filters,
+                                       paths,
+                                       allows_hierarchy);
+
+        if (create_selection_result != E_DSC_IMAGE_SELECTION_OK) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+
+        callback_info.selection = &selection;
+    }
+
     /*
      * Only create the write-path directory at the last-moment to avoid
      * unnecessary mkdir() calls for a shared-cache that may turn up empty.
      */
 
-    const enum dyld_shared_cache_parse_result iterate_images_result =
-        dyld_shared_cache_iterate_images_with_callback(
-            &dsc_info,
-            &callback_info,
-            dsc_iterate_images_callback);
+    enum dyld_shared_cache_parse_result iterate_images_result =
+        E_DYLD_SHARED_CACHE_PARSE_OK;
+
+    /*
+     * Images of a dyld_shared_cache split into sub-caches are always extracted
+     * in the order of the image-table, with each sub-cache already unmapped
+     * once its images are done, so no order is created for them.
+     */
+
+    const uint64_t order_tbd_options =
+        O_TBD_FOR_MAIN_DSC_FILE_ORDER | O_TBD_FOR_MAIN_DSC_RELEASE_PAGES;
+
+    struct dsc_image_order order = {};
+    struct dsc_page_release release = {};
+
+    if ((tbd->options & order_tbd_options) && dsc_info.subcaches_count == 0) {
+        uint64_t order_options = 0;
+        if (tbd->options & O_TBD_FOR_MAIN_DSC_FILE_ORDER) {
+            order_options |= O_DSC_IMAGE_ORDER_BY_FILE_OFFSET;
+        }
+
+        if (tbd->options & O_TBD_FOR_MAIN_DSC_RELEASE_PAGES) {
+            order_options |= O_DSC_IMAGE_ORDER_RELEASE_PAGES;
+        }
+
+        const enum dsc_image_order_result create_order_result =
+            dsc_image_order_create(&order,
+                                   &dsc_info,
+                                   dsc_image_order_filter_callback,
+                                   &callback_info,
+                                   order_options);
+
+        if (create_order_result != E_DSC_IMAGE_ORDER_OK) {
+            fputs("Failed to allocate memory\n", stderr);
+            exit(1);
+        }
+
+        callback_info.order = &order;
+        if (tbd->options & O_TBD_FOR_MAIN_DSC_RELEASE_PAGES) {
+            const enum dsc_page_release_result create_release_result =
+                dsc_page_release_create(&release,
+                                        &dsc_info,
+                                        &order,
+                                        fd,
+                                        tbd->dsc_max_rss);
+
+            if (create_release_result != E_DSC_PAGE_RELEASE_OK) {
+                fputs("Failed to allocate memory\n", stderr);
+                exit(1);
+            }
+
+            callback_info.release = &release;
+        }
+    }
+
+    if (tbd->jobs > 1) {
+        parse_images_with_jobs(&callback_info, tbd->jobs);
+    } else if (callback_info.order != NULL) {
+        parse_images_in_order(&callback_info);
+    } else {
+        iterate_images_result =
+            dyld_shared_cache_iterate_images_with_callback(
+                &dsc_info,
+                &callback_info,
+                dsc_iterate_images_callback);
+    }
+
+    if (callback_info.release != NULL) {
+        dsc_page_release_flush(&release);
+        dsc_page_release_destroy(&release);
+    }
+
+    dsc_image_order_destroy(&order);
+    dsc_image_selection_destroy(&selection);
+
+    dyld_shared_cache_info_destroy(&dsc_info);
+
+    free(extracted_images);
 
     if (is_recursing) {
         free(write_path);
@@ -525,9 +1179,10 @@ struct dsc_list_images_callback {
 };
 
 static bool
-dsc_list_images_callback(struct dyld_cache_image_info *__unused const image,
-                         const char *const image_path,
-                         void *const item)
+dsc_list_images_callback(
+    const struct dyld_cache_image_info *__unused const image,
+    const char *const image_path,
+    void *const item)
 {
     struct dsc_list_images_callback *const callback_info =
         (struct dsc_list_images_callback *)item;
@@ -6,6 +6,8 @@
 //  Copyright © 2018 - 2019 inoahdev. All rights reserved.
 //
 
+#include <sys/stat.h>
+
 #include <errno.h>
 
 #include <stdlib.h>
@@ -14,76 +16,249 @@
 #include <unistd.h>
 
 #include "handle_macho_file_parse_result.h"
+#include "incremental_manifest.h"
 
+#include "macho_dedup.h"
 #include "macho_file.h"
 #include "parse_macho_for_main.h"
+#include "stats.h"
 
-static void
-clear_create_info(struct tbd_create_info *const info_in,
-                  const struct tbd_create_info *const orig)
-{
-    tbd_create_info_destroy(info_in);
-    *info_in = *orig;
-}
-
-bool
-parse_macho_file(struct tbd_for_main *const global,
-                 struct tbd_for_main *const tbd,
-                 const char *const path,
-                 const uint64_t path_length,
-                 const int fd,
-                 const bool print_paths,
-                 uint64_t *const retained_info_in,
-                 void *const magic_in,
-                 uint64_t *const magic_in_size_in)
+enum macho_file_parse_result
+parse_macho_file_into_info(struct tbd_for_main *const tbd,
+                           const int fd,
+                           void *const magic_in,
+                           uint64_t *const magic_in_size_in)
 {
     uint32_t magic =  *(uint32_t *)magic_in;
 
     const uint64_t magic_in_size = *magic_in_size_in;
     if (magic_in_size < sizeof(uint32_t)) {
         const uint64_t read_size = sizeof(uint32_t) - magic_in_size;
-        if (read(fd, &magic + magic_in_size, read_size) < 0) {
-            if (errno == EOVERFLOW) {
-                return false;
-            }
 
-            /*
-             * Manually handle the read fail by passing on to
-             * handle_macho_file_parse_result() as if we went to
-             * macho_file_parse_from_file().
-             */
+        stats_begin_phase(STATS_PHASE_MAGIC);
+        const ssize_t read_result = read(fd, &magic + magic_in_size, read_size);
+        stats_end_phase();
 
-            handle_macho_file_parse_result(global,
-                                           tbd,
-                                           path,
-                                           E_MACHO_FILE_PARSE_READ_FAIL,
-                                           print_paths,
-                                           retained_info_in);
+        if (read_result < 0) {
+            if (errno == EOVERFLOW) {
+                return E_MACHO_FILE_PARSE_NOT_A_MACHO;
+            }
 
-            return true;
+            return E_MACHO_FILE_PARSE_READ_FAIL;
         }
+
+        stats_add(STATS_COUNTER_BYTES_READ, (uint64_t)read_result);
     }
 
     const uint64_t parse_options = tbd->parse_options;
     const uint64_t macho_options =
         O_MACHO_FILE_PARSE_IGNORE_INVALID_FIELDS | tbd->macho_options;
 
-    struct tbd_create_info *const create_info = &tbd->info;
-    struct tbd_create_info original_info = *create_info;
-
+    stats_begin_phase(STATS_PHASE_LOAD_COMMANDS);
     const enum macho_file_parse_result parse_result =
-        macho_file_parse_from_file(create_info,
+        macho_file_parse_from_file(&tbd->info,
                                    fd,
                                    magic,
                                    parse_options,
                                    macho_options);
 
+    stats_end_phase();
+
     if (parse_result == E_MACHO_FILE_PARSE_NOT_A_MACHO) {
         if (magic_in_size < sizeof(magic)) {
             memcpy(magic_in, &magic, sizeof(magic));
             *magic_in_size_in = sizeof(magic);
         }
+    }
+
+    return parse_result;
+}
+
+/*
+ * Write out the tbd of a mach-o file found while recursing, and record it in
+ * the manifest if recursing incrementally.
+ */
+
+static void
+write_macho_file_tbd(const struct tbd_for_main *const tbd,
+                     struct incremental_manifest *const manifest,
+                     struct macho_dedup *const dedup,
+                     const struct macho_dedup_key *const key,
+                     const char *const path,
+                     char *const write_path,
+                     const uint64_t write_path_length,
+                     const struct stat *const sbuf)
+{
+    const bool wrote_tbd =
+        tbd_for_main_write_to_path(tbd,
+                                   path,
+                                   write_path,
+                                   write_path_length,
+                                   true);
+
+    if (!wrote_tbd) {
+        return;
+    }
+
+    if (manifest != NULL) {
+        incremental_manifest_record(manifest,
+                                    path,
+                                    write_path,
+                                    sbuf,
+                                    &tbd->info.uuids);
+    }
+
+    if (dedup != NULL) {
+        macho_dedup_add(dedup, key, path, write_path, &tbd->info.uuids);
+    }
+}
+
+/*
+ * Copy the tbd of an earlier copy of the mach-o file found while recursing,
+ * instead of parsing the mach-o file again.
+ *
+ * Returns false if no earlier copy was written out, in which case the mach-o
+ * file has to be parsed.
+ */
+
+static bool
+copy_original_tbd(const struct tbd_for_main *const tbd,
+                  struct incremental_manifest *const manifest,
+                  struct macho_dedup *const dedup,
+                  const struct macho_dedup_key *const key,
+                  const char *const path,
+                  const uint64_t path_length,
+                  const struct stat *const sbuf)
+{
+    struct array original_uuids = {};
+    const int source_fd =
+        macho_dedup_open_original_output(dedup, key, &original_uuids);
+
+    if (source_fd < 0) {
+        return false;
+    }
+
+    uint64_t length = 0;
+    char *const write_path =
+        tbd_for_main_create_write_path(tbd,
+                                       tbd->write_path,
+                                       tbd->write_path_length,
+                                       path,
+                                       path_length,
+                                       "tbd",
+                                       3,
+                                       true,
+                                       &length);
+
+    if (write_path == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    char *terminator = NULL;
+    FILE *const file =
+        tbd_for_main_open_write_file(tbd,
+                                     path,
+                                     write_path,
+                                     length,
+                                     true,
+                                     &terminator);
+
+    if (file != NULL) {
+        const bool copied_tbd =
+            tbd_for_main_copy_to_file(tbd,
+                                      path,
+                                      write_path,
+                                      length,
+                                      terminator,
+                                      true,
+                                      source_fd,
+                                      file);
+
+        /*
+         * The mach-o file wasn't parsed, so it's recorded with the uuids of
+         * the original's tbd.
+         */
+
+        if (copied_tbd && manifest != NULL) {
+            incremental_manifest_record(manifest,
+                                        path,
+                                        write_path,
+                                        sbuf,
+                                        &original_uuids);
+        }
+    }
+
+    close(source_fd);
+    free(write_path);
+
+    return true;
+}
+
+bool
+parse_macho_file(struct tbd_for_main *const global,
+                 struct tbd_for_main *const tbd,
+                 const char *const path,
+                 const uint64_t path_length,
+                 const int fd,
+                 const bool print_paths,
+                 uint64_t *const retained_info_in,
+                 void *const magic_in,
+                 uint64_t *const magic_in_size_in)
+{
+    struct tbd_create_info *const create_info = &tbd->info;
+    struct tbd_create_info original_info = *create_info;
+
+    /*
+     * Get the file's information before parsing, so that a file changed while
+     * parsing is seen as changed on the next incremental run.
+     */
+
+    struct incremental_manifest *manifest = tbd->manifest;
+    struct stat sbuf = {};
+
+    if (manifest != NULL) {
+        if (fstat(fd, &sbuf) < 0) {
+            manifest = NULL;
+        }
+    }
+
+    /*
+     * Files that aren't mach-o files are left to be parsed below, so their
+     * magic is still read out for the caller.
+     */
 
+    struct macho_dedup *dedup = tbd->dedup;
+    struct macho_dedup_key key = {};
+
+    if (dedup != NULL) {
+        const enum macho_dedup_result create_key_result =
+            macho_dedup_create_key(fd, &key);
+
+        if (create_key_result != E_MACHO_DEDUP_OK) {
+            dedup = NULL;
+        } else {
+            const bool copied_tbd =
+                copy_original_tbd(tbd,
+                                  manifest,
+                                  dedup,
+                                  &key,
+                                  path,
+                                  path_length,
+                                  &sbuf);
+
+            if (copied_tbd) {
+                macho_dedup_key_destroy(&key);
+                return true;
+            }
+        }
+    }
+
+    const enum macho_file_parse_result parse_result =
+        parse_macho_file_into_info(tbd, fd, magic_in, magic_in_size_in);
+
+    if (parse_result == E_MACHO_FILE_PARSE_NOT_A_MACHO) {
+        macho_dedup_key_destroy(&key);
         return false;
     }
 
@@ -96,7 +271,9 @@ parse_macho_file(struct tbd_for_main *const global,
                                        retained_info_in);
 
     if (!should_continue) {
-        clear_create_info(create_info, &original_info);
+        macho_dedup_key_destroy(&key);
+        tbd_create_info_clear(create_info, &original_info);
+
         return true;
     }
 
@@ -120,7 +297,14 @@ parse_macho_file(struct tbd_for_main *const global,
                 exit(1);
             }
 
-            tbd_for_main_write_to_path(tbd, path, write_path, length, true);
+            write_macho_file_tbd(tbd,
+                                 manifest,
+                                 dedup,
+                                 &key,
+                                 path,
+                                 write_path,
+                                 length,
+                                 &sbuf);
             free(write_path);
         } else {
             tbd_for_main_write_to_path(tbd, path, write_path, length, true);
@@ -129,6 +313,8 @@ parse_macho_file(struct tbd_for_main *const global,
         tbd_for_main_write_to_stdout(tbd, path, true);
     }
 
-    clear_create_info(create_info, &original_info);
+    macho_dedup_key_destroy(&key);
+    tbd_create_info_clear(create_info, &original_info);
+
     return true;
 }
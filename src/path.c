@@ -128,21 +128,13 @@ const char *path_get_next_slash(const char *const path) {
 
 const char *path_get_next_slash_or_end(const char *const path) {
     const char *iter = path;
-    char ch = *iter;
-
-    if (ch == '\0') {
-        return NULL;
-    }
-
-    do {
+    for (char ch = *iter; ch != '\0'; ch = *(++iter)) {
         if (ch_is_path_slash(ch)) {
             return iter;
         }
+    }
 
-        ch = *(++iter);
-    } while (ch != '\0');
-
-    return NULL;
+    return iter;
 }
 
 const char *
@@ -568,15 +560,20 @@ path_has_component(const char *const path,
             }
         }
 
+        /*
+         * The last component has no row of slashes after it to skip over.
+         */
+
+        if (*iter_end == '\0') {
+            return false;
+        }
+
         iter_begin = path_get_end_of_row_of_slashes(iter_end);
         if (iter_begin == NULL) {
-            return NULL;
+            return false;
         }
 
         iter_end = path_get_next_slash_or_end(iter_begin);
-        if (iter_end == NULL) {
-            return NULL;
-        }
     } while (true);
 
     return false;
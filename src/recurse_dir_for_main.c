@@ -0,0 +1,656 @@
+//
+//  src/recurse_dir_for_main.c
+//  tbd
+//
+//  Created by inoahdev on 3/9/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "handle_macho_file_parse_result.h"
+#include "incremental_manifest.h"
+#include "macho_dedup.h"
+#include "ordered_jobs.h"
+
+#include "parse_dsc_for_main.h"
+#include "parse_macho_for_main.h"
+
+#include "recurse_dir_for_main.h"
+#include "stats.h"
+#include "unused.h"
+
+/*
+ * The walking-thread pushes every file it finds onto a bounded queue, which
+ * the workers pop files off of in order. The position of a file in the queue
+ * is its index for ordered_jobs.
+ *
+ * Failures while walking are queued as well, so their errors are printed in
+ * the same order as when recursing on a single thread.
+ */
+
+struct recurse_queue_item {
+    char *path;
+    uint64_t path_length;
+
+    bool is_fail;
+    enum dir_recurse_fail_result fail_result;
+    int fail_errno;
+};
+
+struct recurse_jobs_info {
+    struct tbd_for_main *global;
+    struct tbd_for_main *tbd;
+
+    uint64_t *retained_info;
+
+    void *callback_info;
+    dir_recurse_fail_callback fail_callback;
+
+    pthread_mutex_t queue_mutex;
+    pthread_cond_t queue_cond;
+
+    struct recurse_queue_item *queue;
+    uint64_t queue_capacity;
+
+    uint64_t push_index;
+    uint64_t pop_index;
+
+    bool walking_done;
+    enum dir_recurse_result recurse_result;
+
+    struct ordered_jobs jobs;
+};
+
+struct recurse_worker {
+    struct recurse_jobs_info *jobs_info;
+    struct tbd_for_main tbd;
+
+    uint32_t index;
+};
+
+/*
+ * Give each worker a few files of slack, so a worker finishing a file never
+ * has to wait on the walking-thread, while still bounding the memory used
+ * when walking much faster than files can be parsed.
+ */
+
+static const uint64_t queue_items_per_worker = 4;
+
+static void
+push_item(struct recurse_jobs_info *const jobs_info,
+          const struct recurse_queue_item *const item)
+{
+    pthread_mutex_lock(&jobs_info->queue_mutex);
+
+    const uint64_t capacity = jobs_info->queue_capacity;
+    while (jobs_info->push_index - jobs_info->pop_index == capacity) {
+        pthread_cond_wait(&jobs_info->queue_cond, &jobs_info->queue_mutex);
+    }
+
+    const uint64_t push_index = jobs_info->push_index;
+
+    jobs_info->queue[push_index % capacity] = *item;
+    jobs_info->push_index = push_index + 1;
+
+    pthread_cond_broadcast(&jobs_info->queue_cond);
+    pthread_mutex_unlock(&jobs_info->queue_mutex);
+}
+
+static bool
+pop_item(struct recurse_jobs_info *const jobs_info,
+         struct recurse_queue_item *const item_out,
+         uint64_t *const index_out)
+{
+    pthread_mutex_lock(&jobs_info->queue_mutex);
+
+    while (jobs_info->pop_index == jobs_info->push_index) {
+        if (jobs_info->walking_done) {
+            pthread_mutex_unlock(&jobs_info->queue_mutex);
+            return false;
+        }
+
+        pthread_cond_wait(&jobs_info->queue_cond, &jobs_info->queue_mutex);
+    }
+
+    const uint64_t pop_index = jobs_info->pop_index;
+    const uint64_t capacity = jobs_info->queue_capacity;
+
+    *item_out = jobs_info->queue[pop_index % capacity];
+    *index_out = pop_index;
+
+    jobs_info->pop_index = pop_index + 1;
+
+    pthread_cond_broadcast(&jobs_info->queue_cond);
+    pthread_mutex_unlock(&jobs_info->queue_mutex);
+
+    return true;
+}
+
+static char *copy_path(const char *const path, const uint64_t length) {
+    if (path == NULL) {
+        return NULL;
+    }
+
+    char *const copy = malloc(length + 1);
+    if (copy == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    memcpy(copy, path, length);
+    copy[length] = '\0';
+
+    return copy;
+}
+
+static bool
+push_file_callback(const char *const path,
+                   const uint64_t length,
+                   __unused struct dirent *const dirent,
+                   void *const callback_info)
+{
+    const struct recurse_queue_item item = {
+        .path = copy_path(path, length),
+        .path_length = length
+    };
+
+    push_item((struct recurse_jobs_info *)callback_info, &item);
+    return true;
+}
+
+static bool
+push_fail_callback(const char *const path,
+                   const uint64_t length,
+                   const enum dir_recurse_fail_result result,
+                   __unused struct dirent *const dirent,
+                   void *const callback_info)
+{
+    const int fail_errno = errno;
+    const struct recurse_queue_item item = {
+        .path = copy_path(path, length),
+        .path_length = length,
+        .is_fail = true,
+        .fail_result = result,
+        .fail_errno = fail_errno
+    };
+
+    push_item((struct recurse_jobs_info *)callback_info, &item);
+    return true;
+}
+
+static void *recurse_walker_routine(void *const item) {
+    struct recurse_jobs_info *const jobs_info =
+        (struct recurse_jobs_info *)item;
+    const struct tbd_for_main *const tbd = jobs_info->tbd;
+
+    stats_begin_phase(STATS_PHASE_WALK);
+    jobs_info->recurse_result =
+        dir_recurse(tbd->parse_path,
+                    tbd->parse_path_length,
+                    tbd->options & O_TBD_FOR_MAIN_RECURSE_SUBDIRECTORIES,
+                    jobs_info,
+                    push_file_callback,
+                    push_fail_callback);
+
+    stats_end_phase();
+
+    pthread_mutex_lock(&jobs_info->queue_mutex);
+
+    jobs_info->walking_done = true;
+    pthread_cond_broadcast(&jobs_info->queue_cond);
+
+    pthread_mutex_unlock(&jobs_info->queue_mutex);
+    return NULL;
+}
+
+/*
+ * Open the output-file of a mach-o file. If writing to an archive, the file's
+ * tbd is instead added to the archive here, in the file's turn, and NULL is
+ * returned.
+ *
+ * This must only be called in the worker's turn for the file.
+ */
+
+static FILE *
+open_write_file_in_turn(struct recurse_worker *const worker,
+                        const struct recurse_queue_item *const item,
+                        char **const write_path_out,
+                        uint64_t *const write_path_length_out,
+                        char **const terminator_out)
+{
+    struct tbd_for_main *const tbd = &worker->tbd;
+
+    uint64_t length = 0;
+    char *const write_path =
+        tbd_for_main_create_write_path(tbd,
+                                       tbd->write_path,
+                                       tbd->write_path_length,
+                                       item->path,
+                                       item->path_length,
+                                       "tbd",
+                                       3,
+                                       true,
+                                       &length);
+
+    if (write_path == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    *write_path_out = write_path;
+    *write_path_length_out = length;
+
+    if (tbd->archive != NULL) {
+        tbd_for_main_write_to_path(tbd, item->path, write_path, length, true);
+        return NULL;
+    }
+
+    struct ordered_jobs *const jobs = &worker->jobs_info->jobs;
+    ordered_jobs_set_write_path(jobs, worker->index, write_path);
+
+    FILE *const file =
+        tbd_for_main_open_write_file(tbd,
+                                     item->path,
+                                     write_path,
+                                     length,
+                                     true,
+                                     terminator_out);
+
+    if (file == NULL) {
+        ordered_jobs_set_write_path(jobs, worker->index, NULL);
+    }
+
+    return file;
+}
+
+/*
+ * Handle the parse-result of a mach-o file, and open its output-file.
+ *
+ * This must only be called in the worker's turn for the file.
+ */
+
+static FILE *
+handle_macho_file_in_turn(struct recurse_worker *const worker,
+                          const struct recurse_queue_item *const item,
+                          const enum macho_file_parse_result parse_result,
+                          char **const write_path_out,
+                          uint64_t *const write_path_length_out,
+                          char **const terminator_out)
+{
+    struct recurse_jobs_info *const jobs_info = worker->jobs_info;
+
+    struct tbd_for_main *const tbd = &worker->tbd;
+    struct tbd_for_main *const shared_tbd = jobs_info->tbd;
+
+    /*
+     * Requests made for the file may change the tbd's parse-options, which
+     * have to be shared by all workers.
+     */
+
+    tbd->parse_options = shared_tbd->parse_options;
+
+    const bool should_continue =
+        handle_macho_file_parse_result(jobs_info->global,
+                                       tbd,
+                                       item->path,
+                                       parse_result,
+                                       true,
+                                       jobs_info->retained_info);
+
+    shared_tbd->parse_options = tbd->parse_options;
+    if (!should_continue) {
+        return NULL;
+    }
+
+    return open_write_file_in_turn(worker,
+                                   item,
+                                   write_path_out,
+                                   write_path_length_out,
+                                   terminator_out);
+}
+
+static void
+handle_file(struct recurse_worker *const worker,
+            const struct recurse_queue_item *const item,
+            const uint64_t index)
+{
+    struct recurse_jobs_info *const jobs_info = worker->jobs_info;
+    struct ordered_jobs *const jobs = &jobs_info->jobs;
+
+    struct tbd_for_main *const tbd = &worker->tbd;
+    const struct tbd_create_info original_info = tbd->info;
+
+    const uint64_t options = tbd->options;
+
+    /*
+     * Skip opening files that haven't changed since they were last written out
+     * when recursing incrementally. The file's turn still has to be taken and
+     * ended below.
+     */
+
+    struct incremental_manifest *const manifest = tbd->manifest;
+
+    struct stat sbuf = {};
+    bool is_unchanged = false;
+
+    if (manifest != NULL) {
+        if (stat(item->path, &sbuf) == 0) {
+            is_unchanged =
+                incremental_manifest_is_unchanged(manifest, item->path, &sbuf);
+        }
+    }
+
+    int fd = -1;
+    int open_errno = 0;
+
+    if (!is_unchanged) {
+        fd = open(item->path, O_RDONLY);
+        open_errno = errno;
+    }
+
+    /*
+     * Keep a buffer for magic around to use.
+     */
+
+    char magic[16] = {};
+    uint64_t magic_size = 0;
+
+    /*
+     * Only parsing the file as a mach-o file is done outside of the file's
+     * turn. dyld_shared_cache files are rare enough while recursing to be
+     * simply parsed in the file's turn, with the images themselves extracted
+     * in parallel if needed.
+     */
+
+    enum macho_file_parse_result parse_result = E_MACHO_FILE_PARSE_NOT_A_MACHO;
+    const bool parse_as_macho =
+        tbd->filetype != TBD_FOR_MAIN_FILETYPE_DYLD_SHARED_CACHE;
+
+    /*
+     * A mach-o file whose earlier copy was already written out isn't parsed,
+     * and has the earlier copy's tbd copied over instead.
+     */
+
+    struct macho_dedup *dedup = tbd->dedup;
+    struct macho_dedup_key key = {};
+
+    struct array original_uuids = {};
+    int source_fd = -1;
+
+    if (fd >= 0 && parse_as_macho) {
+        if (dedup != NULL) {
+            const enum macho_dedup_result create_key_result =
+                macho_dedup_create_key(fd, &key);
+
+            if (create_key_result == E_MACHO_DEDUP_OK) {
+                source_fd =
+                    macho_dedup_open_original_output(dedup,
+                                                     &key,
+                                                     &original_uuids);
+            } else {
+                dedup = NULL;
+            }
+        }
+
+        if (source_fd < 0) {
+            parse_result =
+                parse_macho_file_into_info(tbd, fd, &magic, &magic_size);
+        }
+    }
+
+    FILE *file = NULL;
+
+    char *write_path = NULL;
+    char *terminator = NULL;
+    uint64_t write_path_length = 0;
+
+    ordered_jobs_wait_for_turn(jobs, index);
+
+    if (fd < 0) {
+        if (!is_unchanged && !(options & O_TBD_FOR_MAIN_IGNORE_WARNINGS)) {
+            fprintf(stderr,
+                    "Warning: Failed to open file (at path %s), error: %s\n",
+                    item->path,
+                    strerror(open_errno));
+        }
+
+        stats_add(STATS_COUNTER_FILES_SKIPPED, 1);
+    } else if (source_fd >= 0) {
+        file =
+            open_write_file_in_turn(worker,
+                                    item,
+                                    &write_path,
+                                    &write_path_length,
+                                    &terminator);
+    } else if (parse_result != E_MACHO_FILE_PARSE_NOT_A_MACHO) {
+        file =
+            handle_macho_file_in_turn(worker,
+                                      item,
+                                      parse_result,
+                                      &write_path,
+                                      &write_path_length,
+                                      &terminator);
+    } else if (options & O_TBD_FOR_MAIN_RECURSE_INCLUDE_DSC) {
+        const bool parse_as_dsc_result =
+            parse_shared_cache(jobs_info->global,
+                               jobs_info->tbd,
+                               item->path,
+                               item->path_length,
+                               fd,
+                               true,
+                               true,
+                               jobs_info->retained_info,
+                               &magic,
+                               &magic_size);
+
+        if (!parse_as_dsc_result) {
+            stats_add(STATS_COUNTER_FILES_SKIPPED, 1);
+        }
+    } else {
+        stats_add(STATS_COUNTER_FILES_SKIPPED, 1);
+    }
+
+    ordered_jobs_end_turn(jobs);
+
+    if (file != NULL) {
+        bool wrote_tbd = false;
+        if (source_fd >= 0) {
+            wrote_tbd =
+                tbd_for_main_copy_to_file(tbd,
+                                          item->path,
+                                          write_path,
+                                          write_path_length,
+                                          terminator,
+                                          true,
+                                          source_fd,
+                                          file);
+        } else {
+            wrote_tbd =
+                tbd_for_main_write_to_file(tbd,
+                                           item->path,
+                                           write_path,
+                                           write_path_length,
+                                           terminator,
+                                           true,
+                                           file);
+        }
+
+        ordered_jobs_set_write_path(jobs, worker->index, NULL);
+
+        /*
+         * A copied tbd's mach-o file wasn't parsed, so it's recorded with the
+         * uuids of the original's tbd.
+         */
+
+        const struct array *uuids = &tbd->info.uuids;
+        if (source_fd >= 0) {
+            uuids = &original_uuids;
+        }
+
+        if (wrote_tbd && manifest != NULL) {
+            incremental_manifest_record(manifest,
+                                        item->path,
+                                        write_path,
+                                        &sbuf,
+                                        uuids);
+        }
+
+        if (wrote_tbd && dedup != NULL) {
+            macho_dedup_add(dedup, &key, item->path, write_path, uuids);
+        }
+    }
+
+    if (source_fd >= 0) {
+        close(source_fd);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    macho_dedup_key_destroy(&key);
+
+    free(write_path);
+    tbd_create_info_clear(&tbd->info, &original_info);
+}
+
+static void *recurse_worker_routine(void *const item) {
+    struct recurse_worker *const worker = (struct recurse_worker *)item;
+    struct recurse_jobs_info *const jobs_info = worker->jobs_info;
+
+    struct recurse_queue_item queue_item = {};
+    uint64_t index = 0;
+
+    while (pop_item(jobs_info, &queue_item, &index)) {
+        if (queue_item.is_fail) {
+            ordered_jobs_wait_for_turn(&jobs_info->jobs, index);
+
+            errno = queue_item.fail_errno;
+            jobs_info->fail_callback(queue_item.path,
+                                     queue_item.path_length,
+                                     queue_item.fail_result,
+                                     NULL,
+                                     jobs_info->callback_info);
+
+            ordered_jobs_end_turn(&jobs_info->jobs);
+        } else {
+            stats_add(STATS_COUNTER_FILES_SEEN, 1);
+            stats_begin_phase(STATS_PHASE_OTHER);
+
+            handle_file(worker, &queue_item, index);
+            stats_end_phase();
+        }
+
+        free(queue_item.path);
+    }
+
+    return NULL;
+}
+
+enum dir_recurse_result
+recurse_directory_with_jobs(struct tbd_for_main *const global,
+                            struct tbd_for_main *const tbd,
+                            uint64_t *const retained_info_in,
+                            void *const callback_info,
+                            const dir_recurse_callback callback,
+                            const dir_recurse_fail_callback fail_callback)
+{
+    const uint32_t workers_count = tbd->jobs;
+    const uint64_t queue_capacity = workers_count * queue_items_per_worker;
+
+    struct recurse_worker *const workers =
+        calloc(workers_count, sizeof(struct recurse_worker));
+
+    struct recurse_queue_item *const queue =
+        calloc(queue_capacity, sizeof(struct recurse_queue_item));
+
+    if (workers == NULL || queue == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    struct recurse_jobs_info jobs_info = {
+        .global = global,
+        .tbd = tbd,
+        .retained_info = retained_info_in,
+        .callback_info = callback_info,
+        .fail_callback = fail_callback,
+        .queue = queue,
+        .queue_capacity = queue_capacity,
+        .recurse_result = E_DIR_RECURSE_OK
+    };
+
+    if (ordered_jobs_init(&jobs_info.jobs, workers_count)) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    pthread_mutex_init(&jobs_info.queue_mutex, NULL);
+    pthread_cond_init(&jobs_info.queue_cond, NULL);
+
+    pthread_t walker;
+    if (pthread_create(&walker, NULL, recurse_walker_routine, &jobs_info)) {
+        pthread_cond_destroy(&jobs_info.queue_cond);
+        pthread_mutex_destroy(&jobs_info.queue_mutex);
+
+        ordered_jobs_destroy(&jobs_info.jobs);
+
+        free(queue);
+        free(workers);
+
+        stats_begin_phase(STATS_PHASE_WALK);
+        const enum dir_recurse_result recurse_result =
+            dir_recurse(tbd->parse_path,
+                        tbd->parse_path_length,
+                        tbd->options & O_TBD_FOR_MAIN_RECURSE_SUBDIRECTORIES,
+                        callback_info,
+                        callback,
+                        fail_callback);
+
+        stats_end_phase();
+        return recurse_result;
+    }
+
+    /*
+     * Each worker gets a shallow copy of the tbd, with the create-info acting
+     * as a template for the create-info of each file, but with its own arena.
+     */
+
+    for (uint32_t i = 0; i != workers_count; i++) {
+        struct recurse_worker *const worker = workers + i;
+
+        worker->jobs_info = &jobs_info;
+        worker->tbd = *tbd;
+        worker->tbd.info.arena = (struct arena){};
+        worker->index = i;
+    }
+
+    ordered_jobs_run(workers,
+                     sizeof(struct recurse_worker),
+                     workers_count,
+                     recurse_worker_routine);
+
+    pthread_join(walker, NULL);
+
+    for (uint32_t i = 0; i != workers_count; i++) {
+        arena_destroy(&workers[i].tbd.info.arena);
+    }
+
+    pthread_cond_destroy(&jobs_info.queue_cond);
+    pthread_mutex_destroy(&jobs_info.queue_mutex);
+
+    ordered_jobs_destroy(&jobs_info.jobs);
+
+    free(queue);
+    free(workers);
+
+    return jobs_info.recurse_result;
+}
@@ -139,11 +139,17 @@ request_install_name(struct tbd_for_main *const global,
                   (char **)&tbd->info.install_name);
 
     tbd->parse_options |= O_TBD_PARSE_IGNORE_INSTALL_NAME;
-    tbd->info.flags |= F_TBD_CREATE_INFO_STRINGS_WERE_COPIED;
+
+    /*
+     * When used for all files, the install-name is handed to global, and is
+     * kept around for the rest of the run, as every later file points to it.
+     */
 
     if (strcmp(should_replace, "for all") == 0) {
         global->info.install_name = tbd->info.install_name;
         global->parse_options |= O_TBD_PARSE_IGNORE_INSTALL_NAME;
+    } else {
+        tbd->info.flags |= F_TBD_CREATE_INFO_INSTALL_NAME_WAS_COPIED;
     }
 
     free(should_replace);
@@ -310,11 +316,17 @@ request_parent_umbrella(struct tbd_for_main *const global,
                   (char **)&tbd->info.parent_umbrella);
 
     tbd->parse_options |= O_TBD_PARSE_IGNORE_PARENT_UMBRELLA;
-    tbd->info.flags |= F_TBD_CREATE_INFO_STRINGS_WERE_COPIED;
+
+    /*
+     * When used for all files, the parent-umbrella is handed to global, and is
+     * kept around for the rest of the run, as every later file points to it.
+     */
 
     if (strcmp(should_replace, "for all") == 0) {
         global->info.parent_umbrella = tbd->info.parent_umbrella;
         global->parse_options |= O_TBD_PARSE_IGNORE_PARENT_UMBRELLA;
+    } else {
+        tbd->info.flags |= F_TBD_CREATE_INFO_PARENT_UMBRELLA_WAS_COPIED;
     }
 
     free(should_replace);
@@ -0,0 +1,337 @@
+//
+//  src/stats.c
+//  tbd
+//
+//  Created by inoahdev on 3/25/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <sys/resource.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stats.h"
+
+/*
+ * Phases nest only a few levels deep, but deeper nesting is still handled by
+ * counting the excess time towards the deepest phase stored.
+ */
+
+#define STATS_PHASE_STACK_SIZE 16
+
+/*
+ * Reading a thread's cpu-time takes a system call on most platforms, which is
+ * far too slow to do on every phase-change, as a phase may only last for a few
+ * microseconds.
+ *
+ * Instead, time spent in a phase is first counted as cpu-time as well, and the
+ * thread's actual cpu-time is only read once this much wall-time has passed
+ * since it was last read. Any time the thread wasn't running on a cpu is then
+ * taken back from the phase the thread is leaving, which bounds the cost of
+ * reading cpu-time to well under a percent.
+ */
+
+#define STATS_CPU_READ_INTERVAL_NS 50000
+
+struct stats_phase_times {
+    uint64_t calls;
+
+    uint64_t wall_ns;
+    uint64_t cpu_ns;
+};
+
+struct stats_thread {
+    uint64_t counters[STATS_COUNTER_COUNT];
+    struct stats_phase_times phases[STATS_PHASE_COUNT];
+
+    enum stats_phase stack[STATS_PHASE_STACK_SIZE];
+    uint32_t depth;
+
+    /*
+     * The wall-time the current phase was last entered or returned to.
+     */
+
+    uint64_t last_wall_ns;
+
+    /*
+     * The wall-time and cpu-time of when cpu-time was last read, and the time
+     * counted as cpu-time since then.
+     */
+
+    uint64_t cpu_read_wall_ns;
+    uint64_t cpu_read_ns;
+    uint64_t unread_cpu_ns;
+
+    struct stats_thread *next;
+};
+
+static const char *const phase_names[STATS_PHASE_COUNT] = {
+    [STATS_PHASE_WALK] = "directory walk",
+    [STATS_PHASE_MAGIC] = "magic sniffing",
+    [STATS_PHASE_LOAD_COMMANDS] = "load-command parsing",
+    [STATS_PHASE_SYMBOLS] = "symbol parsing",
+    [STATS_PHASE_SORT_EXPORTS] = "export sorting",
+    [STATS_PHASE_RENDER] = "yaml rendering",
+    [STATS_PHASE_OPEN_OUTPUT] = "output-file creation",
+    [STATS_PHASE_WRITE_OUTPUT] = "output writing",
+    [STATS_PHASE_OTHER] = "other"
+};
+
+static const char *const counter_names[STATS_COUNTER_COUNT] = {
+    [STATS_COUNTER_FILES_SEEN] = "files seen",
+    [STATS_COUNTER_FILES_SKIPPED] = "files skipped",
+    [STATS_COUNTER_TBDS_WRITTEN] = "tbds written",
+    [STATS_COUNTER_SYMBOLS_SCANNED] = "symbols scanned",
+    [STATS_COUNTER_SYMBOLS_KEPT] = "symbols kept",
+    [STATS_COUNTER_BYTES_READ] = "bytes read",
+    [STATS_COUNTER_BYTES_MAPPED] = "bytes mapped",
+    [STATS_COUNTER_ALLOCATIONS] = "allocations"
+};
+
+/*
+ * enabled is only ever set before any other threads are created, so it can
+ * be read without any locking.
+ */
+
+static bool enabled = false;
+static uint64_t start_wall_ns = 0;
+
+static pthread_mutex_t threads_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct stats_thread *threads = NULL;
+
+static __thread struct stats_thread *current_thread = NULL;
+
+static uint64_t get_time_ns(const clockid_t clock) {
+    struct timespec spec = {};
+    clock_gettime(clock, &spec);
+
+    return (uint64_t)spec.tv_sec * 1000000000 + (uint64_t)spec.tv_nsec;
+}
+
+static struct stats_thread *get_current_thread(void) {
+    struct stats_thread *thread = current_thread;
+    if (thread != NULL) {
+        return thread;
+    }
+
+    thread = calloc(1, sizeof(struct stats_thread));
+    if (thread == NULL) {
+        fputs("Failed to allocate memory\n", stderr);
+        exit(1);
+    }
+
+    pthread_mutex_lock(&threads_mutex);
+
+    thread->next = threads;
+    threads = thread;
+
+    pthread_mutex_unlock(&threads_mutex);
+
+    current_thread = thread;
+    return thread;
+}
+
+void stats_enable(void) {
+    enabled = true;
+    start_wall_ns = get_time_ns(CLOCK_MONOTONIC);
+}
+
+void stats_add(const enum stats_counter counter, const uint64_t amount) {
+    if (!enabled) {
+        return;
+    }
+
+    get_current_thread()->counters[counter] += amount;
+}
+
+/*
+ * Count the time since the last phase-change towards the current phase.
+ */
+
+static void
+charge_current_phase(struct stats_thread *const thread, const uint64_t wall_ns)
+{
+    struct stats_phase_times *times = NULL;
+
+    uint32_t depth = thread->depth;
+    if (depth != 0) {
+        if (depth > STATS_PHASE_STACK_SIZE) {
+            depth = STATS_PHASE_STACK_SIZE;
+        }
+
+        times = thread->phases + thread->stack[depth - 1];
+
+        const uint64_t elapsed_ns = wall_ns - thread->last_wall_ns;
+
+        times->wall_ns += elapsed_ns;
+        times->cpu_ns += elapsed_ns;
+
+        thread->unread_cpu_ns += elapsed_ns;
+    }
+
+    thread->last_wall_ns = wall_ns;
+    if (wall_ns - thread->cpu_read_wall_ns < STATS_CPU_READ_INTERVAL_NS) {
+        return;
+    }
+
+    const uint64_t cpu_ns = get_time_ns(CLOCK_THREAD_CPUTIME_ID);
+    const uint64_t used_cpu_ns = cpu_ns - thread->cpu_read_ns;
+
+    if (times != NULL && used_cpu_ns < thread->unread_cpu_ns) {
+        uint64_t idle_ns = thread->unread_cpu_ns - used_cpu_ns;
+        if (idle_ns > times->cpu_ns) {
+            idle_ns = times->cpu_ns;
+        }
+
+        times->cpu_ns -= idle_ns;
+    }
+
+    thread->cpu_read_wall_ns = wall_ns;
+    thread->cpu_read_ns = cpu_ns;
+    thread->unread_cpu_ns = 0;
+}
+
+void stats_begin_phase(const enum stats_phase phase) {
+    if (!enabled) {
+        return;
+    }
+
+    struct stats_thread *const thread = get_current_thread();
+    charge_current_phase(thread, get_time_ns(CLOCK_MONOTONIC));
+
+    const uint32_t depth = thread->depth;
+    if (depth < STATS_PHASE_STACK_SIZE) {
+        thread->stack[depth] = phase;
+    }
+
+    thread->depth = depth + 1;
+    thread->phases[phase].calls += 1;
+}
+
+void stats_end_phase(void) {
+    if (!enabled) {
+        return;
+    }
+
+    struct stats_thread *const thread = get_current_thread();
+    if (thread->depth == 0) {
+        return;
+    }
+
+    charge_current_phase(thread, get_time_ns(CLOCK_MONOTONIC));
+    thread->depth -= 1;
+}
+
+static double ns_to_ms(const uint64_t ns) {
+    return (double)ns / 1000000;
+}
+
+static uint64_t timeval_to_ns(const struct timeval time) {
+    return (uint64_t)time.tv_sec * 1000000000 + (uint64_t)time.tv_usec * 1000;
+}
+
+void stats_print(FILE *const file) {
+    if (!enabled) {
+        return;
+    }
+
+    uint64_t counters[STATS_COUNTER_COUNT] = {};
+    struct stats_phase_times phases[STATS_PHASE_COUNT] = {};
+
+    uint64_t threads_count = 0;
+
+    pthread_mutex_lock(&threads_mutex);
+
+    const struct stats_thread *thread = threads;
+    for (; thread != NULL; thread = thread->next) {
+        for (uint32_t i = 0; i != STATS_COUNTER_COUNT; i++) {
+            counters[i] += thread->counters[i];
+        }
+
+        for (uint32_t i = 0; i != STATS_PHASE_COUNT; i++) {
+            phases[i].calls += thread->phases[i].calls;
+            phases[i].wall_ns += thread->phases[i].wall_ns;
+            phases[i].cpu_ns += thread->phases[i].cpu_ns;
+        }
+
+        threads_count++;
+    }
+
+    pthread_mutex_unlock(&threads_mutex);
+
+    const uint64_t wall_ns = get_time_ns(CLOCK_MONOTONIC) - start_wall_ns;
+
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+
+    const uint64_t cpu_ns =
+        timeval_to_ns(usage.ru_utime) + timeval_to_ns(usage.ru_stime);
+
+    fputs("\nStatistics:\n", file);
+    fprintf(file,
+            "    %-24s %12s %14s %14s\n",
+            "Phase",
+            "Calls",
+            "Wall (ms)",
+            "CPU (ms)");
+
+    for (uint32_t i = 0; i != STATS_PHASE_COUNT; i++) {
+        const struct stats_phase_times *const times = phases + i;
+        if (times->calls == 0) {
+            continue;
+        }
+
+        fprintf(file,
+                "    %-24s %12llu %14.3f %14.3f\n",
+                phase_names[i],
+                (unsigned long long)times->calls,
+                ns_to_ms(times->wall_ns),
+                ns_to_ms(times->cpu_ns));
+    }
+
+    fprintf(file,
+            "    %-24s %12s %14.3f %14.3f\n",
+            "total (process)",
+            "",
+            ns_to_ms(wall_ns),
+            ns_to_ms(cpu_ns));
+
+    /*
+     * With multiple threads, the time of each phase is summed up across all
+     * threads, and wall-times include time spent waiting on other threads.
+     */
+
+    if (threads_count > 1) {
+        fprintf(file,
+                "    (phase times are summed across %llu threads)\n",
+                (unsigned long long)threads_count);
+    }
+
+    fputc('\n', file);
+
+    for (uint32_t i = 0; i != STATS_COUNTER_COUNT; i++) {
+        fprintf(file,
+                "    %-24s %12llu\n",
+                counter_names[i],
+                (unsigned long long)counters[i]);
+    }
+}
+
+void stats_destroy(void) {
+    pthread_mutex_lock(&threads_mutex);
+
+    struct stats_thread *thread = threads;
+    while (thread != NULL) {
+        struct stats_thread *const next = thread->next;
+
+        free(thread);
+        thread = next;
+    }
+
+    threads = NULL;
+    pthread_mutex_unlock(&threads_mutex);
+
+    current_thread = NULL;
+}
@@ -10,8 +10,10 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "stats.h"
 #include "tbd.h"
-#include "tbd_write.h"
+#include "tbd_write_buffer.h"
+#include "yaml.h"
 
 /*
  * Have the symbols array be sorted first into groups of matching arch-lists.
@@ -163,104 +165,288 @@ tbd_uuid_info_comparator(const void *const array_item, const void *const item) {
     return 0;
 }
 
+struct export_info_key {
+    const struct tbd_export_info *exports;
+    const struct tbd_export_info *info;
+};
+
+static bool export_info_matches(const void *const info, const uint32_t index) {
+    const struct export_info_key *const key = info;
+    const struct tbd_export_info *const export_info = key->info;
+    const struct tbd_export_info *const existing_info = key->exports + index;
+
+    if (existing_info->type != export_info->type) {
+        return false;
+    }
+
+    const uint32_t length = export_info->length;
+    if (existing_info->length != length) {
+        return false;
+    }
+
+    return memcmp(existing_info->string, export_info->string, length) == 0;
+}
+
+enum tbd_add_export_result
+tbd_create_info_add_export(struct tbd_create_info *const info,
+                           const struct tbd_export_info *const export_info,
+                           const bool copy_string)
+{
+    struct hash_table *const index = &info->export_index;
+    const uint64_t capacity = index->capacity;
+
+    if (!hash_table_reserve(index, index->count + 1)) {
+        return E_TBD_ADD_EXPORT_ALLOC_FAIL;
+    }
+
+    if (index->capacity != capacity) {
+        stats_add(STATS_COUNTER_ALLOCATIONS, 1);
+    }
+
+    /*
+     * The type is mixed into the hash, as the same string may be exported as
+     * multiple types.
+     */
+
+    const char *const string = export_info->string;
+    const uint32_t length = export_info->length;
+    const uint32_t basis = HASH_STRING_BASIS ^ (uint32_t)export_info->type;
+    const uint32_t hash = hash_string_with_basis(basis, string, length);
+
+    struct tbd_export_info *const exports = info->exports.data;
+    const struct export_info_key key = {
+        .exports = exports,
+        .info = export_info
+    };
+
+    struct hash_table_slot *const slot =
+        hash_table_find_slot(index, hash, export_info_matches, &key);
+
+    if (slot->index != 0) {
+        struct tbd_export_info *const existing_info =
+            exports + (slot->index - 1);
+
+        /*
+         * Ensure multiple exports for the same arch (which we, for sake of
+         * leniency, ignore) are ignored.
+         */
+
+        const uint64_t archs = existing_info->archs;
+        if (!(archs & export_info->archs)) {
+            existing_info->archs = archs | export_info->archs;
+            existing_info->archs_count += 1;
+        }
+
+        return E_TBD_ADD_EXPORT_OK;
+    }
+
+    struct tbd_export_info new_info = *export_info;
+
+    /*
+     * Unless the provided string outlives the create-info (and can therefore be
+     * borrowed), it comes from a large buffer that will soon be freed, so a
+     * copy is needed before placing it in the list.
+     */
+
+    if (copy_string) {
+        new_info.string = arena_copy_string(&info->arena, string, length);
+        if (new_info.string == NULL) {
+            return E_TBD_ADD_EXPORT_ALLOC_FAIL;
+        }
+    }
+
+    const enum array_result add_export_info_result =
+        array_add_item(&info->exports, sizeof(new_info), &new_info, NULL);
+
+    if (add_export_info_result != E_ARRAY_OK) {
+        return E_TBD_ADD_EXPORT_ARRAY_FAIL;
+    }
+
+    const uint64_t count =
+        array_get_item_count(&info->exports, sizeof(new_info));
+
+    hash_table_set_slot(index, slot, hash, (uint32_t)count - 1);
+
+    return E_TBD_ADD_EXPORT_OK;
+}
+
+enum array_result
+tbd_create_info_sort_exports(struct tbd_create_info *const info) {
+    /*
+     * The export-index stores indexes into the exports-array, and is therefore
+     * no longer valid once the array is sorted.
+     */
+
+    hash_table_destroy(&info->export_index);
+    stats_begin_phase(STATS_PHASE_SORT_EXPORTS);
+
+    const enum array_result sort_exports_result =
+        array_sort_items_with_comparator(&info->exports,
+                                         sizeof(struct tbd_export_info),
+                                         tbd_export_info_comparator);
+
+    if (sort_exports_result != E_ARRAY_OK) {
+        stats_end_phase();
+        return sort_exports_result;
+    }
+
+    /*
+     * Check which export-strings need quotes all at once here, rather than
+     * when each export is added, as by now every duplicate export has been
+     * merged, and the strings are visited in order.
+     */
+
+    struct tbd_export_info *export_info = info->exports.data;
+    const struct tbd_export_info *const end = info->exports.data_end;
+
+    for (; export_info != end; export_info++) {
+        if (yaml_check_c_str(export_info->string, export_info->length)) {
+            export_info->flags |= F_TBD_EXPORT_INFO_STRING_NEEDS_QUOTES;
+        }
+    }
+
+    stats_end_phase();
+    return E_ARRAY_OK;
+}
+
 enum tbd_create_result
-tbd_create_with_info(const struct tbd_create_info *const info,
-                     FILE *const file,
-                     const uint64_t options)
+tbd_create_with_info_to_buffer(const struct tbd_create_info *const info,
+                               struct tbd_write_buffer *const buffer,
+                               const uint64_t options)
 {
     const enum tbd_version version = info->version;
-    if (tbd_write_magic(file, version)) {
+    if (tbd_write_magic_to_buffer(buffer, version)) {
         return E_TBD_CREATE_WRITE_FAIL;
     }
 
-    if (tbd_write_header_archs(file, info->archs)) {
+    if (tbd_write_header_archs_to_buffer(buffer, info->archs)) {
         return E_TBD_CREATE_WRITE_FAIL;
     }
 
     if (!(options & O_TBD_CREATE_IGNORE_UUIDS)) {
         if (version != TBD_VERSION_V1) {
-            if (tbd_write_uuids(file, &info->uuids)) {
+            if (tbd_write_uuids_to_buffer(buffer, &info->uuids)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
     }
 
-    if (tbd_write_platform(file, info->platform)) {
+    if (tbd_write_platform_to_buffer(buffer, info->platform)) {
         return E_TBD_CREATE_WRITE_FAIL;
     }
-    
+
     if (version != TBD_VERSION_V1) {
         if (!(options & O_TBD_CREATE_IGNORE_FLAGS)) {
-            if (tbd_write_flags(file, info->flags_field)) {
+            if (tbd_write_flags_to_buffer(buffer, info->flags_field)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
     }
 
-    if (tbd_write_install_name(file, info)) {
+    if (tbd_write_install_name_to_buffer(buffer, info)) {
         return E_TBD_CREATE_WRITE_FAIL;
     }
 
     if (!(options & O_TBD_CREATE_IGNORE_CURRENT_VERSION)) {
-        if (tbd_write_current_version(file, info->current_version)) {
+        const uint32_t current_version = info->current_version;
+        if (tbd_write_current_version_to_buffer(buffer, current_version)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
 
     if (!(options & O_TBD_CREATE_IGNORE_COMPATIBILITY_VERSION)) {
         const uint32_t compatibility_version = info->compatibility_version;
-        if (tbd_write_compatibility_version(file, compatibility_version)) {
+        if (tbd_write_compatibility_version_to_buffer(buffer,
+                                                      compatibility_version))
+        {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
 
     if (version != TBD_VERSION_V1) {
         if (!(options & O_TBD_CREATE_IGNORE_SWIFT_VERSION)) {
-            if (tbd_write_swift_version(file, version, info->swift_version)) {
+            const uint32_t swift_version = info->swift_version;
+            if (tbd_write_swift_version_to_buffer(buffer,
+                                                  version,
+                                                  swift_version))
+            {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
 
         if (!(options & O_TBD_CREATE_IGNORE_OBJC_CONSTRAINT)) {
-            if (tbd_write_objc_constraint(file, info->objc_constraint)) {
+            const enum tbd_objc_constraint constraint = info->objc_constraint;
+            if (tbd_write_objc_constraint_to_buffer(buffer, constraint)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
 
         if (!(options & O_TBD_CREATE_IGNORE_PARENT_UMBRELLA)) {
-            if (tbd_write_parent_umbrella(file, info)) {
+            if (tbd_write_parent_umbrella_to_buffer(buffer, info)) {
                 return E_TBD_CREATE_WRITE_FAIL;
             }
         }
     }
 
     if (!(options & O_TBD_CREATE_IGNORE_EXPORTS)) {
-        if (tbd_write_exports(file, &info->exports, version)) {
+        if (tbd_write_exports_to_buffer(buffer, &info->exports, version)) {
             return E_TBD_CREATE_WRITE_FAIL;
         }
     }
 
-    if (tbd_write_footer(file)) {
+    if (tbd_write_footer_to_buffer(buffer)) {
         return E_TBD_CREATE_WRITE_FAIL;
     }
 
     return E_TBD_CREATE_OK;
 }
 
-static void destroy_exports_array(struct array *const list) {
-    struct tbd_export_info *info = list->data;
-    const struct tbd_export_info *const end = list->data_end;
+enum tbd_create_result
+tbd_create_with_info(const struct tbd_create_info *const info,
+                     FILE *const file,
+                     const uint64_t options)
+{
+    struct tbd_write_buffer buffer = {};
+    const enum tbd_create_result create_result =
+        tbd_create_with_info_to_buffer(info, &buffer, options);
 
-    for (; info != end; info++) {
-        free(info->string);
+    if (create_result != E_TBD_CREATE_OK) {
+        tbd_write_buffer_destroy(&buffer);
+        return create_result;
     }
-    
-    array_destroy(list);
+
+    const size_t size = (size_t)(buffer.data_end - buffer.data);
+    const size_t written = fwrite(buffer.data, 1, size, file);
+
+    tbd_write_buffer_destroy(&buffer);
+
+    if (written != size) {
+        return E_TBD_CREATE_WRITE_FAIL;
+    }
+
+    return E_TBD_CREATE_OK;
+}
+
+void
+tbd_create_info_clear(struct tbd_create_info *const info,
+                      const struct tbd_create_info *const orig)
+{
+    struct arena arena = info->arena;
+    arena_reset(&arena);
+
+    info->arena = (struct arena){};
+    tbd_create_info_destroy(info);
+
+    *info = *orig;
+    info->arena = arena;
 }
 
 void tbd_create_info_destroy(struct tbd_create_info *const info) {
-    if (info->flags & F_TBD_CREATE_INFO_STRINGS_WERE_COPIED) {
+    if (info->flags & F_TBD_CREATE_INFO_INSTALL_NAME_WAS_COPIED) {
         free((char *)info->install_name);
+    }
+
+    if (info->flags & F_TBD_CREATE_INFO_PARENT_UMBRELLA_WAS_COPIED) {
         free((char *)info->parent_umbrella);
     }
 
@@ -279,6 +465,15 @@ void tbd_create_info_destroy(struct tbd_create_info *const info) {
     info->compatibility_version = 0;
     info->swift_version = 0;
 
-    destroy_exports_array(&info->exports);
+    /*
+     * The export-strings are all stored in the arena, so they don't need to be
+     * freed individually.
+     */
+
+    array_destroy(&info->exports);
+    hash_table_destroy(&info->export_index);
+
+    arena_destroy(&info->arena);
+
     array_destroy(&info->uuids);
 }
@@ -0,0 +1,443 @@
+//
+//  src/tbd_archive.c
+//  tbd
+//
+//  Created by inoahdev on 3/23/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "recursive.h"
+#include "tbd_archive.h"
+
+#define TAR_BLOCK_SIZE 512
+#define TAR_RECORD_SIZE (TAR_BLOCK_SIZE * 20)
+
+#define TBD_ARCHIVE_BUFFER_SIZE (1024 * 1024)
+
+struct tar_header {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char chksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+};
+
+_Static_assert(sizeof(struct tar_header) == TAR_BLOCK_SIZE,
+               "struct tar_header must be exactly one block");
+
+enum tbd_archive_result
+tbd_archive_open(struct tbd_archive *const archive,
+                 char *const path,
+                 const uint64_t path_length,
+                 const bool no_overwrite)
+{
+    char *const buffer = malloc(TBD_ARCHIVE_BUFFER_SIZE);
+    if (buffer == NULL) {
+        return E_TBD_ARCHIVE_ALLOC_FAIL;
+    }
+
+    const int flags = (no_overwrite) ? O_EXCL : 0;
+    const int fd =
+        open_r(path,
+               path_length,
+               O_WRONLY | O_TRUNC | flags,
+               DEFFILEMODE,
+               0755,
+               NULL);
+
+    if (fd < 0) {
+        free(buffer);
+        return E_TBD_ARCHIVE_OPEN_FAIL;
+    }
+
+    archive->fd = fd;
+
+    archive->path = path;
+    archive->path_length = path_length;
+
+    archive->buffer = buffer;
+    archive->buffer_used = 0;
+    archive->size = 0;
+
+    archive->mtime = (int64_t)time(NULL);
+    pthread_mutex_init(&archive->mutex, NULL);
+
+    return E_TBD_ARCHIVE_OK;
+}
+
+static int write_all(const int fd, const char *iter, const uint64_t size) {
+    const char *const end = iter + size;
+    while (iter != end) {
+        const ssize_t write_size = write(fd, iter, (size_t)(end - iter));
+        if (write_size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return 1;
+        }
+
+        iter += write_size;
+    }
+
+    return 0;
+}
+
+static int flush_buffer(struct tbd_archive *const archive) {
+    const uint64_t used = archive->buffer_used;
+    if (used == 0) {
+        return 0;
+    }
+
+    archive->buffer_used = 0;
+    return write_all(archive->fd, archive->buffer, used);
+}
+
+/*
+ * Append data to the archive, through the buffer unless the data is too large
+ * to fit.
+ */
+
+static int
+append(struct tbd_archive *const archive,
+       const void *const data,
+       const uint64_t size)
+{
+    archive->size += size;
+
+    if (archive->buffer_used + size > TBD_ARCHIVE_BUFFER_SIZE) {
+        if (flush_buffer(archive)) {
+            return 1;
+        }
+
+        if (size > TBD_ARCHIVE_BUFFER_SIZE) {
+            return write_all(archive->fd, data, size);
+        }
+    }
+
+    memcpy(archive->buffer + archive->buffer_used, data, size);
+    archive->buffer_used += size;
+
+    return 0;
+}
+
+static int append_padding(struct tbd_archive *const archive) {
+    static const char zeros[TAR_BLOCK_SIZE] = {};
+
+    const uint64_t remainder = archive->size % TAR_BLOCK_SIZE;
+    if (remainder == 0) {
+        return 0;
+    }
+
+    return append(archive, zeros, TAR_BLOCK_SIZE - remainder);
+}
+
+/*
+ * Write number out in octal, padded with zeros to fill the field, followed by
+ * a null-terminator. Returns false if number doesn't fit.
+ */
+
+static bool
+write_octal(char *const field, const uint64_t size, const uint64_t number) {
+    const int digits = (int)size - 1;
+    const int length =
+        snprintf(field, size, "%0*llo", digits, (unsigned long long)number);
+
+    return length == digits;
+}
+
+static void
+init_header(struct tar_header *const header,
+            const struct tbd_archive *const archive,
+            const char typeflag,
+            const uint64_t size)
+{
+    *header = (struct tar_header){};
+
+    write_octal(header->mode, sizeof(header->mode), 0644);
+    write_octal(header->uid, sizeof(header->uid), 0);
+    write_octal(header->gid, sizeof(header->gid), 0);
+    write_octal(header->size, sizeof(header->size), size);
+    write_octal(header->mtime, sizeof(header->mtime), (uint64_t)archive->mtime);
+
+    header->typeflag = typeflag;
+
+    memcpy(header->magic, "ustar", 6);
+    memcpy(header->version, "00", 2);
+}
+
+static void finish_header(struct tar_header *const header) {
+    memset(header->chksum, ' ', sizeof(header->chksum));
+
+    const uint8_t *iter = (const uint8_t *)header;
+    const uint8_t *const end = iter + sizeof(*header);
+
+    uint32_t chksum = 0;
+    for (; iter != end; iter++) {
+        chksum += *iter;
+    }
+
+    snprintf(header->chksum, sizeof(header->chksum), "%06o", chksum);
+    header->chksum[7] = ' ';
+}
+
+/*
+ * Store name in the header's name and prefix fields, returning false if the
+ * name is too long to be split between the two.
+ */
+
+static bool
+set_header_name(struct tar_header *const header,
+                const char *const name,
+                const uint64_t length)
+{
+    if (length <= sizeof(header->name)) {
+        memcpy(header->name, name, length);
+        return true;
+    }
+
+    /*
+     * The prefix holds the name's leading directories, without the slash
+     * separating them from the rest of the name.
+     */
+
+    uint64_t i = sizeof(header->prefix);
+    if (i >= length) {
+        i = length - 1;
+    }
+
+    for (; i != 0; i--) {
+        if (name[i] != '/') {
+            continue;
+        }
+
+        const uint64_t name_length = length - i - 1;
+        if (name_length > sizeof(header->name)) {
+            return false;
+        }
+
+        if (name_length == 0) {
+            continue;
+        }
+
+        memcpy(header->prefix, name, i);
+        memcpy(header->name, name + i + 1, name_length);
+
+        return true;
+    }
+
+    return false;
+}
+
+static uint64_t count_digits(uint64_t number) {
+    uint64_t digits = 1;
+    for (; number >= 10; number /= 10) {
+        digits++;
+    }
+
+    return digits;
+}
+
+/*
+ * Names too long for a ustar header are stored in a pax extended-header
+ * before the entry, as a "path" record.
+ */
+
+static int
+append_pax_path(struct tbd_archive *const archive,
+                const char *const name,
+                const uint64_t length)
+{
+    /*
+     * A pax record is "<length> path=<name>\n", where length is the length of
+     * the entire record, including itself.
+     */
+
+    const uint64_t base_length = strlen(" path=") + length + 1;
+
+    uint64_t record_length = base_length + count_digits(base_length);
+    if (count_digits(record_length) != count_digits(base_length)) {
+        record_length += 1;
+    }
+
+    struct tar_header header = {};
+    init_header(&header, archive, 'x', record_length);
+
+    memcpy(header.name, "././@PaxHeader", 14);
+    finish_header(&header);
+
+    char record_length_string[24] = {};
+    const int record_length_string_length =
+        snprintf(record_length_string,
+                 sizeof(record_length_string),
+                 "%llu path=",
+                 (unsigned long long)record_length);
+
+    if (append(archive, &header, sizeof(header))) {
+        return 1;
+    }
+
+    if (append(archive,
+               record_length_string,
+               (uint64_t)record_length_string_length))
+    {
+        return 1;
+    }
+
+    if (append(archive, name, length)) {
+        return 1;
+    }
+
+    if (append(archive, "\n", 1)) {
+        return 1;
+    }
+
+    return append_padding(archive);
+}
+
+/*
+ * Get the name of the entry for write_path, relative to the archive's path.
+ */
+
+static const char *
+get_entry_name(const struct tbd_archive *const archive,
+               const char *const write_path,
+               const uint64_t write_path_length,
+               uint64_t *const length_out)
+{
+    const char *name = write_path;
+    const char *const end = write_path + write_path_length;
+
+    const uint64_t path_length = archive->path_length;
+    if (write_path_length > path_length &&
+        write_path[path_length] == '/' &&
+        memcmp(write_path, archive->path, path_length) == 0)
+    {
+        name += path_length;
+    }
+
+    while (name != end && *name == '/') {
+        name++;
+    }
+
+    *length_out = (uint64_t)(end - name);
+    return name;
+}
+
+enum tbd_archive_result
+tbd_archive_add_file(struct tbd_archive *const archive,
+                     const char *const write_path,
+                     const uint64_t write_path_length,
+                     const char *const data,
+                     const uint64_t size)
+{
+    uint64_t name_length = 0;
+    const char *const name =
+        get_entry_name(archive, write_path, write_path_length, &name_length);
+
+    struct tar_header header = {};
+    init_header(&header, archive, '0', size);
+
+    if (!write_octal(header.size, sizeof(header.size), size)) {
+        return E_TBD_ARCHIVE_ENTRY_TOO_LARGE;
+    }
+
+    const bool needs_pax_path = !set_header_name(&header, name, name_length);
+    if (needs_pax_path) {
+        memcpy(header.name, name, sizeof(header.name));
+    }
+
+    finish_header(&header);
+    pthread_mutex_lock(&archive->mutex);
+
+    int failed = 0;
+    if (needs_pax_path) {
+        failed = append_pax_path(archive, name, name_length);
+    }
+
+    if (!failed) {
+        failed = append(archive, &header, sizeof(header));
+    }
+
+    if (!failed) {
+        failed = append(archive, data, size);
+    }
+
+    if (!failed) {
+        failed = append_padding(archive);
+    }
+
+    pthread_mutex_unlock(&archive->mutex);
+
+    if (failed) {
+        return E_TBD_ARCHIVE_WRITE_FAIL;
+    }
+
+    return E_TBD_ARCHIVE_OK;
+}
+
+enum tbd_archive_result tbd_archive_close(struct tbd_archive *const archive) {
+    static const char zeros[TAR_BLOCK_SIZE * 2] = {};
+
+    /*
+     * An archive ends with two zero blocks, and is padded with zeros to a
+     * multiple of the record-size.
+     */
+
+    int failed = append(archive, zeros, sizeof(zeros));
+    if (!failed) {
+        const uint64_t remainder = archive->size % TAR_RECORD_SIZE;
+        if (remainder != 0) {
+            const uint64_t padding_size = TAR_RECORD_SIZE - remainder;
+            for (uint64_t i = 0; i < padding_size; i += TAR_BLOCK_SIZE) {
+                failed = append(archive, zeros, TAR_BLOCK_SIZE);
+                if (failed) {
+                    break;
+                }
+            }
+        }
+    }
+
+    if (!failed) {
+        failed = flush_buffer(archive);
+    }
+
+    if (close(archive->fd) != 0) {
+        failed = 1;
+    }
+
+    free(archive->buffer);
+    pthread_mutex_destroy(&archive->mutex);
+
+    archive->fd = -1;
+    archive->buffer = NULL;
+    archive->buffer_used = 0;
+
+    if (failed) {
+        return E_TBD_ARCHIVE_WRITE_FAIL;
+    }
+
+    return E_TBD_ARCHIVE_OK;
+}
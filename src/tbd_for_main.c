@@ -13,13 +13,18 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "dir_cache.h"
 #include "macho_file.h"
 #include "parse_or_list_fields.h"
 
 #include "path.h"
 #include "recursive.h"
+#include "stats.h"
+#include "tbd_archive.h"
 #include "tbd_for_main.h"
+#include "tbd_write_buffer.h"
 
 static void
 add_image_filter(struct tbd_for_main *const tbd,
@@ -146,6 +151,56 @@ add_image_path(struct tbd_for_main *const tbd,
     *index_in = index + 1;
 }
 
+/*
+ * Parse a size, which may end with a K, M, or G suffix, in bytes.
+ */
+
+static bool parse_size(const char *const string, uint64_t *const size_out) {
+    char *end = NULL;
+    uint64_t size = strtoull(string, &end, 10);
+
+    if (end == string) {
+        return false;
+    }
+
+    uint32_t shift = 0;
+    switch (*end) {
+        case '\0':
+            break;
+
+        case 'K':
+        case 'k':
+            shift = 10;
+            end++;
+
+            break;
+
+        case 'M':
+        case 'm':
+            shift = 20;
+            end++;
+
+            break;
+
+        case 'G':
+        case 'g':
+            shift = 30;
+            end++;
+
+            break;
+
+        default:
+            return false;
+    }
+
+    if (*end != '\0' || size > (UINT64_MAX >> shift)) {
+        return false;
+    }
+
+    *size_out = size << shift;
+    return true;
+}
+
 bool
 tbd_for_main_parse_option(struct tbd_for_main *const tbd,
                           const int argc,
@@ -195,6 +250,8 @@ tbd_for_main_parse_option(struct tbd_for_main *const tbd,
         tbd->parse_options |= O_TBD_PARSE_ALLOW_PRIVATE_OBJC_CLASS_SYMBOLS;
     } else if (strcmp(option, "allow-private-objc-ivar-symbols") == 0) {
         tbd->parse_options |= O_TBD_PARSE_ALLOW_PRIVATE_OBJC_IVAR_SYMBOLS;
+    } else if (strcmp(option, "dsc-file-order") == 0) {
+        tbd->options |= O_TBD_FOR_MAIN_DSC_FILE_ORDER;
     } else if (strcmp(option, "ignore-clients") == 0) {
         tbd->parse_options |= O_TBD_PARSE_IGNORE_CLIENTS;
     } else if (strcmp(option, "ignore-compatibility-version") == 0) {
@@ -225,6 +282,41 @@ tbd_for_main_parse_option(struct tbd_for_main *const tbd,
         add_image_number(tbd, argc, argv, &index);
     } else if (strcmp(option, "image-path") == 0) {
         add_image_path(tbd, argc, argv, &index);
+    } else if (strcmp(option, "jobs") == 0) {
+        index += 1;
+        if (index == argc) {
+            fputs("Please provide a number of jobs\n", stderr);
+            exit(1);
+        }
+
+        const char *const argument = argv[index];
+        char *end = NULL;
+        const uint64_t jobs = strtoul(argument, &end, 10);
+
+        if (end == argument || *end != '\0' || jobs == 0 ||
+            jobs > UINT16_MAX)
+        {
+            fprintf(stderr, "A job-count of \"%s\" is invalid\n", argument);
+            exit(1);
+        }
+
+        tbd->jobs = (uint32_t)jobs;
+    } else if (strcmp(option, "max-rss") == 0) {
+        index += 1;
+        if (index == argc) {
+            fputs("Please provide a size of memory to keep resident\n", stderr);
+            exit(1);
+        }
+
+        const char *const argument = argv[index];
+        if (!parse_size(argument, &tbd->dsc_max_rss)) {
+            fprintf(stderr, "A size of \"%s\" is invalid\n", argument);
+            exit(1);
+        }
+
+        tbd->options |= O_TBD_FOR_MAIN_DSC_RELEASE_PAGES;
+    } else if (strcmp(option, "release-pages") == 0) {
+        tbd->options |= O_TBD_FOR_MAIN_DSC_RELEASE_PAGES;
     } else if (strcmp(option, "remove-archs") == 0) {
         if (!(tbd->options & O_TBD_FOR_MAIN_ADD_OR_REMOVE_ARCHS)) {
             if (tbd->archs_re != 0) {
@@ -444,24 +536,82 @@ tbd_for_main_create_write_path(const struct tbd_for_main *const tbd,
     return write_path;
 }
 
-void
-tbd_for_main_write_to_path(const struct tbd_for_main *const tbd,
-                           const char *const input_path,
-                           char *const write_path,
-                           const uint64_t write_path_length,
-                           const bool print_paths)
+static int
+open_write_path(const struct tbd_for_main *const tbd,
+                char *const write_path,
+                const uint64_t write_path_length,
+                const int flags,
+                char **const terminator_out)
+{
+    stats_begin_phase(STATS_PHASE_OPEN_OUTPUT);
+
+    int fd = -1;
+    struct dir_cache *const dir_cache = tbd->dir_cache;
+
+    if (dir_cache != NULL) {
+        fd =
+            dir_cache_open_file(dir_cache,
+                                write_path,
+                                write_path_length,
+                                flags,
+                                DEFFILEMODE,
+                                0755,
+                                terminator_out);
+    } else {
+        fd =
+            open_r(write_path,
+                   write_path_length,
+                   flags,
+                   DEFFILEMODE,
+                   0755,
+                   terminator_out);
+    }
+
+    stats_end_phase();
+    return fd;
+}
+
+/*
+ * Ignore the return value as we cannot be sure if the remove failed as the
+ * directories we created (that are pointed to by terminator) may now be
+ * populated with other files.
+ */
+
+static void
+remove_partial_write_path(const struct tbd_for_main *const tbd,
+                          char *const write_path,
+                          const uint64_t write_path_length,
+                          char *const terminator)
+{
+    struct dir_cache *const dir_cache = tbd->dir_cache;
+    if (dir_cache != NULL) {
+        dir_cache_remove_partial(dir_cache,
+                                 write_path,
+                                 write_path_length,
+                                 terminator);
+    } else {
+        remove_partial_r(write_path, write_path_length, terminator);
+    }
+}
+
+FILE *
+tbd_for_main_open_write_file(const struct tbd_for_main *const tbd,
+                             const char *const input_path,
+                             char *const write_path,
+                             const uint64_t write_path_length,
+                             const bool print_paths,
+                             char **const terminator_out)
 {
     char *terminator = NULL;
     const uint64_t options = tbd->options;
 
     const int flags = (options & O_TBD_FOR_MAIN_NO_OVERWRITE) ? O_EXCL : 0;
     const int write_fd =
-        open_r(write_path,
-               write_path_length,
-               O_WRONLY | O_TRUNC | flags,
-               DEFFILEMODE,
-               0755,
-               &terminator);
+        open_write_path(tbd,
+                        write_path,
+                        write_path_length,
+                        O_WRONLY | O_TRUNC | flags,
+                        &terminator);
     
     if (write_fd < 0) {        
         if (!(options & O_TBD_FOR_MAIN_IGNORE_WARNINGS)) {
@@ -503,16 +653,13 @@ tbd_for_main_write_to_path(const struct tbd_for_main *const tbd,
          */
 
         if (terminator != NULL) {
-            /*
-             * Ignore the return value as we cannot be sure if the remove failed
-             * as the directories we created (that are pointed to by terminator)
-             * may now be populated with other files.
-             */
-            
-            remove_partial_r(write_path, write_path_length, terminator);
+            remove_partial_write_path(tbd,
+                                      write_path,
+                                      write_path_length,
+                                      terminator);
         }
 
-        return;
+        return NULL;
     }
 
     FILE *const write_file = fdopen(write_fd, "w");
@@ -532,38 +679,255 @@ tbd_for_main_write_to_path(const struct tbd_for_main *const tbd,
             }
         }
 
-        return;
+        close(write_fd);
+        return NULL;
     }
-    
-    const struct tbd_create_info *const create_info = &tbd->info;
+
+    *terminator_out = terminator;
+    return write_file;
+}
+
+/*
+ * Write out the tbd to a buffer first, and then to fd with a single write(2),
+ * which is much faster than writing each field and export through stdio.
+ */
+
+static enum tbd_create_result
+write_info_to_fd(const struct tbd_for_main *const tbd, const int fd) {
+    struct tbd_write_buffer buffer = {};
+
+    stats_begin_phase(STATS_PHASE_RENDER);
+    enum tbd_create_result result =
+        tbd_create_with_info_to_buffer(&tbd->info, &buffer, tbd->write_options);
+
+    stats_end_phase();
+
+    if (result == E_TBD_CREATE_OK) {
+        stats_begin_phase(STATS_PHASE_WRITE_OUTPUT);
+        if (tbd_write_buffer_flush(&buffer, fd)) {
+            result = E_TBD_CREATE_WRITE_FAIL;
+        } else {
+            stats_add(STATS_COUNTER_TBDS_WRITTEN, 1);
+        }
+
+        stats_end_phase();
+    }
+
+    tbd_write_buffer_destroy(&buffer);
+    return result;
+}
+
+static void
+handle_write_fail(const struct tbd_for_main *const tbd,
+                  const char *const input_path,
+                  char *const write_path,
+                  const uint64_t write_path_length,
+                  char *const terminator,
+                  const bool print_paths)
+{
+    if (!(tbd->options & O_TBD_FOR_MAIN_IGNORE_WARNINGS)) {
+        if (print_paths) {
+            fprintf(stderr,
+                    "Failed to write to output-file (for input-file at "
+                    "path: %s, to output-file's path: %s)\n",
+                    input_path,
+                    write_path);
+        } else {
+            fputs("Failed to write to provided output-file\n", stderr);
+        }
+    }
+
+    if (terminator != NULL) {
+        remove_partial_write_path(tbd,
+                                  write_path,
+                                  write_path_length,
+                                  terminator);
+    }
+}
+
+bool
+tbd_for_main_write_to_file(const struct tbd_for_main *const tbd,
+                           const char *const input_path,
+                           char *const write_path,
+                           const uint64_t write_path_length,
+                           char *const terminator,
+                           const bool print_paths,
+                           FILE *const write_file)
+{
     const enum tbd_create_result create_tbd_result =
-        tbd_create_with_info(create_info, write_file, tbd->write_options);
+        write_info_to_fd(tbd, fileno(write_file));
 
     if (create_tbd_result != E_TBD_CREATE_OK) {
-        if (!(options & O_TBD_FOR_MAIN_IGNORE_WARNINGS)) {
+        handle_write_fail(tbd,
+                          input_path,
+                          write_path,
+                          write_path_length,
+                          terminator,
+                          print_paths);
+
+        fclose(write_file);
+        return false;
+    }
+
+    fclose(write_file);
+    return true;
+}
+
+static bool copy_fd_contents(const int source_fd, const int fd) {
+    char buffer[16384];
+
+    do {
+        const ssize_t read_size = read(source_fd, buffer, sizeof(buffer));
+        if (read_size < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return false;
+        }
+
+        if (read_size == 0) {
+            return true;
+        }
+
+        const char *iter = buffer;
+        const char *const end = buffer + read_size;
+
+        while (iter != end) {
+            const ssize_t write_size = write(fd, iter, (size_t)(end - iter));
+            if (write_size < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+
+                return false;
+            }
+
+            iter += write_size;
+        }
+    } while (true);
+}
+
+bool
+tbd_for_main_copy_to_file(const struct tbd_for_main *const tbd,
+                          const char *const input_path,
+                          char *const write_path,
+                          const uint64_t write_path_length,
+                          char *const terminator,
+                          const bool print_paths,
+                          const int source_fd,
+                          FILE *const write_file)
+{
+    stats_begin_phase(STATS_PHASE_WRITE_OUTPUT);
+
+    const bool copied_contents =
+        copy_fd_contents(source_fd, fileno(write_file));
+
+    stats_end_phase();
+
+    if (!copied_contents) {
+        handle_write_fail(tbd,
+                          input_path,
+                          write_path,
+                          write_path_length,
+                          terminator,
+                          print_paths);
+
+        fclose(write_file);
+        return false;
+    }
+
+    stats_add(STATS_COUNTER_TBDS_WRITTEN, 1);
+    fclose(write_file);
+
+    return true;
+}
+
+static bool
+write_to_archive(const struct tbd_for_main *const tbd,
+                 const char *const input_path,
+                 const char *const write_path,
+                 const uint64_t write_path_length,
+                 const bool print_paths)
+{
+    struct tbd_write_buffer buffer = {};
+
+    stats_begin_phase(STATS_PHASE_RENDER);
+    const enum tbd_create_result create_tbd_result =
+        tbd_create_with_info_to_buffer(&tbd->info, &buffer, tbd->write_options);
+
+    stats_end_phase();
+
+    enum tbd_archive_result add_file_result = E_TBD_ARCHIVE_WRITE_FAIL;
+    if (create_tbd_result == E_TBD_CREATE_OK) {
+        stats_begin_phase(STATS_PHASE_WRITE_OUTPUT);
+        add_file_result =
+            tbd_archive_add_file(tbd->archive,
+                                 write_path,
+                                 write_path_length,
+                                 buffer.data,
+                                 (uint64_t)(buffer.data_end - buffer.data));
+
+        stats_end_phase();
+    }
+
+    tbd_write_buffer_destroy(&buffer);
+
+    if (add_file_result != E_TBD_ARCHIVE_OK) {
+        if (!(tbd->options & O_TBD_FOR_MAIN_IGNORE_WARNINGS)) {
             if (print_paths) {
                 fprintf(stderr,
-                        "Failed to write to output-file (for input-file at "
-                        "path: %s, to output-file's path: %s)\n",
+                        "Failed to write to archive (for input-file at "
+                        "path: %s, to entry for path: %s)\n",
                         input_path,
                         write_path);
             } else {
-                fputs("Failed to write to provided output-file\n", stderr);
+                fputs("Failed to write to provided archive\n", stderr);
             }
         }
 
-        if (terminator != NULL) {
-            /*
-             * Ignore the return value as we cannot be sure if the remove failed
-             * as the directories we created (that are pointed to by terminator)
-             * may now be populated with other files.
-             */
-            
-            remove_partial_r(write_path, write_path_length, terminator);
-        }
+        return false;
     }
 
-    fclose(write_file);
+    stats_add(STATS_COUNTER_TBDS_WRITTEN, 1);
+    return true;
+}
+
+bool
+tbd_for_main_write_to_path(const struct tbd_for_main *const tbd,
+                           const char *const input_path,
+                           char *const write_path,
+                           const uint64_t write_path_length,
+                           const bool print_paths)
+{
+    if (tbd->archive != NULL) {
+        return write_to_archive(tbd,
+                                input_path,
+                                write_path,
+                                write_path_length,
+                                print_paths);
+    }
+
+    char *terminator = NULL;
+    FILE *const write_file =
+        tbd_for_main_open_write_file(tbd,
+                                     input_path,
+                                     write_path,
+                                     write_path_length,
+                                     print_paths,
+                                     &terminator);
+
+    if (write_file == NULL) {
+        return false;
+    }
+
+    return tbd_for_main_write_to_file(tbd,
+                                      input_path,
+                                      write_path,
+                                      write_path_length,
+                                      terminator,
+                                      print_paths,
+                                      write_file);
 }
 
 void
@@ -571,9 +935,15 @@ tbd_for_main_write_to_stdout(const struct tbd_for_main *const tbd,
                              const char *const input_path,
                              const bool print_paths)
 {
-    const struct tbd_create_info *const create_info = &tbd->info;
+    /*
+     * Flush anything already written to stdout (such as a prompt) so it stays
+     * before the tbd we write out directly to stdout's file-descriptor.
+     */
+
+    fflush(stdout);
+
     const enum tbd_create_result create_tbd_result =
-        tbd_create_with_info(create_info, stdout, tbd->write_options);
+        write_info_to_fd(tbd, STDOUT_FILENO);
 
     if (create_tbd_result != E_TBD_CREATE_OK) {
         if (!(tbd->options & O_TBD_FOR_MAIN_IGNORE_WARNINGS)) {
@@ -746,6 +1116,14 @@ tbd_for_main_apply_from(struct tbd_for_main *const dst,
 
     }
 
+    if (dst->jobs == 0) {
+        dst->jobs = src->jobs;
+    }
+
+    if (!(dst->options & O_TBD_FOR_MAIN_DSC_RELEASE_PAGES)) {
+        dst->dsc_max_rss = src->dsc_max_rss;
+    }
+
     dst->macho_options |= src->macho_options;
     dst->dsc_options |= src->dsc_options;
 
@@ -768,6 +1146,7 @@ void tbd_for_main_destroy(struct tbd_for_main *const tbd) {
 
     tbd->parse_path = NULL;
     tbd->write_path = NULL;
+    tbd->dsc_max_rss = 0;
 
     tbd->macho_options = 0;
     tbd->dsc_options = 0;
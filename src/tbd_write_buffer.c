@@ -0,0 +1,844 @@
+//
+//  src/tbd_write_buffer.c
+//  tbd
+//
+//  Created by inoahdev on 3/16/19.
+//  Copyright © 2018 - 2019 inoahdev. All rights reserved.
+//
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "tbd_write_buffer.h"
+
+int
+tbd_write_buffer_reserve(struct tbd_write_buffer *const buffer,
+                         const uint64_t size)
+{
+    char *const data_end = buffer->data_end;
+    const uint64_t free_size = (uint64_t)(buffer->alloc_end - data_end);
+
+    if (size <= free_size) {
+        return 0;
+    }
+
+    char *const data = buffer->data;
+
+    const uint64_t used_size = (uint64_t)(data_end - data);
+    const uint64_t capacity = (uint64_t)(buffer->alloc_end - data);
+
+    /*
+     * Start off with a capacity large enough for most small tbds, and double
+     * from then on.
+     */
+
+    uint64_t new_capacity = (capacity != 0) ? capacity * 2 : 4096;
+    while (new_capacity - used_size < size) {
+        new_capacity *= 2;
+    }
+
+    char *const new_data = realloc(data, new_capacity);
+    if (new_data == NULL) {
+        return 1;
+    }
+
+    stats_add(STATS_COUNTER_ALLOCATIONS, 1);
+
+    buffer->data = new_data;
+    buffer->data_end = new_data + used_size;
+    buffer->alloc_end = new_data + new_capacity;
+
+    return 0;
+}
+
+int
+tbd_write_buffer_flush(const struct tbd_write_buffer *const buffer,
+                       const int fd)
+{
+    const char *iter = buffer->data;
+    const char *const end = buffer->data_end;
+
+    while (iter != end) {
+        const ssize_t written = write(fd, iter, (size_t)(end - iter));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            return 1;
+        }
+
+        iter += written;
+    }
+
+    return 0;
+}
+
+void tbd_write_buffer_clear(struct tbd_write_buffer *const buffer) {
+    buffer->data_end = buffer->data;
+}
+
+void tbd_write_buffer_destroy(struct tbd_write_buffer *const buffer) {
+    free(buffer->data);
+
+    buffer->data = NULL;
+    buffer->data_end = NULL;
+    buffer->alloc_end = NULL;
+}
+
+static inline int
+append(struct tbd_write_buffer *const buffer,
+       const char *const string,
+       const uint64_t length)
+{
+    if (tbd_write_buffer_reserve(buffer, length)) {
+        return 1;
+    }
+
+    memcpy(buffer->data_end, string, length);
+    buffer->data_end += length;
+
+    return 0;
+}
+
+/*
+ * Append a string-literal, with its length known at compile-time.
+ */
+
+#define append_literal(buffer, literal) \
+    append(buffer, literal, sizeof(literal) - 1)
+
+static inline int
+append_char(struct tbd_write_buffer *const buffer, const char ch) {
+    if (tbd_write_buffer_reserve(buffer, 1)) {
+        return 1;
+    }
+
+    *buffer->data_end = ch;
+    buffer->data_end += 1;
+
+    return 0;
+}
+
+static int
+append_number(struct tbd_write_buffer *const buffer, const uint64_t number) {
+    char digits[20];
+
+    char *const end = digits + sizeof(digits);
+    char *iter = end;
+
+    uint64_t left = number;
+
+    do {
+        iter--;
+        *iter = (char)('0' + (left % 10));
+
+        left /= 10;
+    } while (left != 0);
+
+    return append(buffer, iter, (uint64_t)(end - iter));
+}
+
+static inline int
+append_arch_name(struct tbd_write_buffer *const buffer,
+                 const struct arch_info *const arch)
+{
+    const char *const name = arch->name;
+    return append(buffer, name, strlen(name));
+}
+
+/*
+ * The padding that precedes the second and later lines of a yaml-list, such as
+ * the list of archs or of symbols.
+ */
+
+static const char arch_list_newline[] = "\n                   ";
+static const char export_list_newline[] = ",\n                          ";
+static const char uuid_list_newline[] = ",\n                         ";
+
+static int
+write_archs_list(struct tbd_write_buffer *const buffer,
+                 const uint64_t archs,
+                 const char *const key,
+                 const uint64_t key_length)
+{
+    if (archs == 0) {
+        return 1;
+    }
+
+    /*
+     * We need to find the first arch-info to print the list, and then print
+     * subsequent archs with a preceding comma.
+     */
+
+    const struct arch_info *const arch_info_list = arch_info_get_list();
+
+    uint64_t index = 0;
+    uint64_t archs_iter = archs;
+
+    do {
+        if (archs_iter & 1) {
+            const struct arch_info *const arch = arch_info_list + index;
+            if (append(buffer, key, key_length)) {
+                return 1;
+            }
+
+            if (append_arch_name(buffer, arch)) {
+                return 1;
+            }
+
+            archs_iter >>= 1;
+            break;
+        }
+
+        archs_iter >>= 1;
+        if (archs_iter == 0) {
+            return append_literal(buffer, " ]\n");
+        }
+
+        index += 1;
+    } while (true);
+
+    /*
+     * Break lines for every seven archs written out, counting the arch we just
+     * wrote.
+     */
+
+    uint64_t counter = 1;
+
+    while (archs_iter != 0) {
+        index += 1;
+
+        if (archs_iter & 1) {
+            const struct arch_info *const arch = arch_info_list + index;
+            if (append_literal(buffer, ", ")) {
+                return 1;
+            }
+
+            if (append_arch_name(buffer, arch)) {
+                return 1;
+            }
+
+            counter++;
+            if (counter == 7) {
+                if (append_literal(buffer, arch_list_newline)) {
+                    return 1;
+                }
+
+                counter = 0;
+            }
+        }
+
+        archs_iter >>= 1;
+    }
+
+    return append_literal(buffer, " ]\n");
+}
+
+int
+tbd_write_header_archs_to_buffer(struct tbd_write_buffer *const buffer,
+                                 const uint64_t archs)
+{
+    static const char key[] = "archs:                 [ ";
+    return write_archs_list(buffer, archs, key, sizeof(key) - 1);
+}
+
+static int
+write_exported_archs(struct tbd_write_buffer *const buffer,
+                     const uint64_t archs)
+{
+    static const char key[] = "  - archs:              [ ";
+    return write_archs_list(buffer, archs, key, sizeof(key) - 1);
+}
+
+static int
+write_packed_version(struct tbd_write_buffer *const buffer,
+                     const uint32_t version)
+{
+    const uint8_t revision = version & 0xff;
+    const uint8_t minor = (version & 0xff00) >> 8;
+    const uint16_t major = (uint16_t)(version >> 16);
+
+    if (append_number(buffer, major)) {
+        return 1;
+    }
+
+    if (minor != 0) {
+        if (append_char(buffer, '.')) {
+            return 1;
+        }
+
+        if (append_number(buffer, minor)) {
+            return 1;
+        }
+    }
+
+    if (revision != 0) {
+        /*
+         * Write out a .0 version-component as if minor was zero, we didn't
+         * write it as a component.
+         */
+
+        if (minor == 0) {
+            if (append_literal(buffer, ".0")) {
+                return 1;
+            }
+        }
+
+        if (append_char(buffer, '.')) {
+            return 1;
+        }
+
+        if (append_number(buffer, revision)) {
+            return 1;
+        }
+    }
+
+    return append_char(buffer, '\n');
+}
+
+int
+tbd_write_current_version_to_buffer(struct tbd_write_buffer *const buffer,
+                                    const uint32_t version)
+{
+    if (append_literal(buffer, "current-version:       ")) {
+        return 1;
+    }
+
+    return write_packed_version(buffer, version);
+}
+
+int
+tbd_write_compatibility_version_to_buffer(
+    struct tbd_write_buffer *const buffer,
+    const uint32_t version)
+{
+    if (append_literal(buffer, "compatibility-version: ")) {
+        return 1;
+    }
+
+    return write_packed_version(buffer, version);
+}
+
+int tbd_write_footer_to_buffer(struct tbd_write_buffer *const buffer) {
+    return append_literal(buffer, "...\n");
+}
+
+int
+tbd_write_flags_to_buffer(struct tbd_write_buffer *const buffer,
+                          const uint64_t flags)
+{
+    if (flags == 0) {
+        return 0;
+    }
+
+    if (append_literal(buffer, "flags:                 [ ")) {
+        return 1;
+    }
+
+    if (flags & TBD_FLAG_FLAT_NAMESPACE) {
+        if (append_literal(buffer, "flat_namespace")) {
+            return 1;
+        }
+    }
+
+    if (flags & TBD_FLAG_NOT_APP_EXTENSION_SAFE) {
+        /*
+         * If flags was also marked flat_namespace, we need to write out a comma
+         * first for a valid yaml-list.
+         */
+
+        if (flags & TBD_FLAG_FLAT_NAMESPACE) {
+            if (append_literal(buffer, ", not_app_extension_safe")) {
+                return 1;
+            }
+        } else {
+            if (append_literal(buffer, "not_app_extension_safe")) {
+                return 1;
+            }
+        }
+    }
+
+    return append_literal(buffer, " ]\n");
+}
+
+static int
+write_yaml_string(struct tbd_write_buffer *const buffer,
+                  const char *const string,
+                  const uint64_t length,
+                  const bool needs_quotes)
+{
+    if (!needs_quotes) {
+        return append(buffer, string, length);
+    }
+
+    /*
+     * Reserve space for the string and both quotes at once.
+     */
+
+    if (tbd_write_buffer_reserve(buffer, length + 2)) {
+        return 1;
+    }
+
+    char *const data_end = buffer->data_end;
+
+    data_end[0] = '\"';
+    memcpy(data_end + 1, string, length);
+    data_end[length + 1] = '\"';
+
+    buffer->data_end = data_end + length + 2;
+    return 0;
+}
+
+int
+tbd_write_install_name_to_buffer(struct tbd_write_buffer *const buffer,
+                                 const struct tbd_create_info *const info)
+{
+    if (append_literal(buffer, "install-name:          ")) {
+        return 1;
+    }
+
+    const char *const install_name = info->install_name;
+    const uint32_t length = info->install_name_length;
+
+    const bool needs_quotes =
+        info->flags & F_TBD_CREATE_INFO_INSTALL_NAME_NEEDS_QUOTES;
+
+    if (write_yaml_string(buffer, install_name, length, needs_quotes)) {
+        return 1;
+    }
+
+    return append_char(buffer, '\n');
+}
+
+int
+tbd_write_objc_constraint_to_buffer(struct tbd_write_buffer *const buffer,
+                                    const enum tbd_objc_constraint constraint)
+{
+    switch (constraint) {
+        case TBD_OBJC_CONSTRAINT_NONE:
+            return append_literal(buffer, "objc-constraint:       none\n");
+
+        case TBD_OBJC_CONSTRAINT_GC:
+            return append_literal(buffer, "objc-constraint:       gc\n");
+
+        case TBD_OBJC_CONSTRAINT_RETAIN_RELEASE:
+            return append_literal(buffer,
+                                  "objc-constraint:       retain_release\n");
+
+        case TBD_OBJC_CONSTRAINT_RETAIN_RELEASE_OR_GC:
+            return append_literal(buffer,
+                                  "objc-constraint:       "
+                                  "retain_release_or_gc\n");
+
+        case TBD_OBJC_CONSTRAINT_RETAIN_RELEASE_FOR_SIMULATOR:
+            return append_literal(buffer,
+                                  "objc-constraint:       "
+                                  "retain_release_for_simulator\n");
+    }
+
+    return 0;
+}
+
+int
+tbd_write_magic_to_buffer(struct tbd_write_buffer *const buffer,
+                          const enum tbd_version version)
+{
+    switch (version) {
+        case TBD_VERSION_V1:
+            return append_literal(buffer, "---\n");
+
+        case TBD_VERSION_V2:
+            return append_literal(buffer, "--- !tapi-tbd-v2\n");
+
+        case TBD_VERSION_V3:
+            return append_literal(buffer, "--- !tapi-tbd-v3\n");
+    }
+
+    return 0;
+}
+
+int
+tbd_write_parent_umbrella_to_buffer(struct tbd_write_buffer *const buffer,
+                                    const struct tbd_create_info *const info)
+{
+    const char *const umbrella = info->parent_umbrella;
+    if (umbrella == NULL) {
+        return 0;
+    }
+
+    if (append_literal(buffer, "parent-umbrella:       ")) {
+        return 1;
+    }
+
+    const uint32_t length = info->parent_umbrella_length;
+    const bool needs_quotes =
+        info->flags & F_TBD_CREATE_INFO_PARENT_UMBRELLA_NEEDS_QUOTES;
+
+    if (write_yaml_string(buffer, umbrella, length, needs_quotes)) {
+        return 1;
+    }
+
+    return append_char(buffer, '\n');
+}
+
+int
+tbd_write_platform_to_buffer(struct tbd_write_buffer *const buffer,
+                             const enum tbd_platform platform)
+{
+    switch (platform) {
+        case TBD_PLATFORM_MACOS:
+            return append_literal(buffer, "platform:              macosx\n");
+
+        case TBD_PLATFORM_IOS:
+            return append_literal(buffer, "platform:              ios\n");
+
+        case TBD_PLATFORM_WATCHOS:
+            return append_literal(buffer, "platform:              watchos\n");
+
+        case TBD_PLATFORM_TVOS:
+            return append_literal(buffer, "platform:              tvos\n");
+
+        default:
+            return 1;
+    }
+}
+
+int
+tbd_write_swift_version_to_buffer(struct tbd_write_buffer *const buffer,
+                                  const enum tbd_version tbd_version,
+                                  const uint32_t swift_version)
+{
+    if (swift_version == 0) {
+        return 0;
+    }
+
+    switch (tbd_version) {
+        case TBD_VERSION_V1:
+            return 0;
+
+        case TBD_VERSION_V2:
+            if (append_literal(buffer, "swift-version:         ")) {
+                return 1;
+            }
+
+            break;
+
+        case TBD_VERSION_V3:
+            if (append_literal(buffer, "swift-abi-version:     ")) {
+                return 1;
+            }
+
+            break;
+    }
+
+    switch (swift_version) {
+        case 1:
+            return append_literal(buffer, "1\n");
+
+        case 2:
+            return append_literal(buffer, "1.2\n");
+
+        default:
+            break;
+    }
+
+    /*
+     * tbd_write_swift_version() writes out the version as a signed int, so do
+     * the same for versions that don't fit.
+     */
+
+    const int32_t version = (int32_t)(swift_version - 1);
+    if (version < 0) {
+        if (append_char(buffer, '-')) {
+            return 1;
+        }
+
+        if (append_number(buffer, (uint64_t)-(int64_t)version)) {
+            return 1;
+        }
+    } else {
+        if (append_number(buffer, (uint64_t)version)) {
+            return 1;
+        }
+    }
+
+    return append_char(buffer, '\n');
+}
+
+static const char uppercase_hex[] = "0123456789ABCDEF";
+
+static int
+write_uuid(struct tbd_write_buffer *const buffer,
+           const struct arch_info *const arch,
+           const uint8_t *const uuid,
+           const bool has_comma)
+{
+    if (has_comma) {
+        if (append_literal(buffer, ", '")) {
+            return 1;
+        }
+    } else {
+        if (append_char(buffer, '\'')) {
+            return 1;
+        }
+    }
+
+    if (append_arch_name(buffer, arch)) {
+        return 1;
+    }
+
+    /*
+     * Format the uuid as ": XXXXXXXX-XXXX-XXXX-XXXX-XXXXXXXXXXXX'", with a
+     * dash after the 4th, 6th, 8th and 10th bytes.
+     */
+
+    char uuid_string[39];
+    char *iter = uuid_string;
+
+    *iter++ = ':';
+    *iter++ = ' ';
+
+    for (uint8_t i = 0; i != 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) {
+            *iter++ = '-';
+        }
+
+        const uint8_t byte = uuid[i];
+
+        *iter++ = uppercase_hex[byte >> 4];
+        *iter++ = uppercase_hex[byte & 0xf];
+    }
+
+    *iter = '\'';
+    return append(buffer, uuid_string, sizeof(uuid_string));
+}
+
+int
+tbd_write_uuids_to_buffer(struct tbd_write_buffer *const buffer,
+                          const struct array *const uuids)
+{
+    if (array_is_empty(uuids)) {
+        return 1;
+    }
+
+    if (append_literal(buffer, "uuids:                 [ ")) {
+        return 1;
+    }
+
+    const struct tbd_uuid_info *uuid = uuids->data;
+    const struct tbd_uuid_info *const end = uuids->data_end;
+
+    if (write_uuid(buffer, uuid->arch, uuid->uuid, false)) {
+        return 1;
+    }
+
+    /*
+     * We place a limit on the number of uuid-arch pairs on one line to just
+     * two to maintain short line-lengths.
+     */
+
+    uint64_t counter = 1;
+    bool needs_comma = true;
+
+    for (uuid++; uuid != end; uuid++) {
+        if (write_uuid(buffer, uuid->arch, uuid->uuid, needs_comma)) {
+            return 1;
+        }
+
+        counter++;
+        if (counter == 2) {
+            if (append_literal(buffer, uuid_list_newline)) {
+                return 1;
+            }
+
+            counter = 0;
+            needs_comma = false;
+        } else {
+            needs_comma = true;
+        }
+    }
+
+    return append_literal(buffer, " ]\n");
+}
+
+static int
+write_export_type_key(struct tbd_write_buffer *const buffer,
+                      const enum tbd_export_type type,
+                      const enum tbd_version version)
+{
+    switch (type) {
+        case TBD_EXPORT_TYPE_CLIENT:
+            if (version == TBD_VERSION_V1) {
+                return append_literal(buffer,
+                                      "    allowed-clients:    [ ");
+            }
+
+            return append_literal(buffer, "    allowable-clients:  [ ");
+
+        case TBD_EXPORT_TYPE_REEXPORT:
+            return append_literal(buffer, "    re-exports:         [ ");
+
+        case TBD_EXPORT_TYPE_NORMAL_SYMBOL:
+            return append_literal(buffer, "    symbols:            [ ");
+
+        case TBD_EXPORT_TYPE_OBJC_CLASS_SYMBOL:
+            return append_literal(buffer, "    objc-classes:       [ ");
+
+        case TBD_EXPORT_TYPE_OBJC_IVAR_SYMBOL:
+            return append_literal(buffer, "    objc-ivars:         [ ");
+
+        case TBD_EXPORT_TYPE_WEAK_DEF_SYMBOL:
+            return append_literal(buffer, "    weak-def-symbols:   [ ");
+    }
+
+    return 0;
+}
+
+static const uint32_t line_length_max = 105;
+
+/*
+ * Write either a comma or a comma and a newline before the next export,
+ * depending on whether the string fits on the current line. Strings too long
+ * for any line are written out on a line of their own.
+ *
+ * reset_out is set to whether the line-length should be reset.
+ */
+
+static inline int
+write_comma_or_newline(struct tbd_write_buffer *const buffer,
+                       const uint32_t line_length,
+                       const uint32_t string_length,
+                       bool *const reset_out)
+{
+    if (string_length >= line_length_max) {
+        *reset_out = true;
+        if (line_length == 0) {
+            return 0;
+        }
+
+        return append_literal(buffer, export_list_newline);
+    }
+
+    const uint64_t new_line_length = line_length + string_length + 2;
+    if (new_line_length > line_length_max) {
+        *reset_out = true;
+        return append_literal(buffer, export_list_newline);
+    }
+
+    *reset_out = false;
+    return append_literal(buffer, ", ");
+}
+
+static inline int
+write_export_info(struct tbd_write_buffer *const buffer,
+                  const struct tbd_export_info *const info)
+{
+    const bool needs_quotes =
+        info->flags & F_TBD_EXPORT_INFO_STRING_NEEDS_QUOTES;
+
+    return write_yaml_string(buffer, info->string, info->length, needs_quotes);
+}
+
+int
+tbd_write_exports_to_buffer(struct tbd_write_buffer *const buffer,
+                            const struct array *const exports,
+                            const enum tbd_version version)
+{
+    const struct tbd_export_info *info = exports->data;
+    const struct tbd_export_info *const end = exports->data_end;
+
+    if (info == end) {
+        return 0;
+    }
+
+    if (append_literal(buffer, "exports:\n")) {
+        return 1;
+    }
+
+    /*
+     * Store the length of the current-line written out (excluding the
+     * beginning spaces).
+     */
+
+    uint32_t line_length = 0;
+
+    do {
+        const uint64_t archs = info->archs;
+        if (write_exported_archs(buffer, archs)) {
+            return 1;
+        }
+
+        enum tbd_export_type type = info->type;
+        if (write_export_type_key(buffer, type, version)) {
+            return 1;
+        }
+
+        if (write_export_info(buffer, info)) {
+            return 1;
+        }
+
+        line_length = info->length;
+
+        /*
+         * Iterate over the rest of the export-infos, writing all the
+         * export-type arrays until we reach different archs.
+         */
+
+        for (info++; info != end; info++) {
+            if (info->archs != archs) {
+                break;
+            }
+
+            const enum tbd_export_type inner_type = info->type;
+            if (inner_type != type) {
+                if (append_literal(buffer, " ]\n")) {
+                    return 1;
+                }
+
+                if (write_export_type_key(buffer, inner_type, version)) {
+                    return 1;
+                }
+
+                if (write_export_info(buffer, info)) {
+                    return 1;
+                }
+
+                line_length = info->length;
+                type = inner_type;
+
+                continue;
+            }
+
+            const uint32_t length = info->length;
+            bool reset_line_length = false;
+
+            if (write_comma_or_newline(buffer,
+                                       line_length,
+                                       length,
+                                       &reset_line_length))
+            {
+                return 1;
+            }
+
+            if (reset_line_length) {
+                line_length = 0;
+            }
+
+            if (write_export_info(buffer, info)) {
+                return 1;
+            }
+
+            line_length += length;
+        }
+
+        if (append_literal(buffer, " ]\n")) {
+            return 1;
+        }
+    } while (info != end);
+
+    return 0;
+}
@@ -16,7 +16,9 @@ void print_usage(void) {
     fputs("                  If provided file(s) already exists, contents will be overridden.\n", stdout);
     fputs("                  Can also provide \"stdout\" to print to stdout\n", stdout);
     fputs("    -p, --path,   Path(s) to mach-o file(s) to convert to a tbd file.\n", stdout);
-    fputs("                  Can also provide \"stdin\" to use stdin\n", stdout);
+    fputs("                  Can also provide \"stdin\" to use stdin, which can be a pipe for mach-o files\n", stdout);
+    fputs("        --stats,  Print the time spent in each phase of parsing and writing, and counters\n", stdout);
+    fputs("                  for the files, symbols, bytes and allocations processed, once done\n", stdout);
     fputs("    -u, --usage,  Print this message\n", stdout);
 
     fputc('\n', stdout);
@@ -30,6 +32,9 @@ void print_usage(void) {
     fputs("                       dyld_shared_cache files should be parsed, and not any mach-o files\n", stdout);
     fputs("        --include-dsc, Specify that while recursing, dyld_shared_cache files should be parsed\n", stdout);
     fputs("                       in addition, to mach-o files\n", stdout);
+    fputs("        --incremental, Specify a manifest to recurse incrementally with. Files that haven't\n", stdout);
+    fputs("                       changed since the last run with the same manifest and options are skipped,\n", stdout);
+    fputs("                       and the tbds of files that no longer produce one are removed\n", stdout);
 
     fputc('\n', stdout);
     fputs("Outputting options:\n", stdout);
@@ -40,14 +45,27 @@ void print_usage(void) {
     fputs("                                  This may result in some files being skipped\n", stdout);
     fputs("        --replace-path-extension, Replace the path-extension(s) of provided file(s) when\n", stdout);
     fputs("                                  creating an output-file (Instead of simply appending .tbd)\n", stdout);
+    fputs("        --tar,                    Write every tbd into a single (uncompressed) tar archive at the\n", stdout);
+    fputs("                                  provided path, instead of a directory of files\n", stdout);
 
     fputc('\n', stdout);
     fputs("Both local and global options:\n", stdout);
+    fputs("            --dsc-file-order,      Extract dyld_shared_cache images in the order their data is located\n", stdout);
+    fputs("                                   in the file, reading ahead of each image. Faster on a cold cache,\n", stdout);
+    fputs("                                   but images are extracted (and errors printed) in a different order\n", stdout);
     fputs("            --filter-image-name,   Specify a name (a path-component) to filter out images\n", stdout);
     fputs("            --filter-image-number, Specify the number of an image to parse out.\n", stdout);
     fputs("                                   To get the numbers of all available images, Use the option --list-images\n", stdout);
     fputs("            --image-path,          Specify the path of an image to parse out.\n", stdout);
     fputs("                                   To get the paths of all available images, Use the option --list-images\n", stdout);
+    fputs("            --jobs,                Specify the number of threads to parse files found while recursing,\n", stdout);
+    fputs("                                   and to extract dyld_shared_cache images with.\n", stdout);
+    fputs("                                   Output and errors are the same regardless of the number of jobs\n", stdout);
+    fputs("            --max-rss,             Specify a size (with an optional K, M, or G suffix) of dyld_shared_cache\n", stdout);
+    fputs("                                   pages read by already extracted images allowed to stay in memory.\n", stdout);
+    fputs("                                   Once exceeded, the pages are released (as with --release-pages)\n", stdout);
+    fputs("            --release-pages,       Release the pages of a dyld_shared_cache from memory and the page-cache\n", stdout);
+    fputs("                                   once every image reading them has been extracted\n", stdout);
     fputs("        -v, --version,             Specify version of tbd to convert to (default is v2).\n", stdout);
     fputs("                                   This applies to all files where tbd-version was not explicitly set\n", stdout);
 
@@ -6,37 +6,168 @@
 //  Copyright © 2018 - 2019 inoahdev. All rights reserved.
 //
 
-#include <ctype.h>
 #include <stdbool.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "yaml.h"
 
-static const char needs_quotes[] = {
-    ':', '{', '}', '[', ']', ',', '&', '*', '#', '?', '|', '-', '<', '>', '=',
-    '!', '%', '@', '`', ' '
+/*
+ * A lookup-table of whether each byte requires a yaml string to be quoted.
+ */
+
+static const bool char_needs_quotes_table[256] = {
+    [':'] = true, ['{'] = true, ['}'] = true, ['['] = true, [']'] = true,
+    [','] = true, ['&'] = true, ['*'] = true, ['#'] = true, ['?'] = true,
+    ['|'] = true, ['-'] = true, ['<'] = true, ['>'] = true, ['='] = true,
+    ['!'] = true, ['%'] = true, ['@'] = true, ['`'] = true, [' '] = true
 };
 
 static inline bool char_needs_quotes(const char ch) {
-    for (uint64_t i = 0; i < sizeof(needs_quotes); i++) {
-        const char needs_quotes_ch = needs_quotes[i];
-        if (ch != needs_quotes_ch) {
-            continue;
-        }
+    return char_needs_quotes_table[(uint8_t)ch];
+}
 
-        return true;
-    }
+/*
+ * The same characters as in char_needs_quotes_table, grouped into ranges of
+ * consecutive characters, so a vector of bytes can be checked with fewer
+ * comparisons:
+ *
+ *     ' ' - '!', '%' - '&', ',' - '-', '<' - '@', '{' - '}'
+ *
+ * and the remaining single characters:
+ *
+ *     '#', '*', ':', '[', ']', '`'
+ */
 
-    return false;
+#if defined(__AVX2__)
+
+typedef __m256i yaml_vector;
+
+static inline yaml_vector
+vector_in_range(const yaml_vector vector, const char first, const char last) {
+    /*
+     * Subtract first so that bytes in range are now between zero and
+     * (last - first), which a saturated subtract of (last - first) turns into
+     * zero.
+     */
+
+    const yaml_vector offset =
+        _mm256_sub_epi8(vector, _mm256_set1_epi8(first));
+    const yaml_vector past =
+        _mm256_subs_epu8(offset, _mm256_set1_epi8((char)(last - first)));
+
+    return _mm256_cmpeq_epi8(past, _mm256_setzero_si256());
+}
+
+static inline yaml_vector
+vector_is_char(const yaml_vector vector, const char ch) {
+    return _mm256_cmpeq_epi8(vector, _mm256_set1_epi8(ch));
+}
+
+static inline yaml_vector vector_or(const yaml_vector a, const yaml_vector b) {
+    return _mm256_or_si256(a, b);
+}
+
+static inline yaml_vector vector_load(const char *const string) {
+    return _mm256_loadu_si256((const yaml_vector *)string);
+}
+
+static inline bool vector_is_zero(const yaml_vector vector) {
+    return _mm256_movemask_epi8(vector) == 0;
+}
+
+#elif defined(__SSE2__)
+
+typedef __m128i yaml_vector;
+
+static inline yaml_vector
+vector_in_range(const yaml_vector vector, const char first, const char last) {
+    /*
+     * Subtract first so that bytes in range are now between zero and
+     * (last - first), which a saturated subtract of (last - first) turns into
+     * zero.
+     */
+
+    const yaml_vector offset = _mm_sub_epi8(vector, _mm_set1_epi8(first));
+    const yaml_vector past =
+        _mm_subs_epu8(offset, _mm_set1_epi8((char)(last - first)));
+
+    return _mm_cmpeq_epi8(past, _mm_setzero_si128());
 }
 
+static inline yaml_vector
+vector_is_char(const yaml_vector vector, const char ch) {
+    return _mm_cmpeq_epi8(vector, _mm_set1_epi8(ch));
+}
+
+static inline yaml_vector vector_or(const yaml_vector a, const yaml_vector b) {
+    return _mm_or_si128(a, b);
+}
+
+static inline yaml_vector vector_load(const char *const string) {
+    return _mm_loadu_si128((const yaml_vector *)string);
+}
+
+static inline bool vector_is_zero(const yaml_vector vector) {
+    return _mm_movemask_epi8(vector) == 0;
+}
+
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+static inline bool vector_needs_quotes(const char *const string) {
+    const yaml_vector vector = vector_load(string);
+
+    yaml_vector matches = vector_in_range(vector, ' ', '!');
+    matches = vector_or(matches, vector_in_range(vector, '%', '&'));
+    matches = vector_or(matches, vector_in_range(vector, ',', '-'));
+    matches = vector_or(matches, vector_in_range(vector, '<', '@'));
+    matches = vector_or(matches, vector_in_range(vector, '{', '}'));
+
+    matches = vector_or(matches, vector_is_char(vector, '#'));
+    matches = vector_or(matches, vector_is_char(vector, '*'));
+    matches = vector_or(matches, vector_is_char(vector, ':'));
+    matches = vector_or(matches, vector_is_char(vector, '['));
+    matches = vector_or(matches, vector_is_char(vector, ']'));
+    matches = vector_or(matches, vector_is_char(vector, '`'));
+
+    return !vector_is_zero(matches);
+}
+
+#endif
+
 bool yaml_check_c_str(const char *const string, const uint64_t length) {
-    for (uint64_t i = 0; i != length; i++) {
-        const char ch = string[i];
-        if (!char_needs_quotes(ch)) {
-            continue;
+#if defined(__AVX2__) || defined(__SSE2__)
+    const uint64_t vector_size = sizeof(yaml_vector);
+    if (length >= vector_size) {
+        /*
+         * Never read past the end of the string, as it may end right at the
+         * end of a mapped page. Instead, finish with a vector of the last bytes
+         * of the string, which may overlap with the vector before it.
+         */
+
+        const char *iter = string;
+        const char *const last = string + (length - vector_size);
+
+        for (; iter < last; iter += vector_size) {
+            if (vector_needs_quotes(iter)) {
+                return true;
+            }
         }
 
-        return true;
+        return vector_needs_quotes(last);
+    }
+#endif
+
+    for (uint64_t i = 0; i != length; i++) {
+        if (char_needs_quotes(string[i])) {
+            return true;
+        }
     }
 
     return false;